@@ -5,6 +5,7 @@
 #include "memoria_core_check.hpp"
 #include "memoria_core_debug.hpp"
 #include "memoria_core_errors.hpp"
+#include "memoria_core_guard.hpp"
 #include "memoria_core_hash.hpp"
 #include "memoria_core_misc.hpp"
 #include "memoria_core_options.hpp"
@@ -14,9 +15,23 @@
 #include "memoria_core_signature.hpp"
 #include "memoria_core_windows.hpp"
 #include "memoria_core_write.hpp"
+#include "memoria_core_session.hpp"
+#include "memoria_core_source.hpp"
+#include "memoria_core_cache.hpp"
+#include "memoria_core_dirty.hpp"
+#include "memoria_core_pe.hpp"
+#include "memoria_core_pe_iter.hpp"
+#include "memoria_core_elf.hpp"
+#include "memoria_core_modules.hpp"
+#include "memoria_core_exports.hpp"
+#include "memoria_core_functions.hpp"
+#include "memoria_core_relocs.hpp"
+#include "memoria_core_dump.hpp"
 #include "memoria_core_hook.hpp"
+#include "memoria_core_thunk.hpp"
 
 #include "memoria_utils_buffer.hpp"
+#include "memoria_utils_asm.hpp"
 #include "memoria_utils_assert.hpp"
 #include "memoria_utils_list.hpp"
 #include "memoria_utils_optional.hpp"
@@ -26,4 +41,10 @@
 #include "memoria_ext_logger.hpp"
 #include "memoria_ext_module.hpp"
 #include "memoria_ext_patch.hpp"
+#include "memoria_ext_pointer.hpp"
+#include "memoria_ext_pointerscan.hpp"
+#include "memoria_ext_valuescan.hpp"
+#include "memoria_ext_snapshot.hpp"
+#include "memoria_ext_freezer.hpp"
+#include "memoria_ext_integrity.hpp"
 #include "memoria_ext_sig.hpp"
\ No newline at end of file
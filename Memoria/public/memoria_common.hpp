@@ -24,6 +24,11 @@
 
 #endif
 
+// MSVC keywords used by the headers that also build with GCC and Clang.
+#if !defined(_MSC_VER) && !defined(__forceinline)
+#define __forceinline inline __attribute__((always_inline))
+#endif
+
 MEMORIA_BEGIN
 
 extern bool Startup();
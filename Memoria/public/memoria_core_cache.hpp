@@ -0,0 +1,176 @@
+//
+// memoria_core_cache.hpp
+//
+// LRU cache of 4 KB pages in front of a memory source.
+//
+// Walking object graphs in another process issues thousands of tiny reads that land
+// on the same few pages. `CPageCache` is itself an `IMemorySource`, so `ReadValue`,
+// `ReadAStr`, `FindSignature` etc. work on it unchanged and are served from cached
+// pages without a system call.
+//
+// Cached data goes stale as the target runs. Instead of tracking changes, the cache
+// keeps an epoch counter: `NextEpoch` (typically once per frame or tick) makes every
+// cached page stale at once, in O(1). Stale pages are reloaded on the next access.
+//
+// Misses are loaded through `ReadBatch`, so the source can coalesce them:
+//   - `Prefetch` loads all missing pages of a range in one batch;
+//   - a miss on the page that follows the previous miss loads `readahead` pages at once.
+//
+// Not thread-safe.
+//
+// Example:
+//   CProcessVmMemory process(pid);
+//   CPageCache cache(process, 1024);
+//
+//   while (running)
+//   {
+//       cache.NextEpoch();
+//
+//       auto list = cache.ReadValue<uintptr_t>(players);
+//       ...
+//   }
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_core_source.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+MEMORIA_BEGIN
+
+struct PageCacheStats_t
+{
+	// Page lookups served from the cache.
+	uint64_t Hits;
+
+	// Page lookups that required a load. The first lookup of a page loaded ahead of it
+	// (by `Prefetch`, `ReadBatch`, a multi-page `Read` or readahead) counts as a miss too.
+	uint64_t Misses;
+
+	// Pages loaded ahead of their first lookup, by `Prefetch`, `ReadBatch` and readahead.
+	uint64_t Prefetched;
+
+	uint64_t Evictions;
+
+	double GetHitRate() const
+	{
+		uint64_t total = Hits + Misses;
+		return total ? static_cast<double>(Hits) / static_cast<double>(total) : 0.0;
+	}
+};
+
+class CPageCache : public IMemorySource
+{
+private:
+	CPageCache(const CPageCache &) = delete;
+	CPageCache &operator=(const CPageCache &) = delete;
+
+public:
+	static constexpr size_t PageSize = 4096;
+
+private:
+	static constexpr uint32_t InvalidSlot = static_cast<uint32_t>(-1);
+
+	struct Slot_t
+	{
+		uintptr_t Address;
+		uint32_t Epoch;
+
+		// Number of bytes from the start of the page that could be read.
+		uint32_t Valid;
+
+		// LRU list, most recently used first.
+		uint32_t Prev;
+		uint32_t Next;
+
+		// Loaded, but not looked up since.
+		bool Ahead;
+	};
+
+private:
+	IMemorySource &_source;
+
+	Memoria::Vector<Slot_t> _slots{};
+	Memoria::Vector<uint8_t> _data{};
+
+	// Open addressing, page address -> slot. Size is a power of two.
+	Memoria::Vector<uint32_t> _table{};
+
+	// Scratch buffers, kept to avoid allocating on every miss.
+	Memoria::Vector<uintptr_t> _pending{};
+	Memoria::Vector<MemoryIo_t> _requests{};
+
+	uint32_t _head = InvalidSlot;
+	uint32_t _tail = InvalidSlot;
+
+	// Slots that have never been used.
+	uint32_t _unused = 0;
+
+	uint32_t _epoch = 1;
+	size_t _readahead;
+
+	// The page expected next for sequential access.
+	uintptr_t _next_page = 0;
+
+	PageCacheStats_t _stats{};
+
+private:
+	size_t HashPage(uintptr_t page) const;
+
+	uint32_t Find(uintptr_t page) const;
+	void Insert(uintptr_t page, uint32_t slot);
+	void Erase(uintptr_t page);
+
+	void Unlink(uint32_t slot);
+	void PushFront(uint32_t slot);
+
+	uint32_t AcquireSlot();
+
+	bool IsFresh(uint32_t slot) const { return slot != InvalidSlot && _slots[slot].Epoch == _epoch; }
+
+	// Loads the given pages (which must not be cached and fresh) in one batch.
+	void Load(const uintptr_t *pages, size_t count);
+
+	// Loads the pages listed in `_pending` that are missing or stale.
+	void LoadPending();
+
+	// Returns the fresh slot of the page, loading it if needed.
+	uint32_t GetPage(uintptr_t page);
+
+public:
+	/**
+	 * @param source The underlying source; must outlive the cache.
+	 * @param capacity Maximum number of cached pages.
+	 * @param readahead Pages loaded at once on sequential misses, 1 disables readahead.
+	 */
+	CPageCache(IMemorySource &source, size_t capacity = 256, size_t readahead = 8);
+
+	size_t Read(uintptr_t address, void *buffer, size_t size) override;
+
+	// Loads every page touched by the requests in one batch, then serves them from the cache.
+	size_t ReadBatch(std::span<MemoryIo_t> requests) override;
+
+	// Loads the missing or stale pages of the range in one batch.
+	void Prefetch(uintptr_t address, size_t size);
+
+	// Makes every cached page stale.
+	void NextEpoch();
+	uint32_t GetEpoch() const { return _epoch; }
+
+	// Makes the cached pages of the range stale, e.g. after writing to it.
+	void Invalidate(uintptr_t address, size_t size);
+
+	// Drops every page and resets the statistics.
+	void Clear();
+
+	const PageCacheStats_t &GetStats() const { return _stats; }
+	void ResetStats() { _stats = {}; }
+
+	size_t GetCapacity() const { return _slots.size(); }
+};
+
+MEMORIA_END
\ No newline at end of file
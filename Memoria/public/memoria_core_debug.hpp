@@ -49,6 +49,9 @@ extern bool GetBeautyFunctionAddress(const void *address, char *out, size_t max_
  * @warning The function extracts information from the `IMAGE_DIRECTORY_ENTRY_EXCEPTION` section,
  *       which is usually missing in x86 binaries, so the collection for such files will be empty.
  *
+ * @note The entries come from the cached `GetFunctionIndex`, sorted by address. Parts of a function
+ *       chained to its main entry are listed separately.
+ *
  * @return A tuple collection of function address ranges (start and end addresses).
  */
 extern Memoria::Vector<std::tuple<void */*addr_start*/, void */*addr_end*/>> GetFunctionEntries(HMODULE handle);
@@ -58,6 +61,9 @@ extern Memoria::Vector<std::tuple<void */*addr_start*/, void */*addr_end*/>> Get
  *
  * @param address Pointer to an arbitrary code location within the function.
  *
+ * @note A lookup is a search in the cached `GetFunctionIndex` of the module. For an address in a
+ *       chained part of a function, the start of the function's main entry is returned.
+ *
  * @warning The function extracts information from the `IMAGE_DIRECTORY_ENTRY_EXCEPTION` section,
  *       which is usually missing in x86 binaries, so the collection for such files will be empty.
  *
@@ -0,0 +1,117 @@
+//
+// memoria_core_dirty.hpp
+//
+// Dirty page tracking.
+//
+// Tells which pages of the current process were written since a given epoch, so that
+// repeated scans only revisit those pages:
+//   - Linux: the soft-dirty bit of `/proc/self/pagemap`, cleared by writing "4" to
+//     `/proc/self/clear_refs`. Clearing affects the whole process, so all users should
+//     share the tracker returned by `GetDirtyTracker()`. Kernels built without
+//     `CONFIG_MEM_SOFT_DIRTY` are detected and treated as not tracking anything.
+//   - Windows: `GetWriteWatch`, which only works for memory allocated with
+//     `MEM_WRITE_WATCH`.
+// Where a range cannot be tracked, its pages always count as written.
+//
+// The result is not a strict superset of the written pages. On Linux, reading and clearing
+// the bits are separate steps (the bits can only be read before they are cleared), so a
+// write made by another thread between the two, while `NextEpoch` runs, is missed. Callers
+// that cannot afford that must stop the writers around `NextEpoch`.
+//
+// Example:
+//   auto &tracker = GetDirtyTracker();
+//   tracker.Track(heap_begin, heap_size);
+//
+//   auto epoch = tracker.NextEpoch();
+//   // ... a tick of the target ...
+//   tracker.GetDirtyPages(heap_begin, heap_size, epoch, pages);
+//   scanner.NextScan(eScanCondition::Changed, 0, 0, pages);
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+MEMORIA_BEGIN
+
+class CDirtyTracker
+{
+private:
+	CDirtyTracker(const CDirtyTracker &) = delete;
+	CDirtyTracker &operator=(const CDirtyTracker &) = delete;
+
+public:
+	static constexpr size_t PageSize = 4096;
+
+private:
+	struct Range_t
+	{
+		uintptr_t Begin;
+		uintptr_t End;
+
+		// The last epoch each page was written in.
+		Memoria::Vector<uint32_t> Epochs;
+
+		// Whether the system tracks writes to this range.
+		bool Tracked;
+	};
+
+	Memoria::Vector<Range_t> _ranges{};
+	uint32_t _epoch = 1;
+
+#ifndef _WIN32
+	int _pagemap = -1;
+	int _clear_refs = -1;
+#endif
+
+private:
+	// Records the pages written since the last reset in the current epoch.
+	// `reset` clears the state of the range where the system allows it per range.
+	void Sample(Range_t &range, bool reset);
+
+public:
+	CDirtyTracker() = default;
+	~CDirtyTracker();
+
+	/**
+	 * @brief Starts tracking the pages overlapping `[begin, begin + size)`.
+	 *
+	 * The pages count as written in the current epoch.
+	 *
+	 * @return `false` if the system cannot track the range. Its pages then always count as written.
+	 */
+	bool Track(uintptr_t begin, size_t size);
+
+	// Stops tracking the range that starts at `begin`.
+	void Untrack(uintptr_t begin);
+
+	/**
+	 * @brief Records the writes of the current epoch and starts a new one.
+	 *
+	 * @return The new epoch.
+	 */
+	uint32_t NextEpoch();
+
+	uint32_t GetEpoch() const { return _epoch; }
+
+	/**
+	 * @brief Collects the pages of `[begin, begin + size)` written in epoch `since` or later,
+	 *        including writes made since the last `NextEpoch`.
+	 *
+	 * Pages outside of the tracked ranges count as written.
+	 *
+	 * @return Number of pages appended to `pages`.
+	 */
+	size_t GetDirtyPages(uintptr_t begin, size_t size, uint32_t since, Memoria::Vector<uintptr_t> &pages);
+
+	void Clear();
+};
+
+// The tracker shared by the whole process.
+extern CDirtyTracker &GetDirtyTracker();
+
+MEMORIA_END
\ No newline at end of file
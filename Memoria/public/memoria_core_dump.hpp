@@ -0,0 +1,133 @@
+//
+// memoria_core_dump.hpp
+//
+// Module dumps.
+//
+// A dump is the image of a loaded module as it is in memory, from its base to its end,
+// with its headers rewritten so that the file offset of every section (PE) or segment
+// (ELF) is its offset in memory. Pages that could not be read are zeros. Next to it, a
+// small sidecar file (`<path>.info`) records where the module was loaded, the protection
+// of every region and the fingerprint of the build.
+//
+// `CModuleDump` maps a dump read-only, without copying it, at its original base when that
+// range is free, so that the pointers in it are valid as they are. Elsewhere, addresses are
+// translated between the mapping and the original base.
+//
+// Example:
+//   CModuleDump dump;
+//   if (dump.Load("game.dll.dmp"))
+//       auto vtable = dump.ToView(original_vtable_address);
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <span>
+
+MEMORIA_BEGIN
+
+// Appended to the path of a dump for its sidecar.
+static constexpr const char *ModuleDumpInfoSuffix = ".info";
+
+enum class eModuleDumpFormat : uint32_t
+{
+	Unknown,
+	Pe,
+	Elf,
+};
+
+// A region of the module at the time of the dump. Offsets are from the base of the module, `End` is exclusive.
+struct ModuleDumpRegion_t
+{
+	uint64_t Begin;
+	uint64_t End;
+
+	bool Readable;
+	bool Writable;
+	bool Executable;
+};
+
+class CModuleDump
+{
+private:
+	CModuleDump(const CModuleDump &) = delete;
+	CModuleDump &operator=(const CModuleDump &) = delete;
+
+public:
+	static constexpr size_t MaxFingerprintSize = 32;
+
+private:
+	void *_view = nullptr;
+	size_t _size = 0;
+
+#ifdef _WIN32
+	void *_mapping = nullptr;
+#endif
+
+	eModuleDumpFormat _format = eModuleDumpFormat::Unknown;
+	uint64_t _base = 0;
+
+	uint8_t _fingerprint[MaxFingerprintSize] = {};
+	size_t _fingerprint_size = 0;
+
+	Memoria::Vector<ModuleDumpRegion_t> _regions{};
+
+private:
+	bool LoadInfo(const char *path);
+
+public:
+	CModuleDump() = default;
+	~CModuleDump();
+
+	/**
+	 * @brief Maps the dump at `path` and reads its sidecar.
+	 *
+	 * @return `false` if either file is missing or malformed, or the dump is smaller than the
+	 * module it claims to hold. The object is then empty.
+	 */
+	bool Load(const char *path);
+
+	void Close();
+
+	bool IsLoaded() const { return _view != nullptr; }
+
+	eModuleDumpFormat GetFormat() const { return _format; }
+
+	// The mapping, `GetSize()` bytes laid out as the module was in memory.
+	const void *GetView() const { return _view; }
+	size_t GetSize() const { return _size; }
+
+	// Where the module was loaded when it was dumped.
+	uint64_t GetBase() const { return _base; }
+
+	// Whether the mapping is at the original base, so that pointers in it need no translation.
+	bool IsAtBase() const { return reinterpret_cast<uintptr_t>(_view) == _base; }
+
+	std::span<const uint8_t> GetFingerprint() const { return { _fingerprint, _fingerprint_size }; }
+	std::span<const ModuleDumpRegion_t> GetRegions() const { return { _regions.data(), _regions.size() }; }
+
+	// The address in the mapping of an address of the original module, `nullptr` if it is outside of it.
+	const void *ToView(uint64_t address) const;
+
+	// The address in the original module of an address in the mapping, 0 if it is outside of it.
+	uint64_t ToOriginal(const void *address) const;
+};
+
+/**
+ * @brief Writes the `size` bytes at `base`, a module of the current process, to `path` and
+ * its sidecar next to it.
+ *
+ * `headers` replaces the first bytes of the module in the dump; it holds its headers, already
+ * realigned (`CPeImage::RealignHeaders`, `CElfImage::RealignHeaders`). The module is written
+ * from memory in large chunks, unreadable pages as zeros.
+ *
+ * @return `false` if a file cannot be written.
+ */
+extern bool WriteModuleDump(const char *path, const void *base, size_t size, eModuleDumpFormat format,
+	std::span<const uint8_t> headers, std::span<const uint8_t> fingerprint);
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,192 @@
+//
+// memoria_core_elf.hpp
+//
+// Loaded ELF objects (Linux).
+//
+// The objects of the current process are enumerated with `dl_iterate_phdr`. `CElfImage`
+// describes one of them: its PT_LOAD segments, the GNU build-id from its PT_NOTE
+// segments, and the section headers, which are not mapped and are read once from the
+// file the object was loaded from. Stripped section headers or a file that cannot be
+// read (the vDSO, a deleted library) leave the section table empty.
+//
+// `FindElfModule` maps an address to its object through a sorted table of the PT_LOAD
+// segments of every object, built on the first call and rebuilt only when the loader
+// reports that objects were added or removed. A lookup is then a binary search instead
+// of the walk over every object and its segments that `dladdr` does. It still takes the
+// loader lock once, to read the loader's counters with `dl_iterate_phdr`, which stops
+// at the first object.
+//
+// Example:
+//   ElfModule_t module;
+//   if (FindElfModule(reinterpret_cast<void *>(&printf), module))
+//   {
+//       CElfImage image(module);
+//       auto rodata = image.FindSection(".rodata");
+//   }
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <span>
+
+#ifndef _WIN32
+
+MEMORIA_BEGIN
+
+struct ElfModule_t
+{
+	// Difference between the addresses in the file and in memory.
+	uintptr_t Bias;
+
+	// Lowest and highest address of the PT_LOAD segments.
+	uintptr_t Begin;
+	uintptr_t End;
+
+	// As reported by the loader. Empty for the main program.
+	char Path[256];
+};
+
+struct ElfSegment_t
+{
+	uintptr_t Begin;
+	uintptr_t End;
+
+	bool Readable;
+	bool Writable;
+	bool Executable;
+};
+
+// A program header, at its address in memory.
+struct ElfProgramHeader_t
+{
+	uint32_t Type;
+	uint32_t Flags;
+	uintptr_t Address;
+	size_t Size;
+};
+
+struct ElfSection_t
+{
+	char Name[32];
+	uintptr_t Address;
+	size_t Size;
+	uint32_t Type;
+	uint64_t Flags;
+};
+
+// Called for every loaded object. Returning `false` stops the enumeration.
+using ElfModuleCallback_t = bool(*)(const ElfModule_t &module, void *param);
+
+// Enumerates the loaded objects, the main program first. Returns the number of objects visited.
+extern size_t EnumerateElfModules(ElfModuleCallback_t cb, void *param);
+
+/**
+ * @brief Finds the object with a PT_LOAD segment that contains `address`.
+ *
+ * Uses the cached segment table, which is rebuilt when objects were loaded or unloaded since.
+ */
+extern bool FindElfModule(const void *address, ElfModule_t &out);
+
+// Finds an object by the file name of its path, e.g. "libc.so.6". An empty name finds the main program.
+extern bool FindElfModule(const char *name, ElfModule_t &out);
+
+// Reads the loader's counters of objects loaded and unloaded so far, which change together
+// with the set of loaded objects. Returns `false` if the loader does not provide them.
+// Takes the loader lock, as it goes through `dl_iterate_phdr`.
+extern bool GetElfLoaderCounters(unsigned long long &adds, unsigned long long &subs);
+
+class CElfImage
+{
+private:
+	CElfImage(const CElfImage &) = delete;
+	CElfImage &operator=(const CElfImage &) = delete;
+
+public:
+	static constexpr size_t MaxBuildIdSize = 32;
+
+private:
+	ElfModule_t _module{};
+	bool _valid = false;
+
+	Memoria::Vector<ElfSegment_t> _segments{};
+	Memoria::Vector<ElfProgramHeader_t> _headers{};
+	Memoria::Vector<ElfSection_t> _sections{};
+
+	uint8_t _build_id[MaxBuildIdSize] = {};
+	size_t _build_id_size = 0;
+
+private:
+	// Reads the section headers from the file of the object.
+	void LoadSections();
+
+	// Adds the segments and program headers of an object loaded with `bias`, and its build-id.
+	void ReadProgramHeaders(uintptr_t bias, const void *headers, size_t count);
+
+public:
+	CElfImage() = default;
+
+	CElfImage(const ElfModule_t &module)
+	{
+		Parse(module);
+	}
+
+	/**
+	 * @brief Reads the program headers of a loaded object, and its section headers from its file.
+	 *
+	 * @return `false` if the object is no longer loaded. The object is then empty.
+	 */
+	bool Parse(const ElfModule_t &module);
+
+	/**
+	 * @brief Reads the program headers of an object laid out as in memory at `base`, which was
+	 * not loaded by the loader: a dump mapped from a file. The lowest segment starts at `base`
+	 * and every segment must lie in the `size` bytes there.
+	 *
+	 * The object has no path and no section headers.
+	 */
+	bool ParseMapped(const void *base, size_t size);
+
+	void Clear();
+
+	bool IsValid() const { return _valid; }
+
+	const ElfModule_t &GetModule() const { return _module; }
+	uintptr_t GetBias() const { return _module.Bias; }
+	uintptr_t GetBegin() const { return _module.Begin; }
+	uintptr_t GetEnd() const { return _module.End; }
+
+	std::span<const ElfSegment_t> GetSegments() const { return { _segments.data(), _segments.size() }; }
+	std::span<const ElfProgramHeader_t> GetProgramHeaders() const { return { _headers.data(), _headers.size() }; }
+	std::span<const ElfSection_t> GetSections() const { return { _sections.data(), _sections.size() }; }
+
+	// Only sections that are loaded into memory (SHF_ALLOC) are kept, at their address in memory.
+	const ElfSection_t *FindSection(const char *name) const;
+	const ElfSection_t *FindSection(const void *address) const;
+
+	const ElfSegment_t *FindSegment(const void *address) const;
+
+	// The first program header of `type` (PT_DYNAMIC, PT_GNU_EH_FRAME, ...), `nullptr` if there is none.
+	const ElfProgramHeader_t *FindProgramHeader(uint32_t type) const;
+
+	/**
+	 * @brief Rewrites `headers`, a copy of the first bytes of this object in memory, for a file
+	 * that holds the object as it is in memory: the file offset of every segment becomes its
+	 * offset from the lowest segment, PT_LOAD segments are as large in the file as in memory,
+	 * and the section headers, which are not in memory, are dropped.
+	 *
+	 * @return `false` if `headers` does not hold the ELF header and the program headers.
+	 */
+	bool RealignHeaders(std::span<uint8_t> headers) const;
+
+	// The GNU build-id, empty if the object has none.
+	std::span<const uint8_t> GetBuildId() const { return { _build_id, _build_id_size }; }
+};
+
+MEMORIA_END
+
+#endif
\ No newline at end of file
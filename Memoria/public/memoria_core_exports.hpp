@@ -0,0 +1,119 @@
+//
+// memoria_core_exports.hpp
+//
+// Export indexes.
+//
+// `CExportIndex` reads the export directory of a PE image once and keeps the named
+// exports as (name hash, RVA, ordinal) sorted by hash, so that a lookup by the `FNV1a64`
+// hash of a name is a binary search instead of hashing every export name again.
+//
+// `BuildExportIndexes` indexes many images at once, in parallel.
+//
+// `FindExport` resolves the exports of loaded modules, the modules being found through
+// the module registry. The index of a module is built the first time it is needed and
+// kept until the module is unloaded. Forwarders ("NTDLL.RtlAllocateHeap") are followed
+// once and the address they lead to is kept. A lookup in every module goes through one
+// table of all exported name hashes, which lists the modules exporting each of them in
+// load order.
+//
+// Example:
+//   auto fn = FindExport(FNV1a64("kernel32.dll"), FNV1a64("HeapAlloc"));
+//   auto any = FindExport(0, FNV1a64("RtlAllocateHeap"));
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_core_pe.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <span>
+
+MEMORIA_BEGIN
+
+struct ExportEntry_t
+{
+	uint64_t NameHash;
+	uint32_t Rva;
+
+	// Index into the function table, i.e. the ordinal without the ordinal base.
+	uint16_t Ordinal;
+};
+
+class CExportIndex
+{
+private:
+	CExportIndex(const CExportIndex &) = delete;
+	CExportIndex &operator=(const CExportIndex &) = delete;
+
+private:
+	// Sorted by name hash, entries with the same hash in name table order.
+	Memoria::Vector<ExportEntry_t> _entries{};
+
+	// RVAs by ordinal index.
+	Memoria::Vector<uint32_t> _functions{};
+	uint32_t _ordinal_base = 0;
+
+	// The export directory. Exports that point into it are forwarders.
+	uint32_t _directory_begin = 0;
+	uint32_t _directory_end = 0;
+
+public:
+	CExportIndex() = default;
+
+	CExportIndex(CExportIndex &&) = default;
+	CExportIndex &operator=(CExportIndex &&) = default;
+
+	/**
+	 * @brief Indexes the export directory of `image`.
+	 *
+	 * Names are hashed with `FNV1a64`, case-insensitively, as `GetProcAddressDirect` expects.
+	 *
+	 * @return `false` if the image has no export directory or it is malformed. The index is then empty.
+	 */
+	bool Build(const CPeImage &image);
+
+	void Clear();
+
+	bool IsEmpty() const { return _functions.empty(); }
+
+	std::span<const ExportEntry_t> GetEntries() const { return { _entries.data(), _entries.size() }; }
+
+	// The first entry with the hash, `nullptr` if there is none.
+	const ExportEntry_t *Find(uint64_t name_hash) const;
+
+	// All entries with the hash. More than one only on a hash collision.
+	std::span<const ExportEntry_t> FindAll(uint64_t name_hash) const;
+
+	// RVA of the export with `ordinal`, as passed to `GetProcAddress`, 0 if there is none.
+	uint32_t FindOrdinal(uint32_t ordinal) const;
+
+	uint32_t GetOrdinalBase() const { return _ordinal_base; }
+
+	// Whether the export at `rva` is a forwarder, i.e. `rva` holds "MODULE.Function" or "MODULE.#Ordinal".
+	bool IsForwarder(uint32_t rva) const { return rva >= _directory_begin && rva < _directory_end; }
+};
+
+/**
+ * @brief Builds `out[i]` from `images[i]` for every image, the images spread over `workers` threads.
+ *
+ * A null image leaves an empty index.
+ *
+ * @param workers 0 for one thread per core.
+ *
+ * @return Number of indexes built.
+ */
+extern size_t BuildExportIndexes(std::span<const CPeImage *const> images, std::span<CExportIndex> out, size_t workers = 0);
+
+/**
+ * @brief Finds an export of a loaded module by the `FNV1a64` hash of its name.
+ *
+ * @param module_name_hash Hash of the module's file name, 0 to search every module in load order.
+ *
+ * @return Address of the export, with forwarders followed, or `nullptr` if not found.
+ */
+extern void *FindExport(uint64_t module_name_hash, uint64_t function_name_hash);
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,168 @@
+//
+// memoria_core_functions.hpp
+//
+// Function tables.
+//
+// `CFunctionIndex` reads the function table of a module once: the `.pdata` entries of a
+// PE image (x64 and ARM64), or the binary search table of `.eh_frame_hdr` on ELF. Both
+// list the code ranges the unwinder knows about, which is every function that is not a
+// leaf. A lookup by address is then a search in a copy of the begin addresses kept in
+// Eytzinger order (the implicit layout of a balanced search tree), where the first steps
+// of every search touch the same few cache lines.
+//
+// On x64 a function may be split into several entries, its cold parts chained to the
+// entry of its prologue. Every entry knows the entry it is a part of.
+//
+// `GetFunctionIndex` keeps the index of every module it is asked for until the module is
+// unloaded.
+//
+// Example:
+//   auto functions = GetFunctionIndex(address);
+//   if (auto entry = functions ? functions->FindPrimary(address) : nullptr)
+//       auto begin = functions->GetAddress(entry->Begin);
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_core_pe.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <span>
+
+#ifndef _WIN32
+#include "memoria_core_elf.hpp"
+#endif
+
+MEMORIA_BEGIN
+
+struct FunctionEntry_t
+{
+	// Offsets from the base of the module. `End` is exclusive.
+	uint32_t Begin;
+	uint32_t End;
+
+	// PE: RVA of the unwind information, or of the packed unwind data itself on ARM64.
+	// ELF: offset of the FDE.
+	uint32_t Unwind;
+
+	// Index of the entry of the function this entry is a part of, its own index if it is
+	// not chained to another one.
+	uint32_t Primary;
+};
+
+// The header of an x64 UNWIND_INFO.
+struct PeUnwindInfo_t
+{
+	uint8_t Version;
+	uint8_t Flags;
+	uint8_t SizeOfProlog;
+	uint8_t CountOfCodes;
+	uint8_t FrameRegister;
+	uint8_t FrameOffset;
+
+	// RVA of the `CountOfCodes` unwind codes, 2 bytes each.
+	uint32_t Codes;
+
+	// RVA of the language-specific handler and of its data, 0 without one.
+	uint32_t Handler;
+	uint32_t HandlerData;
+
+	// `Begin` of the entry this one continues, 0 if not chained.
+	uint32_t Chained;
+};
+
+static constexpr uint8_t PeUnwindFlagExceptionHandler = 0x01;
+static constexpr uint8_t PeUnwindFlagTerminationHandler = 0x02;
+static constexpr uint8_t PeUnwindFlagChainInfo = 0x04;
+
+class CFunctionIndex
+{
+private:
+	CFunctionIndex(const CFunctionIndex &) = delete;
+	CFunctionIndex &operator=(const CFunctionIndex &) = delete;
+
+private:
+	// Sorted by `Begin`.
+	Memoria::Vector<FunctionEntry_t> _entries{};
+
+	// `_entries[i].Begin` in Eytzinger order, 1-based. `_order[k]` is the index of `_keys[k]` in `_entries`.
+	Memoria::Vector<uint32_t> _keys{};
+	Memoria::Vector<uint32_t> _order{};
+
+	uintptr_t _base = 0;
+
+private:
+	// Sorts the entries, resolves `Primary` and builds the search tree.
+	void Finish();
+
+	// Index of the entry with the greatest `Begin` not above `offset`, `_entries.size()` if there is none.
+	size_t Search(uint32_t offset) const;
+
+public:
+	CFunctionIndex() = default;
+
+	CFunctionIndex(CFunctionIndex &&) = default;
+	CFunctionIndex &operator=(CFunctionIndex &&) = default;
+
+	/**
+	 * @brief Indexes the exception directory of `image`.
+	 *
+	 * Works on loaded images and on file images alike. Addresses are those of a loaded image
+	 * only if `image` is one.
+	 *
+	 * @return `false` if the image has no function table or its machine has none that is
+	 * supported. The index is then empty.
+	 */
+	bool Build(const CPeImage &image);
+
+#ifndef _WIN32
+	/**
+	 * @brief Indexes the `.eh_frame_hdr` of a loaded object.
+	 *
+	 * @return `false` if the object has none, or its search table is missing or has an encoding
+	 * other than the 4-byte ones linkers write. The index is then empty.
+	 */
+	bool Build(const ElfModule_t &module);
+#endif
+
+	void Clear();
+
+	bool IsEmpty() const { return _entries.empty(); }
+
+	// Address the offsets are relative to.
+	uintptr_t GetBase() const { return _base; }
+	void *GetAddress(uint32_t offset) const { return reinterpret_cast<void *>(_base + offset); }
+
+	std::span<const FunctionEntry_t> GetEntries() const { return { _entries.data(), _entries.size() }; }
+
+	// The entry whose range contains `offset`, `nullptr` if there is none.
+	const FunctionEntry_t *Find(uint32_t offset) const;
+	const FunctionEntry_t *Find(const void *address) const;
+
+	// Like `Find`, but follows chained entries to the one the function starts with.
+	const FunctionEntry_t *FindPrimary(const void *address) const;
+
+	const FunctionEntry_t &GetPrimary(const FunctionEntry_t &entry) const { return _entries[entry.Primary]; }
+
+	/**
+	 * @brief Reads the x64 unwind information of `entry` from `image`, the image the index was built from.
+	 *
+	 * @return `false` if the image is not x64 or the information is out of its bounds.
+	 */
+	static bool GetUnwindInfo(const CPeImage &image, const FunctionEntry_t &entry, PeUnwindInfo_t &out);
+};
+
+/**
+ * @brief The function index of the module that contains `address`.
+ *
+ * Built on first use and shared until the module is unloaded.
+ *
+ * @return `nullptr` if `address` is not in a module.
+ */
+extern std::shared_ptr<const CFunctionIndex> GetFunctionIndex(const void *address);
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,61 @@
+//
+// memoria_core_guard.hpp
+//
+// Fault-tolerant memory access.
+//
+// Instead of asking the system whether memory is accessible before every access
+// (a `VirtualQuery` system call), the access is simply attempted and a fault is caught:
+//   - Windows: SEH, `__try`/`__except` for access violations and in-page errors.
+//   - Linux: a SIGSEGV/SIGBUS handler that `siglongjmp`s to a thread-local landing pad
+//     armed around the access. Faults outside of a guarded access are forwarded to the
+//     previously installed handler.
+//
+// On the success path a guarded copy costs about as much as a plain `memcpy`.
+//
+// The read functions use these when safe mode is active.
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+MEMORIA_BEGIN
+
+using GuardedFn_t = void(*)(void *context);
+
+/**
+ * @brief Calls `fn(context)` and catches memory access faults raised by it.
+ *
+ * On Linux, a fault unwinds by `siglongjmp`, so `fn` must not own objects with destructors
+ * or hold locks at the point where it may fault.
+ *
+ * @return `true` if `fn` returned normally, `false` if it faulted.
+ */
+extern bool GuardedCall(GuardedFn_t fn, void *context);
+
+/**
+ * @brief Copies `size` bytes from `src` to `dest`, stopping at the first inaccessible page.
+ *
+ * @return Number of bytes copied.
+ */
+extern size_t GuardedCopy(void *dest, const void *src, size_t size);
+
+// `GuardedCopy` of exactly `size` bytes.
+static inline bool GuardedRead(void *dest, const void *src, size_t size)
+{
+	return GuardedCopy(dest, src, size) == size;
+}
+
+// Copies a null-terminated string, truncated to `max_size - 1` characters like `strncpy_s`
+// with `_TRUNCATE`. Returns `false` if the source faults before the terminator; `dest` then
+// holds the characters read so far.
+extern bool GuardedCopyAStr(char *dest, const char *src, size_t max_size);
+extern bool GuardedCopyWStr(wchar_t *dest, const wchar_t *src, size_t max_size);
+
+// Whether the byte at `addr` can be read.
+extern bool ProbeMemory(const void *addr);
+
+MEMORIA_END
\ No newline at end of file
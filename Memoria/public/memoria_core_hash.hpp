@@ -2,6 +2,7 @@
 
 #include "memoria_common.hpp"
 
+#include <stddef.h>
 #include <stdint.h>
 #include <type_traits>
 
@@ -23,42 +24,83 @@ inline constexpr wchar_t towlower_constexpr(wchar_t ch)
 	return (ch >= L'A' && ch <= L'Z') ? (ch + L'a' - L'A') : ch;
 }
 
+//
+// The string hashes process the characters from the last to the first, as the recursive
+// definition they replace did, so existing hashes stay valid. They are loops so that
+// hashing at runtime (e.g. module and export names) does not recurse per character.
+//
+
+template <typename T>
+inline constexpr size_t StrLenConstexpr(const T *str) noexcept
+{
+	size_t length = 0;
+
+	while (str[length] != T{})
+		length++;
+
+	return length;
+}
+
 inline constexpr uint32_t FNV1a32(const char *const str, bool case_insensitive = true) noexcept
 {
-	return (str[0] == '\0')
-		? FNV1A_32_BASIS
-		: ((FNV1a32(str + 1, case_insensitive) ^
-			static_cast<uint8_t>(case_insensitive ? tolower_constexpr(str[0]) : str[0]))
-			* FNV1A_32_PRIME);
+	uint32_t hash = FNV1A_32_BASIS;
+
+	for (size_t i = StrLenConstexpr(str); i-- > 0;)
+		hash = (hash ^ static_cast<uint8_t>(case_insensitive ? tolower_constexpr(str[i]) : str[i])) * FNV1A_32_PRIME;
+
+	return hash;
 }
 
 inline constexpr uint32_t FNV1a32(const wchar_t *const str, bool case_insensitive = true) noexcept
 {
-	return (str[0] == L'\0')
-		? FNV1A_32_BASIS
-		: ((FNV1a32(str + 1, case_insensitive) ^
-			static_cast<uint32_t>(case_insensitive ? towlower_constexpr(str[0]) : str[0]))
-			* FNV1A_32_PRIME);
+	uint32_t hash = FNV1A_32_BASIS;
+
+	for (size_t i = StrLenConstexpr(str); i-- > 0;)
+		hash = (hash ^ static_cast<uint32_t>(case_insensitive ? towlower_constexpr(str[i]) : str[i])) * FNV1A_32_PRIME;
+
+	return hash;
 }
 
 inline constexpr uint64_t FNV1a64(const char *const str, bool case_insensitive = true) noexcept
 {
-	return (str[0] == '\0')
-		? FNV1A_64_BASIS
-		: ((FNV1a64(str + 1, case_insensitive) ^
-			static_cast<uint8_t>(case_insensitive ? tolower_constexpr(str[0]) : str[0]))
-			* FNV1A_64_PRIME);
+	uint64_t hash = FNV1A_64_BASIS;
+
+	for (size_t i = StrLenConstexpr(str); i-- > 0;)
+		hash = (hash ^ static_cast<uint8_t>(case_insensitive ? tolower_constexpr(str[i]) : str[i])) * FNV1A_64_PRIME;
+
+	return hash;
 }
 
 inline constexpr uint64_t FNV1a64(const wchar_t *const str, bool case_insensitive = true) noexcept
 {
-	return (str[0] == L'\0')
-		? FNV1A_64_BASIS
-		: ((FNV1a64(str + 1, case_insensitive) ^
-			static_cast<uint64_t>(case_insensitive ? towlower_constexpr(str[0]) : str[0]))
-			* FNV1A_64_PRIME);
+	uint64_t hash = FNV1A_64_BASIS;
+
+	for (size_t i = StrLenConstexpr(str); i-- > 0;)
+		hash = (hash ^ static_cast<uint64_t>(case_insensitive ? towlower_constexpr(str[i]) : str[i])) * FNV1A_64_PRIME;
+
+	return hash;
 }
 
+// Hashes raw bytes. Pass the previous result as `hash` to hash several blocks as one.
+inline uint64_t FNV1a64Data(const void *data, size_t size, uint64_t hash = FNV1A_64_BASIS) noexcept
+{
+	auto bytes = static_cast<const uint8_t *>(data);
+
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * FNV1A_64_PRIME;
+
+	return hash;
+}
+
+/**
+ * @brief Computes CRC-32C (Castagnoli) of `data`.
+ *
+ * Uses the SSE4.2 `crc32` instruction when the CPU supports it, and a lookup table otherwise.
+ *
+ * @param crc The result of a previous call, to compute the checksum of several blocks as one.
+ */
+extern uint32_t CRC32C(const void *data, size_t size, uint32_t crc = 0);
+
 // Stub. Should be removed in the future.
 using fnv1a_t = uint64_t;
 
@@ -2,6 +2,7 @@
 
 #include "memoria_common.hpp"
 #include "memoria_utils_assert.hpp"
+#include "memoria_utils_vector.hpp"
 
 #include <stdint.h>
 #include <memory> // std::unique_ptr
@@ -86,6 +87,11 @@ public:
 	bool Hook();
 	bool Unhook();
 
+	void *GetTarget() const { return _pointer; }
+	const void *GetHook() const { return _hook; }
+	eInvokeMethod GetMethod() const { return _method; }
+	bool Is64Bit() const { return _x64; }
+
 	void *GetJmpHook() { return reinterpret_cast<void *>(&_backup[0]); }
 	void *GetOriginal() { return reinterpret_cast<void *>(&_backup[5]); }
 
@@ -130,14 +136,19 @@ private:
 	size_t _hooks = 0;
 	size_t _max_hooks = 0;
 
+	// Released trampolines, handed out again before new ones.
+	Memoria::Vector<CTrampoline *> _released{};
+
 public:
 	CHookMgr() = default;
 	CHookMgr(const void *addr_nearest, size_t max_hooks = 64);
 	~CHookMgr();
 
 	CTrampoline *Allocate(void *target, const void *hook, bool is_x64, eInvokeMethod method);
+	void Release(CTrampoline *trampoline);
 
 	bool IsNear(const void *addr) const;
+	bool Owns(const CTrampoline *trampoline) const;
 };
 
 extern size_t CalculateInstructionSize32(const void *addr, ptrdiff_t offset = 0);
@@ -152,6 +163,28 @@ extern bool WriteHook64(void *addr_target, const void *addr_value, eInvokeMethod
 extern size_t CalculateHookSize32(void *addr_target, eInvokeMethod method);
 extern size_t CalculateHookSize64(void *addr_target, eInvokeMethod method);
 
+/**
+ * @brief Encodes a hook jump from `addr_target` to `addr_value` into `buffer` without writing it to `addr_target`.
+ *
+ * @return The size of the hook, or `0` if it does not fit or cannot be encoded.
+ */
+extern size_t AssembleHook(void *buffer, size_t size, const void *addr_target, const void *addr_value, bool is_x64, eInvokeMethod method);
+
+/**
+ * @brief Allocates a trampoline for `target` without installing the hook.
+ *
+ * The hook can then be installed with `CTrampoline::Hook` or written by other means,
+ * e.g. as part of a `CPatchSet`.
+ */
+extern CTrampoline *CreateTrampoline(void *target, const void *hook, bool is_x64 = IsX64(), eInvokeMethod method = eInvokeMethod::JumpRel);
+
+/**
+ * @brief Releases a trampoline from `CreateTrampoline`, so that its memory is reused.
+ *
+ * The hook must not be installed, and no thread may still run the original code through it.
+ */
+extern void FreeTrampoline(CTrampoline *trampoline);
+
 extern bool Hook32(void *target, const void *hook, void *trampoline, eInvokeMethod method = eInvokeMethod::JumpRel);
 extern bool Hook64(void *target, const void *hook, void *trampoline, eInvokeMethod method = eInvokeMethod::JumpRel);
 
@@ -5,12 +5,19 @@
 #include "memoria_common.hpp"
 #include "memoria_core_hash.hpp"
 
+#include <stddef.h>
 #include <stdint.h>
-#include <Windows.h>
 #include <functional>
+#include <limits>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
 
 MEMORIA_BEGIN
 
+#ifdef _WIN32
+
 typedef struct _PEB_LDR_DATA
 {
 	UINT8 _PADDING_[12];
@@ -48,6 +55,8 @@ typedef struct _LDR_DATA_TABLE_ENTRY
 	UNICODE_STRING BaseDllName;
 } LDR_DATA_TABLE_ENTRY, *PLDR_DATA_TABLE_ENTRY;
 
+#endif
+
 
 /**
  * @brief Performs an offset relative to `addr` forward or backward by the value of `offset`.
@@ -247,22 +256,22 @@ extern bool IsMemoryValid(const void *addr, ptrdiff_t offset = 0);
 extern bool IsMemoryExecutable(const void *addr, ptrdiff_t offset = 0);
 
 /**
- * @brief
+ * @brief Returns the base address of the pointer `addr`.
  *
- * @param
+ * @param addr Pointer to an arbitrary memory location.
  *
- * @return
+ * @return Base address.
  */
-extern bool MakeWritable(void *addr);
+extern void *GetBaseAddress(const void *addr);
 
 /**
- * @brief
+ * @brief Finds a loaded module by its file name, e.g. "client.dll" or "libc.so.6".
  *
- * @param
+ * @param name File name of the module, empty or `nullptr` for the main program.
  *
- * @return
+ * @return Base address of the module, `nullptr` if it is not loaded.
  */
-extern bool MakeReadable(void *addr);
+extern void *GetModuleBase(const char *name);
 
 /**
  * @brief
@@ -271,7 +280,7 @@ extern bool MakeReadable(void *addr);
  *
  * @return
  */
-extern bool MakeExecutable(void *addr);
+extern size_t Align(size_t value, int alignment = 16);
 
 /**
  * @brief
@@ -280,7 +289,9 @@ extern bool MakeExecutable(void *addr);
  *
  * @return
  */
-extern bool RemoveWritable(void *addr);
+extern void *Align(const void *value, int alignment = 16);
+
+#ifdef _WIN32
 
 /**
  * @brief
@@ -289,7 +300,7 @@ extern bool RemoveWritable(void *addr);
  *
  * @return
  */
-extern bool RemoveReadable(void *addr);
+extern bool MakeWritable(void *addr);
 
 /**
  * @brief
@@ -298,25 +309,25 @@ extern bool RemoveReadable(void *addr);
  *
  * @return
  */
-extern bool RemoveExecutable(void *addr);
+extern bool MakeReadable(void *addr);
 
 /**
- * @brief Returns the base address of the pointer `addr`.
+ * @brief
  *
- * @param addr Pointer to an arbitrary memory location.
+ * @param
  *
- * @return Base address.
+ * @return
  */
-extern void *GetBaseAddress(const void *addr);
+extern bool MakeExecutable(void *addr);
 
 /**
- * @brief Retrieves the address (ImageBase) of the module (DLL/EXE) that called the function.
+ * @brief
  *
- * @return The ImageBase of the caller.
+ * @param
+ *
+ * @return
  */
-extern __declspec(noinline) void *GetSelfAddress();
-
-extern __declspec(noinline) HMODULE GetSelfHandle();
+extern bool RemoveWritable(void *addr);
 
 /**
  * @brief
@@ -325,7 +336,7 @@ extern __declspec(noinline) HMODULE GetSelfHandle();
  *
  * @return
  */
-bool GetModuleName(HMODULE hModule, char *out, size_t max_size);
+extern bool RemoveReadable(void *addr);
 
 /**
  * @brief
@@ -334,7 +345,16 @@ bool GetModuleName(HMODULE hModule, char *out, size_t max_size);
  *
  * @return
  */
-bool GetModuleNameForAddress(const void *address, char *out, size_t max_size);
+extern bool RemoveExecutable(void *addr);
+
+/**
+ * @brief Retrieves the address (ImageBase) of the module (DLL/EXE) that called the function.
+ *
+ * @return The ImageBase of the caller.
+ */
+extern __declspec(noinline) void *GetSelfAddress();
+
+extern __declspec(noinline) HMODULE GetSelfHandle();
 
 /**
  * @brief
@@ -343,7 +363,7 @@ bool GetModuleNameForAddress(const void *address, char *out, size_t max_size);
  *
  * @return
  */
-bool BeautifyPointer(const void *addr, char *out, size_t max_size);
+bool GetModuleName(HMODULE hModule, char *out, size_t max_size);
 
 /**
  * @brief
@@ -352,7 +372,7 @@ bool BeautifyPointer(const void *addr, char *out, size_t max_size);
  *
  * @return
  */
-extern size_t Align(size_t value, int alignment = 16);
+bool GetModuleNameForAddress(const void *address, char *out, size_t max_size);
 
 /**
  * @brief
@@ -361,7 +381,7 @@ extern size_t Align(size_t value, int alignment = 16);
  *
  * @return
  */
-extern void *Align(const void *value, int alignment = 16);
+bool BeautifyPointer(const void *addr, char *out, size_t max_size);
 
 /**
  * @brief
@@ -372,12 +392,17 @@ extern void *Align(const void *value, int alignment = 16);
  */
 extern DWORD BeginThread(void (*fnFunction)(LPVOID), LPVOID param);
 
+using EnumModulesFn_t = bool(*)(PLDR_DATA_TABLE_ENTRY entry, LPVOID param);
+
+// Walks the loader's list of modules in the PEB, in memory order. Returning `false` stops the walk.
+extern void EnumModules(EnumModulesFn_t fn, LPVOID param);
+
 /**
- * @brief
+ * @brief Finds a loaded module by the `FNV1a64` hash of its file name, through the module registry.
  *
- * @param
+ * @param module_name_hash Hash of the name, e.g. `FNV1a64("kernel32.dll")`.
  *
- * @return
+ * @return Handle of the module, or `NULL` if none is loaded.
  */
 extern HMODULE GetModuleHandleDirect(fnv1a_t module_name_hash);
 
@@ -414,4 +439,6 @@ extern void *GetInterfaceAddress(HMODULE handle, const char *module_name);
  */
 extern void *GetInterfaceAddress(const char *module_name, const char *nterface_name);
 
+#endif
+
 MEMORIA_END
\ No newline at end of file
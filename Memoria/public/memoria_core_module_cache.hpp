@@ -0,0 +1,158 @@
+//
+// memoria_core_module_cache.hpp
+//
+// Internal: the cache behind `GetRelocationIndex`, `GetFunctionIndex` and `GetRttiIndex`.
+//
+// Keeps one index per loaded module, built on first use and shared until the module is
+// unloaded. Whenever the version of the module registry changes, the indexes of the modules
+// that are gone are dropped.
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_core_errors.hpp"
+#include "memoria_core_modules.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+#ifdef _WIN32
+#include "memoria_core_misc.hpp"
+#include "memoria_core_pe.hpp"
+#else
+#include "memoria_core_elf.hpp"
+#endif
+
+MEMORIA_BEGIN
+
+template <typename T>
+class CModuleIndexCache
+{
+private:
+	CModuleIndexCache(const CModuleIndexCache &) = delete;
+	CModuleIndexCache &operator=(const CModuleIndexCache &) = delete;
+
+	struct Entry_t
+	{
+		uintptr_t Base;
+		size_t Size;
+		std::shared_ptr<const T> Index;
+	};
+
+private:
+	std::mutex _lock;
+
+	// The registry version the modules were last checked against.
+	uint64_t _version = 0;
+	Memoria::Vector<Entry_t> _modules{};
+
+private:
+	// Drops the indexes of modules that are no longer loaded. `_lock` must be held.
+	void Prune()
+	{
+		auto &registry = GetModuleRegistry();
+
+		if (registry.GetVersion() == _version)
+			return;
+
+		Memoria::Vector<ModuleRecord_t> modules{};
+		Memoria::Vector<Entry_t> kept{};
+
+		_version = registry.GetModules(modules);
+
+		for (auto &entry : _modules)
+		{
+			bool loaded = std::any_of(modules.begin(), modules.end(), [&entry](const ModuleRecord_t &module)
+			{
+				return module.Base == entry.Base && module.Size == entry.Size;
+			});
+
+			if (loaded)
+				kept.push_back(std::move(entry));
+		}
+
+		_modules = std::move(kept);
+	}
+
+public:
+	CModuleIndexCache() = default;
+
+	/**
+	 * @brief The index of the loaded module that contains `address`.
+	 *
+	 * On first use, `build(T &index, const auto &module)` indexes the module, given as the
+	 * `CPeImage` of the loaded image on Windows and as an `ElfModule_t` on Linux. It runs
+	 * without the lock, as indexing a large module takes a while.
+	 *
+	 * @return `nullptr` if `address` is not in a module.
+	 */
+	template <typename Fn>
+	std::shared_ptr<const T> Get(const void *address, Fn build)
+	{
+		auto value = reinterpret_cast<uintptr_t>(address);
+
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+
+			Prune();
+
+			for (const auto &entry : _modules)
+			{
+				if (value >= entry.Base && value - entry.Base < entry.Size)
+					return entry.Index;
+			}
+		}
+
+		auto index = std::make_shared<T>();
+		uintptr_t base;
+		size_t size;
+
+#ifdef _WIN32
+		CPeImage image;
+
+		if (!image.ParseMapped(GetBaseAddress(address)))
+		{
+			SetError(ME_NOT_FOUND);
+			return nullptr;
+		}
+
+		base = reinterpret_cast<uintptr_t>(image.GetData().data());
+		size = image.GetSizeOfImage();
+
+		build(*index, image);
+#else
+		ElfModule_t module;
+
+		if (!FindElfModule(address, module))
+		{
+			SetError(ME_NOT_FOUND);
+			return nullptr;
+		}
+
+		base = module.Begin;
+		size = module.End - module.Begin;
+
+		build(*index, module);
+#endif
+
+		std::lock_guard<std::mutex> guard(_lock);
+
+		// Another thread may have built it meanwhile.
+		for (const auto &entry : _modules)
+		{
+			if (entry.Base == base && entry.Size == size)
+				return entry.Index;
+		}
+
+		_modules.push_back({ base, size, index });
+
+		return index;
+	}
+};
+
+MEMORIA_END
\ No newline at end of file
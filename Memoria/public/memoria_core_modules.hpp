@@ -0,0 +1,137 @@
+//
+// memoria_core_modules.hpp
+//
+// Module registry.
+//
+// Maps the hash of a module name (`FNV1a64` of the file name, e.g. "kernel32.dll" or
+// "libc.so.6") to the module's base and size. The registry is built once, from the PEB
+// loader list on Windows or `dl_iterate_phdr` on Linux, and kept current afterwards:
+//   - Windows: `LdrRegisterDllNotification` reports every load and unload, which are
+//     applied one at a time. Where it is not available, a lookup that finds nothing
+//     rebuilds the registry once before giving up.
+//   - Linux: a lookup compares the loader's add/remove counters with those the registry
+//     was built with, and rebuilds it when they differ.
+//
+// The table is an immutable snapshot that updates replace as a whole, so reading it does
+// not lock; a replaced snapshot is freed once no lookup is using it anymore. On Linux,
+// however, reading the loader's counters goes through `dl_iterate_phdr`, which takes the
+// loader lock, so every lookup there briefly contends with `dlopen`/`dlclose`.
+//
+// Example:
+//   ModuleRecord_t module;
+//   if (GetModuleRegistry().Find(FNV1a64("ntdll.dll"), module))
+//       auto ntdll = reinterpret_cast<HMODULE>(module.Base);
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_core_hash.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+MEMORIA_BEGIN
+
+struct ModuleRecord_t
+{
+	uint64_t NameHash;
+	uintptr_t Base;
+	size_t Size;
+};
+
+class CModuleRegistry
+{
+private:
+	CModuleRegistry(const CModuleRegistry &) = delete;
+	CModuleRegistry &operator=(const CModuleRegistry &) = delete;
+
+private:
+	// Never changed once published.
+	struct Snapshot_t
+	{
+		// In load order.
+		Memoria::Vector<ModuleRecord_t> Modules;
+
+		// Open-addressed by name hash with linear probing, at most half full.
+		// Each slot is an index into `Modules` plus one, 0 if free.
+		Memoria::Vector<uint32_t> Slots;
+		size_t Mask;
+
+		uint64_t Version;
+	};
+
+	std::atomic<const Snapshot_t *> _snapshot{ nullptr };
+
+	// Lookups in progress. Replaced snapshots are only freed when there are none.
+	std::atomic<uint32_t> _readers{ 0 };
+
+	// Guards updates and `_retired`.
+	std::mutex _lock;
+	Memoria::Vector<const Snapshot_t *> _retired{};
+	uint64_t _version = 0;
+
+	// Whether the registry learns about loads and unloads without being asked.
+	std::atomic<bool> _tracked{ false };
+
+#ifdef _WIN32
+	void *_cookie = nullptr;
+#else
+	// The sum of the loader's add and remove counters when the snapshot was built.
+	std::atomic<unsigned long long> _generation{ 0 };
+#endif
+
+private:
+	// `_lock` must be held.
+	Snapshot_t *MakeSnapshot(const ModuleRecord_t *records, size_t count);
+
+	// Publishes `snapshot` and frees the replaced ones if no lookup is in progress. `_lock` must be held.
+	void Publish(const Snapshot_t *snapshot);
+
+	// Whether the loader reported changes since the snapshot was built.
+	bool IsStale() const;
+
+	static const ModuleRecord_t *FindSlot(const Snapshot_t *snapshot, uint64_t name_hash);
+
+	// Keeps the snapshot loaded in between from being freed.
+	void BeginRead() { _readers.fetch_add(1); }
+	void EndRead() { _readers.fetch_sub(1); }
+
+	bool Read(uint64_t name_hash, ModuleRecord_t &out);
+
+public:
+	// Subscribes to loader notifications where available and builds the registry.
+	CModuleRegistry();
+	~CModuleRegistry();
+
+	/**
+	 * @brief Finds a loaded module by the `FNV1a64` hash of its file name.
+	 *
+	 * If several loaded modules have the same name, the one loaded first is found.
+	 */
+	bool Find(uint64_t name_hash, ModuleRecord_t &out);
+
+	// Rebuilds the registry from the loader's list of modules.
+	void Refresh();
+
+	// Called by the loader notification.
+	void OnLoad(const ModuleRecord_t &record);
+	void OnUnload(uintptr_t base);
+
+	// Copies the modules in load order. Returns the version they were copied from.
+	uint64_t GetModules(Memoria::Vector<ModuleRecord_t> &out);
+
+	// Changes whenever a module is added or removed.
+	uint64_t GetVersion();
+
+	// Number of modules in the current snapshot.
+	size_t GetCount();
+};
+
+// The registry of the current process, built and subscribed to loader notifications on first use.
+extern CModuleRegistry &GetModuleRegistry();
+
+MEMORIA_END
\ No newline at end of file
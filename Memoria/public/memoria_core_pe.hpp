@@ -0,0 +1,573 @@
+//
+// memoria_core_pe.hpp
+//
+// Portable PE parser.
+//
+// `CPeImage` reads the headers of a PE image once and keeps a compact table of the
+// sections, the data directories together with the section that holds each of them, and
+// the section of the entry point. Lookups afterwards are array accesses instead of walks
+// over the DOS, NT and section headers.
+//
+// The image is given as a span of bytes, either a loaded image (`mapped`, an RVA is an
+// offset into the span) or a raw file (RVAs are translated through the section table).
+// Every read is checked against the span. The header structures are defined here, so the
+// parser builds without <Windows.h> and handles PE32 and PE32+ on any host.
+//
+// Example:
+//   CPeImage image(file_bytes, false);
+//   auto exports = image.GetDirectoryData(ePeDirectory::Export);
+//   auto text = image.FindSection(".text");
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <span>
+
+MEMORIA_BEGIN
+
+enum class ePeDirectory : uint8_t
+{
+	Export,
+	Import,
+	Resource,
+	Exception,
+	Security,
+	BaseReloc,
+	Debug,
+	Architecture,
+	GlobalPtr,
+	TLS,
+	LoadConfig,
+	BoundImport,
+	IAT,
+	DelayImport,
+	CLR,
+	Reserved,
+};
+
+static constexpr size_t PeDirectoryCount = 16;
+
+//
+// On-disk structures, as in <winnt.h>.
+//
+
+struct PeFileHeader_t
+{
+	uint16_t Machine;
+	uint16_t NumberOfSections;
+	uint32_t TimeDateStamp;
+	uint32_t PointerToSymbolTable;
+	uint32_t NumberOfSymbols;
+	uint16_t SizeOfOptionalHeader;
+	uint16_t Characteristics;
+};
+
+struct PeDataDirectory_t
+{
+	uint32_t VirtualAddress;
+	uint32_t Size;
+};
+
+struct PeSectionHeader_t
+{
+	char Name[8];
+	uint32_t VirtualSize;
+	uint32_t VirtualAddress;
+	uint32_t SizeOfRawData;
+	uint32_t PointerToRawData;
+	uint32_t PointerToRelocations;
+	uint32_t PointerToLinenumbers;
+	uint16_t NumberOfRelocations;
+	uint16_t NumberOfLinenumbers;
+	uint32_t Characteristics;
+};
+
+struct PeExportDirectory_t
+{
+	uint32_t Characteristics;
+	uint32_t TimeDateStamp;
+	uint16_t MajorVersion;
+	uint16_t MinorVersion;
+	uint32_t Name;
+	uint32_t Base;
+	uint32_t NumberOfFunctions;
+	uint32_t NumberOfNames;
+	uint32_t AddressOfFunctions;
+	uint32_t AddressOfNames;
+	uint32_t AddressOfNameOrdinals;
+};
+
+struct PeImportDescriptor_t
+{
+	uint32_t OriginalFirstThunk;
+	uint32_t TimeDateStamp;
+	uint32_t ForwarderChain;
+	uint32_t Name;
+	uint32_t FirstThunk;
+};
+
+static_assert(sizeof(PeFileHeader_t) == 20);
+static_assert(sizeof(PeDataDirectory_t) == 8);
+static_assert(sizeof(PeSectionHeader_t) == 40);
+static_assert(sizeof(PeExportDirectory_t) == 40);
+static_assert(sizeof(PeImportDescriptor_t) == 20);
+
+static constexpr uint16_t PeDosSignature = 0x5A4D;      // "MZ"
+static constexpr uint32_t PeNtSignature = 0x00004550;   // "PE\0\0"
+static constexpr uint16_t PeMagic32 = 0x10B;
+static constexpr uint16_t PeMagic64 = 0x20B;
+
+static constexpr uint16_t PeMachineI386 = 0x014C;
+static constexpr uint16_t PeMachineAmd64 = 0x8664;
+static constexpr uint16_t PeMachineArm64 = 0xAA64;
+
+// The image has no base relocations and can only be loaded at its preferred base.
+static constexpr uint16_t PeFileRelocsStripped = 0x0001;
+
+static constexpr uint32_t PeSectionCode = 0x00000020;
+static constexpr uint32_t PeSectionExecute = 0x20000000;
+static constexpr uint32_t PeSectionRead = 0x40000000;
+static constexpr uint32_t PeSectionWrite = 0x80000000;
+
+// A section as kept by `CPeImage`.
+struct PeSection_t
+{
+	char Name[8];
+	uint32_t VirtualAddress;
+
+	// The raw size if the header gives no virtual size.
+	uint32_t VirtualSize;
+
+	uint32_t RawOffset;
+	uint32_t RawSize;
+	uint32_t Characteristics;
+};
+
+// A data directory as kept by `CPeImage`.
+struct PeDirectory_t
+{
+	uint32_t VirtualAddress;
+	uint32_t Size;
+
+	// Index of the section that holds the directory, `CPeImage::NoSection` if none does.
+	uint16_t Section;
+};
+
+class CPeImage
+{
+private:
+	CPeImage(const CPeImage &) = delete;
+	CPeImage &operator=(const CPeImage &) = delete;
+
+public:
+	static constexpr uint16_t NoSection = 0xFFFF;
+	static constexpr size_t InvalidOffset = static_cast<size_t>(-1);
+
+private:
+	// Offsets within the optional header.
+	static constexpr size_t OptEntryPoint = 16;
+	static constexpr size_t OptImageBase32 = 28;
+	static constexpr size_t OptImageBase64 = 24;
+	static constexpr size_t OptSectionAlignment = 32;
+	static constexpr size_t OptFileAlignment = 36;
+	static constexpr size_t OptSizeOfImage = 56;
+	static constexpr size_t OptSizeOfHeaders = 60;
+	static constexpr size_t OptDirectories32 = 96;
+	static constexpr size_t OptDirectories64 = 112;
+
+private:
+	std::span<const uint8_t> _data{};
+	bool _mapped = false;
+	bool _valid = false;
+	bool _is64 = false;
+
+	uint16_t _machine = 0;
+	uint16_t _characteristics = 0;
+	uint64_t _image_base = 0;
+	uint32_t _entry_point = 0;
+	uint32_t _size_of_image = 0;
+	uint32_t _size_of_headers = 0;
+
+	// Offsets of the optional header and of the section table in the data.
+	size_t _optional = 0;
+	size_t _section_table = 0;
+
+	Memoria::Vector<PeSection_t> _sections{};
+	PeDirectory_t _directories[PeDirectoryCount] = {};
+	uint16_t _entry_section = NoSection;
+
+private:
+	template <typename T>
+	bool ReadAt(size_t offset, T &out) const
+	{
+		if (offset > _data.size() || _data.size() - offset < sizeof(T))
+			return false;
+
+		memcpy(&out, _data.data() + offset, sizeof(T));
+		return true;
+	}
+
+	bool Fail()
+	{
+		Clear();
+		return false;
+	}
+
+	uint16_t FindSectionIndex(uint32_t rva) const
+	{
+		for (size_t i = 0; i < _sections.size(); i++)
+		{
+			if (rva >= _sections[i].VirtualAddress && rva - _sections[i].VirtualAddress < _sections[i].VirtualSize)
+				return static_cast<uint16_t>(i);
+		}
+
+		return NoSection;
+	}
+
+public:
+	CPeImage() = default;
+
+	CPeImage(std::span<const uint8_t> data, bool mapped)
+	{
+		Parse(data, mapped);
+	}
+
+	/**
+	 * @brief Parses the headers of the image in `data`.
+	 *
+	 * @param mapped `true` for a loaded image, `false` for the contents of a file.
+	 *
+	 * @return `false` if `data` does not hold a valid PE image. The object is then empty.
+	 */
+	bool Parse(std::span<const uint8_t> data, bool mapped)
+	{
+		Clear();
+
+		_data = data;
+		_mapped = mapped;
+
+		uint16_t dos_signature;
+		uint32_t nt_offset;
+		uint32_t nt_signature;
+		PeFileHeader_t file;
+
+		if (!ReadAt(0, dos_signature) || dos_signature != PeDosSignature)
+			return Fail();
+
+		if (!ReadAt(0x3C, nt_offset) || !ReadAt(nt_offset, nt_signature) || nt_signature != PeNtSignature)
+			return Fail();
+
+		if (!ReadAt(nt_offset + 4, file))
+			return Fail();
+
+		size_t optional = nt_offset + 4 + sizeof(PeFileHeader_t);
+		uint16_t magic;
+
+		if (!ReadAt(optional, magic) || (magic != PeMagic32 && magic != PeMagic64))
+			return Fail();
+
+		_is64 = (magic == PeMagic64);
+		_machine = file.Machine;
+		_characteristics = file.Characteristics;
+
+		uint32_t directory_count;
+		size_t directories = optional + (_is64 ? OptDirectories64 : OptDirectories32);
+
+		if (!ReadAt(optional + OptEntryPoint, _entry_point) ||
+			!ReadAt(optional + OptSizeOfImage, _size_of_image) ||
+			!ReadAt(optional + OptSizeOfHeaders, _size_of_headers) ||
+			!ReadAt(directories - 4, directory_count))
+		{
+			return Fail();
+		}
+
+		if (_is64)
+		{
+			if (!ReadAt(optional + OptImageBase64, _image_base))
+				return Fail();
+		}
+		else
+		{
+			uint32_t image_base;
+
+			if (!ReadAt(optional + OptImageBase32, image_base))
+				return Fail();
+
+			_image_base = image_base;
+		}
+
+		// Sections follow the optional header, whose size the file header gives.
+		size_t section_table = optional + file.SizeOfOptionalHeader;
+
+		_optional = optional;
+		_section_table = section_table;
+		_sections.reserve(file.NumberOfSections);
+
+		for (size_t i = 0; i < file.NumberOfSections; i++)
+		{
+			PeSectionHeader_t header;
+
+			if (!ReadAt(section_table + i * sizeof(PeSectionHeader_t), header))
+				return Fail();
+
+			PeSection_t section;
+
+			memcpy(section.Name, header.Name, sizeof(section.Name));
+			section.VirtualAddress = header.VirtualAddress;
+			section.VirtualSize = header.VirtualSize ? header.VirtualSize : header.SizeOfRawData;
+			section.RawOffset = header.PointerToRawData;
+			section.RawSize = header.SizeOfRawData;
+			section.Characteristics = header.Characteristics;
+
+			_sections.push_back(section);
+		}
+
+		for (size_t i = 0; i < PeDirectoryCount && i < directory_count; i++)
+		{
+			PeDataDirectory_t directory;
+
+			if (!ReadAt(directories + i * sizeof(PeDataDirectory_t), directory))
+				break;
+
+			_directories[i].VirtualAddress = directory.VirtualAddress;
+			_directories[i].Size = directory.Size;
+			_directories[i].Section = directory.VirtualAddress ? FindSectionIndex(directory.VirtualAddress) : NoSection;
+		}
+
+		_entry_section = _entry_point ? FindSectionIndex(_entry_point) : NoSection;
+		_valid = true;
+
+		return true;
+	}
+
+	/**
+	 * @brief Parses the image loaded at `base`, taking its size from its own headers.
+	 *
+	 * The headers are trusted to be readable, as they are for any loaded module.
+	 */
+	bool ParseMapped(const void *base)
+	{
+		Clear();
+
+		if (!base)
+			return false;
+
+		auto bytes = static_cast<const uint8_t *>(base);
+
+		uint16_t dos_signature;
+		uint32_t nt_offset;
+		uint32_t nt_signature;
+		uint32_t size_of_image;
+
+		memcpy(&dos_signature, bytes, sizeof(dos_signature));
+		memcpy(&nt_offset, bytes + 0x3C, sizeof(nt_offset));
+
+		if (dos_signature != PeDosSignature)
+			return false;
+
+		memcpy(&nt_signature, bytes + nt_offset, sizeof(nt_signature));
+
+		if (nt_signature != PeNtSignature)
+			return false;
+
+		memcpy(&size_of_image, bytes + nt_offset + 4 + sizeof(PeFileHeader_t) + OptSizeOfImage, sizeof(size_of_image));
+
+		return Parse({ bytes, size_of_image }, true);
+	}
+
+	void Clear()
+	{
+		_data = {};
+		_valid = false;
+		_sections = Memoria::Vector<PeSection_t>();
+		_entry_section = NoSection;
+
+		for (auto &directory : _directories)
+			directory = { 0, 0, NoSection };
+	}
+
+	bool IsValid() const { return _valid; }
+	bool IsMapped() const { return _mapped; }
+	bool Is64() const { return _is64; }
+
+	uint16_t GetMachine() const { return _machine; }
+	uint16_t GetCharacteristics() const { return _characteristics; }
+	uint64_t GetImageBase() const { return _image_base; }
+	uint32_t GetEntryPoint() const { return _entry_point; }
+	uint32_t GetSizeOfImage() const { return _size_of_image; }
+	uint32_t GetSizeOfHeaders() const { return _size_of_headers; }
+
+	std::span<const uint8_t> GetData() const { return _data; }
+
+	//
+	// Sections
+	//
+
+	std::span<const PeSection_t> GetSections() const { return { _sections.data(), _sections.size() }; }
+
+	const PeSection_t *GetSection(size_t index) const
+	{
+		return index < _sections.size() ? &_sections[index] : nullptr;
+	}
+
+	// Section names are compared in full, up to their 8 characters.
+	const PeSection_t *FindSection(const char *name) const
+	{
+		size_t length = strlen(name);
+
+		if (length > sizeof(PeSection_t::Name))
+			return nullptr;
+
+		for (const auto &section : _sections)
+		{
+			if (memcmp(section.Name, name, length) == 0 && (length == sizeof(section.Name) || section.Name[length] == '\0'))
+				return &section;
+		}
+
+		return nullptr;
+	}
+
+	const PeSection_t *FindSectionByRva(uint32_t rva) const
+	{
+		return GetSection(FindSectionIndex(rva));
+	}
+
+	// The section that holds the entry point.
+	const PeSection_t *GetEntrySection() const { return GetSection(_entry_section); }
+
+	//
+	// Directories
+	//
+
+	// An index past the last directory yields an empty directory.
+	const PeDirectory_t &GetDirectory(ePeDirectory directory) const
+	{
+		static constexpr PeDirectory_t Empty = { 0, 0, NoSection };
+
+		size_t index = static_cast<size_t>(directory);
+		return index < PeDirectoryCount ? _directories[index] : Empty;
+	}
+
+	// The section that holds the directory.
+	const PeSection_t *GetDirectorySection(ePeDirectory directory) const
+	{
+		return GetSection(GetDirectory(directory).Section);
+	}
+
+	// The contents of the directory, empty if it is absent or lies outside of the data.
+	std::span<const uint8_t> GetDirectoryData(ePeDirectory directory) const
+	{
+		const auto &entry = GetDirectory(directory);
+
+		if (!entry.VirtualAddress)
+			return {};
+
+		auto data = GetPointer(entry.VirtualAddress, entry.Size);
+
+		if (!data)
+			return {};
+
+		return { data, entry.Size };
+	}
+
+	//
+	// Addressing
+	//
+
+	// Offset of `rva` in the data, `InvalidOffset` if no byte of the data maps to it.
+	size_t RvaToOffset(uint32_t rva) const
+	{
+		if (_mapped || rva < _size_of_headers)
+			return rva < _data.size() ? rva : InvalidOffset;
+
+		auto section = FindSectionByRva(rva);
+
+		if (!section || rva - section->VirtualAddress >= section->RawSize)
+			return InvalidOffset;
+
+		size_t offset = static_cast<size_t>(section->RawOffset) + (rva - section->VirtualAddress);
+		return offset < _data.size() ? offset : InvalidOffset;
+	}
+
+	// Pointer to `size` bytes at `rva`, or `nullptr` if they are not all in the data.
+	const uint8_t *GetPointer(uint32_t rva, size_t size) const
+	{
+		size_t offset = RvaToOffset(rva);
+
+		if (offset == InvalidOffset || _data.size() - offset < size)
+			return nullptr;
+
+		return _data.data() + offset;
+	}
+
+	template <typename T>
+	bool Read(uint32_t rva, T &out) const
+	{
+		size_t offset = RvaToOffset(rva);
+		return offset != InvalidOffset && ReadAt(offset, out);
+	}
+
+	// The null-terminated string at `rva`, or `nullptr` if it runs past the data.
+	const char *GetString(uint32_t rva) const
+	{
+		size_t offset = RvaToOffset(rva);
+
+		if (offset == InvalidOffset)
+			return nullptr;
+
+		auto string = reinterpret_cast<const char *>(_data.data() + offset);
+		return memchr(string, 0, _data.size() - offset) ? string : nullptr;
+	}
+
+	//
+	// Dumps
+	//
+
+	/**
+	 * @brief Rewrites `headers`, a copy of the first bytes of this loaded image, for a file that
+	 * holds the image as it is in memory: every section starts at its RVA and spans its virtual
+	 * size rounded up to the section alignment, which becomes the file alignment as well.
+	 *
+	 * A dump with these headers reads as a file image and as a loaded image alike.
+	 *
+	 * @return `false` if `headers` does not hold the optional header and the section table.
+	 */
+	bool RealignHeaders(std::span<uint8_t> headers) const
+	{
+		uint32_t alignment;
+		size_t end = _section_table + _sections.size() * sizeof(PeSectionHeader_t);
+
+		if (!_valid || headers.size() < end || !ReadAt(_optional + OptSectionAlignment, alignment))
+			return false;
+
+		memcpy(headers.data() + _optional + OptFileAlignment, &alignment, sizeof(alignment));
+
+		for (size_t i = 0; i < _sections.size(); i++)
+		{
+			const auto &section = _sections[i];
+			uint32_t raw_size = 0;
+
+			if (section.VirtualAddress < _size_of_image)
+			{
+				uint64_t aligned = alignment ? (uint64_t(section.VirtualSize) + alignment - 1) / alignment * alignment : section.VirtualSize;
+				raw_size = static_cast<uint32_t>((std::min)(aligned, uint64_t(_size_of_image - section.VirtualAddress)));
+			}
+
+			auto header = headers.data() + _section_table + i * sizeof(PeSectionHeader_t);
+
+			memcpy(header + offsetof(PeSectionHeader_t, SizeOfRawData), &raw_size, sizeof(raw_size));
+			memcpy(header + offsetof(PeSectionHeader_t, PointerToRawData), &section.VirtualAddress, sizeof(uint32_t));
+		}
+
+		return true;
+	}
+};
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,361 @@
+//
+// memoria_core_pe_iter.hpp
+//
+// Export and import iterators over a `CPeImage`.
+//
+// The iterators read the directories in place, one entry per step, and allocate
+// nothing. Every RVA goes through the image, so they work the same on a loaded module
+// and on the bytes of a file, and stop at the first entry that lies outside of the
+// data instead of reading past it.
+//
+// Example:
+//   for (const auto &entry : CPeExports(image))
+//       printf("%s %u\n", entry.Name, entry.Ordinal);
+//
+//   for (const auto &entry : CPeImports(image))
+//       if (entry.Name && strcmp(entry.Name, "Sleep") == 0)
+//           slot = entry.Slot;
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_core_pe.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <iterator>
+
+MEMORIA_BEGIN
+
+//
+// Exports
+//
+
+struct PeExport_t
+{
+	// `nullptr` for exports without a name.
+	const char *Name;
+
+	// As passed to `GetProcAddress`, i.e. with the ordinal base.
+	uint32_t Ordinal;
+
+	// 0 for an unused ordinal.
+	uint32_t Rva;
+
+	// `Rva` holds "MODULE.Function" or "MODULE.#Ordinal" instead of code or data.
+	bool Forwarder;
+};
+
+class CPeExportIterator
+{
+public:
+	using iterator_category = std::forward_iterator_tag;
+	using value_type = PeExport_t;
+	using difference_type = ptrdiff_t;
+	using pointer = const PeExport_t *;
+	using reference = const PeExport_t &;
+
+private:
+	const CPeImage *_image = nullptr;
+	PeExportDirectory_t _directory{};
+	PeDirectory_t _range{};
+
+	// Walks the name table, or the function table if `false`.
+	bool _by_name = true;
+
+	uint32_t _index = 0;
+	uint32_t _count = 0;
+
+	PeExport_t _current{};
+
+private:
+	uint32_t ReadU32(uint32_t rva) const
+	{
+		uint32_t value;
+		return _image->Read(rva, value) ? value : 0;
+	}
+
+	// Fills `_current` for `_index`. Ends the walk at an entry outside of the data.
+	void Load()
+	{
+		if (_index >= _count)
+			return;
+
+		uint32_t ordinal = _index;
+		const char *name = nullptr;
+
+		if (_by_name)
+		{
+			uint16_t name_ordinal;
+
+			name = _image->GetString(ReadU32(_directory.AddressOfNames + _index * sizeof(uint32_t)));
+
+			if (!name || !_image->Read(_directory.AddressOfNameOrdinals + _index * sizeof(uint16_t), name_ordinal) ||
+				name_ordinal >= _directory.NumberOfFunctions)
+			{
+				_index = _count;
+				return;
+			}
+
+			ordinal = name_ordinal;
+		}
+
+		uint32_t rva;
+
+		if (!_image->Read(_directory.AddressOfFunctions + ordinal * sizeof(uint32_t), rva))
+		{
+			_index = _count;
+			return;
+		}
+
+		_current.Name = name;
+		_current.Ordinal = _directory.Base + ordinal;
+		_current.Rva = rva;
+		_current.Forwarder = rva >= _range.VirtualAddress && rva - _range.VirtualAddress < _range.Size;
+	}
+
+public:
+	// The end of any walk.
+	CPeExportIterator() = default;
+
+	CPeExportIterator(const CPeImage &image, bool by_name)
+		: _image(&image)
+		, _range(image.GetDirectory(ePeDirectory::Export))
+		, _by_name(by_name)
+	{
+		if (!_range.VirtualAddress || !image.Read(_range.VirtualAddress, _directory))
+			return;
+
+		_count = by_name ? _directory.NumberOfNames : _directory.NumberOfFunctions;
+		Load();
+	}
+
+	reference operator*() const { return _current; }
+	pointer operator->() const { return &_current; }
+
+	CPeExportIterator &operator++()
+	{
+		_index++;
+		Load();
+
+		return *this;
+	}
+
+	CPeExportIterator operator++(int)
+	{
+		auto copy = *this;
+		++*this;
+
+		return copy;
+	}
+
+	bool operator==(const CPeExportIterator &other) const
+	{
+		bool end = (_index >= _count);
+		bool other_end = (other._index >= other._count);
+
+		if (end || other_end)
+			return end == other_end;
+
+		return _image == other._image && _by_name == other._by_name && _index == other._index;
+	}
+
+	bool operator!=(const CPeExportIterator &other) const { return !(*this == other); }
+};
+
+// The exports of an image: the named ones in name table order (sorted by name), or with
+// `by_name == false`, every slot of the function table in ordinal order, without names.
+class CPeExports
+{
+private:
+	const CPeImage &_image;
+	bool _by_name;
+
+public:
+	CPeExports(const CPeImage &image, bool by_name = true)
+		: _image(image)
+		, _by_name(by_name)
+	{
+
+	}
+
+	CPeExportIterator begin() const { return CPeExportIterator(_image, _by_name); }
+	CPeExportIterator end() const { return {}; }
+};
+
+//
+// Imports
+//
+
+struct PeImport_t
+{
+	// Name of the module imported from.
+	const char *Module;
+
+	// RVA of the import descriptor.
+	uint32_t Descriptor;
+
+	// RVA of the entry in the lookup table, 0 if the descriptor has none.
+	uint32_t Thunk;
+
+	// RVA of the IAT slot, which a loaded module holds the imported address in.
+	uint32_t Slot;
+
+	// `nullptr` for an import by ordinal, or if a loaded module has no lookup table to read it from.
+	const char *Name;
+	uint16_t Hint;
+
+	// For imports by ordinal.
+	uint16_t Ordinal;
+};
+
+class CPeImportIterator
+{
+public:
+	using iterator_category = std::forward_iterator_tag;
+	using value_type = PeImport_t;
+	using difference_type = ptrdiff_t;
+	using pointer = const PeImport_t *;
+	using reference = const PeImport_t &;
+
+private:
+	const CPeImage *_image = nullptr;
+
+	// 0 at the end.
+	uint32_t _descriptor = 0;
+	uint32_t _index = 0;
+
+	PeImport_t _current{};
+
+private:
+	bool ReadThunk(uint32_t rva, uint64_t &value) const
+	{
+		if (_image->Is64())
+			return _image->Read(rva, value);
+
+		uint32_t value32;
+
+		if (!_image->Read(rva, value32))
+			return false;
+
+		value = value32;
+		return true;
+	}
+
+	// Fills `_current` for the thunk `_index` of `_descriptor`, moving on to the next
+	// descriptor at the end of a thunk list.
+	void Load()
+	{
+		size_t width = _image->Is64() ? sizeof(uint64_t) : sizeof(uint32_t);
+		uint64_t ordinal_flag = _image->Is64() ? (1ull << 63) : (1ull << 31);
+
+		while (_descriptor)
+		{
+			PeImportDescriptor_t descriptor;
+
+			if (!_image->Read(_descriptor, descriptor) || (!descriptor.Name && !descriptor.FirstThunk))
+			{
+				_descriptor = 0;
+				return;
+			}
+
+			// In a loaded module the IAT holds addresses, so names are only found in the lookup table.
+			uint32_t table = descriptor.OriginalFirstThunk;
+
+			if (!table && !_image->IsMapped())
+				table = descriptor.FirstThunk;
+
+			uint32_t slot = descriptor.FirstThunk + static_cast<uint32_t>(_index * width);
+			uint32_t thunk = table ? table + static_cast<uint32_t>(_index * width) : 0;
+			uint64_t value;
+
+			if (!ReadThunk(thunk ? thunk : slot, value) || !value)
+			{
+				_descriptor += sizeof(PeImportDescriptor_t);
+				_index = 0;
+				continue;
+			}
+
+			_current = {};
+			_current.Module = _image->GetString(descriptor.Name);
+			_current.Descriptor = _descriptor;
+			_current.Thunk = thunk;
+			_current.Slot = slot;
+
+			if (!thunk)
+				return;
+
+			if (value & ordinal_flag)
+			{
+				_current.Ordinal = static_cast<uint16_t>(value & 0xFFFF);
+			}
+			else
+			{
+				uint32_t by_name = static_cast<uint32_t>(value & 0x7FFFFFFF);
+
+				_image->Read(by_name, _current.Hint);
+				_current.Name = _image->GetString(by_name + sizeof(uint16_t));
+			}
+
+			return;
+		}
+	}
+
+public:
+	// The end of any walk.
+	CPeImportIterator() = default;
+
+	CPeImportIterator(const CPeImage &image)
+		: _image(&image)
+		, _descriptor(image.GetDirectory(ePeDirectory::Import).VirtualAddress)
+	{
+		Load();
+	}
+
+	reference operator*() const { return _current; }
+	pointer operator->() const { return &_current; }
+
+	CPeImportIterator &operator++()
+	{
+		_index++;
+		Load();
+
+		return *this;
+	}
+
+	CPeImportIterator operator++(int)
+	{
+		auto copy = *this;
+		++*this;
+
+		return copy;
+	}
+
+	bool operator==(const CPeImportIterator &other) const
+	{
+		return _descriptor == other._descriptor && (!_descriptor || (_image == other._image && _index == other._index));
+	}
+
+	bool operator!=(const CPeImportIterator &other) const { return !(*this == other); }
+};
+
+// The imports of an image, descriptor by descriptor and thunk by thunk.
+class CPeImports
+{
+private:
+	const CPeImage &_image;
+
+public:
+	CPeImports(const CPeImage &image)
+		: _image(image)
+	{
+
+	}
+
+	CPeImportIterator begin() const { return CPeImportIterator(_image); }
+	CPeImportIterator end() const { return {}; }
+};
+
+MEMORIA_END
\ No newline at end of file
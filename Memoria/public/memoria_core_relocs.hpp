@@ -0,0 +1,154 @@
+//
+// memoria_core_relocs.hpp
+//
+// Relocation tables.
+//
+// `CRelocationIndex` lists where the absolute pointers of a module are: the slots the
+// loader rebases or binds, from the `.reloc` directory and the import address table of a
+// PE image or the RELATIVE (and word-sized absolute) relocations, the PLT relocations and
+// the RELR table of an ELF object. The slots are
+// sorted offsets from the base of the module, so those in a range are a binary search
+// away.
+//
+// A value that the loader wrote is only ever found in a slot, unless the module wrote it
+// elsewhere itself, which only writable memory allows. `FindReferences` therefore looks
+// for absolute references in the read-only parts of a module by comparing the values of
+// its slots, a few thousand comparisons instead of one per byte, and keeps scanning the
+// writable parts. That only holds for modules that can be loaded anywhere (see
+// `IsComplete`): a non-PIE executable or a PE image with stripped relocations has
+// absolute pointers the loader never touches, and is scanned.
+//
+// Example:
+//   // "48 B9 ?? ?? ?? ?? ?? ?? ?? ?? FF D1" for `mov rcx, imm64; call rcx` with a relocated imm64.
+//   auto signature = MakeSignature(code, 12);
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_core_pe.hpp"
+#include "memoria_core_signature.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <span>
+
+#ifndef _WIN32
+#include "memoria_core_elf.hpp"
+#endif
+
+MEMORIA_BEGIN
+
+// Offsets from the base of the module. `End` is exclusive.
+struct RelocationRange_t
+{
+	uint32_t Begin;
+	uint32_t End;
+};
+
+class CRelocationIndex
+{
+private:
+	CRelocationIndex(const CRelocationIndex &) = delete;
+	CRelocationIndex &operator=(const CRelocationIndex &) = delete;
+
+private:
+	// Sorted, without duplicates. Each slot holds a pointer of `_width` bytes.
+	Memoria::Vector<uint32_t> _slots{};
+
+	// Where the module may have written pointers of its own, sorted.
+	Memoria::Vector<RelocationRange_t> _writable{};
+
+	uintptr_t _base = 0;
+	size_t _size = 0;
+	uint8_t _width = sizeof(void *);
+	bool _complete = false;
+
+private:
+	// Sorts the slots and drops those that do not fit in the module.
+	void Finish();
+
+public:
+	CRelocationIndex() = default;
+
+	CRelocationIndex(CRelocationIndex &&) = default;
+	CRelocationIndex &operator=(CRelocationIndex &&) = default;
+
+	/**
+	 * @brief Indexes the base relocation directory and the import address table of `image`.
+	 *
+	 * Only relocations of the image's pointer size are kept (HIGHLOW on PE32, DIR64 on PE32+).
+	 * Every entry of the import address table is a slot, the loader writes the imports there.
+	 * Slot values can be read only if `image` is a loaded image.
+	 *
+	 * @return `false` if the image has no relocations. The index is then empty.
+	 */
+	bool Build(const CPeImage &image);
+
+#ifndef _WIN32
+	/**
+	 * @brief Indexes the dynamic relocations of a loaded object: REL/RELA entries of the
+	 * RELATIVE, IRELATIVE, GLOB_DAT and word-sized absolute types, the JUMP_SLOT entries of
+	 * the PLT relocations (`DT_JMPREL`) and the RELR table.
+	 *
+	 * Lazy binding changes the values of the PLT slots after loading, not where they are.
+	 *
+	 * @return `false` if the object has no such relocations. The index is then empty.
+	 */
+	bool Build(const ElfModule_t &module);
+#endif
+
+	void Clear();
+
+	bool IsEmpty() const { return _slots.empty(); }
+
+	// Whether every absolute pointer the module was built with is in a slot, i.e. the module
+	// is relocatable: a PE image whose relocations were not stripped, or an ET_DYN object.
+	bool IsComplete() const { return _complete; }
+
+	uintptr_t GetBase() const { return _base; }
+	size_t GetSize() const { return _size; }
+
+	// Size of a slot, the pointer size of the module.
+	size_t GetWidth() const { return _width; }
+
+	std::span<const uint32_t> GetSlots() const { return { _slots.data(), _slots.size() }; }
+	std::span<const RelocationRange_t> GetWritableRanges() const { return { _writable.data(), _writable.size() }; }
+
+	// The slots that start in [begin, end).
+	std::span<const uint32_t> FindSlots(uint32_t begin, uint32_t end) const;
+
+	// Whether the byte at `offset` is part of a slot.
+	bool IsRelocated(uint32_t offset) const;
+
+	bool IsWritable(uint32_t offset) const;
+
+	/**
+	 * @brief Finds the slots of a loaded module that hold `value`.
+	 *
+	 * @return Number of slot addresses written to `out`.
+	 */
+	size_t FindValue(uintptr_t value, void **out, size_t max_size) const;
+};
+
+/**
+ * @brief The relocation index of the loaded module that contains `address`.
+ *
+ * Built on first use and shared until the module is unloaded.
+ *
+ * @return `nullptr` if `address` is not in a module.
+ */
+extern std::shared_ptr<const CRelocationIndex> GetRelocationIndex(const void *address);
+
+/**
+ * @brief Builds a signature from the `size` bytes at `address`, with the bytes of every
+ * relocation slot among them made wildcards.
+ *
+ * Relocated bytes hold the load address of the module and differ between runs. Bytes not
+ * in a module are taken as they are.
+ */
+extern CSignature MakeSignature(const void *address, size_t size);
+
+MEMORIA_END
\ No newline at end of file
@@ -1,11 +1,221 @@
+//
+// memoria_core_rtti.hpp
+//
+// Run-time type information.
+//
+// `CRttiIndex` reads the MSVC RTTI of a module once. It finds every type descriptor
+// (".?AV"/".?AU" names) and every complete object locator that refers to one, validated by
+// its signature and, on x64, by its self RVA. Then it finds every vtable, which is the slot
+// after a pointer to a locator. The classes go into a hash table keyed by their name, so a
+// lookup takes one probe instead of three scans of the module.
+//
+// On Linux it reads the Itanium C++ ABI RTTI of GCC and Clang objects instead. A vtable is
+// an offset-to-top, a pointer to the type_info of the class, then the virtual functions; the
+// type_info (`__class_type_info`, `__si_class_type_info` or `__vmi_class_type_info`) starts
+// with its own vtable pointer and the mangled name of the class, the string of the `_ZTS`
+// symbol. The type_info vtables are those of the C++ runtime, so they are learned from the
+// vtables of the module, and from the runtime itself for a loaded object. Every other class
+// type_info of the module uses one of them.
+//
+// A class is found by any of these names:
+//   - The raw name: ".?AVCPlayer@game@@" (MSVC) or "N4game7CPlayerE" (Itanium, with or
+//     without the "_ZTS" or "_ZTI" of its symbol).
+//   - The qualified name: "game::CPlayer". Template instances and classes in anonymous
+//     namespaces have no qualified name. Itanium names are split into their parts, not
+//     demangled.
+//   - The class name alone: "CPlayer". If classes in different namespaces share it, the
+//     first one in the module is found.
+//
+// `GetRttiIndex` keeps the index of every module it is asked for until the module is
+// unloaded. The legacy functions below use it when their range lies in a module, and
+// scan the range otherwise.
+//
+// Example:
+//   auto rtti = GetRttiIndex(module_base);
+//   if (auto cls = rtti ? rtti->Find("CPlayer") : nullptr)
+//       auto vtable = static_cast<void **>(rtti->GetAddress(cls->VTable));
+//
+
 #pragma once
 
 #include "memoria_common.hpp"
+#include "memoria_core_pe.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <span>
 
-// TODO: Export only GetVTableForClass?
+#ifndef _WIN32
+#include "memoria_core_elf.hpp"
+#endif
 
 MEMORIA_BEGIN
 
+struct RttiClass_t
+{
+	// Offsets from the base of the module. `VTable` is that of the primary vtable, the one at
+	// offset 0 in the object, 0 if the class has none. `Locator` is the offset of its complete
+	// object locator (MSVC) or of its offset-to-top slot, the start of the vtable (Itanium).
+	uint32_t TypeDescriptor;
+	uint32_t Locator;
+	uint32_t VTable;
+
+	// Range of the vtables of the class in `CRttiIndex::GetVTables`.
+	uint32_t FirstVTable;
+	uint32_t VTableCount;
+
+	// Offsets of the names in the name pool of the index. `Name` is that of an empty string if
+	// the class has no qualified name.
+	uint32_t RawName;
+	uint32_t Name;
+};
+
+// A vtable of a class, one for each base class subobject that has one.
+struct RttiVTable_t
+{
+	// Offsets from the base of the module. `VTable` is the first virtual function slot,
+	// `Locator` the complete object locator (MSVC) or the offset-to-top slot at the start of
+	// the vtable (Itanium). The value of the offset-to-top is in `Offset`, negated.
+	uint32_t Locator;
+	uint32_t VTable;
+
+	// Offset of the subobject that uses the vtable within the complete object.
+	uint32_t Offset;
+};
+
+class CRttiIndex
+{
+private:
+	CRttiIndex(const CRttiIndex &) = delete;
+	CRttiIndex &operator=(const CRttiIndex &) = delete;
+
+private:
+	// Sorted by `TypeDescriptor`.
+	Memoria::Vector<RttiClass_t> _classes{};
+
+	// Sorted by class, then by `Offset`.
+	Memoria::Vector<RttiVTable_t> _vtables{};
+
+	// Null-terminated names, starting with an empty one.
+	Memoria::Vector<char> _names{};
+
+	// Open addressing over `FNV1a64` hashes of every name of every class. A slot holds an index
+	// into `_keys` plus one, 0 if it is empty.
+	struct Key_t
+	{
+		uint64_t Hash;
+		uint32_t Class;
+	};
+
+	Memoria::Vector<Key_t> _keys{};
+	Memoria::Vector<uint32_t> _slots{};
+	size_t _mask = 0;
+
+	uintptr_t _base = 0;
+	size_t _size = 0;
+
+	// A type descriptor (MSVC) or type_info (Itanium) found while building, and its raw name.
+	struct Descriptor_t
+	{
+		uint32_t Offset;
+		const char *Name;
+		size_t Length;
+	};
+
+	// Writes the qualified name of a raw name, `false` if it has none.
+	using UndecorateFn_t = bool(*)(const char *raw, Memoria::Vector<char> &out);
+
+private:
+	uint32_t AddName(const char *name, size_t length);
+
+	// Fills `_classes` and `_vtables` from the descriptors, sorted by offset, and the vtables,
+	// `owners` holding the descriptor of each. Then builds the hash table.
+	void Assemble(const Memoria::Vector<Descriptor_t> &descriptors, const Memoria::Vector<RttiVTable_t> &vtables,
+		const Memoria::Vector<uint32_t> &owners, UndecorateFn_t undecorate);
+
+	// Builds the hash table over the names of `_classes`.
+	void Finish();
+
+public:
+	CRttiIndex() = default;
+
+	CRttiIndex(CRttiIndex &&) = default;
+	CRttiIndex &operator=(CRttiIndex &&) = default;
+
+	/**
+	 * @brief Indexes the MSVC RTTI of `image`.
+	 *
+	 * Works on loaded images, on dumps mapped from a file (`CModuleDump`) and on file images.
+	 * Addresses are those of the mapping only if `image` is a loaded image.
+	 *
+	 * @param base The address the module was loaded at, which the pointers in it are relative
+	 * to on x86. 0 for the image base in its headers, which the loader updates.
+	 *
+	 * @return `false` if the image has no type descriptors. The index is then empty.
+	 */
+	bool Build(const CPeImage &image, uint64_t base = 0);
+
+#ifndef _WIN32
+	/**
+	 * @brief Indexes the Itanium C++ ABI RTTI of `image`, a loaded object or a dump mapped with
+	 * `CElfImage::ParseMapped`.
+	 *
+	 * Only the classes of the module are indexed. A class without a vtable is found if its
+	 * type_info uses a type_info vtable seen in the module.
+	 *
+	 * @param base The address the module was loaded at, which the pointers in it are relative
+	 * to. 0 for the address of `image`.
+	 *
+	 * @return `false` if the object has no class type_info. The index is then empty.
+	 */
+	bool Build(const CElfImage &image, uint64_t base = 0);
+#endif
+
+	void Clear();
+
+	bool IsEmpty() const { return _classes.empty(); }
+
+	// Address the offsets are relative to, 0 if the index was built from a PE file image.
+	uintptr_t GetBase() const { return _base; }
+	void *GetAddress(uint32_t offset) const { return (_base && offset) ? reinterpret_cast<void *>(_base + offset) : nullptr; }
+
+	// Size of the module.
+	size_t GetSize() const { return _size; }
+
+	std::span<const RttiClass_t> GetClasses() const { return { _classes.data(), _classes.size() }; }
+	std::span<const RttiVTable_t> GetVTables(const RttiClass_t &cls) const { return { _vtables.data() + cls.FirstVTable, cls.VTableCount }; }
+
+	const char *GetRawName(const RttiClass_t &cls) const { return &_names[cls.RawName]; }
+	const char *GetName(const RttiClass_t &cls) const { return &_names[cls.Name]; }
+
+	// The class with the raw, qualified or bare name, compared case-insensitively. `nullptr` if there is none.
+	// An Itanium raw name may keep the "_ZTS" or "_ZTI" prefix of its symbol.
+	const RttiClass_t *Find(const char *name) const;
+
+	// The class whose type descriptor or type_info is at `offset`.
+	const RttiClass_t *FindByDescriptor(uint32_t offset) const;
+};
+
+/**
+ * @brief The RTTI index of the loaded module that contains `address`.
+ *
+ * Built on first use and shared until the module is unloaded.
+ *
+ * @return `nullptr` if `address` is not in a module.
+ */
+extern std::shared_ptr<const CRttiIndex> GetRttiIndex(const void *address);
+
+/**
+ * Lookups in [addr_min, addr_max) that only return what lies at or after `addr_start`, as a
+ * forward scan from there would. Served from the index of the module when the range lies in
+ * one, by scanning otherwise (Windows only).
+ *
+ * `rtti_name` is anything `CRttiIndex::Find` accepts, or the start of an MSVC raw name after
+ * ".?AV", up to an '@': "CPlayer@game" finds ".?AVCPlayer@game@@". Among several matches,
+ * the one with the lowest type descriptor is used.
+ */
 extern void *GetRTTIDescriptor(const void *addr_start, const void *addr_min, const void *addr_max, const char *rtti_name);
 extern void **GetVTableForDescriptor(const void *addr_start, const void *addr_min, const void *addr_max, const void *rtti_descriptor);
 
@@ -9,6 +9,8 @@
 
 MEMORIA_BEGIN
 
+class IMemorySource;
+
 extern uint8_t  *FindU8(const void *addr_start, const void *addr_min, const void *addr_max, uint8_t value, bool backward = false, ptrdiff_t offset = 0);
 extern uint16_t *FindU16(const void *addr_start, const void *addr_min, const void *addr_max, uint16_t value, bool backward = false, ptrdiff_t offset = 0);
 extern uint32_t *FindU24(const void *addr_start, const void *addr_min, const void *addr_max, uint8_t value[3], bool backward = false, ptrdiff_t offset = 0);
@@ -31,6 +33,15 @@ extern void *FindSignature(const void *addr_start, const void *addr_min, const v
 extern void *FindSignature(const void *addr_start, const void *addr_min, const void *addr_max, const char *sig, bool backward = false, ptrdiff_t offset = 0);
 extern void *FindFirstSignature(const void *addr_start, const void *addr_min, const void *addr_max, const Memoria::Vector<CSignature> &sig, bool backward = false, ptrdiff_t offset = 0);
 
+//
+// Search through a memory source (e.g. another process). The range `[addr_min, addr_max)` is read
+// in large chunks and searched from `addr_min` (or from `addr_max` if `backward`). Returns 0 if nothing is found.
+//
+
+extern uintptr_t FindBlock(IMemorySource &source, uintptr_t addr_min, uintptr_t addr_max, const void *data, size_t size, bool backward = false, ptrdiff_t offset = 0);
+extern uintptr_t FindSignature(IMemorySource &source, uintptr_t addr_min, uintptr_t addr_max, const CSignature &sig, bool backward = false, ptrdiff_t offset = 0);
+extern uintptr_t FindSignature(IMemorySource &source, uintptr_t addr_min, uintptr_t addr_max, const char *sig, bool backward = false, ptrdiff_t offset = 0);
+
 struct Ref_t
 {
 	// xref points to 'void *' if true (e.g. CALL ref), 'int32_t' otherwise (mov REG, offset ref)
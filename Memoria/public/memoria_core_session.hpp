@@ -0,0 +1,112 @@
+//
+// memoria_core_session.hpp
+//
+// Coalescing write sessions.
+//
+// Normally every `WriteMemory` call (and every `Write*` function built on it) queries
+// the protection, makes the memory writable, copies the data and restores the protection.
+// While a `CWriteSession` is alive on the current thread, these calls only stage the data.
+// When the session is committed, the staged writes are sorted by address, grouped by
+// memory region and written with a single protection change per group, after which
+// the original protection is restored exactly.
+//
+// Writes are applied in the order they were made, so overlapping writes behave the same
+// as without a session. Reads made during the session do not see the staged data.
+//
+// Example:
+//   {
+//       CWriteSession session;
+//
+//       for (auto ref : references)
+//           WriteRelative(ref, new_target);
+//   } // committed here
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+MEMORIA_BEGIN
+
+class CWriteSession
+{
+private:
+	CWriteSession(const CWriteSession &) = delete;
+	CWriteSession &operator=(const CWriteSession &) = delete;
+
+	struct Write_t
+	{
+		uint8_t *Address;
+
+		// Offset of the data in `_data`.
+		size_t Offset;
+		size_t Size;
+
+		// Position of the write in the session.
+		uint32_t Seq;
+
+		bool Atomic;
+		bool Written;
+	};
+
+private:
+	CWriteSession *_previous;
+
+	Memoria::Vector<Write_t> _writes{};
+	Memoria::Vector<uint8_t> _data{};
+
+	// Writes before this index have already been committed.
+	size_t _committed = 0;
+
+	bool _active = true;
+
+private:
+	void Deactivate();
+
+	// Writes a single entry that crosses a region boundary, one region at a time.
+	bool CommitSpanning(Write_t &write);
+
+public:
+	// Starts a session and makes it the active one on the current thread.
+	// Sessions can be nested; the inner one is committed first.
+	CWriteSession();
+
+	// Commits the session unless it was already committed or discarded.
+	~CWriteSession();
+
+	/**
+	 * @brief Stages a write.
+	 *
+	 * @param atomic Write the data with a single compare-exchange if it fits into an aligned
+	 *               8-byte (16-byte on x64 with MSVC) block, so that other threads never observe it half-written.
+	 *
+	 * @return The index of the write, see `IsWritten`.
+	 */
+	size_t Stage(void *addr, const void *data, size_t size, bool atomic = false);
+
+	// Same as `Stage`, but fills `size` bytes with `value`.
+	size_t StageFill(void *addr, uint8_t value, size_t size);
+
+	// Writes everything staged since the last commit. Returns `false` if any write failed.
+	// The session stays usable and can stage more writes afterwards.
+	//
+	// Does not allocate on Windows, so it is safe to call while other threads are suspended.
+	bool Commit();
+
+	// Drops all staged writes and ends the session.
+	void Discard();
+
+	// Whether the write with this index has been performed by `Commit`.
+	bool IsWritten(size_t index) const { return index < _writes.size() && _writes[index].Written; }
+
+	size_t GetCount() const { return _writes.size(); }
+
+	// The innermost session of the current thread, or `nullptr`.
+	static CWriteSession *GetActive();
+};
+
+MEMORIA_END
\ No newline at end of file
@@ -19,6 +19,9 @@ public:
 	CSignature(const char *str);
 	CSignature(const void *data, size_t size, Memoria::Optional<uint8_t> ignore_byte = std::nullopt);
 
+	// `mask` holds 'x' for a byte to match and '?' for a wildcard, one per byte of `data`.
+	CSignature(const void *data, const char *mask, size_t size);
+
 	const Memoria::Vector<uint8_t> &GetPayload() const { return _payload; }
 	const Memoria::Vector<uint8_t> &GetMask() const { return _mask; }
 
@@ -0,0 +1,251 @@
+//
+// memoria_core_source.hpp
+//
+// Pluggable memory backends.
+//
+// `IMemorySource` and `IMemorySink` abstract reading and writing memory that may live
+// in another process. Addresses are plain integers, since a remote pointer must never
+// be dereferenced locally.
+//
+// Backends:
+//   - `CLocalMemory`: the current process (`GetLocalMemory()`).
+//   - `CProcessMemory` (Windows): `ReadProcessMemory`/`WriteProcessMemory`.
+//   - `CProcessVmMemory` (Linux): `process_vm_readv`/`process_vm_writev`.
+//   - `CProcMemMemory` (Linux): `pread`/`pwrite` on `/proc/<pid>/mem`.
+//
+// Batched requests (`ReadBatch`/`WriteBatch`) are the fast path for remote processes.
+// `process_vm_readv` transfers a whole batch in one system call; other backends sort
+// the requests and coalesce neighbouring ones into a single larger read.
+//
+// The search functions in `memoria_core_search.hpp` accept a source directly.
+// For `CSigHandle`, `CMemoryBlock` and everything else that works on local pointers,
+// copy the range into a `CMemoryMirror` and translate the results back with `ToRemote`.
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_utils_optional.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <span>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#endif
+
+MEMORIA_BEGIN
+
+struct MemoryIo_t
+{
+	uintptr_t Address;
+
+	// Destination for reads, source for writes.
+	void *Buffer;
+	size_t Size;
+
+	// Set by the batch functions to the number of bytes actually transferred.
+	size_t Transferred;
+};
+
+class IMemorySource
+{
+public:
+	// Neighbouring requests closer than this are read together by the default `ReadBatch`.
+	static constexpr size_t MaxCoalesceGap = 256;
+
+	// Upper bound for the size of a coalesced read.
+	static constexpr size_t MaxCoalesceSize = 64 * 1024;
+
+public:
+	virtual ~IMemorySource() = default;
+
+	// Reads up to `size` bytes. Returns the number of bytes read, which is less than `size`
+	// if the range runs into inaccessible memory.
+	virtual size_t Read(uintptr_t address, void *buffer, size_t size) = 0;
+
+	// Performs every request and sets its `Transferred`. The order of execution is unspecified.
+	// Returns the number of requests that were transferred completely.
+	virtual size_t ReadBatch(std::span<MemoryIo_t> requests);
+
+	bool ReadExact(uintptr_t address, void *buffer, size_t size)
+	{
+		return Read(address, buffer, size) == size;
+	}
+
+	template <typename T>
+	Memoria::Optional<T> ReadValue(uintptr_t address, ptrdiff_t offset = 0)
+	{
+		T value;
+
+		if (!ReadExact(address + offset, &value, sizeof(T)))
+			return std::nullopt;
+
+		return value;
+	}
+
+	// Reads a null-terminated string of at most `max_size - 1` characters.
+	bool ReadAStr(uintptr_t address, char *out, size_t max_size);
+	bool ReadWStr(uintptr_t address, wchar_t *out, size_t max_size);
+};
+
+class IMemorySink
+{
+public:
+	virtual ~IMemorySink() = default;
+
+	// Writes up to `size` bytes. Returns the number of bytes written.
+	virtual size_t Write(uintptr_t address, const void *data, size_t size) = 0;
+
+	// Performs every request and sets its `Transferred`.
+	// Returns the number of requests that were transferred completely.
+	virtual size_t WriteBatch(std::span<MemoryIo_t> requests);
+
+	bool WriteExact(uintptr_t address, const void *data, size_t size)
+	{
+		return Write(address, data, size) == size;
+	}
+
+	template <typename T>
+	bool WriteValue(uintptr_t address, const T &value, ptrdiff_t offset = 0)
+	{
+		return WriteExact(address + offset, &value, sizeof(T));
+	}
+};
+
+//
+// The current process. Honors safe mode, and writes through `WriteMemory`,
+// so they take part in an active `CWriteSession`.
+//
+class CLocalMemory : public IMemorySource, public IMemorySink
+{
+public:
+	size_t Read(uintptr_t address, void *buffer, size_t size) override;
+	size_t ReadBatch(std::span<MemoryIo_t> requests) override;
+
+	size_t Write(uintptr_t address, const void *data, size_t size) override;
+};
+
+extern CLocalMemory &GetLocalMemory();
+
+struct MemoryRegion_t
+{
+	uintptr_t Begin;
+	uintptr_t End;
+
+	bool Readable;
+	bool Writable;
+	bool Executable;
+};
+
+// Called for every region. Returning `false` stops the enumeration.
+using MemoryRegionCallback_t = bool(*)(const MemoryRegion_t &region, void *param);
+
+// Enumerates the committed regions of the current process. Returns the number of regions visited.
+extern size_t EnumerateLocalRegions(MemoryRegionCallback_t cb, void *param);
+
+#ifdef _WIN32
+
+class CProcessMemory : public IMemorySource, public IMemorySink
+{
+private:
+	CProcessMemory(const CProcessMemory &) = delete;
+	CProcessMemory &operator=(const CProcessMemory &) = delete;
+
+private:
+	HANDLE _process;
+	bool _owns_handle;
+
+public:
+	// Opens the process with the rights needed for reading and writing.
+	CProcessMemory(DWORD pid);
+
+	// Uses an existing handle, which needs `PROCESS_VM_READ` (and `PROCESS_VM_WRITE | PROCESS_VM_OPERATION` for writing).
+	CProcessMemory(HANDLE process, bool owns_handle = false);
+	~CProcessMemory();
+
+	bool IsOpen() const { return _process != nullptr; }
+
+	size_t Read(uintptr_t address, void *buffer, size_t size) override;
+	size_t Write(uintptr_t address, const void *data, size_t size) override;
+};
+
+#else
+
+class CProcessVmMemory : public IMemorySource, public IMemorySink
+{
+private:
+	pid_t _pid;
+
+public:
+	CProcessVmMemory(pid_t pid) : _pid(pid) {}
+
+	size_t Read(uintptr_t address, void *buffer, size_t size) override;
+	size_t ReadBatch(std::span<MemoryIo_t> requests) override;
+
+	size_t Write(uintptr_t address, const void *data, size_t size) override;
+	size_t WriteBatch(std::span<MemoryIo_t> requests) override;
+};
+
+class CProcMemMemory : public IMemorySource, public IMemorySink
+{
+private:
+	CProcMemMemory(const CProcMemMemory &) = delete;
+	CProcMemMemory &operator=(const CProcMemMemory &) = delete;
+
+private:
+	int _fd;
+
+public:
+	// Opens `/proc/<pid>/mem` for reading and, if permitted, writing.
+	// Like a debugger, it ignores page protection: only unmapped memory fails.
+	CProcMemMemory(pid_t pid);
+	~CProcMemMemory();
+
+	bool IsOpen() const { return _fd >= 0; }
+
+	size_t Read(uintptr_t address, void *buffer, size_t size) override;
+	size_t Write(uintptr_t address, const void *data, size_t size) override;
+};
+
+#endif
+
+//
+// Local copy of a range of a source.
+//
+// Lets code written for local pointers (`CSigHandle`, `CMemoryBlock`, `Find*`) run on
+// remote memory. Pointers into the copy are converted back with `ToRemote`. Note that
+// values read from the copy (e.g. by `CSigHandle::Deref`) are remote addresses.
+//
+class CMemoryMirror
+{
+private:
+	CMemoryMirror(const CMemoryMirror &) = delete;
+	CMemoryMirror &operator=(const CMemoryMirror &) = delete;
+
+private:
+	uintptr_t _remote_base = 0;
+	Memoria::Vector<uint8_t> _data{};
+
+public:
+	CMemoryMirror() = default;
+
+	// Copies `[base, base + size)`. Pages that cannot be read are zero-filled.
+	// Returns `false` if nothing could be read.
+	bool Load(IMemorySource &source, uintptr_t base, size_t size);
+
+	const uint8_t *GetBegin() const { return _data.data(); }
+	const uint8_t *GetEnd() const { return _data.data() + _data.size(); }
+	size_t GetSize() const { return _data.size(); }
+
+	uintptr_t GetRemoteBase() const { return _remote_base; }
+
+	const void *ToLocal(uintptr_t remote) const;
+	uintptr_t ToRemote(const void *local) const;
+};
+
+MEMORIA_END
\ No newline at end of file
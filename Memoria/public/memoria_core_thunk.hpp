@@ -0,0 +1,153 @@
+//
+// memoria_core_thunk.hpp
+//
+// Executable thunks that bind a context pointer to a function, producing
+// a unique plain function pointer.
+//
+// Useful wherever an API accepts only a function pointer (hook targets, callbacks)
+// but the handler lives in an object: instead of looking the object up in a global
+// table on every call, the thunk loads it into the `this` register and jumps
+// directly to the member function.
+//
+// Thunks are allocated from a pool of chunks. Each chunk consists of a code page,
+// written once and then made read+execute, and a data page holding the bound
+// context and target of every slot. Rebinding or freeing a thunk therefore never
+// touches executable memory. Allocation and freeing are O(1), under a lock, and may
+// be called from any thread.
+//
+// Calling conventions:
+//   - x64: the integer and vector argument registers are shifted by one and the
+//     context is loaded into RCX, so member functions with up to 3 arguments are supported.
+//   - x86: the context is loaded into ECX, i.e. the thunk is a `__stdcall` function
+//     that forwards to a `__thiscall` member function with the same arguments.
+//
+// Example:
+//   auto fn = MakeThunk(this, &CRenderer::OnPresent);
+//   Hook(present, fn);
+//   ...
+//   FreeThunk(fn);
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+MEMORIA_BEGIN
+
+#ifdef MEMORIA_64BIT
+#define MEMORIA_THUNK_CALL
+#else
+#define MEMORIA_THUNK_CALL __stdcall
+#endif
+
+/**
+ * @brief Allocates a thunk which, when called, invokes `target` with `context` as the first
+ *        (`this`) argument followed by the arguments passed to the thunk.
+ *
+ * @param context The value loaded into RCX/ECX.
+ * @param target The function to jump to.
+ *
+ * @return Pointer to the executable thunk, or `nullptr` on failure.
+ */
+extern void *AllocateThunk(void *context, const void *target);
+
+/**
+ * @brief Changes the context and target of an existing thunk.
+ *
+ * @param thunk A thunk returned by `AllocateThunk` or `MakeThunk`.
+ *
+ * @return `true` on success, `false` if `thunk` is not an allocated thunk.
+ */
+extern bool RebindThunk(const void *thunk, void *context, const void *target);
+
+/**
+ * @brief Returns a thunk to the pool.
+ *
+ * @param thunk A thunk returned by `AllocateThunk` or `MakeThunk`.
+ *
+ * @return `true` on success, `false` if `thunk` is not an allocated thunk.
+ */
+extern bool FreeThunk(const void *thunk);
+
+// Releases every chunk. All thunks become invalid.
+extern void FreeThunks();
+
+namespace detail
+{
+	// Resolves a pointer to member function to the address of the code to be called
+	// and adjusts `object` to the `this` value expected by that code.
+	template <typename T>
+	const void *ResolveMethod(void *&object, T method)
+	{
+#ifdef _MSC_VER
+		// The MSVC ABI, which clang-cl follows too. With single inheritance an MSVC pointer to member function is a plain code pointer
+		// (a vcall thunk for virtual functions), which handles `this` on its own.
+		static_assert(sizeof(T) == sizeof(void *), "Only classes with single inheritance are supported.");
+
+		const void *code;
+		memcpy(&code, &method, sizeof(code));
+		return code;
+#else
+		// Itanium ABI: { ptr, adj }, where an odd `ptr` is 1 + the vtable offset of a virtual function.
+		struct
+		{
+			uintptr_t Ptr;
+			ptrdiff_t Adj;
+		} pmf;
+
+		static_assert(sizeof(T) == sizeof(pmf), "Unexpected pointer to member function layout.");
+		memcpy(&pmf, &method, sizeof(pmf));
+
+		object = static_cast<uint8_t *>(object) + pmf.Adj;
+
+		if (pmf.Ptr & 1)
+		{
+			auto vtable = *static_cast<uint8_t **>(object);
+			return *reinterpret_cast<const void **>(vtable + pmf.Ptr - 1);
+		}
+
+		return reinterpret_cast<const void *>(pmf.Ptr);
+#endif
+	}
+
+	template <typename R, typename... Args>
+	auto MakeThunk(void *object, const void *code) -> R(MEMORIA_THUNK_CALL *)(Args...)
+	{
+#ifdef MEMORIA_64BIT
+		static_assert(sizeof...(Args) <= 3, "Thunks support at most 3 arguments on x64.");
+#endif
+		static_assert(std::is_void_v<R> || std::is_scalar_v<R>, "Thunks do not support functions returning aggregates.");
+
+		return reinterpret_cast<R(MEMORIA_THUNK_CALL *)(Args...)>(AllocateThunk(object, code));
+	}
+}
+
+/**
+ * @brief Creates a plain function pointer that calls `method` on `object`.
+ *
+ * @return The thunk, or `nullptr` on failure. Must be released with `FreeThunk`.
+ */
+template <typename C, typename R, typename... Args>
+auto MakeThunk(C *object, R(C::*method)(Args...)) -> R(MEMORIA_THUNK_CALL *)(Args...)
+{
+	void *self = object;
+	const void *code = detail::ResolveMethod(self, method);
+
+	return detail::MakeThunk<R, Args...>(self, code);
+}
+
+template <typename C, typename R, typename... Args>
+auto MakeThunk(const C *object, R(C::*method)(Args...) const) -> R(MEMORIA_THUNK_CALL *)(Args...)
+{
+	void *self = const_cast<C *>(object);
+	const void *code = detail::ResolveMethod(self, method);
+
+	return detail::MakeThunk<R, Args...>(self, code);
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,68 @@
+//
+// memoria_core_workers.hpp
+//
+// Internal: the worker threads of the scanners, the snapshot and the export indexes.
+//
+// Every worker runs the same function, which takes its share of the work from shared
+// state (an atomic index into the work items), so the work gets done with however
+// many threads could be started.
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+
+#include <stddef.h>
+#include <algorithm>
+#include <memory>
+#include <system_error>
+#include <thread>
+
+MEMORIA_BEGIN
+
+// `workers`, or one per hardware thread if it is 0.
+inline size_t GetWorkerCount(size_t workers)
+{
+	if (workers)
+		return workers;
+
+	return (std::max)(static_cast<size_t>(std::thread::hardware_concurrency()), size_t(1));
+}
+
+// Runs `fn` on up to `count` threads, one of them the calling thread. If a thread cannot
+// be started, `fn` runs on those that were. Every started thread is joined before the
+// function returns, also if `fn` throws on the calling thread.
+template <typename Fn>
+void RunWorkers(size_t count, Fn &&fn)
+{
+	count = (std::max)(count, size_t(1));
+
+	auto threads = std::make_unique<std::thread[]>(count - 1);
+	size_t started = 0;
+
+	try
+	{
+		for (; started < count - 1; started++)
+			threads[started] = std::thread(fn);
+	}
+	catch (const std::system_error &)
+	{
+	}
+
+	try
+	{
+		fn();
+	}
+	catch (...)
+	{
+		for (size_t i = 0; i < started; i++)
+			threads[i].join();
+
+		throw;
+	}
+
+	for (size_t i = 0; i < started; i++)
+		threads[i].join();
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -2,10 +2,20 @@
 
 #include "memoria_common.hpp"
 
+#include <stddef.h>
 #include <stdint.h>
 
 MEMORIA_BEGIN
 
+/**
+ * @brief Writes `size` bytes of `data` (or `size` copies of its first byte with `use_setmem`)
+ * to `addr + offset`, making the memory writable for the duration of the write.
+ *
+ * While a `CWriteSession` is active on the current thread, the write is only staged, and `true`
+ * means no more than that: the memory is not touched yet. Whether the write was then performed
+ * is known after the commit, from `CWriteSession::IsWritten` with the index of the write
+ * (the session's `GetCount()` before the call). The same applies to every `Write*` function below.
+ */
 extern bool WriteMemory(void *addr, const void *data, size_t size, ptrdiff_t offset = 0, bool use_setmem = false);
 
 extern bool WriteU8(void *addr, uint8_t value, ptrdiff_t offset = 0);
@@ -0,0 +1,251 @@
+//
+// memoria_ext_freezer.hpp
+//
+// Value freezer: holds a set of addresses at fixed values.
+//
+// Writing every frozen value with `Write*` costs a protection query and two protection
+// changes per value and tick. `CFreezer` instead makes the pages that hold frozen values
+// writable once, on the first tick after the entries are added, and keeps them that way
+// until the entries are removed, after which their original protection is restored.
+//
+// A tick is then a plain store loop: entries are grouped by width into arrays of
+// addresses and values, sorted by address, and each value is only written if the memory
+// holds something else, so cache lines (and soft-dirty or write-watch bits) of values
+// that did not change are left alone.
+//
+// Ticks run on a scheduler thread at a fixed period, waiting on a high-resolution timer
+// (a waitable timer on Windows). The thread records how late it woke up (jitter) and how
+// many deadlines it missed because a tick ran too long or the thread woke up too late.
+// Missed ticks are skipped, not caught up on.
+//
+// Example:
+//   CFreezer freezer;
+//   freezer.Add(&player->Health, 100);
+//   freezer.Add(&player->Ammo, int16_t(30));
+//   freezer.Start(10000); // every 10 ms
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+MEMORIA_BEGIN
+
+using FreezeId_t = uint32_t;
+
+static constexpr FreezeId_t InvalidFreezeId = static_cast<FreezeId_t>(-1);
+
+struct FreezerOptions_t
+{
+	// Only write values that differ from the memory.
+	bool WriteIfDifferent = true;
+};
+
+struct FreezerStats_t
+{
+	uint64_t Ticks;
+
+	// Deadlines that passed before the tick for them could start.
+	uint64_t Missed;
+
+	// Values written. With `WriteIfDifferent`, values that were already right are not counted.
+	uint64_t Writes;
+
+	// How late the thread woke up relative to the deadline.
+	uint64_t MeanJitterNs;
+	uint64_t MaxJitterNs;
+
+	// Time spent writing in a tick.
+	uint64_t MeanApplyNs;
+	uint64_t MaxApplyNs;
+};
+
+class CFreezer
+{
+private:
+	CFreezer(const CFreezer &) = delete;
+	CFreezer &operator=(const CFreezer &) = delete;
+
+	static constexpr uintptr_t PageSize = 4096;
+
+	enum : uint8_t
+	{
+		FlagRemoved = 1 << 0,
+
+		// The memory faulted on a write in safe mode.
+		FlagFaulted = 1 << 1,
+	};
+
+	struct Entry_t
+	{
+		uintptr_t Address;
+
+		// Offset of the value in `_values`.
+		uint32_t Offset;
+		uint16_t Size;
+		uint8_t Flags;
+	};
+
+	struct Page_t
+	{
+		uintptr_t Base;
+		uint32_t Protect;
+
+		// The protection was changed to make the page writable.
+		bool Changed;
+	};
+
+	// Entries of one width, in address order.
+	template <typename T>
+	struct Lane_t
+	{
+		Memoria::Vector<uint8_t *> Addresses;
+		Memoria::Vector<T> Values;
+	};
+
+	// Entries of other widths.
+	struct Bytes_t
+	{
+		uint8_t *Address;
+		uint32_t Offset;
+		uint32_t Size;
+	};
+
+	struct Totals_t
+	{
+		uint64_t Ticks;
+		uint64_t Missed;
+		uint64_t Writes;
+		uint64_t Jitter;
+		uint64_t MaxJitter;
+		uint64_t Apply;
+		uint64_t MaxApply;
+	};
+
+private:
+	FreezerOptions_t _options;
+
+	// By id.
+	Memoria::Vector<Entry_t> _entries{};
+	Memoria::Vector<uint8_t> _values{};
+
+	// Pages held writable, sorted by address.
+	Memoria::Vector<Page_t> _pages{};
+
+	// The store plan, rebuilt from `_entries` before the next tick after any change.
+	Lane_t<uint8_t> _lane8{};
+	Lane_t<uint16_t> _lane16{};
+	Lane_t<uint32_t> _lane32{};
+	Lane_t<uint64_t> _lane64{};
+	Memoria::Vector<Bytes_t> _bytes{};
+
+	bool _changed = false;
+
+	Totals_t _totals{};
+
+	// Guards everything above.
+	mutable std::mutex _lock;
+
+	std::thread _thread;
+	uint32_t _period = 0;
+	std::atomic<bool> _stop{ false };
+
+#ifdef _WIN32
+	void *_timer = nullptr;
+	void *_stop_event = nullptr;
+#else
+	std::mutex _wait_lock;
+	std::condition_variable _wait;
+#endif
+
+private:
+	// Makes the pages of the live entries writable, restores the others and rebuilds the plan.
+	void Rebuild();
+
+	// Rebuilds the plan if needed and writes it, under a fault guard in safe mode.
+	// Returns the number of values written. `_lock` must be held.
+	size_t Store();
+
+	// Writes every value of the plan.
+	size_t StorePlan();
+
+	// Writes the live entries one by one under a fault guard, and drops those that fault.
+	size_t StoreEntries();
+
+	// Restores the protection of the pages in `_pages` that were made writable.
+	void ReleasePages();
+
+	// Returns `false` if the freezer is being stopped.
+	bool WaitUntil(int64_t deadline);
+
+	void ThreadProc();
+
+public:
+	CFreezer(const FreezerOptions_t &options = {});
+
+	// Stops the thread and restores the protection of all pages.
+	~CFreezer();
+
+	/**
+	 * @brief Freezes `size` bytes at `address` to `value`.
+	 *
+	 * Takes effect with the next tick. Entries of 1, 2, 4 and 8 bytes are written with
+	 * single stores, others are copied.
+	 */
+	FreezeId_t Add(void *address, const void *value, size_t size);
+
+	template <typename T>
+	FreezeId_t Add(void *address, const T &value)
+	{
+		return Add(address, &value, sizeof(T));
+	}
+
+	// Changes the value of an entry. `size` must match the size it was added with.
+	bool Set(FreezeId_t id, const void *value, size_t size);
+
+	template <typename T>
+	bool Set(FreezeId_t id, const T &value)
+	{
+		return Set(id, &value, sizeof(T));
+	}
+
+	// Stops writing the entry. The id is not reused.
+	bool Remove(FreezeId_t id);
+
+	// Whether the entry is being written, i.e. it was not removed and its memory did not fault.
+	bool IsActive(FreezeId_t id) const;
+
+	/**
+	 * @brief Writes all values once on the calling thread.
+	 *
+	 * @return Number of values written.
+	 */
+	size_t Apply();
+
+	/**
+	 * @brief Starts writing all values every `period_us` microseconds on a scheduler thread.
+	 */
+	bool Start(uint32_t period_us);
+	void Stop();
+
+	bool IsRunning() const { return _thread.joinable(); }
+
+	FreezerStats_t GetStats() const;
+	void ResetStats();
+
+	// Number of ids handed out, including removed ones.
+	size_t GetCount() const;
+
+	// Removes every entry and restores the protection of all pages. Invalidates all ids.
+	void Clear();
+};
+
+MEMORIA_END
\ No newline at end of file
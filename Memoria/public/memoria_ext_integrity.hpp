@@ -0,0 +1,98 @@
+//
+// memoria_ext_integrity.hpp
+//
+// Background monitor that detects when patches of a `CPatchRegistry` are overwritten
+// by someone else (the target itself, another tool, an anti-tamper routine).
+//
+// Instead of comparing every patch, the monitor keeps one CRC32C per page that holds
+// patches. A check hashes each of those pages and only looks at the individual
+// patches of the pages whose hash changed, so its cost depends on the number of
+// pages, not on the number of patches.
+//
+// Example:
+//   CIntegrityMonitor monitor;
+//   monitor.SetCallback([](PatchId_t id, void *) { LOG("Patch %u was overwritten", id); });
+//   monitor.Rebuild();
+//   monitor.Start(100);
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_ext_patch.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stdint.h>
+#include <mutex>
+#include <thread>
+
+MEMORIA_BEGIN
+
+// Called for every patch whose bytes no longer match its state in the registry.
+// When the monitor is started, this is called from the monitor thread.
+using IntegrityCallback_t = void(*)(PatchId_t id, void *param);
+
+class CIntegrityMonitor
+{
+private:
+	CIntegrityMonitor(const CIntegrityMonitor &) = delete;
+	CIntegrityMonitor &operator=(const CIntegrityMonitor &) = delete;
+
+	struct Page_t
+	{
+		uintptr_t Base;
+		uint32_t Crc;
+
+		// Range of the page's patches in `_entries`.
+		uint32_t First;
+		uint32_t Count;
+
+		// The hash changed and a patch was invalid on the previous check, but the change
+		// was not reported yet, because it could have been a registry toggle in progress.
+		bool Suspect;
+	};
+
+private:
+	CPatchRegistry *_registry;
+
+	IntegrityCallback_t _callback = nullptr;
+	void *_param = nullptr;
+
+	Memoria::Vector<Page_t> _pages{};
+	Memoria::Vector<PatchId_t> _entries{};
+
+	// Guards everything above. The callback is called after it is released.
+	std::mutex _lock;
+
+	std::thread _thread;
+	void *_stop_event = nullptr;
+	uint32_t _interval = 0;
+
+private:
+	size_t CheckPages(bool confirm);
+
+	void ThreadProc();
+
+public:
+	CIntegrityMonitor(CPatchRegistry &registry = GetPatchRegistry());
+	~CIntegrityMonitor();
+
+	void SetCallback(IntegrityCallback_t callback, void *param = nullptr);
+
+	// Rebuilds the page table from the registry. Must be called after patches are added
+	// or removed. The registry must not be modified while the monitor thread is running,
+	// except for toggling patches.
+	void Rebuild();
+
+	// Checks all pages once on the calling thread and returns the number of reported patches.
+	size_t Check();
+
+	// Starts checking all pages every `interval_ms` milliseconds on a background thread.
+	bool Start(uint32_t interval_ms);
+	void Stop();
+
+	bool IsRunning() const { return _thread.joinable(); }
+	size_t GetPageCount() const { return _pages.size(); }
+};
+
+MEMORIA_END
\ No newline at end of file
@@ -1,13 +1,23 @@
 #pragma once
 
 #include "memoria_common.hpp"
+#include "memoria_core_dump.hpp"
+#include "memoria_core_functions.hpp"
+#include "memoria_core_pe.hpp"
+#include "memoria_core_rtti.hpp"
 
 #include "memoria_ext_sig.hpp"
 #include "memoria_utils_list.hpp"
 
 #include <memory>
+#include <mutex>
 #include <stdint.h>
+
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include "memoria_core_elf.hpp"
+#endif
 
 MEMORIA_BEGIN
 
@@ -32,12 +42,14 @@ public:
 	size_t GetSize() const;
 	void *GetLastByte() const;
 
+#ifdef _WIN32
 	// Hooks
 	// use 0 opcode value to hook all addresses
 
 	size_t HookRefAddr(const void *addr_target, const void *addr_hook, uint16_t opcode = 0);
 	size_t HookRefCall(const void *addr_target, const void *addr_hook); // 0xE8 CALLS only
 	size_t HookRefJump(const void *addr_target, const void *addr_hook); // 0xE9 JUMPS only
+#endif
 
 	//
 	// Signaturing
@@ -54,24 +66,31 @@ public:
 	static std::unique_ptr<CMemoryBlock> CreateFromAddress(const void *address, size_t size = 0);
 };
 
+// On ELF, sections are found by name. Values without an equivalent there are not found.
 enum class eSection : uint8_t
 {
-	Export,        // .rdata / .edata
+	Export,        // .rdata / .edata          ELF: .dynsym
 	Import,        // .rdata / .idata
 	Resource,      // .rsrc
-	Exception,     // .pdata
+	Exception,     // .pdata                   ELF: .eh_frame
 	Security,      // [cannot be mapped]
-	BaseReloc,     // .reloc
+	BaseReloc,     // .reloc                   ELF: .rela.dyn
 	Debug,         // .rdata / .debug
 	Architecture,  // .rdata
 	GlobalPtr,     // .data
-	TLS,           // .tls / .data
+	TLS,           // .tls / .data             ELF: .tdata
 	LoadConfig,    // .rdata / .data
 	BoundImport,   // .rdata
-	IAT,           // .idata
+	IAT,           // .idata                   ELF: .got.plt
 	DelayImport,   // .didat
 	CLR,           // .clr / .text
 	Reserved,      // -
+
+	// Sections without a data directory.
+	Code,          // .text                    ELF: .text
+	ReadOnlyData,  // .rdata                   ELF: .rodata
+	RelRo,         // [none]                   ELF: .data.rel.ro
+	Data,          // .data                    ELF: .data
 };
 
 class CMemoryModule : public CMemoryBlock
@@ -80,16 +99,70 @@ private:
 	CMemoryModule(const CMemoryModule &) = delete;
 	CMemoryModule &operator=(const CMemoryModule &) = delete;
 
-	inline HMODULE GetHandle() const { return reinterpret_cast<HMODULE>(const_cast<void *>(_address)); }
+public:
+	// Enough for a GNU build-id or a CodeView GUID and age.
+	static constexpr size_t MaxFingerprintSize = 32;
+
+private:
+	// The headers, parsed once when the module is created. On Linux, `_image` is only
+	// parsed for a dump of a PE module.
+	CPeImage _image{};
+
+#ifndef _WIN32
+	CElfImage _elf{};
+#endif
+
+	// The mapping a module created from a dump lives in, its function table, and its RTTI
+	// index once it is asked for.
+	std::unique_ptr<CModuleDump> _dump{};
+	std::shared_ptr<const CFunctionIndex> _functions{};
+
+	mutable std::once_flag _rtti_once{};
+	mutable std::shared_ptr<const CRttiIndex> _rtti{};
+
 	std::pair<void *, size_t> GetSectionInfo(eSection section);
 
 public:
 	CMemoryModule() = default;
 	CMemoryModule(const char *libname, size_t size);
+#ifdef _WIN32
 	CMemoryModule(HMODULE handle, size_t size);
+#else
+	CMemoryModule(const ElfModule_t &module, size_t size);
+#endif
+	explicit CMemoryModule(std::unique_ptr<CModuleDump> dump);
 
 	bool IsLoaded() const;
 
+	const CPeImage &GetImage() const { return _image; }
+#ifndef _WIN32
+	const CElfImage &GetElfImage() const { return _elf; }
+#endif
+
+	/**
+	 * @brief Identifies the build of the module: the GNU build-id on ELF, the CodeView GUID
+	 * and age (as in the PDB path lookup) on PE.
+	 *
+	 * @return Number of bytes written to `out`, 0 if the module has no fingerprint or `max_size` is too small.
+	 */
+	size_t GetFingerprint(uint8_t *out, size_t max_size) const;
+
+	//
+	// Dumps
+	//
+
+	/**
+	 * @brief Writes the module as it is in memory to `path`, with its headers realigned so that
+	 * every section starts in the file at its offset in memory, and a sidecar with the load
+	 * base, the protection of every region and the fingerprint to `path` + `ModuleDumpInfoSuffix`.
+	 *
+	 * The dump loads with `CreateFromDump`, on any platform, or as a file image in other tools.
+	 */
+	bool Dump(const char *path) const;
+
+	// The dump the module was created from, `nullptr` for a loaded module.
+	const CModuleDump *GetDump() const { return _dump.get(); }
+
 	std::unique_ptr<CMemoryBlock> GetSection(eSection section);
 	std::unique_ptr<CMemoryBlock> GetEntrySection();
 
@@ -101,15 +174,60 @@ public:
 	bool SigSec(eSection directory, const char *signature, SigCallbackFn cb, void *lpParam);
 	bool SigSec(eSection directory, SigCallbackFn cb, void *lpParam);
 
+	//
+	// Functions
+	//
+
+	// The function table of the module (`.pdata` or `.eh_frame_hdr`), shared with `GetFunctionIndex`.
+	// That of a PE dump is built when the dump is loaded.
+	std::shared_ptr<const CFunctionIndex> GetFunctions() const;
+
+	// Like `SigSec`, over the function that contains `address` instead of a section.
+	bool SigFunction(const void *address, const CSignature &signature, SigCallbackFn cb, void *lpParam);
+	bool SigFunction(const void *address, const char *signature, SigCallbackFn cb, void *lpParam);
+
+	/**
+	 * @brief Finds `signature` in the code of the function table only, skipping the padding,
+	 * jump tables and data between functions. A match must lie within one function entry.
+	 *
+	 * @return Number of matches written to `out`, in address order.
+	 */
+	size_t FindInFunctions(const CSignature &signature, void **out, size_t max_size);
+
+	//
+	// RTTI
+	//
+
+	// The classes of the module, shared with `GetRttiIndex`. That of a dump is built the first
+	// time it is asked for, with the pointers in it taken as relative to the original base.
+	std::shared_ptr<const CRttiIndex> GetRtti() const;
+
+	// The primary vtable of the class with the raw, qualified or bare name, `nullptr` if there is none.
+	// For a dump, the vtable in the mapping; `GetDump()->ToOriginal` gives its address in the process.
+	void **GetVTableForClass(const char *name) const;
+
 	//
 	// Static builders
 	//
 
 	static std::unique_ptr<CMemoryModule> CreateFromExecutable();
 	static std::unique_ptr<CMemoryModule> CreateFromLibrary(const char *libname, size_t size = 0);
+#ifdef _WIN32
 	static std::unique_ptr<CMemoryModule> CreateFromHandle(HMODULE handle, size_t size = 0);
+#endif
+
+	// On ELF, finds the object that owns `address`, which may be any address inside of it.
 	static std::unique_ptr<CMemoryModule> CreateFromAddress(const void *address, size_t size = 0);
 	static std::unique_ptr<CMemoryModule> CreateFromAddress(std::nullptr_t);
+
+	/**
+	 * @brief Maps a dump written by `Dump` read-only, without copying it, as a module.
+	 *
+	 * The mapping is at the original base when that range is free. Elsewhere, pointers read from
+	 * it are translated with `GetDump()->ToView`. PE dumps load on any platform, ELF dumps on
+	 * Linux only; an ELF dump has no section headers, and sections fall back to its segments.
+	 */
+	static std::unique_ptr<CMemoryModule> CreateFromDump(const char *path);
 };
 
 MEMORIA_END
\ No newline at end of file
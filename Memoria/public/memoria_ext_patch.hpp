@@ -1,10 +1,13 @@
 #pragma once
 
 #include "memoria_common.hpp"
+#include "memoria_core_hook.hpp"
 #include "memoria_utils_vector.hpp"
 
 #include <stdint.h>
 #include <memory>
+#include <mutex>
+#include <span>
 
 MEMORIA_BEGIN
 
@@ -81,6 +84,198 @@ extern CPatch *PatchRelative(void *addr, const void *value, bool instant_deploy
 extern CPatch *PatchAStr(void *addr, const char *value, bool instant_deploy = true, ptrdiff_t offset = 0);
 extern CPatch *PatchWStr(void *addr, const wchar_t *value, bool instant_deploy = true, ptrdiff_t offset = 0);
 
+class CWriteSession;
+
+using PatchId_t = uint32_t;
+
+static constexpr PatchId_t InvalidPatchId = static_cast<PatchId_t>(-1);
+
+//
+// Registry of patches backed by a single byte arena.
+//
+// Unlike `CPatch`, a registered patch costs a 16-byte record (12 bytes on x86) plus its
+// original and patched bytes. A patch must be smaller than 16 MiB, the number of patches is not limited.
+// Patches are referenced by id, which stays valid until the registry is cleared.
+//
+// Group operations (`Apply`/`Restore` with a list of ids, `ApplyAll`, `RestoreAll`)
+// go through a `CWriteSession`, which changes the protection once per run of
+// patches that share a memory region, instead of twice per patch.
+//
+class CPatchRegistry
+{
+	friend class CPatchSet;
+	friend class CIntegrityMonitor;
+
+private:
+	CPatchRegistry(const CPatchRegistry &) = delete;
+	CPatchRegistry &operator=(const CPatchRegistry &) = delete;
+
+	enum : uint8_t
+	{
+		FlagActive  = 1 << 0,
+		FlagRemoved = 1 << 1,
+	};
+
+	struct Record_t
+	{
+		void *Address;
+
+		// Offset of the original bytes in the arena, patched bytes follow them.
+		// The arena stays below 4 GiB.
+		uint32_t DataOffset;
+		uint32_t Size : 24;
+		uint32_t Flags : 8;
+	};
+
+	static_assert(sizeof(Record_t) == sizeof(void *) + 8);
+
+public:
+	static constexpr size_t MaxPatchSize = (1 << 24) - 1;
+
+private:
+	Memoria::Vector<Record_t> _records{};
+	Memoria::Vector<uint8_t> _arena{};
+
+	// Guards the flags of the records, which `CIntegrityMonitor` reads on its own thread.
+	mutable std::mutex _lock;
+
+private:
+	Record_t *GetRecord(PatchId_t id);
+	const Record_t *GetRecord(PatchId_t id) const;
+
+	// Stages the patched (`state == true`) or original bytes of every listed record
+	// whose state differs from `state`. Reorders `indices`. Returns the number of staged patches,
+	// which occupy `indices[0..n)` and the session entries starting at `session.GetCount()` before the call.
+	size_t Stage(CWriteSession &session, uint32_t *indices, size_t count, bool state, bool atomic);
+
+	// Flips the state of the staged patches that the session has written.
+	// Returns the number of toggled patches.
+	size_t Complete(const CWriteSession &session, size_t first, const uint32_t *indices, size_t count);
+
+	// `Stage` + `Commit` + `Complete` in a session of its own.
+	size_t Write(uint32_t *indices, size_t count, bool state, bool atomic);
+
+public:
+	CPatchRegistry() = default;
+
+	PatchId_t Add(void *address, const void *data, size_t size, bool instant_deploy = false);
+
+	template <typename T>
+	PatchId_t Add(void *address, const T &value, bool instant_deploy = false)
+	{
+		return Add(address, &value, sizeof(T), instant_deploy);
+	}
+
+	// Restores the patch if it is active. The id is not reused.
+	bool Remove(PatchId_t id);
+
+	bool IsActive(PatchId_t id) const;
+	bool IsValid(PatchId_t id) const;
+
+	bool Apply(PatchId_t id);
+	bool Restore(PatchId_t id);
+	bool Toggle(PatchId_t id, bool state);
+
+	size_t Apply(std::span<const PatchId_t> ids);
+	size_t Restore(std::span<const PatchId_t> ids);
+
+	// With `atomic`, patches that fit into an aligned 8-byte (or 16-byte on x64) block
+	// are written with a single `lock cmpxchg`, so other threads never observe them half-written.
+	size_t Toggle(std::span<const PatchId_t> ids, bool state, bool atomic = false);
+
+	size_t ApplyAll();
+	size_t RestoreAll();
+
+	void *GetAddress(PatchId_t id) const;
+	size_t GetSize(PatchId_t id) const;
+
+	const uint8_t *GetDataOrigin(PatchId_t id) const;
+	const uint8_t *GetDataPatch(PatchId_t id) const;
+
+	// Number of ids handed out, including removed ones.
+	size_t GetCount() const { return _records.size(); }
+
+	// Restores every patch and releases all memory. Invalidates all ids.
+	void Clear();
+};
+
+extern CPatchRegistry &GetPatchRegistry();
+
+//
+// A named group of patches and hooks that is toggled as one unit.
+//
+// By default, all other threads of the process are suspended while the set is being
+// toggled, so none of them can run with only part of the set applied (or be stopped
+// in the middle of a patched instruction). Alternatively, the set can be toggled without
+// suspending, in which case each patch of up to 8 bytes (16 on x64) is written atomically.
+// If the threads can't be suspended outside of the patched code, nothing is written and
+// the toggle fails with `ME_INVALID_MEMORY`.
+//
+// `IsValid` checks the whole set with a single hash compare.
+//
+// Patches are stored in a `CPatchRegistry` (the global one by default), so toggling
+// a set changes the protection once per memory region, not once per patch.
+//
+class CPatchSet
+{
+private:
+	CPatchSet(const CPatchSet &) = delete;
+	CPatchSet &operator=(const CPatchSet &) = delete;
+
+private:
+	const char *_name;
+	CPatchRegistry *_registry;
+
+	Memoria::Vector<PatchId_t> _patches{};
+	bool _active = false;
+
+	struct Hook_t
+	{
+		PatchId_t Patch;
+		CTrampoline *Trampoline;
+	};
+
+	// The trampolines of the hooks added by `AddHook`, owned by the set.
+	Memoria::Vector<Hook_t> _hooks{};
+
+	// FNV-1a of the bytes of all patches, in order, for both states.
+	uint64_t _hash_origin;
+	uint64_t _hash_patch;
+
+public:
+	// `name` must stay alive for the lifetime of the set.
+	CPatchSet(const char *name, CPatchRegistry &registry = GetPatchRegistry());
+
+	// Adds a patch. If the set is active, the patch is applied immediately.
+	PatchId_t Add(void *address, const void *data, size_t size);
+
+	template <typename T>
+	PatchId_t Add(void *address, const T &value)
+	{
+		return Add(address, &value, sizeof(T));
+	}
+
+	// Adds a hook from `target` to `hook`. If `trampoline` is not null, it receives
+	// a pointer through which the original function can be called.
+	bool AddHook(void *target, const void *hook, void *trampoline = nullptr, eInvokeMethod method = eInvokeMethod::JumpRel);
+
+	bool Apply(bool suspend_threads = true);
+	bool Restore(bool suspend_threads = true);
+	bool Toggle(bool state, bool suspend_threads = true);
+
+	bool IsActive() const { return _active; }
+	bool IsValid() const;
+
+	const char *GetName() const { return _name; }
+	size_t GetCount() const { return _patches.size(); }
+
+	std::span<const PatchId_t> GetPatches() const { return { _patches.data(), _patches.size() }; }
+
+	// Restores the set and removes its patches from the registry. Frees the trampolines
+	// of the restored hooks, so no thread may still call the original functions through them.
+	void Clear();
+};
+
 extern Memoria::FixedVector<CPatch, MAX_PATCHES_COUNT> &GetPatches();
 extern bool FreePatches();
 
@@ -0,0 +1,190 @@
+//
+// memoria_ext_pointer.hpp
+//
+// Multi-level pointer paths.
+//
+// A path such as `[[[client.dll+0x1A2B30]+0x18]+0x40]+0x10` is parsed once into a base
+// address and a list of offsets. Each bracket is one dereference:
+//
+//   a0 = client.dll + 0x1A2B30
+//   a1 = *a0 + 0x18
+//   a2 = *a1 + 0x40
+//   result = *a2 + 0x10
+//
+// Before a pointer is dereferenced, its address is checked against a `CRegionMap`, which
+// caches the readable regions of the process, so a hop costs a binary search instead of
+// a `VirtualQuery`. A path also remembers the addresses it read last time: as long as a hop
+// reads the same value as before, the following hops are known to be valid and are not
+// checked again. Only hops from the first changed value onward are revalidated.
+//
+// `CPointerTrie` resolves many paths at once. Paths that share a base and leading offsets
+// share trie nodes, so every shared hop is read only once per resolve.
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_utils_optional.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <initializer_list>
+#include <span>
+
+MEMORIA_BEGIN
+
+class CSigHandle;
+
+//
+// Sorted cache of readable memory regions.
+//
+class CRegionMap
+{
+private:
+	struct Region_t
+	{
+		uintptr_t Begin;
+		uintptr_t End;
+	};
+
+	Memoria::Vector<Region_t> _regions{};
+
+	// Last region that matched, most lookups hit it again.
+	size_t _last = 0;
+
+private:
+	bool Learn(uintptr_t address);
+
+public:
+	// Whether `[address, address + size)` is readable. Regions not yet cached are queried once.
+	bool IsReadable(uintptr_t address, size_t size);
+
+	// Forgets every region, e.g. after modules were unloaded.
+	void Clear();
+
+	size_t GetCount() const { return _regions.size(); }
+};
+
+// The region map shared by all paths unless one is given explicitly.
+extern CRegionMap &GetRegionMap();
+
+class CPointerPath
+{
+private:
+	uintptr_t _base = 0;
+	Memoria::Vector<ptrdiff_t> _offsets{};
+
+	// `_links[i]`: the address dereferenced by hop `i` during the last resolve, 0 if not reached.
+	// Every stored link has passed the region check.
+	Memoria::Vector<uintptr_t> _links{};
+
+public:
+	CPointerPath() = default;
+	CPointerPath(const void *base, std::initializer_list<ptrdiff_t> offsets);
+	CPointerPath(const void *base, std::span<const ptrdiff_t> offsets);
+
+	/**
+	 * @brief Parses a path such as `[[module.dll+0x10]+0x18]+0x20` or `[[0x7FF600001000]-8]`.
+	 *
+	 * Numbers are hexadecimal, with or without the `0x` prefix. A module name is resolved
+	 * with `GetModuleBase` when the path is parsed.
+	 *
+	 * @return The path, or `std::nullopt` if the syntax is invalid or the module is not loaded.
+	 */
+	static Memoria::Optional<CPointerPath> Parse(const char *text);
+
+	// Uses the result of a signature search as the base.
+	static CPointerPath CreateFromSigHandle(const CSigHandle &handle, std::initializer_list<ptrdiff_t> offsets);
+
+	/**
+	 * @brief Follows the path.
+	 *
+	 * @return The final address, or `nullptr` if a hop reads from unreadable memory.
+	 */
+	void *Resolve(CRegionMap &regions = GetRegionMap());
+
+	template <typename T>
+	Memoria::Optional<T> ReadValue(CRegionMap &regions = GetRegionMap())
+	{
+		auto address = static_cast<const T *>(Resolve(regions));
+
+		if (!address || !regions.IsReadable(reinterpret_cast<uintptr_t>(address), sizeof(T)))
+			return std::nullopt;
+
+		return *address;
+	}
+
+	// Forgets the cached links, the next resolve validates every hop.
+	void Invalidate();
+
+	void *GetBase() const { return reinterpret_cast<void *>(_base); }
+	std::span<const ptrdiff_t> GetOffsets() const { return { _offsets.data(), _offsets.size() }; }
+
+	// Number of dereferences.
+	size_t GetDepth() const { return _offsets.size(); }
+
+	// The address dereferenced by hop `index` during the last resolve, 0 if it was not reached.
+	uintptr_t GetLink(size_t index) const { return index < _links.size() ? _links[index] : 0; }
+};
+
+//
+// Resolves many pointer paths at once.
+//
+class CPointerTrie
+{
+private:
+	static constexpr uint32_t InvalidNode = static_cast<uint32_t>(-1);
+
+	struct Node_t
+	{
+		uint32_t Parent;
+
+		// Base address for roots, offset added to the parent's pointer otherwise.
+		intptr_t Offset;
+
+		bool HasChildren;
+	};
+
+private:
+	// Parents always precede their children.
+	Memoria::Vector<Node_t> _nodes{};
+
+	// Resolved address and, for nodes with children, the pointer read from it. 0 if unreachable.
+	Memoria::Vector<uintptr_t> _addresses{};
+	Memoria::Vector<uintptr_t> _values{};
+
+	// Leaf node of each path.
+	Memoria::Vector<uint32_t> _paths{};
+
+	// Open addressing, (parent, offset) -> node. Size is a power of two.
+	Memoria::Vector<uint32_t> _lookup{};
+
+private:
+	size_t HashNode(uint32_t parent, intptr_t offset) const;
+	void Rehash(size_t buckets);
+
+	uint32_t FindOrAddNode(uint32_t parent, intptr_t offset);
+
+public:
+	CPointerTrie() = default;
+
+	// Adds a path and returns its index.
+	size_t Add(const CPointerPath &path);
+	size_t Add(const void *base, std::span<const ptrdiff_t> offsets);
+
+	// Resolves every path. Returns the number of paths that resolved.
+	size_t Resolve(CRegionMap &regions = GetRegionMap());
+
+	// Result of the path with this index from the last `Resolve`, `nullptr` if it failed.
+	void *GetResult(size_t index) const;
+
+	size_t GetPathCount() const { return _paths.size(); }
+
+	// Number of distinct hops, i.e. the reads per resolve.
+	size_t GetNodeCount() const { return _nodes.size(); }
+
+	void Clear();
+};
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,250 @@
+//
+// memoria_ext_pointerscan.hpp
+//
+// Pointer scanner: finds static pointer paths that lead to a dynamic address.
+//
+// A scan has two phases:
+//   1. `Snapshot` reads every added region and records each aligned slot holding a value
+//      that points into one of the regions. The result is a reverse map, sorted by value,
+//      from a pointer value to the locations that hold it. The candidate test runs on
+//      whole vectors of slots (SSE2/SSE4.2) before the exact region lookup.
+//   2. `Scan` walks backwards from the target, breadth first. At each level it looks up
+//      every location holding a pointer up to `MaxOffset` below an address of the level.
+//      A location inside a static region (a module's data section) ends a path, every
+//      other location becomes an address of the next level. An address is reached by its
+//      shortest paths only, and through at most `MaxParents` of them: the paths through
+//      the other addresses it points into are dropped.
+//
+// Both phases are split across worker threads. Results can be streamed into a compact
+// file; the files of several runs (e.g. after restarting the target) are intersected
+// with `CPointerScanFile` to keep only the paths that survived every run.
+//
+// Example:
+//   CPointerScanner scanner;
+//   scanner.AddLocalRegions();
+//   scanner.AddModule("game.exe", *CMemoryModule::CreateFromExecutable());
+//   scanner.Snapshot();
+//   scanner.ScanToFile(reinterpret_cast<uintptr_t>(player), "player.mps");
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_core_source.hpp"
+#include "memoria_ext_pointer.hpp"
+#include "memoria_utils_optional.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+MEMORIA_BEGIN
+
+class CMemoryModule;
+
+// Upper bound for `PointerScanOptions_t::MaxDepth`.
+static constexpr size_t MaxPointerScanDepth = 8;
+
+struct PointerScanOptions_t
+{
+	// Maximum number of dereferences in a path.
+	size_t MaxDepth = 5;
+
+	// Maximum offset added to a pointer, i.e. how far into an object a field may lie.
+	size_t MaxOffset = 0x1000;
+
+	// Pointers are looked for at this alignment only.
+	size_t Alignment = sizeof(void *);
+
+	// Number of worker threads, 0 for one per hardware thread.
+	size_t Workers = 0;
+
+	// Stops the scan after this many results, 0 for no limit.
+	size_t MaxResults = 0;
+
+	// How many of the addresses of a level a location pointing into several of them is
+	// followed through. Each one is a separate path, so the results grow with this.
+	size_t MaxParents = 1;
+};
+
+struct PointerScanResult_t
+{
+	// Index into the module table of the scanner or the file.
+	uint32_t Module;
+	uint32_t Depth;
+
+	// Address of the static pointer, relative to the module base.
+	uintptr_t BaseOffset;
+
+	// `Offsets[0]` is added to the static pointer, `Offsets[Depth - 1]` yields the target.
+	uint32_t Offsets[MaxPointerScanDepth];
+};
+
+// Called for every path found. Returning `false` stops the scan.
+using PointerScanCallback_t = bool(*)(const PointerScanResult_t &result, void *param);
+
+class CPointerScanner
+{
+private:
+	CPointerScanner(const CPointerScanner &) = delete;
+	CPointerScanner &operator=(const CPointerScanner &) = delete;
+
+	static constexpr uint32_t InvalidIndex = static_cast<uint32_t>(-1);
+
+	struct Region_t
+	{
+		uintptr_t Begin;
+		uintptr_t End;
+
+		// Module of a static region, `InvalidIndex` otherwise.
+		uint32_t Module;
+	};
+
+	struct Module_t
+	{
+		char Name[64];
+		uintptr_t Base;
+	};
+
+	struct Ref_t
+	{
+		// The pointer and the address it is stored at.
+		uintptr_t Value;
+		uintptr_t Location;
+	};
+
+	struct Node_t
+	{
+		uintptr_t Address;
+
+		// Node this one points to, and the offset added to reach it.
+		uint32_t Parent;
+		uint32_t Offset;
+	};
+
+private:
+	PointerScanOptions_t _options;
+
+	// Memory to snapshot, merged and sorted by `Snapshot`.
+	Memoria::Vector<Region_t> _regions{};
+
+	// Static regions, sorted and non-overlapping.
+	Memoria::Vector<Region_t> _statics{};
+	Memoria::Vector<Module_t> _modules{};
+
+	// Sorted by value.
+	Memoria::Vector<Ref_t> _refs{};
+
+	// Addresses reached by the last scan, the target is node 0.
+	Memoria::Vector<Node_t> _nodes{};
+
+private:
+	size_t GetWorkerCount() const;
+
+	const Region_t *FindStatic(uintptr_t address) const;
+	void MakeResult(uint32_t node, uintptr_t location, uint32_t offset, const Region_t &region, PointerScanResult_t &result) const;
+
+public:
+	CPointerScanner(const PointerScanOptions_t &options = {});
+
+	// Adds memory whose pointers are followed.
+	void AddRegion(uintptr_t begin, size_t size);
+
+	/**
+	 * @brief Adds a static region, where a path may start.
+	 *
+	 * Results store addresses in the region relative to `base`, so that they stay valid when
+	 * the module is loaded elsewhere. The region is also added as memory to snapshot.
+	 *
+	 * @return `false` if the region overlaps another static region.
+	 */
+	bool AddStaticRegion(const char *name, uintptr_t base, uintptr_t begin, size_t size);
+
+	// Adds the `.data` section of the module as a static region. On ELF, its writable
+	// segments, which also hold `.bss`.
+	bool AddModule(const char *name, const CMemoryModule &module);
+
+	// Adds every readable region of the current process. Returns the number of regions.
+	size_t AddLocalRegions();
+
+	/**
+	 * @brief Reads the regions and builds the reverse pointer map.
+	 *
+	 * The source is read from all workers at once, so it must allow concurrent reads.
+	 * All built-in backends do except `CPageCache`.
+	 *
+	 * @return Number of pointers found.
+	 */
+	size_t Snapshot(IMemorySource &source = GetLocalMemory());
+
+	/**
+	 * @brief Searches paths from the static regions to `target` in the last snapshot.
+	 *
+	 * The callback is called from the calling thread. Each address is expanded only at the
+	 * depth it is first reached at, so every path found is a shortest one through its
+	 * intermediate addresses.
+	 *
+	 * @return Number of paths found.
+	 */
+	size_t Scan(uintptr_t target, PointerScanCallback_t cb, void *param);
+
+	// `Scan` that streams the results into a file readable by `CPointerScanFile`.
+	// Returns the number of paths written, 0 if the file cannot be written.
+	size_t ScanToFile(uintptr_t target, const char *path);
+
+	size_t GetModuleCount() const { return _modules.size(); }
+	const char *GetModuleName(uint32_t module) const;
+
+	// Number of pointers in the snapshot.
+	size_t GetPointerCount() const { return _refs.size(); }
+
+	void Clear();
+};
+
+//
+// Results of a scan, loaded from a file.
+//
+class CPointerScanFile
+{
+private:
+	struct Module_t
+	{
+		char Name[64];
+	};
+
+	Memoria::Vector<Module_t> _modules{};
+	Memoria::Vector<PointerScanResult_t> _results{};
+
+private:
+	uint32_t FindModule(const char *name) const;
+
+public:
+	CPointerScanFile() = default;
+
+	// Loads a file written by `CPointerScanner::ScanToFile`. A truncated file loads up to its last complete result.
+	bool Load(const char *path);
+	bool Save(const char *path) const;
+
+	/**
+	 * @brief Keeps only the paths that are also in `other`.
+	 *
+	 * Modules are matched by name, so the files may come from runs with different module bases.
+	 *
+	 * @return Number of paths left.
+	 */
+	size_t Intersect(const CPointerScanFile &other);
+
+	size_t GetCount() const { return _results.size(); }
+	const PointerScanResult_t &GetResult(size_t index) const { return _results[index]; }
+
+	size_t GetModuleCount() const { return _modules.size(); }
+	const char *GetModuleName(uint32_t module) const;
+
+	// The path of a result, with the module loaded at `module_base`.
+	CPointerPath GetPath(size_t index, uintptr_t module_base) const;
+
+	// The path of a result, with the module base found by `GetModuleBase`.
+	Memoria::Optional<CPointerPath> GetPath(size_t index) const;
+};
+
+MEMORIA_END
\ No newline at end of file
@@ -6,8 +6,12 @@
 
 #include "memoria_utils_optional.hpp"
 
+#include <stddef.h>
 #include <stdint.h>
+
+#ifdef _WIN32
 #include <vcruntime.h>
+#endif
 
 MEMORIA_BEGIN
 
@@ -0,0 +1,164 @@
+//
+// memoria_ext_snapshot.hpp
+//
+// Memory snapshots and diffs.
+//
+// `CMemorySnapshot` copies regions page by page into a store of unique pages. Each 4 KB
+// page is hashed with CRC32C; a page identical to one already stored (zero pages, copies
+// of the same object) is kept only once. Stored pages are optionally compressed with a
+// small LZ77 codec, unless that does not make them smaller.
+//
+// A diff against the live memory, or against another snapshot, compares the page hashes
+// first and compares bytes only on the pages whose hashes differ (16 bytes at a time with
+// SSE2). The result is a list of changed ranges, adjacent changes merged into one range.
+//
+// A snapshot is itself an `IMemorySource`, so the scanners and search functions can run
+// on the captured state.
+//
+// Example:
+//   CMemorySnapshot before;
+//   before.Capture(heap_begin, heap_size);
+//   // ... do something in the target ...
+//   Memoria::Vector<DiffRange_t> changes;
+//   before.Diff(GetLocalMemory(), changes);
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_core_source.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <span>
+
+MEMORIA_BEGIN
+
+struct DiffRange_t
+{
+	uintptr_t Address;
+	size_t Size;
+};
+
+struct SnapshotOptions_t
+{
+	// Compress stored pages.
+	bool Compress = true;
+
+	// Number of worker threads for diffs against live memory, 0 for one per hardware thread.
+	size_t Workers = 0;
+};
+
+class CMemorySnapshot : public IMemorySource
+{
+private:
+	CMemorySnapshot(const CMemorySnapshot &) = delete;
+	CMemorySnapshot &operator=(const CMemorySnapshot &) = delete;
+
+public:
+	static constexpr size_t PageSize = 4096;
+
+private:
+	static constexpr uint32_t InvalidPage = static_cast<uint32_t>(-1);
+
+	struct Page_t
+	{
+		uintptr_t Address;
+		uint32_t Hash;
+
+		// Index into `_stored`, `InvalidPage` if the page could not be read.
+		uint32_t Stored;
+	};
+
+	struct StoredPage_t
+	{
+		uint32_t Hash;
+		uint32_t Chunk;
+		uint32_t Offset;
+
+		// `PageSize` if stored uncompressed.
+		uint32_t Size;
+	};
+
+private:
+	SnapshotOptions_t _options;
+
+	// Sorted by address.
+	Memoria::Vector<Page_t> _pages{};
+
+	Memoria::Vector<StoredPage_t> _stored{};
+	Memoria::Vector<Memoria::Vector<uint8_t>> _chunks{};
+
+	// Open addressing, hash -> stored page. Size is a power of two.
+	Memoria::Vector<uint32_t> _table{};
+
+private:
+	size_t GetWorkerCount() const;
+
+	const Page_t *FindPage(uintptr_t address) const;
+
+	// Copies a stored page, decompressing it if needed, into `buffer` of `PageSize` bytes.
+	bool LoadPage(uint32_t stored, uint8_t *buffer) const;
+
+	// Returns the stored page with this content, storing it if it is new.
+	uint32_t StorePage(const uint8_t *data, uint32_t hash);
+	void Rehash(size_t buckets);
+
+	// Diffs the pages `_pages[indices[0..pages)]`, or the first `pages` pages if `indices` is null.
+	size_t DiffPages(IMemorySource &source, const uint32_t *indices, size_t pages, Memoria::Vector<DiffRange_t> &ranges) const;
+
+public:
+	CMemorySnapshot(const SnapshotOptions_t &options = {});
+
+	/**
+	 * @brief Captures the pages that overlap `[begin, begin + size)`.
+	 *
+	 * Captures accumulate; a page captured again replaces the old copy. Pages that cannot
+	 * be read are recorded as such.
+	 *
+	 * @return Number of pages read.
+	 */
+	size_t Capture(uintptr_t begin, size_t size, IMemorySource &source = GetLocalMemory());
+
+	/**
+	 * @brief Compares the snapshot with the current contents of `source`.
+	 *
+	 * Pages that became readable or unreadable count as changed as a whole.
+	 *
+	 * @return Number of changed bytes.
+	 */
+	size_t Diff(IMemorySource &source, Memoria::Vector<DiffRange_t> &ranges) const;
+
+	/**
+	 * @brief Like `Diff`, but only compares the pages listed in `pages`, for example the
+	 *        dirty pages from `CDirtyTracker`. The other pages count as unchanged.
+	 *
+	 * @param pages Page addresses in ascending order.
+	 */
+	size_t Diff(IMemorySource &source, std::span<const uintptr_t> pages, Memoria::Vector<DiffRange_t> &ranges) const;
+
+	/**
+	 * @brief Compares the snapshot with `other`, which is taken to be the newer one.
+	 *
+	 * Pages captured by only one of them count as changed as a whole.
+	 *
+	 * @return Number of changed bytes.
+	 */
+	size_t Diff(const CMemorySnapshot &other, Memoria::Vector<DiffRange_t> &ranges) const;
+
+	// Reads the captured contents. Stops at a page that was not captured or not readable.
+	size_t Read(uintptr_t address, void *buffer, size_t size) override;
+
+	size_t GetPageCount() const { return _pages.size(); }
+
+	// Number of distinct pages stored.
+	size_t GetStoredCount() const { return _stored.size(); }
+
+	// Bytes held for page contents.
+	size_t GetStoredSize() const;
+
+	void Clear();
+};
+
+MEMORIA_END
\ No newline at end of file
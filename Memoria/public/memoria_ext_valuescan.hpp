@@ -0,0 +1,191 @@
+//
+// memoria_ext_valuescan.hpp
+//
+// Value scanner: narrows down the addresses of a value over several scans.
+//
+// The first scan looks for an exact value, a range, or takes every slot when the value
+// is unknown. Each next scan re-reads the remaining candidates and keeps those that
+// changed, stayed unchanged, increased, decreased, or match a value or range.
+//
+// Memory is split into blocks of 1 MB, which are scanned in parallel. The candidates of
+// a block are stored either as a bitmap with one bit per slot, or, once they are sparse,
+// as a list of varint-encoded distances between slots, whichever is smaller. A block
+// where every slot is a candidate (an unknown first scan) stores no candidate data at
+// all. Next to the candidates, a block keeps their values from the last scan.
+//
+// Example:
+//   CValueScanner<int32_t> scanner;
+//   scanner.AddLocalRegions();
+//   scanner.FirstScan(eScanCondition::Equal, 100);
+//   // ... health drops ...
+//   scanner.NextScan(eScanCondition::Decreased);
+//   scanner.NextScan(eScanCondition::Equal, 87);
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_core_source.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <span>
+#include <type_traits>
+
+MEMORIA_BEGIN
+
+enum class eScanCondition : uint8_t
+{
+	Equal,      // == a
+	Between,    // a <= value <= b
+	Unknown,    // any value, first scan only
+
+	// Next scans only, compared to the value of the previous scan.
+	Changed,
+	Unchanged,
+	Increased,
+	Decreased,
+};
+
+struct ValueScanOptions_t
+{
+	// Values are looked for at multiples of their size. Otherwise at every byte.
+	bool Aligned = true;
+
+	// Number of worker threads, 0 for one per hardware thread.
+	size_t Workers = 0;
+};
+
+// Called for every candidate. Returning `false` stops the enumeration.
+template <typename T>
+using ValueScanCallback_t = bool(*)(uintptr_t address, T value, void *param);
+
+template <typename T>
+class CValueScanner
+{
+	static_assert(std::is_arithmetic_v<T>, "Only integer and floating-point values can be scanned.");
+
+private:
+	CValueScanner(const CValueScanner &) = delete;
+	CValueScanner &operator=(const CValueScanner &) = delete;
+
+	enum class eEncoding : uint8_t
+	{
+		All,     // every slot, no candidate data
+		Bitmap,  // one bit per slot
+		List,    // varint distances between slots
+	};
+
+	struct Region_t
+	{
+		uintptr_t Begin;
+		uintptr_t End;
+	};
+
+	struct Block_t
+	{
+		uintptr_t Begin;
+
+		// Number of slots, and how many of them are candidates.
+		uint32_t Slots;
+		uint32_t Count;
+
+		eEncoding Encoding;
+		Memoria::Vector<uint8_t> Candidates;
+
+		// `All`: the memory of the block as read. Otherwise the candidate values in slot order.
+		Memoria::Vector<uint8_t> Values;
+	};
+
+	struct Scratch_t;
+
+private:
+	ValueScanOptions_t _options;
+	size_t _stride;
+
+	Memoria::Vector<Region_t> _regions{};
+	Memoria::Vector<Block_t> _blocks{};
+
+	size_t _count = 0;
+	bool _scanned = false;
+
+private:
+	size_t GetWorkerCount() const;
+
+	// Calls `fn(slot, index)` for every candidate of the block, `index` counting the candidates.
+	template <typename Fn>
+	static void ForEachCandidate(const Block_t &block, Fn &&fn);
+
+	// Stores the candidates `slots[0..count)` in the smaller of the two encodings.
+	static void EncodeCandidates(Block_t &block, const uint32_t *slots, size_t count);
+
+	// Rebuilds the memory of the block from its stored values, as far as the candidates need it.
+	void RestoreBlock(const Block_t &block, uint8_t *memory) const;
+
+	// `pages`: if set, only these pages are read, the rest is taken from the last scan.
+	void ScanBlock(Block_t &block, IMemorySource &source, eScanCondition condition, T a, T b, bool first, const std::span<const uintptr_t> *pages, Scratch_t &scratch) const;
+	size_t Run(IMemorySource &source, eScanCondition condition, T a, T b, bool first, const std::span<const uintptr_t> *pages);
+
+public:
+	CValueScanner(const ValueScanOptions_t &options = {});
+
+	// Adds memory to scan. Takes effect with the next first scan.
+	void AddRegion(uintptr_t begin, size_t size);
+
+	// Adds every writable region of the current process. Returns the number of regions.
+	size_t AddLocalRegions();
+
+	/**
+	 * @brief Scans the regions, replacing all candidates.
+	 *
+	 * @param condition `Equal`, `Between` or `Unknown`.
+	 * @param source Read from all workers at once, so it must allow concurrent reads.
+	 *
+	 * @return Number of candidates.
+	 */
+	size_t FirstScan(eScanCondition condition, T a = T(), T b = T(), IMemorySource &source = GetLocalMemory());
+
+	/**
+	 * @brief Re-reads the candidates and keeps those that satisfy `condition`.
+	 *
+	 * Candidates that can no longer be read are dropped.
+	 *
+	 * @return Number of candidates left.
+	 */
+	size_t NextScan(eScanCondition condition, T a = T(), T b = T(), IMemorySource &source = GetLocalMemory());
+
+	/**
+	 * @brief Like `NextScan`, but only reads the pages listed in `pages`, for example the
+	 *        dirty pages from `CDirtyTracker`. Memory outside of them counts as unchanged.
+	 *
+	 * @param pages Addresses of 4 KB pages in ascending order.
+	 */
+	size_t NextScan(eScanCondition condition, T a, T b, std::span<const uintptr_t> pages, IMemorySource &source = GetLocalMemory());
+
+	size_t GetCount() const { return _count; }
+
+	// Calls `cb` with every candidate and its value from the last scan, in address order.
+	// Returns the number of candidates visited.
+	size_t Enumerate(ValueScanCallback_t<T> cb, void *param) const;
+
+	// Bytes held for candidates and their values.
+	size_t GetMemoryUsage() const;
+
+	// Forgets the candidates, keeps the regions.
+	void Reset();
+	void Clear();
+};
+
+extern template class CValueScanner<uint8_t>;
+extern template class CValueScanner<uint16_t>;
+extern template class CValueScanner<uint32_t>;
+extern template class CValueScanner<uint64_t>;
+extern template class CValueScanner<int8_t>;
+extern template class CValueScanner<int16_t>;
+extern template class CValueScanner<int32_t>;
+extern template class CValueScanner<int64_t>;
+extern template class CValueScanner<float>;
+extern template class CValueScanner<double>;
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,301 @@
+//
+// memoria_utils_asm.hpp
+//
+// A small x86/x64 assembler built on top of `CWriteBuffer`.
+//
+// Covers only the subset of instructions that Memoria needs for stub generation
+// (hooks, trampolines, thunks). Jumps to labels are emitted in the short form
+// first and widened to rel32 during `Finalize` if the distance does not fit,
+// so forward references can be used freely.
+//
+// Every relative operand (labels, absolute call/jump targets, RIP-relative memory)
+// is resolved in `Finalize` against the runtime address passed to the constructor,
+// which means the code can be assembled in a temporary buffer and cloned to
+// its final location afterwards.
+//
+// Example:
+//   CIndependentAssembler64 a(target, true);
+//   auto skip = a.NewLabel();
+//   a.Test(eReg::Rcx, eReg::Rcx);
+//   a.Jcc(eCond::E, skip);
+//   a.Call(some_function);
+//   a.Bind(skip);
+//   a.Jmp(continuation);
+//   a.Finalize();
+//   a.Clone(target, true);
+//
+
+#pragma once
+
+#include "memoria_common.hpp"
+#include "memoria_utils_buffer.hpp"
+#include "memoria_utils_vector.hpp"
+
+#include <stdint.h>
+
+MEMORIA_BEGIN
+
+enum class eReg : uint8_t
+{
+	Rax, Rcx, Rdx, Rbx, Rsp, Rbp, Rsi, Rdi,
+	R8, R9, R10, R11, R12, R13, R14, R15,
+
+	None = 0xFF
+};
+
+enum class eXmm : uint8_t
+{
+	Xmm0, Xmm1, Xmm2, Xmm3, Xmm4, Xmm5, Xmm6, Xmm7,
+	Xmm8, Xmm9, Xmm10, Xmm11, Xmm12, Xmm13, Xmm14, Xmm15
+};
+
+// Condition codes in hardware order, i.e. `0x70 + code` is the short Jcc opcode.
+enum class eCond : uint8_t
+{
+	O, NO, B, AE, E, NE, BE, A, S, NS, P, NP, L, GE, LE, G
+};
+
+using Label_t = uint32_t;
+
+//
+// Memory operand: [base + index * scale + disp], [rip + target] or [disp32].
+//
+// In x86 mode RIP-relative operands are encoded as absolute [disp32] addresses.
+//
+struct Mem_t
+{
+	eReg Base = eReg::None;
+	eReg Index = eReg::None;
+	uint8_t Scale = 1;
+	int32_t Disp = 0;
+
+	bool IsRip = false;
+	const void *Target = nullptr;
+	Label_t Label = static_cast<Label_t>(-1);
+};
+
+static inline Mem_t Mem(eReg base, int32_t disp = 0)
+{
+	Mem_t mem;
+	mem.Base = base;
+	mem.Disp = disp;
+	return mem;
+}
+
+static inline Mem_t Mem(eReg base, eReg index, uint8_t scale, int32_t disp = 0)
+{
+	Mem_t mem;
+	mem.Base = base;
+	mem.Index = index;
+	mem.Scale = scale;
+	mem.Disp = disp;
+	return mem;
+}
+
+static inline Mem_t MemRip(const void *target)
+{
+	Mem_t mem;
+	mem.IsRip = true;
+	mem.Target = target;
+	return mem;
+}
+
+static inline Mem_t MemRip(Label_t label)
+{
+	Mem_t mem;
+	mem.IsRip = true;
+	mem.Label = label;
+	return mem;
+}
+
+class CAssembler : public CWriteBuffer
+{
+	CAssembler(const CAssembler &) = delete;
+	CAssembler &operator=(const CAssembler &) = delete;
+
+private:
+	enum class eFixup : uint8_t
+	{
+		// Short jump to a label, may be widened to rel32.
+		LabelRel8,
+
+		// rel32 to a label (call, widened jump, RIP-relative memory).
+		LabelRel32,
+
+		// rel32 to an absolute address.
+		AbsRel32,
+
+		// Absolute 32-bit address of a label (x86 memory operands only).
+		LabelAbs32,
+	};
+
+	struct Fixup_t
+	{
+		// Offset of the displacement field inside the buffer.
+		uint32_t Pos;
+
+		// Number of instruction bytes that follow the displacement field.
+		uint8_t Tail;
+
+		eFixup Kind;
+
+		// true for a Jcc, false for a JMP (relevant for `LabelRel8` only).
+		bool IsCond;
+
+		Label_t Label;
+		const void *Target;
+	};
+
+	static constexpr uint32_t UnboundLabel = static_cast<uint32_t>(-1);
+
+	// Location where the code will be executed.
+	const uint8_t *_runtime;
+
+	bool _x64;
+	bool _failed = false;
+	bool _finalized = false;
+
+	Memoria::FixedVector<uint32_t, 32> _labels{};
+	Memoria::FixedVector<Fixup_t, 64> _fixups{};
+
+private:
+	void Fail();
+
+	void EmitRex(bool w, uint8_t reg, uint8_t index, uint8_t base);
+	void EmitRexFor(bool w, uint8_t reg, const Mem_t &mem);
+
+	void EmitModRM(uint8_t mod, uint8_t reg, uint8_t rm);
+	void EmitMem(uint8_t reg, const Mem_t &mem, uint8_t tail);
+
+	void EmitRegRm(uint8_t opcode, uint8_t reg, uint8_t rm);
+	void EmitRegMem(uint8_t opcode, uint8_t reg, const Mem_t &mem, uint8_t tail = 0);
+	void EmitGroupImm(uint8_t ext, eReg dst, int32_t imm);
+
+	void AddFixup(eFixup kind, uint8_t tail, Label_t label, const void *target, bool is_cond = false);
+	bool Relax();
+
+	uint8_t RegBits(eReg reg);
+	bool Reserve(size_t size);
+
+public:
+	CAssembler(void *data, size_t size, const void *runtime_address = nullptr, bool is_x64 = IsX64());
+
+	bool Is64Bit() const { return _x64; }
+	bool IsFailed() const { return _failed; }
+
+	// Address at which the instruction at the current offset will run.
+	const void *GetRuntimeAddress() const { return _runtime + _pos; }
+
+	//
+	// Raw data
+	//
+	// Same as in `CWriteBuffer`, but running out of space marks the assembler as failed
+	// instead of silently dropping the data.
+	//
+
+	void WriteU8(uint8_t value) { if (Reserve(sizeof(value))) CWriteBuffer::WriteU8(value); }
+	void WriteU16(uint16_t value) { if (Reserve(sizeof(value))) CWriteBuffer::WriteU16(value); }
+	void WriteU32(uint32_t value) { if (Reserve(sizeof(value))) CWriteBuffer::WriteU32(value); }
+	void WriteU64(uint64_t value) { if (Reserve(sizeof(value))) CWriteBuffer::WriteU64(value); }
+	void WriteI8(int8_t value) { if (Reserve(sizeof(value))) CWriteBuffer::WriteI8(value); }
+	void WriteI32(int32_t value) { if (Reserve(sizeof(value))) CWriteBuffer::WriteI32(value); }
+	void WriteData(const void *src, size_t size) { if (Reserve(size)) CWriteBuffer::WriteData(src, size); }
+
+	//
+	// Labels
+	//
+
+	Label_t NewLabel();
+	void Bind(Label_t label);
+
+	//
+	// Data movement
+	//
+
+	void Mov(eReg dst, eReg src);
+	void Mov(eReg dst, const Mem_t &src);
+	void Mov(const Mem_t &dst, eReg src);
+
+	// Picks the shortest encoding for the value.
+	void Mov(eReg dst, uint64_t imm);
+
+	// Always uses the full-width immediate (`mov r64, imm64`), so the size does not depend on the value.
+	void MovAbs(eReg dst, uint64_t imm);
+
+	void Lea(eReg dst, const Mem_t &src);
+
+	void Push(eReg reg);
+	void Push(int32_t imm);
+	// Always uses the imm32 form.
+	void PushAbs(uint32_t imm);
+	void Pop(eReg reg);
+
+	void Movdqu(eXmm dst, const Mem_t &src);
+	void Movdqu(const Mem_t &dst, eXmm src);
+	void Movaps(eXmm dst, eXmm src);
+
+	//
+	// Arithmetic
+	//
+
+	void Add(eReg dst, int32_t imm);
+	void Add(eReg dst, eReg src);
+	void Sub(eReg dst, int32_t imm);
+	void Sub(eReg dst, eReg src);
+	void Xor(eReg dst, eReg src);
+
+	void Cmp(eReg lhs, int32_t imm);
+	void Cmp(eReg lhs, eReg rhs);
+	void Cmp(const Mem_t &lhs, eReg rhs);
+
+	void Test(eReg lhs, eReg rhs);
+	void Test(eReg lhs, int32_t imm);
+
+	//
+	// Control flow
+	//
+
+	// rel32 to an absolute address, fails in `Finalize` if out of range.
+	void Call(const void *target);
+	void Call(Label_t label);
+	void Call(eReg reg);
+	void Call(const Mem_t &mem);
+
+	// Jumps to absolute targets are always rel32, jumps to labels are auto-sized.
+	void Jmp(const void *target);
+	void Jmp(Label_t label);
+	void Jmp(eReg reg);
+	void Jmp(const Mem_t &mem);
+
+	void Jcc(eCond cond, const void *target);
+	void Jcc(eCond cond, Label_t label);
+
+	void Ret(uint16_t pop_bytes = 0);
+
+	void Nop(size_t count = 1);
+	void Int3(size_t count = 1);
+
+	//
+	// Resolution
+	//
+
+	// Widens the short jumps that do not fit and writes every displacement.
+	// Must be called before the code is used or cloned.
+	bool Finalize();
+};
+
+template <size_t size>
+class CIndependentAssembler : public CAssembler
+{
+private:
+	uint8_t _buf[size];
+
+public:
+	CIndependentAssembler(const void *runtime_address = nullptr, bool is_x64 = IsX64())
+		: CAssembler(&_buf, size, runtime_address, is_x64) {}
+};
+
+using CIndependentAssembler64 = CIndependentAssembler<64>;
+using CIndependentAssembler256 = CIndependentAssembler<256>;
+
+MEMORIA_END
\ No newline at end of file
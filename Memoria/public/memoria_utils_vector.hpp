@@ -302,7 +302,14 @@ private:
 		if (min_capacity <= this->_capacity)
 			return;
 
-		reserve(min_capacity);
+		// Grow geometrically so that appending one element at a time stays amortized O(1).
+		// `reserve` still allocates exactly what it is asked for.
+		size_t grown = this->_capacity * 2;
+
+		if (grown < 8)
+			grown = 8;
+
+		reserve(grown > min_capacity ? grown : min_capacity);
 	}
 
 public:
@@ -576,15 +583,11 @@ public:
 
 	bool full() const
 	{
-		ensure_capacity(0);
-
 		return this->_size == this->_capacity;
 	}
 
 	size_t capacity() const
 	{
-		ensure_capacity(0);
-
 		return this->_capacity;
 	}
 };
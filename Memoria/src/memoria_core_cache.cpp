@@ -0,0 +1,395 @@
+#include "memoria_core_cache.hpp"
+
+#include "memoria_core_errors.hpp"
+#include "memoria_utils_assert.hpp"
+
+#include <string.h>
+#include <algorithm>
+
+MEMORIA_BEGIN
+
+static constexpr uint32_t EmptyBucket = static_cast<uint32_t>(-1);
+
+// Epoch of pages that must be reloaded regardless of the current epoch.
+static constexpr uint32_t StaleEpoch = 0;
+
+CPageCache::CPageCache(IMemorySource &source, size_t capacity, size_t readahead)
+	: _source(source)
+	, _readahead((std::max)(readahead, size_t(1)))
+{
+	capacity = (std::max)(capacity, size_t(1));
+
+	_slots.resize(capacity);
+	_data.resize(capacity * PageSize);
+
+	// At most half full, so that probe sequences stay short.
+	size_t buckets = 16;
+
+	while (buckets < capacity * 2)
+		buckets *= 2;
+
+	_table.resize(buckets);
+
+	for (auto &bucket : _table)
+		bucket = EmptyBucket;
+}
+
+size_t CPageCache::HashPage(uintptr_t page) const
+{
+	uint64_t hash = static_cast<uint64_t>(page / PageSize) * 0x9E3779B97F4A7C15ull;
+	return static_cast<size_t>(hash >> 32) & (_table.size() - 1);
+}
+
+uint32_t CPageCache::Find(uintptr_t page) const
+{
+	size_t mask = _table.size() - 1;
+
+	for (size_t i = HashPage(page);; i = (i + 1) & mask)
+	{
+		uint32_t slot = _table[i];
+
+		if (slot == EmptyBucket)
+			return InvalidSlot;
+
+		if (_slots[slot].Address == page)
+			return slot;
+	}
+}
+
+void CPageCache::Insert(uintptr_t page, uint32_t slot)
+{
+	size_t mask = _table.size() - 1;
+	size_t i = HashPage(page);
+
+	while (_table[i] != EmptyBucket)
+		i = (i + 1) & mask;
+
+	_table[i] = slot;
+}
+
+void CPageCache::Erase(uintptr_t page)
+{
+	size_t mask = _table.size() - 1;
+	size_t i = HashPage(page);
+
+	while (_table[i] != EmptyBucket && _slots[_table[i]].Address != page)
+		i = (i + 1) & mask;
+
+	if (_table[i] == EmptyBucket)
+		return;
+
+	// Backward shift deletion: move up every following entry whose probe sequence passes the hole.
+	size_t hole = i;
+
+	for (size_t j = (i + 1) & mask; _table[j] != EmptyBucket; j = (j + 1) & mask)
+	{
+		size_t home = HashPage(_slots[_table[j]].Address);
+
+		// Whether `home` lies cyclically in `(hole, j]`.
+		bool stays = (hole <= j) ? (hole < home && home <= j) : (hole < home || home <= j);
+
+		if (!stays)
+		{
+			_table[hole] = _table[j];
+			hole = j;
+		}
+	}
+
+	_table[hole] = EmptyBucket;
+}
+
+void CPageCache::Unlink(uint32_t slot)
+{
+	auto &entry = _slots[slot];
+
+	if (entry.Prev != InvalidSlot)
+		_slots[entry.Prev].Next = entry.Next;
+	else
+		_head = entry.Next;
+
+	if (entry.Next != InvalidSlot)
+		_slots[entry.Next].Prev = entry.Prev;
+	else
+		_tail = entry.Prev;
+
+	entry.Prev = entry.Next = InvalidSlot;
+}
+
+void CPageCache::PushFront(uint32_t slot)
+{
+	auto &entry = _slots[slot];
+
+	entry.Prev = InvalidSlot;
+	entry.Next = _head;
+
+	if (_head != InvalidSlot)
+		_slots[_head].Prev = slot;
+	else
+		_tail = slot;
+
+	_head = slot;
+}
+
+uint32_t CPageCache::AcquireSlot()
+{
+	if (_unused < _slots.size())
+		return _unused++;
+
+	uint32_t slot = _tail;
+
+	Erase(_slots[slot].Address);
+	Unlink(slot);
+
+	_stats.Evictions++;
+	return slot;
+}
+
+void CPageCache::Load(const uintptr_t *pages, size_t count)
+{
+	AssertMsg(count <= _slots.size(), "More pages requested than the cache can hold.");
+
+	_requests.clear();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t slot = Find(pages[i]);
+
+		if (slot != InvalidSlot)
+		{
+			// A stale page is reloaded into its own slot.
+			Unlink(slot);
+		}
+		else
+		{
+			slot = AcquireSlot();
+			_slots[slot].Address = pages[i];
+			Insert(pages[i], slot);
+		}
+
+		// Loaded pages go to the front right away, so that they cannot evict each other.
+		PushFront(slot);
+
+		_requests.push_back({ pages[i], &_data[slot * PageSize], PageSize, 0 });
+	}
+
+	_source.ReadBatch({ _requests.data(), _requests.size() });
+
+	for (const auto &request : _requests)
+	{
+		size_t slot = (static_cast<uint8_t *>(request.Buffer) - _data.data()) / PageSize;
+
+		_slots[slot].Valid = static_cast<uint32_t>(request.Transferred);
+		_slots[slot].Epoch = _epoch;
+		_slots[slot].Ahead = true;
+	}
+}
+
+void CPageCache::LoadPending()
+{
+	std::sort(_pending.begin(), _pending.end());
+
+	size_t count = 0;
+
+	for (size_t i = 0; i < _pending.size(); i++)
+	{
+		if ((i == 0 || _pending[i] != _pending[i - 1]) && !IsFresh(Find(_pending[i])))
+			_pending[count++] = _pending[i];
+	}
+
+	// In batches the cache can hold; with too small a cache the first pages are evicted again.
+	for (size_t i = 0; i < count; i += _slots.size())
+		Load(&_pending[i], (std::min)(count - i, _slots.size()));
+
+	_stats.Prefetched += count;
+	_pending.clear();
+}
+
+uint32_t CPageCache::GetPage(uintptr_t page)
+{
+	uint32_t slot = Find(page);
+
+	if (IsFresh(slot))
+	{
+		// The first lookup of a page loaded ahead of it (by a prefetch or readahead) still cost a load.
+		if (_slots[slot].Ahead)
+			_stats.Misses++;
+		else
+			_stats.Hits++;
+
+		Unlink(slot);
+		PushFront(slot);
+	}
+	else
+	{
+		_stats.Misses++;
+
+		// On sequential access, load the following pages along with this one.
+		size_t count = (page == _next_page) ? (std::min)(_readahead, _slots.size()) : 1;
+
+		_pending.clear();
+
+		for (size_t i = 0; i < count; i++)
+		{
+			uintptr_t next = page + i * PageSize;
+
+			if (next < page)
+				break;
+
+			if (i == 0 || !IsFresh(Find(next)))
+				_pending.push_back(next);
+		}
+
+		_stats.Prefetched += _pending.size() - 1;
+
+		Load(_pending.data(), _pending.size());
+		_pending.clear();
+
+		slot = Find(page);
+	}
+
+	_slots[slot].Ahead = false;
+	_next_page = page + PageSize;
+	return slot;
+}
+
+size_t CPageCache::Read(uintptr_t address, void *buffer, size_t size)
+{
+	if (size == 0)
+		return 0;
+
+	// Load all missing pages of a larger read at once.
+	if ((address & (PageSize - 1)) + size > PageSize)
+		Prefetch(address, size);
+
+	size_t total = 0;
+
+	while (total < size)
+	{
+		uintptr_t current = address + total;
+		uintptr_t page = current & ~static_cast<uintptr_t>(PageSize - 1);
+
+		size_t offset = current - page;
+		size_t chunk = (std::min)(size - total, PageSize - offset);
+
+		const auto &slot = _slots[GetPage(page)];
+
+		if (offset >= slot.Valid)
+			break;
+
+		size_t count = (std::min)(chunk, static_cast<size_t>(slot.Valid) - offset);
+		memcpy(static_cast<uint8_t *>(buffer) + total, &_data[(&slot - _slots.data()) * PageSize + offset], count);
+
+		total += count;
+
+		if (count < chunk)
+			break;
+	}
+
+	if (total < size)
+		SetError(ME_INVALID_MEMORY);
+
+	return total;
+}
+
+size_t CPageCache::ReadBatch(std::span<MemoryIo_t> requests)
+{
+	_pending.clear();
+
+	for (const auto &request : requests)
+	{
+		if (request.Size == 0)
+			continue;
+
+		uintptr_t first = request.Address & ~static_cast<uintptr_t>(PageSize - 1);
+		uintptr_t last = (request.Address + request.Size - 1) & ~static_cast<uintptr_t>(PageSize - 1);
+
+		for (uintptr_t page = first;; page += PageSize)
+		{
+			_pending.push_back(page);
+
+			if (page == last)
+				break;
+		}
+	}
+
+	LoadPending();
+
+	size_t completed = 0;
+
+	for (auto &request : requests)
+	{
+		request.Transferred = Read(request.Address, request.Buffer, request.Size);
+
+		if (request.Transferred == request.Size)
+			completed++;
+	}
+
+	return completed;
+}
+
+void CPageCache::Prefetch(uintptr_t address, size_t size)
+{
+	if (size == 0)
+		return;
+
+	uintptr_t first = address & ~static_cast<uintptr_t>(PageSize - 1);
+	uintptr_t last = (address + size - 1) & ~static_cast<uintptr_t>(PageSize - 1);
+
+	_pending.clear();
+
+	for (uintptr_t page = first;; page += PageSize)
+	{
+		_pending.push_back(page);
+
+		if (page == last)
+			break;
+	}
+
+	LoadPending();
+}
+
+void CPageCache::NextEpoch()
+{
+	// After wrapping around, old pages could appear fresh again.
+	if (++_epoch == StaleEpoch)
+	{
+		for (size_t i = 0; i < _unused; i++)
+			_slots[i].Epoch = StaleEpoch;
+
+		_epoch = StaleEpoch + 1;
+	}
+}
+
+void CPageCache::Invalidate(uintptr_t address, size_t size)
+{
+	if (size == 0)
+		return;
+
+	uintptr_t first = address & ~static_cast<uintptr_t>(PageSize - 1);
+	uintptr_t last = (address + size - 1) & ~static_cast<uintptr_t>(PageSize - 1);
+
+	for (uintptr_t page = first;; page += PageSize)
+	{
+		uint32_t slot = Find(page);
+
+		if (slot != InvalidSlot)
+			_slots[slot].Epoch = StaleEpoch;
+
+		if (page == last)
+			break;
+	}
+}
+
+void CPageCache::Clear()
+{
+	for (auto &bucket : _table)
+		bucket = EmptyBucket;
+
+	_head = _tail = InvalidSlot;
+	_unused = 0;
+	_next_page = 0;
+
+	_stats = {};
+}
+
+MEMORIA_END
\ No newline at end of file
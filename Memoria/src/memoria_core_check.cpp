@@ -4,6 +4,7 @@
 #include "memoria_core_options.hpp"
 #include "memoria_core_errors.hpp"
 
+#include <string.h>
 #include <string_view>
 
 MEMORIA_BEGIN
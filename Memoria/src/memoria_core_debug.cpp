@@ -1,5 +1,6 @@
 #include "memoria_core_debug.hpp"
 
+#include "memoria_core_functions.hpp"
 #include "memoria_core_misc.hpp"
 #include "memoria_utils_format.hpp"
 #include "memoria_utils_optional.hpp"
@@ -244,62 +245,26 @@ Memoria::Vector<std::tuple<void *, void *>> GetFunctionEntries(HMODULE handle)
 	if (!handle)
 		return {};
 
-	uint32_t size;
-	PIMAGE_RUNTIME_FUNCTION_ENTRY pFunc = reinterpret_cast<PIMAGE_RUNTIME_FUNCTION_ENTRY>(
-		GetImageDirectoryData(handle, TRUE, IMAGE_DIRECTORY_ENTRY_EXCEPTION, &size));
+	auto functions = GetFunctionIndex(handle);
 
-	if (!pFunc)
+	if (!functions)
 		return {};
 
-	DWORD count = size / sizeof(IMAGE_RUNTIME_FUNCTION_ENTRY);
-
 	Memoria::Vector<std::tuple<void *, void *>> result{};
-	result.reserve(count);
-
-	for (size_t i = 0u; i < count; ++i)
-	{
-		if (!pFunc[i].BeginAddress || !pFunc[i].EndAddress)
-			continue;
+	result.reserve(functions->GetEntries().size());
 
-		void *addr_begin = PtrOffset(handle, pFunc[i].BeginAddress);
-		void *addr_end = PtrOffset(handle, pFunc[i].EndAddress);
-
-		result.emplace_back(addr_begin, addr_end);
-	}
+	for (const auto &entry : functions->GetEntries())
+		result.emplace_back(functions->GetAddress(entry.Begin), functions->GetAddress(entry.End));
 
 	return result;
 }
 
 void *GetFunctionBaseAddressFromItsCode(const void *address)
 {
-	HMODULE hModule = static_cast<HMODULE>(GetBaseAddress(address));
-	if (!hModule)
-		return nullptr;
-
-	uint32_t size;
-	PIMAGE_RUNTIME_FUNCTION_ENTRY pFunc = reinterpret_cast<PIMAGE_RUNTIME_FUNCTION_ENTRY>(
-		GetImageDirectoryData(hModule, TRUE, IMAGE_DIRECTORY_ENTRY_EXCEPTION, &size));
-
-	if (!pFunc)
-		return nullptr;
+	auto functions = GetFunctionIndex(address);
+	auto entry = functions ? functions->FindPrimary(address) : nullptr;
 
-	DWORD count = size / sizeof(IMAGE_RUNTIME_FUNCTION_ENTRY);
-
-	for (size_t i = 0u; i < count; ++i)
-	{
-		if (!pFunc[i].BeginAddress || !pFunc[i].EndAddress)
-			continue;
-
-		uintptr_t addr_begin = reinterpret_cast<uintptr_t>(hModule) + pFunc[i].BeginAddress;
-		uintptr_t addr_end = reinterpret_cast<uintptr_t>(hModule) + pFunc[i].EndAddress;
-
-		uintptr_t addr_needed = reinterpret_cast<uintptr_t>(address);
-
-		if (IsInBounds(addr_needed, addr_begin, addr_end))
-			return reinterpret_cast<void *>(addr_begin);
-	}
-
-	return nullptr;
+	return entry ? functions->GetAddress(entry->Begin) : nullptr;
 }
 
 Memoria::FixedVector<void *, 128> GetStackBacktrace()
@@ -0,0 +1,270 @@
+#include "memoria_core_dirty.hpp"
+
+#include "memoria_core_errors.hpp"
+
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MEMORIA_BEGIN
+
+#ifndef _WIN32
+
+// Bit 55 of a pagemap entry: the page was written since the soft-dirty bits were cleared.
+static constexpr uint64_t PagemapSoftDirty = 1ull << 55;
+
+// Pagemap entries read per system call.
+static constexpr size_t PagemapBatch = 512;
+
+// Kernels built without `CONFIG_MEM_SOFT_DIRTY` accept "4" but never set the bit.
+// A freshly mapped and written page is soft-dirty on the kernels that support it.
+static bool ProbeSoftDirty(int pagemap)
+{
+	void *page = mmap(nullptr, CDirtyTracker::PageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (page == MAP_FAILED)
+		return false;
+
+	*static_cast<volatile uint8_t *>(page) = 1;
+
+	uint64_t entry = 0;
+	off_t offset = static_cast<off_t>(reinterpret_cast<uintptr_t>(page) / CDirtyTracker::PageSize * sizeof(uint64_t));
+
+	bool supported = (pread(pagemap, &entry, sizeof(entry), offset) == sizeof(entry) && (entry & PagemapSoftDirty));
+
+	munmap(page, CDirtyTracker::PageSize);
+	return supported;
+}
+
+#endif
+
+CDirtyTracker::~CDirtyTracker()
+{
+#ifndef _WIN32
+	if (_pagemap >= 0)
+		close(_pagemap);
+
+	if (_clear_refs >= 0)
+		close(_clear_refs);
+#endif
+}
+
+#ifdef _WIN32
+
+void CDirtyTracker::Sample(Range_t &range, bool reset)
+{
+	if (!range.Tracked)
+		return;
+
+	size_t pages = range.Epochs.size();
+
+	Memoria::Vector<PVOID> addresses(pages);
+	ULONG_PTR count = pages;
+	ULONG granularity;
+
+	if (GetWriteWatch(reset ? WRITE_WATCH_FLAG_RESET : 0, reinterpret_cast<PVOID>(range.Begin), range.End - range.Begin, addresses.data(), &count, &granularity) != 0)
+	{
+		// No longer watchable, e.g. freed and reallocated without `MEM_WRITE_WATCH`.
+		range.Tracked = false;
+		return;
+	}
+
+	for (ULONG_PTR i = 0; i < count; i++)
+	{
+		size_t page = (reinterpret_cast<uintptr_t>(addresses[i]) - range.Begin) / PageSize;
+
+		if (page < pages)
+			range.Epochs[page] = _epoch;
+	}
+}
+
+#else
+
+void CDirtyTracker::Sample(Range_t &range, bool)
+{
+	if (!range.Tracked)
+		return;
+
+	uint64_t entries[PagemapBatch];
+	size_t pages = range.Epochs.size();
+
+	for (size_t first = 0; first < pages; first += PagemapBatch)
+	{
+		size_t count = (std::min)(PagemapBatch, pages - first);
+		off_t offset = static_cast<off_t>((range.Begin / PageSize + first) * sizeof(uint64_t));
+
+		if (pread(_pagemap, entries, count * sizeof(uint64_t), offset) != static_cast<ssize_t>(count * sizeof(uint64_t)))
+		{
+			range.Tracked = false;
+			return;
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			if (entries[i] & PagemapSoftDirty)
+				range.Epochs[first + i] = _epoch;
+		}
+	}
+}
+
+#endif
+
+bool CDirtyTracker::Track(uintptr_t begin, size_t size)
+{
+	if (size == 0)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	Range_t range;
+
+	range.Begin = begin & ~static_cast<uintptr_t>(PageSize - 1);
+	range.End = (begin + size + PageSize - 1) & ~static_cast<uintptr_t>(PageSize - 1);
+	range.Epochs.resize((range.End - range.Begin) / PageSize);
+	range.Tracked = true;
+
+	// Nothing is known about earlier writes.
+	for (auto &epoch : range.Epochs)
+		epoch = _epoch;
+
+#ifdef _WIN32
+	// Fails unless the memory was allocated with `MEM_WRITE_WATCH`.
+	ULONG_PTR count = 0;
+	ULONG granularity;
+
+	range.Tracked = GetWriteWatch(0, reinterpret_cast<PVOID>(range.Begin), range.End - range.Begin, nullptr, &count, &granularity) == 0;
+#else
+	if (_pagemap < 0)
+	{
+		_pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+
+		if (_pagemap >= 0 && !ProbeSoftDirty(_pagemap))
+		{
+			close(_pagemap);
+			_pagemap = -1;
+		}
+	}
+
+	if (_clear_refs < 0)
+		_clear_refs = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+
+	range.Tracked = (_pagemap >= 0 && _clear_refs >= 0);
+#endif
+
+	bool tracked = range.Tracked;
+
+	auto it = std::lower_bound(_ranges.begin(), _ranges.end(), range.Begin, [](const Range_t &a, uintptr_t b)
+	{
+		return a.Begin < b;
+	});
+
+	size_t index = it - _ranges.begin();
+
+	_ranges.insert(_ranges.begin() + index, std::move(range));
+
+	if (!tracked)
+		SetError(ME_INVALID_MEMORY);
+
+	return tracked;
+}
+
+void CDirtyTracker::Untrack(uintptr_t begin)
+{
+	begin &= ~static_cast<uintptr_t>(PageSize - 1);
+
+	for (size_t i = 0; i < _ranges.size(); i++)
+	{
+		if (_ranges[i].Begin == begin)
+		{
+			_ranges.erase(_ranges.begin() + i);
+			return;
+		}
+	}
+}
+
+uint32_t CDirtyTracker::NextEpoch()
+{
+	for (auto &range : _ranges)
+		Sample(range, true);
+
+#ifndef _WIN32
+	// Clears the soft-dirty bits of the whole process.
+	if (_clear_refs >= 0 && pwrite(_clear_refs, "4", 1, 0) != 1)
+	{
+		for (auto &range : _ranges)
+			range.Tracked = false;
+	}
+#endif
+
+	return ++_epoch;
+}
+
+size_t CDirtyTracker::GetDirtyPages(uintptr_t begin, size_t size, uint32_t since, Memoria::Vector<uintptr_t> &pages)
+{
+	if (size == 0)
+		return 0;
+
+	uintptr_t first = begin & ~static_cast<uintptr_t>(PageSize - 1);
+	uintptr_t last = (begin + size - 1) & ~static_cast<uintptr_t>(PageSize - 1);
+
+	size_t count = 0;
+
+	for (uintptr_t page = first; page <= last && page >= first;)
+	{
+		auto it = std::upper_bound(_ranges.begin(), _ranges.end(), page, [](uintptr_t a, const Range_t &b)
+		{
+			return a < b.Begin;
+		});
+
+		Range_t *range = (it != _ranges.begin() && page < (it - 1)->End) ? it - 1 : nullptr;
+
+		if (!range)
+		{
+			// Untracked up to the next range.
+			uintptr_t end = (it != _ranges.end()) ? (std::min)(it->Begin, last + PageSize) : last + PageSize;
+
+			for (; page != end && page <= last && page >= first; page += PageSize, count++)
+			{
+				pages.push_back(page);
+			}
+
+			continue;
+		}
+
+		// Writes since the last epoch change belong to the current epoch.
+		Sample(*range, false);
+
+		for (; page < range->End && page <= last && page >= first; page += PageSize)
+		{
+			if (!range->Tracked || range->Epochs[(page - range->Begin) / PageSize] >= since)
+			{
+				pages.push_back(page);
+
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+
+void CDirtyTracker::Clear()
+{
+	_ranges.clear();
+}
+
+CDirtyTracker &GetDirtyTracker()
+{
+	static CDirtyTracker tracker;
+	return tracker;
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,379 @@
+#include "memoria_core_dump.hpp"
+
+#include "memoria_core_errors.hpp"
+#include "memoria_core_source.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MEMORIA_BEGIN
+
+// Readable memory is written straight from the module, this much at a time.
+static constexpr size_t DumpChunkSize = 4 * 1024 * 1024;
+
+// Zeros for the pages that cannot be read.
+static constexpr size_t DumpZeroSize = 64 * 1024;
+
+static constexpr size_t MaxDumpRegions = 65536;
+static constexpr size_t MaxDumpPath = 1024;
+
+//
+// Sidecar format
+//
+// Header: magic, version, format (4 bytes each), base, size (8 bytes each),
+// fingerprint size (4 bytes), fingerprint (32 bytes), region count (4 bytes).
+// Regions: begin, end (8 bytes each), protection (4 bytes: 1 readable, 2 writable, 4 executable).
+//
+
+// "MDMI"
+static constexpr uint32_t DumpInfoMagic = 0x494D444D;
+static constexpr uint32_t DumpInfoVersion = 1;
+
+static constexpr uint32_t DumpReadable = 1;
+static constexpr uint32_t DumpWritable = 2;
+static constexpr uint32_t DumpExecutable = 4;
+
+static FILE *OpenFile(const char *path, const char *mode)
+{
+#ifdef _MSC_VER
+	FILE *file = nullptr;
+	return (fopen_s(&file, path, mode) == 0) ? file : nullptr;
+#else
+	return fopen(path, mode);
+#endif
+}
+
+// `path` followed by the sidecar suffix. Returns `false` if it does not fit.
+static bool GetInfoPath(const char *path, char *out, size_t max_size)
+{
+	size_t length = strlen(path);
+	size_t suffix = strlen(ModuleDumpInfoSuffix);
+
+	if (length + suffix >= max_size)
+		return false;
+
+	memcpy(out, path, length);
+	memcpy(out + length, ModuleDumpInfoSuffix, suffix + 1);
+
+	return true;
+}
+
+// The regions of the current process that overlap [begin, end), clipped to it.
+static Memoria::Vector<ModuleDumpRegion_t> GetModuleRegions(uintptr_t begin, uintptr_t end)
+{
+	struct Context_t
+	{
+		uintptr_t Begin;
+		uintptr_t End;
+		Memoria::Vector<ModuleDumpRegion_t> Regions;
+	} context{ begin, end, {} };
+
+	EnumerateLocalRegions([](const MemoryRegion_t &region, void *param)
+	{
+		auto context = static_cast<Context_t *>(param);
+
+		if (region.End <= context->Begin)
+			return true;
+
+		if (region.Begin >= context->End || context->Regions.size() >= MaxDumpRegions)
+			return false;
+
+		ModuleDumpRegion_t entry;
+
+		entry.Begin = (std::max)(region.Begin, context->Begin) - context->Begin;
+		entry.End = (std::min)(region.End, context->End) - context->Begin;
+		entry.Readable = region.Readable;
+		entry.Writable = region.Writable;
+		entry.Executable = region.Executable;
+
+		if (context->Regions.size() == context->Regions.capacity())
+			context->Regions.reserve((std::max)(context->Regions.capacity() * 2, size_t(16)));
+
+		context->Regions.push_back(entry);
+		return true;
+	}, &context);
+
+	return std::move(context.Regions);
+}
+
+static bool WriteZeros(FILE *file, size_t size)
+{
+	static const uint8_t zeros[DumpZeroSize] = {};
+
+	for (size_t written = 0; written < size;)
+	{
+		size_t count = (std::min)(size - written, DumpZeroSize);
+
+		if (fwrite(zeros, 1, count, file) != count)
+			return false;
+
+		written += count;
+	}
+
+	return true;
+}
+
+// Writes [offset, end) of the module, the readable regions from memory and everything else as zeros.
+static bool WriteImage(FILE *file, const uint8_t *base, size_t offset, size_t end, std::span<const ModuleDumpRegion_t> regions)
+{
+	for (const auto &region : regions)
+	{
+		if (region.End <= offset || !region.Readable)
+			continue;
+
+		if (region.Begin >= end)
+			break;
+
+		size_t begin = (std::max)(static_cast<size_t>(region.Begin), offset);
+		size_t last = (std::min)(static_cast<size_t>(region.End), end);
+
+		if (!WriteZeros(file, begin - offset))
+			return false;
+
+		for (offset = begin; offset < last;)
+		{
+			size_t count = (std::min)(last - offset, DumpChunkSize);
+
+			if (fwrite(base + offset, 1, count, file) != count)
+				return false;
+
+			offset += count;
+		}
+	}
+
+	return WriteZeros(file, end > offset ? end - offset : 0);
+}
+
+static bool WriteInfo(const char *path, uint64_t base, uint64_t size, eModuleDumpFormat format,
+	std::span<const uint8_t> fingerprint, std::span<const ModuleDumpRegion_t> regions)
+{
+	FILE *file = OpenFile(path, "wb");
+
+	if (!file)
+		return false;
+
+	uint32_t header[3] = { DumpInfoMagic, DumpInfoVersion, static_cast<uint32_t>(format) };
+	uint64_t range[2] = { base, size };
+	uint8_t id[CModuleDump::MaxFingerprintSize] = {};
+	uint32_t id_size = static_cast<uint32_t>((std::min)(fingerprint.size(), sizeof(id)));
+	uint32_t count = static_cast<uint32_t>(regions.size());
+
+	memcpy(id, fingerprint.data(), id_size);
+
+	bool result = fwrite(header, sizeof(header), 1, file) == 1 &&
+		fwrite(range, sizeof(range), 1, file) == 1 &&
+		fwrite(&id_size, sizeof(id_size), 1, file) == 1 &&
+		fwrite(id, sizeof(id), 1, file) == 1 &&
+		fwrite(&count, sizeof(count), 1, file) == 1;
+
+	for (size_t i = 0; result && i < regions.size(); i++)
+	{
+		const auto &region = regions[i];
+
+		uint64_t bounds[2] = { region.Begin, region.End };
+		uint32_t protection = (region.Readable ? DumpReadable : 0) | (region.Writable ? DumpWritable : 0) |
+			(region.Executable ? DumpExecutable : 0);
+
+		result = fwrite(bounds, sizeof(bounds), 1, file) == 1 && fwrite(&protection, sizeof(protection), 1, file) == 1;
+	}
+
+	return (fclose(file) == 0) && result;
+}
+
+bool WriteModuleDump(const char *path, const void *base, size_t size, eModuleDumpFormat format,
+	std::span<const uint8_t> headers, std::span<const uint8_t> fingerprint)
+{
+	char info_path[MaxDumpPath];
+
+	if (!path || !base || size == 0 || headers.size() > size || !GetInfoPath(path, info_path, sizeof(info_path)))
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	auto begin = reinterpret_cast<uintptr_t>(base);
+	auto regions = GetModuleRegions(begin, begin + size);
+	FILE *file = OpenFile(path, "wb");
+
+	if (!file)
+	{
+		SetError(ME_NOT_FOUND);
+		return false;
+	}
+
+	// Large writes go to the file directly, the buffer would only add a copy.
+	setvbuf(file, nullptr, _IONBF, 0);
+
+	bool result = fwrite(headers.data(), 1, headers.size(), file) == headers.size() &&
+		WriteImage(file, static_cast<const uint8_t *>(base), headers.size(), size, { regions.data(), regions.size() });
+
+	result = (fclose(file) == 0) && result;
+
+	if (result)
+		result = WriteInfo(info_path, begin, size, format, fingerprint, { regions.data(), regions.size() });
+
+	if (!result)
+		SetError(ME_INVALID_MEMORY);
+
+	return result;
+}
+
+CModuleDump::~CModuleDump()
+{
+	Close();
+}
+
+bool CModuleDump::LoadInfo(const char *path)
+{
+	FILE *file = OpenFile(path, "rb");
+
+	if (!file)
+		return false;
+
+	uint32_t header[3];
+	uint64_t range[2];
+	uint32_t id_size;
+	uint32_t count;
+
+	bool result = fread(header, sizeof(header), 1, file) == 1 &&
+		header[0] == DumpInfoMagic && header[1] == DumpInfoVersion &&
+		fread(range, sizeof(range), 1, file) == 1 &&
+		fread(&id_size, sizeof(id_size), 1, file) == 1 && id_size <= MaxFingerprintSize &&
+		fread(_fingerprint, sizeof(_fingerprint), 1, file) == 1 &&
+		fread(&count, sizeof(count), 1, file) == 1 && count <= MaxDumpRegions;
+
+	if (result)
+	{
+		_format = static_cast<eModuleDumpFormat>(header[2]);
+		_base = range[0];
+		_size = static_cast<size_t>(range[1]);
+		_fingerprint_size = id_size;
+		_regions.reserve(count);
+	}
+
+	for (uint32_t i = 0; result && i < count; i++)
+	{
+		uint64_t bounds[2];
+		uint32_t protection;
+
+		result = fread(bounds, sizeof(bounds), 1, file) == 1 && fread(&protection, sizeof(protection), 1, file) == 1 &&
+			bounds[0] < bounds[1] && bounds[1] <= range[1];
+
+		if (result)
+			_regions.push_back({ bounds[0], bounds[1], (protection & DumpReadable) != 0, (protection & DumpWritable) != 0, (protection & DumpExecutable) != 0 });
+	}
+
+	fclose(file);
+	return result && range[1] == _size && _size > 0;
+}
+
+bool CModuleDump::Load(const char *path)
+{
+	Close();
+
+	char info_path[MaxDumpPath];
+
+	if (!path || !GetInfoPath(path, info_path, sizeof(info_path)) || !LoadInfo(info_path))
+	{
+		Close();
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	// At the original base if that range is free, anywhere otherwise.
+	auto hint = reinterpret_cast<void *>(static_cast<uintptr_t>(_base));
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	LARGE_INTEGER file_size{};
+
+	if (file != INVALID_HANDLE_VALUE && GetFileSizeEx(file, &file_size) && static_cast<uint64_t>(file_size.QuadPart) >= _size)
+		_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	if (_mapping)
+	{
+		_view = MapViewOfFileEx(_mapping, FILE_MAP_READ, 0, 0, _size, hint);
+
+		if (!_view)
+			_view = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, _size);
+	}
+#else
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	struct stat info;
+
+	if (fd >= 0 && fstat(fd, &info) == 0 && static_cast<uint64_t>(info.st_size) >= _size)
+	{
+		// Without MAP_FIXED the address is a hint, and nothing already mapped there is replaced.
+		void *view = mmap(hint, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+		_view = (view != MAP_FAILED) ? view : nullptr;
+	}
+
+	if (fd >= 0)
+		close(fd);
+#endif
+
+	if (!_view)
+	{
+		Close();
+		SetError(ME_INVALID_MEMORY);
+		return false;
+	}
+
+	return true;
+}
+
+void CModuleDump::Close()
+{
+#ifdef _WIN32
+	if (_view)
+		UnmapViewOfFile(_view);
+
+	if (_mapping)
+		CloseHandle(_mapping);
+
+	_mapping = nullptr;
+#else
+	if (_view)
+		munmap(_view, _size);
+#endif
+
+	_view = nullptr;
+	_size = 0;
+	_format = eModuleDumpFormat::Unknown;
+	_base = 0;
+	_fingerprint_size = 0;
+	_regions = Memoria::Vector<ModuleDumpRegion_t>();
+}
+
+const void *CModuleDump::ToView(uint64_t address) const
+{
+	if (!_view || address < _base || address - _base >= _size)
+		return nullptr;
+
+	return static_cast<const uint8_t *>(_view) + (address - _base);
+}
+
+uint64_t CModuleDump::ToOriginal(const void *address) const
+{
+	auto offset = reinterpret_cast<uintptr_t>(address) - reinterpret_cast<uintptr_t>(_view);
+
+	if (!_view || reinterpret_cast<uintptr_t>(address) < reinterpret_cast<uintptr_t>(_view) || offset >= _size)
+		return 0;
+
+	return _base + offset;
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,626 @@
+#include "memoria_core_elf.hpp"
+
+#ifndef _WIN32
+
+#include "memoria_core_errors.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <unistd.h>
+
+MEMORIA_BEGIN
+
+// Limits for the section headers read from a file, which is not trusted.
+static constexpr size_t MaxElfSections = 4096;
+static constexpr size_t MaxElfStringTable = 1 << 20;
+
+// The class of the objects the process can load.
+static constexpr unsigned char ElfClass = (sizeof(void *) == 8) ? ELFCLASS64 : ELFCLASS32;
+
+static void CopyName(char *out, size_t max_size, const char *name)
+{
+	size_t length = name ? strnlen(name, max_size - 1) : 0;
+
+	memcpy(out, name, length);
+	out[length] = '\0';
+}
+
+static ElfModule_t MakeModule(const dl_phdr_info *info)
+{
+	ElfModule_t module{};
+
+	module.Bias = info->dlpi_addr;
+	module.Begin = UINTPTR_MAX;
+
+	for (size_t i = 0; i < info->dlpi_phnum; i++)
+	{
+		const auto &phdr = info->dlpi_phdr[i];
+
+		if (phdr.p_type != PT_LOAD)
+			continue;
+
+		module.Begin = (std::min)(module.Begin, static_cast<uintptr_t>(info->dlpi_addr + phdr.p_vaddr));
+		module.End = (std::max)(module.End, static_cast<uintptr_t>(info->dlpi_addr + phdr.p_vaddr + phdr.p_memsz));
+	}
+
+	if (module.Begin > module.End)
+		module.Begin = module.End = 0;
+
+	CopyName(module.Path, sizeof(module.Path), info->dlpi_name);
+	return module;
+}
+
+// Whether `info` still describes the object `module` was made from.
+static bool IsSameModule(const dl_phdr_info *info, const ElfModule_t &module)
+{
+	if (info->dlpi_addr != module.Bias)
+		return false;
+
+	auto current = MakeModule(info);
+	return current.Begin == module.Begin && current.End == module.End;
+}
+
+//
+// Enumeration
+//
+
+size_t EnumerateElfModules(ElfModuleCallback_t cb, void *param)
+{
+	if (!cb)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return 0;
+	}
+
+	struct Context_t
+	{
+		ElfModuleCallback_t Callback;
+		void *Param;
+		size_t Count;
+	} context{ cb, param, 0 };
+
+	dl_iterate_phdr([](dl_phdr_info *info, size_t, void *data) -> int
+	{
+		auto context = static_cast<Context_t *>(data);
+		auto module = MakeModule(info);
+
+		if (module.Begin == module.End)
+			return 0;
+
+		context->Count++;
+		return context->Callback(module, context->Param) ? 0 : 1;
+	}, &context);
+
+	return context.Count;
+}
+
+//
+// Segment table
+//
+
+struct ElfCache_t
+{
+	struct Segment_t
+	{
+		uintptr_t Begin;
+		uintptr_t End;
+		uint32_t Module;
+	};
+
+	std::mutex Lock;
+
+	Memoria::Vector<ElfModule_t> Modules{};
+
+	// Sorted by address. Segments of loaded objects do not overlap.
+	Memoria::Vector<Segment_t> Segments{};
+
+	// The loader's counters of objects added and removed when the table was built.
+	unsigned long long Adds = 0;
+	unsigned long long Subs = 0;
+	bool Built = false;
+};
+
+static ElfCache_t &GetElfCache()
+{
+	static ElfCache_t cache;
+	return cache;
+}
+
+bool GetElfLoaderCounters(unsigned long long &adds, unsigned long long &subs)
+{
+	// Every object reports the same counters, so only the first is visited.
+	struct Counters_t
+	{
+		unsigned long long Adds;
+		unsigned long long Subs;
+		bool Valid;
+	} counters{};
+
+	dl_iterate_phdr([](dl_phdr_info *info, size_t size, void *data) -> int
+	{
+		auto counters = static_cast<Counters_t *>(data);
+
+		if (size >= offsetof(dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs))
+		{
+			counters->Adds = info->dlpi_adds;
+			counters->Subs = info->dlpi_subs;
+			counters->Valid = true;
+		}
+
+		return 1;
+	}, &counters);
+
+	adds = counters.Adds;
+	subs = counters.Subs;
+
+	return counters.Valid;
+}
+
+static void BuildSegmentTable(ElfCache_t &cache)
+{
+	cache.Modules = Memoria::Vector<ElfModule_t>();
+	cache.Segments = Memoria::Vector<ElfCache_t::Segment_t>();
+
+	dl_iterate_phdr([](dl_phdr_info *info, size_t, void *data) -> int
+	{
+		auto &cache = *static_cast<ElfCache_t *>(data);
+		auto module = MakeModule(info);
+
+		if (module.Begin == module.End)
+			return 0;
+
+		auto index = static_cast<uint32_t>(cache.Modules.size());
+
+		cache.Modules.push_back(module);
+
+		for (size_t i = 0; i < info->dlpi_phnum; i++)
+		{
+			const auto &phdr = info->dlpi_phdr[i];
+
+			if (phdr.p_type != PT_LOAD || !phdr.p_memsz)
+				continue;
+
+			uintptr_t begin = info->dlpi_addr + phdr.p_vaddr;
+
+			cache.Segments.push_back({ begin, begin + phdr.p_memsz, index });
+		}
+
+		return 0;
+	}, &cache);
+
+	std::sort(cache.Segments.begin(), cache.Segments.end(), [](const auto &a, const auto &b)
+	{
+		return a.Begin < b.Begin;
+	});
+}
+
+bool FindElfModule(const void *address, ElfModule_t &out)
+{
+	auto &cache = GetElfCache();
+	auto target = reinterpret_cast<uintptr_t>(address);
+
+	std::lock_guard<std::mutex> guard(cache.Lock);
+
+	unsigned long long adds, subs;
+	bool counted = GetElfLoaderCounters(adds, subs);
+
+	// Without the counters there is no way to tell that the table is still current.
+	if (!cache.Built || !counted || adds != cache.Adds || subs != cache.Subs)
+	{
+		BuildSegmentTable(cache);
+
+		cache.Adds = adds;
+		cache.Subs = subs;
+		cache.Built = true;
+	}
+
+	// The last segment that begins at or before the address.
+	auto it = std::upper_bound(cache.Segments.begin(), cache.Segments.end(), target, [](uintptr_t value, const auto &segment)
+	{
+		return value < segment.Begin;
+	});
+
+	if (it == cache.Segments.begin() || target >= (it - 1)->End)
+	{
+		SetError(ME_NOT_FOUND);
+		return false;
+	}
+
+	out = cache.Modules[(it - 1)->Module];
+	return true;
+}
+
+bool FindElfModule(const char *name, ElfModule_t &out)
+{
+	if (!name)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	struct Context_t
+	{
+		const char *Name;
+		ElfModule_t *Out;
+		bool Found;
+	} context{ name, &out, false };
+
+	EnumerateElfModules([](const ElfModule_t &module, void *param) -> bool
+	{
+		auto context = static_cast<Context_t *>(param);
+
+		// The main program comes first and has no path.
+		if (*context->Name)
+		{
+			auto slash = strrchr(module.Path, '/');
+
+			if (strcmp(slash ? slash + 1 : module.Path, context->Name) != 0)
+				return true;
+		}
+
+		*context->Out = module;
+		context->Found = true;
+
+		return false;
+	}, &context);
+
+	if (!context.Found)
+		SetError(ME_NOT_FOUND);
+
+	return context.Found;
+}
+
+//
+// CElfImage
+//
+
+void CElfImage::ReadProgramHeaders(uintptr_t bias, const void *headers, size_t count)
+{
+	auto phdrs = static_cast<const ElfW(Phdr) *>(headers);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto &phdr = phdrs[i];
+		uintptr_t begin = bias + phdr.p_vaddr;
+
+		_headers.push_back({ phdr.p_type, phdr.p_flags, begin, phdr.p_memsz });
+
+		if (phdr.p_type == PT_LOAD)
+		{
+			_segments.push_back({ begin, begin + phdr.p_memsz,
+				(phdr.p_flags & PF_R) != 0, (phdr.p_flags & PF_W) != 0, (phdr.p_flags & PF_X) != 0 });
+
+			continue;
+		}
+
+		if (phdr.p_type != PT_NOTE || _build_id_size)
+			continue;
+
+		// Notes are padded to 8 bytes in segments aligned to 8, to 4 bytes otherwise.
+		size_t align = (phdr.p_align == 8) ? 8 : 4;
+		size_t offset = 0;
+
+		while (phdr.p_memsz - offset >= sizeof(ElfW(Nhdr)))
+		{
+			auto note = reinterpret_cast<const ElfW(Nhdr) *>(begin + offset);
+			auto name = reinterpret_cast<const char *>(note + 1);
+
+			size_t name_size = (note->n_namesz + align - 1) & ~(align - 1);
+			size_t desc_size = (note->n_descsz + align - 1) & ~(align - 1);
+
+			if (phdr.p_memsz - offset - sizeof(ElfW(Nhdr)) < name_size + desc_size)
+				break;
+
+			if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 && memcmp(name, "GNU", 4) == 0 &&
+				note->n_descsz <= MaxBuildIdSize)
+			{
+				memcpy(_build_id, name + name_size, note->n_descsz);
+				_build_id_size = note->n_descsz;
+				break;
+			}
+
+			offset += sizeof(ElfW(Nhdr)) + name_size + desc_size;
+		}
+	}
+}
+
+bool CElfImage::Parse(const ElfModule_t &module)
+{
+	Clear();
+
+	struct Context_t
+	{
+		CElfImage *Image;
+		const ElfModule_t *Module;
+	} context{ this, &module };
+
+	dl_iterate_phdr([](dl_phdr_info *info, size_t, void *data) -> int
+	{
+		auto context = static_cast<Context_t *>(data);
+		auto image = context->Image;
+
+		if (!IsSameModule(info, *context->Module))
+			return 0;
+
+		image->_module = MakeModule(info);
+		image->_valid = true;
+		image->ReadProgramHeaders(info->dlpi_addr, info->dlpi_phdr, info->dlpi_phnum);
+
+		return 1;
+	}, &context);
+
+	if (!_valid)
+	{
+		SetError(ME_NOT_FOUND);
+		return false;
+	}
+
+	LoadSections();
+	return true;
+}
+
+// The program headers of the object whose lowest segment starts at `base`, if they lie in the `size` bytes there.
+static const ElfW(Phdr) *GetMappedProgramHeaders(const void *base, size_t size, size_t &count, uintptr_t &low)
+{
+	ElfW(Ehdr) header;
+
+	if (size < sizeof(header))
+		return nullptr;
+
+	memcpy(&header, base, sizeof(header));
+
+	if (memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ElfClass ||
+		header.e_phentsize != sizeof(ElfW(Phdr)) || header.e_phoff > size ||
+		(size - header.e_phoff) / sizeof(ElfW(Phdr)) < header.e_phnum ||
+		header.e_phoff % alignof(ElfW(Phdr)) != 0)
+	{
+		return nullptr;
+	}
+
+	auto phdrs = reinterpret_cast<const ElfW(Phdr) *>(static_cast<const uint8_t *>(base) + header.e_phoff);
+
+	count = header.e_phnum;
+	low = UINTPTR_MAX;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (phdrs[i].p_type == PT_LOAD)
+			low = (std::min)(low, static_cast<uintptr_t>(phdrs[i].p_vaddr));
+	}
+
+	return (low != UINTPTR_MAX) ? phdrs : nullptr;
+}
+
+bool CElfImage::ParseMapped(const void *base, size_t size)
+{
+	Clear();
+
+	size_t count;
+	uintptr_t low;
+	auto phdrs = base ? GetMappedProgramHeaders(base, size, count, low) : nullptr;
+
+	if (!phdrs)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	uintptr_t begin = reinterpret_cast<uintptr_t>(base);
+
+	// Every segment must lie in the mapping, which is not trusted to match its headers.
+	for (size_t i = 0; i < count; i++)
+	{
+		if (phdrs[i].p_vaddr < low || phdrs[i].p_vaddr - low > size || size - (phdrs[i].p_vaddr - low) < phdrs[i].p_memsz)
+		{
+			SetError(ME_INVALID_ARGUMENT);
+			return false;
+		}
+	}
+
+	_module.Bias = begin - low;
+	_module.Begin = begin;
+	_module.End = begin + size;
+	_valid = true;
+
+	ReadProgramHeaders(_module.Bias, phdrs, count);
+	return true;
+}
+
+bool CElfImage::RealignHeaders(std::span<uint8_t> headers) const
+{
+	size_t count;
+	uintptr_t low;
+
+	if (!_valid || !GetMappedProgramHeaders(headers.data(), headers.size(), count, low))
+		return false;
+
+	ElfW(Ehdr) header;
+	memcpy(&header, headers.data(), sizeof(header));
+
+	for (size_t i = 0; i < count; i++)
+	{
+		auto at = headers.data() + header.e_phoff + i * sizeof(ElfW(Phdr));
+
+		ElfW(Phdr) phdr;
+		memcpy(&phdr, at, sizeof(phdr));
+
+		// Segments that are not loaded (PT_GNU_STACK) keep their offsets.
+		if (phdr.p_vaddr >= low && (phdr.p_type != PT_NULL && phdr.p_type != PT_GNU_STACK))
+		{
+			phdr.p_offset = phdr.p_vaddr - low;
+
+			if (phdr.p_type == PT_LOAD)
+				phdr.p_filesz = phdr.p_memsz;
+		}
+
+		memcpy(at, &phdr, sizeof(phdr));
+	}
+
+	// The section headers are not in memory.
+	header.e_shoff = 0;
+	header.e_shnum = 0;
+	header.e_shstrndx = SHN_UNDEF;
+
+	memcpy(headers.data(), &header, sizeof(header));
+	return true;
+}
+
+void CElfImage::LoadSections()
+{
+	// The main program has no path of its own.
+	int fd = open(*_module.Path ? _module.Path : "/proc/self/exe", O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return;
+
+	ElfW(Ehdr) header;
+	Memoria::Vector<ElfW(Shdr)> headers{};
+	Memoria::Vector<char> strings{};
+
+	auto read_at = [fd](void *buffer, size_t size, uint64_t offset)
+	{
+		return pread(fd, buffer, size, static_cast<off_t>(offset)) == static_cast<ssize_t>(size);
+	};
+
+	bool valid = read_at(&header, sizeof(header), 0) &&
+		memcmp(header.e_ident, ELFMAG, SELFMAG) == 0 &&
+		header.e_shoff != 0 &&
+		header.e_shentsize == sizeof(ElfW(Shdr));
+
+	size_t count = valid ? header.e_shnum : 0;
+	size_t strings_index = valid ? header.e_shstrndx : 0;
+
+	// With 0xFF00 sections or more, the counts are kept in the first section header.
+	if (valid && (count == 0 || strings_index == SHN_XINDEX))
+	{
+		ElfW(Shdr) first;
+
+		valid = read_at(&first, sizeof(first), header.e_shoff);
+
+		if (valid && count == 0)
+			count = first.sh_size;
+
+		if (valid && strings_index == SHN_XINDEX)
+			strings_index = first.sh_link;
+	}
+
+	if (valid && count > 0 && count <= MaxElfSections && strings_index < count)
+	{
+		headers = Memoria::Vector<ElfW(Shdr)>(count);
+		valid = read_at(headers.data(), count * sizeof(ElfW(Shdr)), header.e_shoff);
+
+		const auto &table = headers[strings_index];
+
+		if (valid && table.sh_size > 0 && table.sh_size <= MaxElfStringTable)
+		{
+			strings = Memoria::Vector<char>(table.sh_size + 1);
+			valid = read_at(strings.data(), table.sh_size, table.sh_offset);
+			strings[table.sh_size] = '\0';
+		}
+		else
+		{
+			valid = false;
+		}
+	}
+	else
+	{
+		valid = false;
+	}
+
+	close(fd);
+
+	if (!valid)
+		return;
+
+	for (const auto &section : headers)
+	{
+		if (!(section.sh_flags & SHF_ALLOC) || !section.sh_addr || section.sh_name >= strings.size())
+			continue;
+
+		ElfSection_t entry{};
+
+		CopyName(entry.Name, sizeof(entry.Name), &strings[section.sh_name]);
+		entry.Address = _module.Bias + section.sh_addr;
+		entry.Size = section.sh_size;
+		entry.Type = section.sh_type;
+		entry.Flags = section.sh_flags;
+
+		_sections.push_back(entry);
+	}
+}
+
+void CElfImage::Clear()
+{
+	_module = {};
+	_valid = false;
+
+	_segments = Memoria::Vector<ElfSegment_t>();
+	_headers = Memoria::Vector<ElfProgramHeader_t>();
+	_sections = Memoria::Vector<ElfSection_t>();
+
+	_build_id_size = 0;
+}
+
+const ElfSection_t *CElfImage::FindSection(const char *name) const
+{
+	for (const auto &section : _sections)
+	{
+		if (strcmp(section.Name, name) == 0)
+			return &section;
+	}
+
+	return nullptr;
+}
+
+const ElfSection_t *CElfImage::FindSection(const void *address) const
+{
+	auto target = reinterpret_cast<uintptr_t>(address);
+
+	for (const auto &section : _sections)
+	{
+		// SHT_NOBITS sections such as .tbss may share their address with the next section.
+		if (section.Type != SHT_NOBITS && target >= section.Address && target - section.Address < section.Size)
+			return &section;
+	}
+
+	for (const auto &section : _sections)
+	{
+		if (target >= section.Address && target - section.Address < section.Size)
+			return &section;
+	}
+
+	return nullptr;
+}
+
+const ElfSegment_t *CElfImage::FindSegment(const void *address) const
+{
+	auto target = reinterpret_cast<uintptr_t>(address);
+
+	for (const auto &segment : _segments)
+	{
+		if (target >= segment.Begin && target < segment.End)
+			return &segment;
+	}
+
+	return nullptr;
+}
+
+const ElfProgramHeader_t *CElfImage::FindProgramHeader(uint32_t type) const
+{
+	for (const auto &header : _headers)
+	{
+		if (header.Type == type)
+			return &header;
+	}
+
+	return nullptr;
+}
+
+MEMORIA_END
+
+#endif
\ No newline at end of file
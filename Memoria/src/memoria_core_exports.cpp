@@ -0,0 +1,405 @@
+#include "memoria_core_exports.hpp"
+
+#include "memoria_core_errors.hpp"
+#include "memoria_core_hash.hpp"
+#include "memoria_core_modules.hpp"
+#include "memoria_core_pe_iter.hpp"
+#include "memoria_core_workers.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+MEMORIA_BEGIN
+
+// Forwarders may lead to other forwarders. Real chains are one or two links long.
+static constexpr size_t MaxForwarderDepth = 8;
+
+// Upper bound for the function and name counts of an export directory, since ordinals are 16 bits.
+static constexpr uint32_t MaxExports = 0x10000;
+
+//
+// CExportIndex
+//
+
+bool CExportIndex::Build(const CPeImage &image)
+{
+	Clear();
+
+	const auto &directory = image.GetDirectory(ePeDirectory::Export);
+	PeExportDirectory_t header;
+
+	if (!directory.VirtualAddress || !image.Read(directory.VirtualAddress, header))
+		return false;
+
+	if (!header.NumberOfFunctions || header.NumberOfFunctions > MaxExports || header.NumberOfNames > MaxExports)
+		return false;
+
+	auto functions = image.GetPointer(header.AddressOfFunctions, header.NumberOfFunctions * sizeof(uint32_t));
+
+	if (!functions)
+		return false;
+
+	_functions = Memoria::Vector<uint32_t>(header.NumberOfFunctions);
+	memcpy(_functions.data(), functions, header.NumberOfFunctions * sizeof(uint32_t));
+
+	_entries.reserve(header.NumberOfNames);
+
+	for (const auto &entry : CPeExports(image))
+		_entries.push_back({ FNV1a64(entry.Name), entry.Rva, static_cast<uint16_t>(entry.Ordinal - header.Base) });
+
+	std::stable_sort(_entries.begin(), _entries.end(), [](const ExportEntry_t &a, const ExportEntry_t &b)
+	{
+		return a.NameHash < b.NameHash;
+	});
+
+	_ordinal_base = header.Base;
+	_directory_begin = directory.VirtualAddress;
+	_directory_end = directory.VirtualAddress + directory.Size;
+
+	return true;
+}
+
+void CExportIndex::Clear()
+{
+	_entries = Memoria::Vector<ExportEntry_t>();
+	_functions = Memoria::Vector<uint32_t>();
+
+	_ordinal_base = 0;
+	_directory_begin = _directory_end = 0;
+}
+
+std::span<const ExportEntry_t> CExportIndex::FindAll(uint64_t name_hash) const
+{
+	auto [first, last] = std::equal_range(_entries.begin(), _entries.end(), ExportEntry_t{ name_hash, 0, 0 },
+		[](const ExportEntry_t &a, const ExportEntry_t &b)
+	{
+		return a.NameHash < b.NameHash;
+	});
+
+	return { first, static_cast<size_t>(last - first) };
+}
+
+const ExportEntry_t *CExportIndex::Find(uint64_t name_hash) const
+{
+	auto entries = FindAll(name_hash);
+	return entries.empty() ? nullptr : entries.data();
+}
+
+uint32_t CExportIndex::FindOrdinal(uint32_t ordinal) const
+{
+	if (ordinal < _ordinal_base || ordinal - _ordinal_base >= _functions.size())
+		return 0;
+
+	return _functions[ordinal - _ordinal_base];
+}
+
+size_t BuildExportIndexes(std::span<const CPeImage *const> images, std::span<CExportIndex> out, size_t workers)
+{
+	size_t count = (std::min)(images.size(), out.size());
+	std::atomic<size_t> next{ 0 };
+	std::atomic<size_t> built{ 0 };
+
+	RunWorkers((std::min)(GetWorkerCount(workers), count), [&]()
+	{
+		for (size_t i; (i = next.fetch_add(1)) < count;)
+		{
+			if (images[i] ? out[i].Build(*images[i]) : (out[i].Clear(), false))
+				built.fetch_add(1);
+		}
+	});
+
+	return built.load();
+}
+
+//
+// Cache of the loaded modules
+//
+
+struct CachedModule_t
+{
+	ModuleRecord_t Module;
+	CExportIndex Index;
+
+	// Addresses of the entries of `Index` once resolved, 0 before.
+	Memoria::Vector<uintptr_t> Resolved;
+
+	bool Built;
+};
+
+struct GlobalExport_t
+{
+	uint64_t NameHash;
+	uint32_t Module;
+	uint32_t Entry;
+};
+
+struct ExportCache_t
+{
+	std::mutex Lock;
+
+	// The registry version `Modules` matches.
+	uint64_t Version = 0;
+
+	// In load order.
+	Memoria::Vector<std::unique_ptr<CachedModule_t>> Modules{};
+
+	// Every named export of every module, sorted by hash, then in load order.
+	Memoria::Vector<GlobalExport_t> Global{};
+	bool GlobalBuilt = false;
+};
+
+static ExportCache_t &GetExportCache()
+{
+	static ExportCache_t cache;
+	return cache;
+}
+
+// Brings the module list up to date with the registry, keeping the indexes of the modules still loaded.
+static void SyncModules(ExportCache_t &cache)
+{
+	auto &registry = GetModuleRegistry();
+
+	if (cache.Version && registry.GetVersion() == cache.Version)
+		return;
+
+	Memoria::Vector<ModuleRecord_t> modules{};
+	Memoria::Vector<std::unique_ptr<CachedModule_t>> cached{};
+	size_t kept = 0;
+
+	cache.Version = registry.GetModules(modules);
+	cached.reserve(modules.size());
+
+	for (const auto &module : modules)
+	{
+		auto it = std::find_if(cache.Modules.begin(), cache.Modules.end(), [&module](const auto &entry)
+		{
+			return entry && entry->Module.Base == module.Base && entry->Module.Size == module.Size && entry->Module.NameHash == module.NameHash;
+		});
+
+		if (it != cache.Modules.end())
+		{
+			cached.push_back(std::move(*it));
+			kept++;
+			continue;
+		}
+
+		auto entry = std::make_unique<CachedModule_t>();
+		entry->Module = module;
+
+		cached.push_back(std::move(entry));
+	}
+
+	// A forwarder resolved earlier may lead into a module that is gone.
+	if (kept != cache.Modules.size())
+	{
+		for (auto &module : cached)
+		{
+			for (auto &address : module->Resolved)
+				address = 0;
+		}
+	}
+
+	cache.Modules = std::move(cached);
+	cache.Global = Memoria::Vector<GlobalExport_t>();
+	cache.GlobalBuilt = false;
+}
+
+static CachedModule_t &BuildModule(CachedModule_t &module)
+{
+	if (module.Built)
+		return module;
+
+	CPeImage image;
+
+	if (image.ParseMapped(reinterpret_cast<const void *>(module.Module.Base)))
+		module.Index.Build(image);
+
+	module.Resolved = Memoria::Vector<uintptr_t>(module.Index.GetEntries().size());
+	module.Built = true;
+
+	return module;
+}
+
+static CachedModule_t *FindModule(ExportCache_t &cache, uint64_t name_hash)
+{
+	for (auto &module : cache.Modules)
+	{
+		if (module->Module.NameHash == name_hash)
+			return &BuildModule(*module);
+	}
+
+	return nullptr;
+}
+
+static void BuildGlobal(ExportCache_t &cache)
+{
+	if (cache.GlobalBuilt)
+		return;
+
+	Memoria::Vector<CachedModule_t *> pending{};
+
+	for (auto &module : cache.Modules)
+	{
+		if (!module->Built)
+		{
+			pending.push_back(module.get());
+		}
+	}
+
+	// The headers are parsed here and the export directories, where the time goes, on every core.
+	if (!pending.empty())
+	{
+		Memoria::Vector<CPeImage> images(pending.size());
+		Memoria::Vector<const CPeImage *> parsed(pending.size());
+		Memoria::Vector<CExportIndex> indexes(pending.size());
+
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			if (images[i].ParseMapped(reinterpret_cast<const void *>(pending[i]->Module.Base)))
+				parsed[i] = &images[i];
+		}
+
+		BuildExportIndexes({ parsed.data(), parsed.size() }, { indexes.data(), indexes.size() });
+
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			pending[i]->Index = std::move(indexes[i]);
+			pending[i]->Resolved = Memoria::Vector<uintptr_t>(pending[i]->Index.GetEntries().size());
+			pending[i]->Built = true;
+		}
+	}
+
+	size_t count = 0;
+
+	for (auto &module : cache.Modules)
+		count += module->Index.GetEntries().size();
+
+	cache.Global = Memoria::Vector<GlobalExport_t>();
+	cache.Global.reserve(count);
+
+	for (size_t i = 0; i < cache.Modules.size(); i++)
+	{
+		auto entries = cache.Modules[i]->Index.GetEntries();
+
+		for (size_t j = 0; j < entries.size(); j++)
+			cache.Global.push_back({ entries[j].NameHash, static_cast<uint32_t>(i), static_cast<uint32_t>(j) });
+	}
+
+	// Stable, so that modules loaded first come first.
+	std::stable_sort(cache.Global.begin(), cache.Global.end(), [](const GlobalExport_t &a, const GlobalExport_t &b)
+	{
+		return a.NameHash < b.NameHash;
+	});
+
+	cache.GlobalBuilt = true;
+}
+
+static uintptr_t ResolveEntry(ExportCache_t &cache, CachedModule_t &module, size_t index, size_t depth);
+
+// Follows `rva` of `module` to an address, through forwarders if needed.
+static uintptr_t ResolveRva(ExportCache_t &cache, CachedModule_t &module, uint32_t rva, size_t depth)
+{
+	if (!module.Index.IsForwarder(rva))
+		return module.Module.Base + rva;
+
+	if (depth >= MaxForwarderDepth)
+		return 0;
+
+	auto forwarder = reinterpret_cast<const char *>(module.Module.Base + rva);
+	auto dot = strrchr(forwarder, '.');
+
+	// "MODULE.Function" or "MODULE.#Ordinal", the module named without its extension.
+	// Forwarders to API sets name no loaded module and are not resolved.
+	char module_name[256];
+	size_t length = dot ? static_cast<size_t>(dot - forwarder) : 0;
+
+	if (!length || length + sizeof(".dll") > sizeof(module_name))
+		return 0;
+
+	memcpy(module_name, forwarder, length);
+	memcpy(module_name + length, ".dll", sizeof(".dll"));
+
+	auto target = FindModule(cache, FNV1a64(module_name));
+
+	if (!target)
+		return 0;
+
+	if (dot[1] == '#')
+	{
+		uint32_t target_rva = target->Index.FindOrdinal(static_cast<uint32_t>(strtoul(dot + 2, nullptr, 10)));
+		return target_rva ? ResolveRva(cache, *target, target_rva, depth + 1) : 0;
+	}
+
+	auto entries = target->Index.GetEntries();
+
+	for (const auto &entry : target->Index.FindAll(FNV1a64(dot + 1)))
+	{
+		if (auto address = ResolveEntry(cache, *target, &entry - entries.data(), depth + 1))
+			return address;
+	}
+
+	return 0;
+}
+
+static uintptr_t ResolveEntry(ExportCache_t &cache, CachedModule_t &module, size_t index, size_t depth)
+{
+	if (module.Resolved[index])
+		return module.Resolved[index];
+
+	uintptr_t address = ResolveRva(cache, module, module.Index.GetEntries()[index].Rva, depth);
+
+	// Failures are not kept: the module a forwarder leads to may be loaded later.
+	module.Resolved[index] = address;
+	return address;
+}
+
+void *FindExport(uint64_t module_name_hash, uint64_t function_name_hash)
+{
+	auto &cache = GetExportCache();
+
+	std::lock_guard<std::mutex> guard(cache.Lock);
+
+	SyncModules(cache);
+
+	if (module_name_hash != 0)
+	{
+		auto module = FindModule(cache, module_name_hash);
+
+		if (module)
+		{
+			auto entries = module->Index.GetEntries();
+
+			for (const auto &entry : module->Index.FindAll(function_name_hash))
+			{
+				if (auto address = ResolveEntry(cache, *module, &entry - entries.data(), 0))
+					return reinterpret_cast<void *>(address);
+			}
+		}
+	}
+	else
+	{
+		BuildGlobal(cache);
+
+		auto [first, last] = std::equal_range(cache.Global.begin(), cache.Global.end(), GlobalExport_t{ function_name_hash, 0, 0 },
+			[](const GlobalExport_t &a, const GlobalExport_t &b)
+		{
+			return a.NameHash < b.NameHash;
+		});
+
+		// The first module with the name wins, unless its export is a forwarder that leads nowhere.
+		for (auto it = first; it != last; ++it)
+		{
+			if (auto address = ResolveEntry(cache, *cache.Modules[it->Module], it->Entry, 0))
+				return reinterpret_cast<void *>(address);
+		}
+	}
+
+	SetError(ME_NOT_FOUND);
+	return nullptr;
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,512 @@
+#include "memoria_core_functions.hpp"
+
+#include "memoria_core_errors.hpp"
+#include "memoria_core_module_cache.hpp"
+
+#ifndef _WIN32
+#include <elf.h>
+#endif
+
+#include <string.h>
+#include <algorithm>
+#include <bit>
+
+MEMORIA_BEGIN
+
+// `Primary` of an entry before `Finish`: the `Begin` of the entry it is chained to, or this value if none.
+static constexpr uint32_t NotChained = UINT32_MAX;
+
+// Chained entries lead to the primary one in a step or two. Longer chains are malformed.
+static constexpr size_t MaxChainDepth = 32;
+
+// Sizes of a RUNTIME_FUNCTION entry.
+static constexpr size_t PdataEntryX64 = 12;
+static constexpr size_t PdataEntryArm64 = 8;
+
+//
+// CFunctionIndex
+//
+
+// Fills `keys` and `order` from `entries[next...]` in the order of an in-order walk of the implicit tree rooted at `k`.
+static size_t FillEytzinger(const Memoria::Vector<FunctionEntry_t> &entries, Memoria::Vector<uint32_t> &keys,
+	Memoria::Vector<uint32_t> &order, size_t next, size_t k)
+{
+	if (k > entries.size())
+		return next;
+
+	next = FillEytzinger(entries, keys, order, next, 2 * k);
+
+	keys[k] = entries[next].Begin;
+	order[k] = static_cast<uint32_t>(next);
+
+	return FillEytzinger(entries, keys, order, next + 1, 2 * k + 1);
+}
+
+void CFunctionIndex::Finish()
+{
+	std::sort(_entries.begin(), _entries.end(), [](const FunctionEntry_t &a, const FunctionEntry_t &b)
+	{
+		return a.Begin < b.Begin;
+	});
+
+	size_t count = _entries.size();
+
+	// 1-based, slot 0 unused.
+	_keys = Memoria::Vector<uint32_t>(count + 1);
+	_order = Memoria::Vector<uint32_t>(count + 1);
+
+	FillEytzinger(_entries, _keys, _order, 0, 1);
+
+	// `Primary` holds the `Begin` the entry is chained to; turn it into the index of the entry the chain ends at.
+	Memoria::Vector<uint32_t> parents(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		auto parent = _entries[i].Primary;
+		size_t index = parent == NotChained ? count : Search(parent);
+
+		parents[i] = static_cast<uint32_t>(index < count && _entries[index].Begin == parent && index != i ? index : i);
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t index = i;
+
+		for (size_t depth = 0; depth < MaxChainDepth && parents[index] != index; depth++)
+			index = parents[index];
+
+		_entries[i].Primary = static_cast<uint32_t>(index);
+	}
+}
+
+size_t CFunctionIndex::Search(uint32_t offset) const
+{
+	size_t count = _entries.size();
+	size_t k = 1;
+
+	// Descends to the right while the key is not above `offset`. The path taken ends with
+	// the last left turn, which was at the first key above `offset`.
+	while (k <= count)
+		k = 2 * k + (_keys[k] <= offset);
+
+	k >>= std::countr_one(k) + 1;
+
+	// `k` is 0 if every key is at most `offset`.
+	size_t upper = k ? _order[k] : count;
+	return upper ? upper - 1 : count;
+}
+
+bool CFunctionIndex::Build(const CPeImage &image)
+{
+	Clear();
+
+	auto data = image.GetDirectoryData(ePeDirectory::Exception);
+
+	if (data.empty())
+		return false;
+
+	size_t width;
+
+	if (image.GetMachine() == PeMachineAmd64)
+		width = PdataEntryX64;
+	else if (image.GetMachine() == PeMachineArm64)
+		width = PdataEntryArm64;
+	else
+		return false;
+
+	size_t count = data.size() / width;
+
+	_entries.reserve(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t fields[3] = {};
+		memcpy(fields, data.data() + i * width, width);
+
+		FunctionEntry_t entry{ fields[0], 0, 0, NotChained };
+
+		if (width == PdataEntryX64)
+		{
+			entry.End = fields[1];
+			entry.Unwind = fields[2];
+
+			// The low bit marks unwind data that is another entry, the one this entry is a part of.
+			uint32_t parent[3];
+
+			if ((entry.Unwind & 1) && image.Read(entry.Unwind & ~1u, parent))
+			{
+				entry.Primary = parent[0];
+			}
+			else
+			{
+				PeUnwindInfo_t info;
+
+				if (GetUnwindInfo(image, entry, info) && (info.Flags & PeUnwindFlagChainInfo))
+					entry.Primary = info.Chained;
+			}
+		}
+		else
+		{
+			// ARM64: the length is packed into the unwind data, or is the first field of the .xdata record.
+			uint32_t length = 0;
+
+			entry.Unwind = fields[1];
+
+			if (entry.Unwind & 3)
+				length = ((entry.Unwind >> 2) & 0x7FF) * 4;
+			else if (uint32_t header; image.Read(entry.Unwind, header))
+				length = (header & 0x3FFFF) * 4;
+
+			entry.End = entry.Begin + length;
+		}
+
+		if (!entry.Begin || entry.End <= entry.Begin)
+			continue;
+
+		_entries.push_back(entry);
+	}
+
+	if (_entries.empty())
+		return false;
+
+	_base = image.IsMapped() ? reinterpret_cast<uintptr_t>(image.GetData().data()) : 0;
+	Finish();
+
+	return true;
+}
+
+#ifndef _WIN32
+
+// DW_EH_PE pointer encodings.
+static constexpr uint8_t EhPeOmit = 0xFF;
+static constexpr uint8_t EhPeFormatMask = 0x0F;
+static constexpr uint8_t EhPeUleb128 = 0x01;
+static constexpr uint8_t EhPeUdata2 = 0x02;
+static constexpr uint8_t EhPeUdata4 = 0x03;
+static constexpr uint8_t EhPeUdata8 = 0x04;
+static constexpr uint8_t EhPeSleb128 = 0x09;
+static constexpr uint8_t EhPeSdata2 = 0x0A;
+static constexpr uint8_t EhPeSdata4 = 0x0B;
+static constexpr uint8_t EhPeSdata8 = 0x0C;
+static constexpr uint8_t EhPeDatarel = 0x30;
+
+static uint64_t ReadUleb128(const uint8_t *&p)
+{
+	uint64_t value = 0;
+
+	for (unsigned shift = 0; ; shift += 7)
+	{
+		uint8_t byte = *p++;
+
+		if (shift < 64)
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+		if (!(byte & 0x80))
+			return value;
+	}
+}
+
+static int64_t ReadSleb128(const uint8_t *&p)
+{
+	int64_t value = 0;
+	unsigned shift = 0;
+	uint8_t byte;
+
+	do
+	{
+		byte = *p++;
+
+		if (shift < 64)
+			value |= static_cast<int64_t>(byte & 0x7F) << shift;
+
+		shift += 7;
+	} while (byte & 0x80);
+
+	if (shift < 64 && (byte & 0x40))
+		value |= -(int64_t(1) << shift);
+
+	return value;
+}
+
+// Reads a value in the format of `encoding`, without applying its base. Returns `false` for a format it does not know.
+static bool ReadEncoded(const uint8_t *&p, uint8_t encoding, uint64_t &out)
+{
+	switch (encoding & EhPeFormatMask)
+	{
+	case 0:           out = 0; memcpy(&out, p, sizeof(void *)); p += sizeof(void *); return true;
+	case EhPeUleb128: out = ReadUleb128(p); return true;
+	case EhPeSleb128: out = static_cast<uint64_t>(ReadSleb128(p)); return true;
+	case EhPeUdata2:
+	case EhPeSdata2:  { uint16_t v; memcpy(&v, p, 2); p += 2; out = v; return true; }
+	case EhPeUdata4:
+	case EhPeSdata4:  { uint32_t v; memcpy(&v, p, 4); p += 4; out = v; return true; }
+	case EhPeUdata8:
+	case EhPeSdata8:  memcpy(&out, p, 8); p += 8; return true;
+	default:          return false;
+	}
+}
+
+// The encoding of the code addresses in the FDEs of `cie`, from its "R" augmentation.
+static bool ReadCieEncoding(const uint8_t *cie, uint8_t &out)
+{
+	const uint8_t *p = cie + 4;
+
+	// A 32-bit id of 0 marks a CIE. 64-bit lengths are not written for `.eh_frame`.
+	uint32_t length, id;
+
+	memcpy(&length, cie, sizeof(length));
+	memcpy(&id, p, sizeof(id));
+
+	if (length == 0 || length == UINT32_MAX || id != 0)
+		return false;
+
+	p += 4;
+
+	uint8_t version = *p++;
+	auto augmentation = reinterpret_cast<const char *>(p);
+
+	p += strlen(augmentation) + 1;
+
+	// The alignment factors and the return address register.
+	ReadUleb128(p);
+	ReadSleb128(p);
+
+	if (version == 1)
+		p++;
+	else
+		ReadUleb128(p);
+
+	// Without "z" the FDEs hold absolute pointers.
+	out = 0;
+
+	if (augmentation[0] != 'z')
+		return true;
+
+	ReadUleb128(p);
+
+	for (auto c = augmentation + 1; *c; c++)
+	{
+		switch (*c)
+		{
+		case 'R':
+			out = *p++;
+			return true;
+
+		case 'L':
+			p++;
+			break;
+
+		case 'P':
+		{
+			uint8_t encoding = *p++;
+			uint64_t personality;
+
+			if (!ReadEncoded(p, encoding, personality))
+				return false;
+
+			break;
+		}
+
+		case 'S':
+		case 'B':
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool CFunctionIndex::Build(const ElfModule_t &module)
+{
+	Clear();
+
+	CElfImage image(module);
+	auto segment = image.FindProgramHeader(PT_GNU_EH_FRAME);
+
+	if (!segment)
+		return false;
+
+	std::span<const uint8_t> header(reinterpret_cast<const uint8_t *>(segment->Address), segment->Size);
+
+	// Version 1, then the encodings of the `.eh_frame` pointer, the FDE count and the table.
+	// The table is sorted, which only linkers that write the count as udata4 and the table
+	// as 4-byte offsets from the header guarantee.
+	if (!header.data() || header.size() < 12 || header[0] != 1 ||
+		header[2] != EhPeUdata4 || header[3] != (EhPeDatarel | EhPeSdata4))
+	{
+		return false;
+	}
+
+	const uint8_t *p = header.data() + 4;
+	uint64_t eh_frame, count;
+
+	if (header[1] == EhPeOmit || !ReadEncoded(p, header[1], eh_frame) || !ReadEncoded(p, header[2], count))
+		return false;
+
+	const uint8_t *table = p;
+
+	if (count == 0 || count > (header.size() - (table - header.data())) / 8 || count > UINT32_MAX)
+		return false;
+
+	_entries.reserve(static_cast<size_t>(count));
+
+	// FDEs of one object almost always share one CIE.
+	const uint8_t *last_cie = nullptr;
+	uint8_t last_encoding = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		int32_t fields[2];
+		memcpy(fields, table + i * 8, sizeof(fields));
+
+		uintptr_t begin = reinterpret_cast<uintptr_t>(header.data()) + fields[0];
+		auto fde = header.data() + fields[1];
+
+		if (begin < module.Begin || begin >= module.End || reinterpret_cast<uintptr_t>(fde) < module.Begin ||
+			reinterpret_cast<uintptr_t>(fde) >= module.End)
+		{
+			continue;
+		}
+
+		// Length, then the offset back to the CIE from where it is stored.
+		uint32_t length;
+		int32_t cie_offset;
+
+		memcpy(&length, fde, sizeof(length));
+		memcpy(&cie_offset, fde + 4, sizeof(cie_offset));
+
+		if (length == 0 || length == UINT32_MAX)
+			continue;
+
+		auto cie = fde + 4 - cie_offset;
+		uint8_t encoding;
+
+		if (cie == last_cie)
+		{
+			encoding = last_encoding;
+		}
+		else
+		{
+			if (!ReadCieEncoding(cie, encoding))
+				continue;
+
+			last_cie = cie;
+			last_encoding = encoding;
+		}
+
+		// The FDE's own start address is skipped; the table has it already. The range has its format, without a base.
+		const uint8_t *q = fde + 8;
+		uint64_t ignored, range;
+
+		if (!ReadEncoded(q, encoding, ignored) || !ReadEncoded(q, encoding & EhPeFormatMask, range))
+			continue;
+
+		if (!range || range > module.End - begin)
+			continue;
+
+		auto offset = static_cast<uint32_t>(begin - module.Begin);
+
+		_entries.push_back({ offset, offset + static_cast<uint32_t>(range),
+			static_cast<uint32_t>(reinterpret_cast<uintptr_t>(fde) - module.Begin), NotChained });
+	}
+
+	if (_entries.empty())
+		return false;
+
+	_base = module.Begin;
+	Finish();
+
+	return true;
+}
+
+#endif
+
+void CFunctionIndex::Clear()
+{
+	_entries = Memoria::Vector<FunctionEntry_t>();
+	_keys = Memoria::Vector<uint32_t>();
+	_order = Memoria::Vector<uint32_t>();
+
+	_base = 0;
+}
+
+const FunctionEntry_t *CFunctionIndex::Find(uint32_t offset) const
+{
+	size_t index = Search(offset);
+
+	if (index >= _entries.size() || offset >= _entries[index].End)
+		return nullptr;
+
+	return &_entries[index];
+}
+
+const FunctionEntry_t *CFunctionIndex::Find(const void *address) const
+{
+	auto value = reinterpret_cast<uintptr_t>(address);
+
+	if (value < _base || value - _base > UINT32_MAX)
+		return nullptr;
+
+	return Find(static_cast<uint32_t>(value - _base));
+}
+
+const FunctionEntry_t *CFunctionIndex::FindPrimary(const void *address) const
+{
+	auto entry = Find(address);
+	return entry ? &GetPrimary(*entry) : nullptr;
+}
+
+bool CFunctionIndex::GetUnwindInfo(const CPeImage &image, const FunctionEntry_t &entry, PeUnwindInfo_t &out)
+{
+	if (image.GetMachine() != PeMachineAmd64 || (entry.Unwind & 1))
+		return false;
+
+	uint8_t header[4];
+
+	if (!image.Read(entry.Unwind, header))
+		return false;
+
+	out = {};
+	out.Version = header[0] & 0x07;
+	out.Flags = header[0] >> 3;
+	out.SizeOfProlog = header[1];
+	out.CountOfCodes = header[2];
+	out.FrameRegister = header[3] & 0x0F;
+	out.FrameOffset = header[3] >> 4;
+	out.Codes = entry.Unwind + sizeof(header);
+
+	// The codes are padded to an even count. Either a chained entry or a handler follows them.
+	uint32_t tail = out.Codes + ((out.CountOfCodes + 1u) & ~1u) * sizeof(uint16_t);
+
+	if (out.Flags & PeUnwindFlagChainInfo)
+		return image.Read(tail, out.Chained);
+
+	if (out.Flags & (PeUnwindFlagExceptionHandler | PeUnwindFlagTerminationHandler))
+	{
+		if (!image.Read(tail, out.Handler))
+			return false;
+
+		out.HandlerData = tail + sizeof(uint32_t);
+	}
+
+	return true;
+}
+
+//
+// Cache of the loaded modules
+//
+
+std::shared_ptr<const CFunctionIndex> GetFunctionIndex(const void *address)
+{
+	static CModuleIndexCache<CFunctionIndex> cache;
+
+	return cache.Get(address, [](CFunctionIndex &index, const auto &module)
+	{
+		index.Build(module);
+	});
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include "memoria_core_guard.hpp"
+
+#include <string.h>
+#include <wchar.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <setjmp.h>
+#include <signal.h>
+#endif
+
+MEMORIA_BEGIN
+
+static constexpr uintptr_t GuardPageSize = 4096;
+
+#ifdef _WIN32
+
+static int FilterFault(DWORD code)
+{
+	// Guard page violations are left alone, the system relies on them for stack growth.
+	if (code == EXCEPTION_ACCESS_VIOLATION || code == EXCEPTION_IN_PAGE_ERROR)
+		return EXCEPTION_EXECUTE_HANDLER;
+
+	return EXCEPTION_CONTINUE_SEARCH;
+}
+
+bool GuardedCall(GuardedFn_t fn, void *context)
+{
+	__try
+	{
+		fn(context);
+	}
+	__except (FilterFault(GetExceptionCode()))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+#else
+
+struct GuardState_t
+{
+	sigjmp_buf Landing;
+	volatile sig_atomic_t Armed;
+};
+
+static thread_local GuardState_t gGuard;
+
+static struct sigaction gPreviousSegv;
+static struct sigaction gPreviousBus;
+
+static void GuardSignalHandler(int sig, siginfo_t *info, void *ucontext)
+{
+	auto &guard = gGuard;
+
+	if (guard.Armed)
+	{
+		guard.Armed = 0;
+		siglongjmp(guard.Landing, 1);
+	}
+
+	// Not a guarded access, hand it to whoever was installed before.
+	const auto &previous = (sig == SIGSEGV) ? gPreviousSegv : gPreviousBus;
+
+	if (previous.sa_flags & SA_SIGINFO)
+	{
+		previous.sa_sigaction(sig, info, ucontext);
+	}
+	else if (previous.sa_handler == SIG_DFL || previous.sa_handler == SIG_IGN)
+	{
+		// Returning re-executes the faulting instruction, which now hits the default action.
+		sigaction(sig, &previous, nullptr);
+	}
+	else
+	{
+		previous.sa_handler(sig);
+	}
+}
+
+static bool InstallGuardHandlers()
+{
+	struct sigaction action{};
+
+	action.sa_sigaction = GuardSignalHandler;
+	sigemptyset(&action.sa_mask);
+
+	// `SA_NODEFER`: the landing pad is reached by a jump, not by returning from the handler,
+	// so the signal must not stay blocked. This also spares `sigsetjmp` saving the signal mask.
+	action.sa_flags = SA_SIGINFO | SA_NODEFER | SA_ONSTACK;
+
+	return sigaction(SIGSEGV, &action, &gPreviousSegv) == 0 && sigaction(SIGBUS, &action, &gPreviousBus) == 0;
+}
+
+bool GuardedCall(GuardedFn_t fn, void *context)
+{
+	static const bool installed = InstallGuardHandlers();
+
+	if (!installed)
+		return false;
+
+	auto &guard = gGuard;
+
+	// Guarded calls may nest, the inner one borrows the landing pad.
+	sigjmp_buf outer;
+	sig_atomic_t outer_armed = guard.Armed;
+
+	if (outer_armed)
+		memcpy(&outer, &guard.Landing, sizeof(outer));
+
+	bool result = true;
+
+	if (sigsetjmp(guard.Landing, 0) == 0)
+	{
+		guard.Armed = 1;
+		fn(context);
+		guard.Armed = 0;
+	}
+	else
+	{
+		result = false;
+	}
+
+	if (outer_armed)
+	{
+		memcpy(&guard.Landing, &outer, sizeof(outer));
+		guard.Armed = 1;
+	}
+
+	return result;
+}
+
+#endif
+
+struct GuardedCopy_t
+{
+	void *Dest;
+	const void *Src;
+	size_t Size;
+};
+
+static void CopyBlock(void *context)
+{
+	auto copy = static_cast<GuardedCopy_t *>(context);
+	memcpy(copy->Dest, copy->Src, copy->Size);
+}
+
+size_t GuardedCopy(void *dest, const void *src, size_t size)
+{
+	if (size == 0)
+		return 0;
+
+	GuardedCopy_t copy{ dest, src, size };
+
+	if (GuardedCall(CopyBlock, &copy))
+		return size;
+
+	// Faults are page-granular: copy page by page up to the first inaccessible one.
+	size_t total = 0;
+
+	while (total < size)
+	{
+		auto current = static_cast<const uint8_t *>(src) + total;
+		size_t chunk = GuardPageSize - (reinterpret_cast<uintptr_t>(current) & (GuardPageSize - 1));
+
+		if (chunk > size - total)
+			chunk = size - total;
+
+		copy = { static_cast<uint8_t *>(dest) + total, current, chunk };
+
+		if (!GuardedCall(CopyBlock, &copy))
+			break;
+
+		total += chunk;
+	}
+
+	return total;
+}
+
+template <typename T>
+struct GuardedString_t
+{
+	T *Dest;
+	const T *Src;
+	size_t MaxSize;
+
+	// Updated as the copy goes, so it is accurate after a fault.
+	volatile size_t Length;
+};
+
+template <typename T>
+static void CopyString(void *context)
+{
+	auto copy = static_cast<GuardedString_t<T> *>(context);
+
+	for (size_t i = 0; i + 1 < copy->MaxSize; i++)
+	{
+		T ch = copy->Src[i];
+
+		if (ch == T(0))
+			break;
+
+		copy->Dest[i] = ch;
+		copy->Length = i + 1;
+	}
+}
+
+template <typename T>
+static bool GuardedCopyString(T *dest, const T *src, size_t max_size)
+{
+	if (!dest || max_size == 0)
+		return false;
+
+	GuardedString_t<T> copy{ dest, src, max_size, 0 };
+	bool result = GuardedCall(CopyString<T>, &copy);
+
+	dest[copy.Length] = T(0);
+	return result;
+}
+
+bool GuardedCopyAStr(char *dest, const char *src, size_t max_size)
+{
+	return GuardedCopyString(dest, src, max_size);
+}
+
+bool GuardedCopyWStr(wchar_t *dest, const wchar_t *src, size_t max_size)
+{
+	return GuardedCopyString(dest, src, max_size);
+}
+
+bool ProbeMemory(const void *addr)
+{
+	uint8_t value;
+	return addr != nullptr && GuardedCopy(&value, addr, 1) == 1;
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "memoria_core_hash.hpp"
+
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#include <nmmintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MEMORIA_TARGET_SSE42 __attribute__((target("sse4.2")))
+#else
+#define MEMORIA_TARGET_SSE42
+#endif
+
+MEMORIA_BEGIN
+
+// Reflected Castagnoli polynomial.
+static constexpr uint32_t CRC32C_POLY = 0x82F63B78;
+
+struct CRC32CTable_t
+{
+	uint32_t Data[256];
+
+	constexpr CRC32CTable_t() : Data()
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t crc = i;
+
+			for (int bit = 0; bit < 8; bit++)
+				crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+
+			Data[i] = crc;
+		}
+	}
+};
+
+static constexpr CRC32CTable_t CRC32CTable{};
+
+static uint32_t CRC32CSoftware(const uint8_t *data, size_t size, uint32_t crc)
+{
+	for (size_t i = 0; i < size; i++)
+		crc = CRC32CTable.Data[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+	return crc;
+}
+
+MEMORIA_TARGET_SSE42 static uint32_t CRC32CHardware(const uint8_t *data, size_t size, uint32_t crc)
+{
+#ifdef MEMORIA_64BIT
+	uint64_t crc64 = crc;
+
+	for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), data += sizeof(uint64_t))
+	{
+		uint64_t value;
+		memcpy(&value, data, sizeof(value));
+		crc64 = _mm_crc32_u64(crc64, value);
+	}
+
+	crc = static_cast<uint32_t>(crc64);
+#endif
+
+	for (; size >= sizeof(uint32_t); size -= sizeof(uint32_t), data += sizeof(uint32_t))
+	{
+		uint32_t value;
+		memcpy(&value, data, sizeof(value));
+		crc = _mm_crc32_u32(crc, value);
+	}
+
+	for (; size > 0; size--, data++)
+		crc = _mm_crc32_u8(crc, *data);
+
+	return crc;
+}
+
+static bool IsSSE42Supported()
+{
+	// CPUID.01H:ECX.SSE4_2[bit 20]
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 20)) != 0;
+#else
+	unsigned int eax, ebx, ecx, edx;
+	return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 20)) != 0;
+#endif
+}
+
+uint32_t CRC32C(const void *data, size_t size, uint32_t crc)
+{
+	// Detected once, thread-safe as a function-local static.
+	static const bool has_sse42 = IsSSE42Supported();
+
+	auto bytes = static_cast<const uint8_t *>(data);
+
+	crc = ~crc;
+	crc = has_sse42 ? CRC32CHardware(bytes, size, crc) : CRC32CSoftware(bytes, size, crc);
+
+	return ~crc;
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -1,6 +1,6 @@
 #include "memoria_core_hook.hpp"
 
-#include "memoria_utils_buffer.hpp"
+#include "memoria_utils_asm.hpp"
 #include "memoria_utils_assert.hpp"
 
 #include "memoria_core_write.hpp"
@@ -13,141 +13,102 @@
 
 MEMORIA_BEGIN
 
-static size_t WriteJumpRel32(void *addr_target, const void *addr_value)
+static bool EmitJumpRel(CAssembler &as, const void *addr_value)
 {
-	CIndependentBuffer64 buf;
-
-	buf.WriteU8(0xE9);                          // JMP rel32
-	buf.WriteRelative(addr_target, addr_value, 1); // rel32
-
-	if (addr_value && !buf.Clone(addr_target, true))
-		return 0;
-
-	return buf.GetSize();
-}
-
-static size_t WriteCallRel32(void *addr_target, const void *addr_value)
-{
-	CIndependentBuffer64 buf;
-
-	buf.WriteU8(0xE8);                          // CALL rel32
-	buf.WriteRelative(addr_target, addr_value, 1); // rel32
-
-	if (addr_value && !buf.Clone(addr_target, true))
-		return 0;
-
-	return buf.GetSize();
+	as.Jmp(addr_value); // JMP rel32, fails in Finalize if the target is out of range
+	return true;
 }
 
-static size_t WritePushRet32(void *addr_target, const void *addr_value)
+static bool EmitCallRel(CAssembler &as, const void *addr_value)
 {
-	CIndependentBuffer64 buf;
-
-	buf.WriteU8(0x68);            // PUSH imm32
-	buf.WritePointer(addr_value); // imm32
-	buf.WriteU8(0xC3);            // RET
-
-	if (addr_value && !buf.Clone(addr_target, true))
-		return 0;
-
-	return buf.GetSize();
+	as.Call(addr_value); // CALL rel32, fails in Finalize if the target is out of range
+	return true;
 }
 
-static size_t WriteJumpAbs32(void *addr_target, const void *addr_value)
+static bool EmitPushRet(CAssembler &as, const void *addr_value)
 {
-	CIndependentBuffer64 buf;
-
-	buf.WriteU8(0xB8);            // MOV EAX, imm32
-	buf.WritePointer(addr_value); // imm32
-	buf.WriteU16(0xE0FF);         // JMP EAX
-
-	if (addr_value && !buf.Clone(addr_target, true))
-		return 0;
+	if (as.Is64Bit())
+	{
+		as.MovAbs(eReg::Rax, reinterpret_cast<uintptr_t>(addr_value)); // MOV RAX, imm64
+		as.Push(eReg::Rax);                                           // PUSH RAX
+	}
+	else
+	{
+		as.PushAbs(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(addr_value))); // PUSH imm32
+	}
 
-	return buf.GetSize();
+	as.Ret(); // RET
+	return true;
 }
 
-static size_t WriteJumpMem32(void *addr_target, const void *addr_value)
+static bool EmitJumpAbs(CAssembler &as, const void *addr_value)
 {
-	AssertMsg(false, "WriteJumpMem is not supported in x32 mode.");
-	return 0;
+	as.MovAbs(eReg::Rax, reinterpret_cast<uintptr_t>(addr_value)); // MOV EAX/RAX, imm32/imm64
+	as.Jmp(eReg::Rax);                                            // JMP EAX/RAX
+	return true;
 }
 
-static size_t WriteJumpRel64(void *addr_target, const void *addr_value)
+static bool EmitJumpMem(CAssembler &as, const void *addr_value)
 {
-	if (addr_value && !IsIn32BitRange(addr_target, addr_value))
+	if (!as.Is64Bit())
+	{
+		AssertMsg(false, "WriteJumpMem is not supported in x32 mode.");
 		return false;
+	}
 
-	CIndependentBuffer64 buf;
-
-	buf.WriteU8(0xE9);                          // JMP
-	buf.WriteRelative(addr_target, addr_value, 1); // rel32
+	auto slot = as.NewLabel();
 
-	if (addr_value && !buf.Clone(addr_target, true))
-		return 0;
-
-	return buf.GetSize();
+	as.Jmp(MemRip(slot));                                   // JMP [RIP+0]
+	as.Bind(slot);
+	as.WriteU64(reinterpret_cast<uintptr_t>(addr_value)); // DQ imm64
+	return true;
 }
 
-static size_t WriteCallRel64(void *addr_target, const void *addr_value)
+static bool EmitHook(CAssembler &as, const void *addr_value, eInvokeMethod method)
 {
-	if (addr_value && !IsIn32BitRange(addr_target, addr_value))
-		return false;
-
-	CIndependentBuffer64 buf;
+	switch (method)
+	{
 
-	buf.WriteU8(0xE8);                          // CALL
-	buf.WriteRelative(addr_target, addr_value, 1); // rel32
+	case eInvokeMethod::JumpRel:
+		return EmitJumpRel(as, addr_value);
 
-	if (addr_value && !buf.Clone(addr_target, true))
-		return 0;
+	case eInvokeMethod::CallRel:
+		return EmitCallRel(as, addr_value);
 
-	return buf.GetSize();
-}
+	case eInvokeMethod::PushRet:
+		return EmitPushRet(as, addr_value);
 
-static size_t WritePushRet64(void *addr_target, const void *addr_value)
-{
-	CIndependentBuffer64 buf;
+	case eInvokeMethod::JumpAbs:
+		return EmitJumpAbs(as, addr_value);
 
-	buf.WriteU8(0x48);            // REX.W
-	buf.WriteU8(0xB8);            // MOV RAX, IMM64
-	buf.WritePointer(addr_value); // IMM64
-	buf.WriteU8(0x50);            // PUSH RAX
-	buf.WriteU8(0xC3);            // RET
+	case eInvokeMethod::JumpMem:
+		return EmitJumpMem(as, addr_value);
 
-	if (addr_value && !buf.Clone(addr_target, true))
-		return 0;
+	default:
+		return false;
 
-	return buf.GetSize();
+	}
 }
 
-static size_t WriteJumpAbs64(void *addr_target, const void *addr_value)
+static bool WriteHookInternal(void *addr_target, const void *addr_value, bool is_x64, eInvokeMethod method)
 {
-	CIndependentBuffer64 buf;
-
-	buf.WriteU8(0x48);            // REX.W
-	buf.WriteU8(0xB8);            // MOV RAX, IMM64
-	buf.WritePointer(addr_value); // IMM64
-	buf.WriteU16(0xE0FF);         // JMP RAX
+	CIndependentAssembler64 as(addr_target, is_x64);
 
-	if (addr_value && !buf.Clone(addr_target, true))
-		return 0;
+	if (!EmitHook(as, addr_value, method) || !as.Finalize())
+		return false;
 
-	return buf.GetSize();
+	return as.Clone(addr_target, true);
 }
 
-static size_t WriteJumpMem64(void *addr_target, const void *addr_value)
+static size_t CalculateHookSizeInternal(void *addr_target, bool is_x64, eInvokeMethod method)
 {
-	CIndependentBuffer64 buf;
+	CIndependentAssembler64 as(addr_target, is_x64);
 
-	buf.WriteU16(0x25FF);         // JMP
-	buf.WriteU32(0);              // 0
-	buf.WritePointer(addr_value); // DQ IMM64
-
-	if (addr_value && !buf.Clone(addr_target, true))
+	// The encodings do not depend on the value, so nothing has to be resolved.
+	if (!EmitHook(as, nullptr, method))
 		return 0;
 
-	return buf.GetSize();
+	return as.GetSize();
 }
 
 MEMORIA_END
@@ -175,54 +136,12 @@ size_t CalculateInstructionBoundary32(const void *addr, size_t min_size)
 
 bool WriteHook32(void *addr_target, const void *addr_value, eInvokeMethod method)
 {
-	switch (method)
-	{
-
-	case eInvokeMethod::JumpRel:
-		return WriteJumpRel32(addr_target, addr_value) != 0;
-
-	case eInvokeMethod::CallRel:
-		return WriteCallRel32(addr_target, addr_value) != 0;
-
-	case eInvokeMethod::PushRet:
-		return WritePushRet32(addr_target, addr_value) != 0;
-
-	case eInvokeMethod::JumpAbs:
-		return WriteJumpAbs32(addr_target, addr_value) != 0;
-
-	case eInvokeMethod::JumpMem:
-		return WriteJumpMem32(addr_target, addr_value) != 0;
-
-	default:
-		return false;
-
-	}
+	return WriteHookInternal(addr_target, addr_value, false, method);
 }
 
 size_t CalculateHookSize32(void *addr_target, eInvokeMethod method)
 {
-	switch (method)
-	{
-
-	case eInvokeMethod::JumpRel:
-		return WriteJumpRel32(addr_target, nullptr);
-
-	case eInvokeMethod::CallRel:
-		return WriteCallRel32(addr_target, nullptr);
-
-	case eInvokeMethod::PushRet:
-		return WritePushRet32(addr_target, nullptr);
-
-	case eInvokeMethod::JumpAbs:
-		return WriteJumpAbs32(addr_target, nullptr);
-
-	case eInvokeMethod::JumpMem:
-		return WriteJumpMem32(addr_target, nullptr);
-
-	default:
-		return 0;
-
-	}
+	return CalculateHookSizeInternal(addr_target, false, method);
 }
 
 size_t CalculateInstructionSize64(const void *addr, ptrdiff_t offset)
@@ -246,54 +165,22 @@ size_t CalculateInstructionBoundary64(const void *addr, size_t min_size)
 
 bool WriteHook64(void *addr_target, const void *addr_value, eInvokeMethod method)
 {
-	switch (method)
-	{
-
-	case eInvokeMethod::JumpRel:
-		return WriteJumpRel64(addr_target, addr_value);
-
-	case eInvokeMethod::CallRel:
-		return WriteCallRel64(addr_target, addr_value);
-
-	case eInvokeMethod::PushRet:
-		return WritePushRet64(addr_target, addr_value);
-
-	case eInvokeMethod::JumpAbs:
-		return WriteJumpAbs64(addr_target, addr_value);
-
-	case eInvokeMethod::JumpMem:
-		return WriteJumpMem64(addr_target, addr_value);
-
-	default:
-		return false;
-
-	}
+	return WriteHookInternal(addr_target, addr_value, true, method);
 }
 
 size_t CalculateHookSize64(void *addr_target, eInvokeMethod method)
 {
-	switch (method)
-	{
-
-	case eInvokeMethod::JumpRel:
-		return WriteJumpRel64(addr_target, nullptr);
-
-	case eInvokeMethod::CallRel:
-		return WriteCallRel64(addr_target, nullptr);
-
-	case eInvokeMethod::PushRet:
-		return WritePushRet64(addr_target, nullptr);
-
-	case eInvokeMethod::JumpAbs:
-		return WriteJumpAbs64(addr_target, nullptr);
+	return CalculateHookSizeInternal(addr_target, true, method);
+}
 
-	case eInvokeMethod::JumpMem:
-		return WriteJumpMem64(addr_target, nullptr);
+size_t AssembleHook(void *buffer, size_t size, const void *addr_target, const void *addr_value, bool is_x64, eInvokeMethod method)
+{
+	CAssembler as(buffer, size, addr_target, is_x64);
 
-	default:
+	if (!EmitHook(as, addr_value, method) || !as.Finalize())
 		return 0;
 
-	}
+	return as.GetSize();
 }
 
 MEMORIA_END
@@ -318,9 +205,9 @@ CTrampoline::CTrampoline(CHookMgr *manager, void *target, const void *hook, bool
 	std::memset(_backup, 0x90, sizeof(_backup));
 #endif
 
-	CWriteBuffer buf(GetJmpHook(), 5);
-	buf.WriteU8(0xE9);
-	buf.WriteRelative(_hook, GetJmpHook());
+	CAssembler as(GetJmpHook(), 5, nullptr, _x64);
+	as.Jmp(_hook);
+	as.Finalize();
 
 	memcpy(GetOriginal(), target, size);
 
@@ -373,17 +260,27 @@ CHookMgr::CHookMgr(const void *addr_nearest, size_t max_hooks)
 
 CTrampoline *CHookMgr::Allocate(void *target, const void *hook, bool is_x64, eInvokeMethod method)
 {
-	if (_hooks >= _max_hooks)
-		return nullptr;
-
 	if (_data == nullptr)
 		return nullptr;
 
-	uintptr_t base = reinterpret_cast<uintptr_t>(_data);
-	size_t offset = sizeof(CTrampoline) * _hooks;
+	CTrampoline *result;
 
-	CTrampoline *result = reinterpret_cast<CTrampoline *>(base + offset);
-	++_hooks;
+	if (!_released.empty())
+	{
+		result = _released.back();
+		_released.pop_back();
+	}
+	else
+	{
+		if (_hooks >= _max_hooks)
+			return nullptr;
+
+		uintptr_t base = reinterpret_cast<uintptr_t>(_data);
+		size_t offset = sizeof(CTrampoline) * _hooks;
+
+		result = reinterpret_cast<CTrampoline *>(base + offset);
+		++_hooks;
+	}
 
 	size_t size;
 
@@ -402,11 +299,25 @@ CTrampoline *CHookMgr::Allocate(void *target, const void *hook, bool is_x64, eIn
 	return result;
 }
 
+void CHookMgr::Release(CTrampoline *trampoline)
+{
+	std::destroy_at(trampoline);
+	_released.push_back(trampoline);
+}
+
 bool CHookMgr::IsNear(const void *addr) const
 {
 	return IsIn32BitRange(_data, addr);
 }
 
+bool CHookMgr::Owns(const CTrampoline *trampoline) const
+{
+	auto address = reinterpret_cast<uintptr_t>(trampoline);
+	auto base = reinterpret_cast<uintptr_t>(_data);
+
+	return _data && address >= base && address < base + _hooks * sizeof(CTrampoline);
+}
+
 static Memoria::List<CHookMgr> gTrampolineMgrs;
 
 static CHookMgr *FindNearestTrampolineMgr(const void *addr)
@@ -421,15 +332,32 @@ static CHookMgr *FindNearestTrampolineMgr(const void *addr)
 	return &gTrampolineMgrs.back();
 }
 
-static bool HookInternal(void *target, const void *hook, void *trampoline, bool is_x64, eInvokeMethod method)
+CTrampoline *CreateTrampoline(void *target, const void *hook, bool is_x64, eInvokeMethod method)
 {
 	auto mgr = FindNearestTrampolineMgr(target);
 	if (!mgr)
-		return false;
+		return nullptr;
+
+	return mgr->Allocate(target, hook, is_x64, method);
+}
 
-	CTrampoline *tmp = mgr->Allocate(target, hook, is_x64, method);
+void FreeTrampoline(CTrampoline *trampoline)
+{
+	for (auto &mgr : gTrampolineMgrs)
+	{
+		if (mgr.Owns(trampoline))
+		{
+			mgr.Release(trampoline);
+			return;
+		}
+	}
+}
+
+static bool HookInternal(void *target, const void *hook, void *trampoline, bool is_x64, eInvokeMethod method)
+{
+	CTrampoline *tmp = CreateTrampoline(target, hook, is_x64, method);
 
-	if (!tmp->Hook())
+	if (!tmp || !tmp->Hook())
 		return false;
 
 	if (trampoline)
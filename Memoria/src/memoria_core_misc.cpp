@@ -1,7 +1,11 @@
 #include "memoria_core_misc.hpp"
 
+#ifdef _WIN32
+
 #include "memoria_utils_format.hpp"
 
+#include "memoria_core_exports.hpp"
+#include "memoria_core_modules.hpp"
 #include "memoria_core_windows.hpp"
 
 #include <Windows.h>
@@ -18,8 +22,18 @@
 	#define LoadLibraryA     LI_FN_EX("kernel32.dll", LoadLibraryA)
 #endif
 
+#else
+
+#include "memoria_core_elf.hpp"
+#include "memoria_core_guard.hpp"
+#include "memoria_core_source.hpp"
+
+#endif
+
 MEMORIA_BEGIN
 
+#ifdef _WIN32
+
 bool IsMemoryValid(const void *addr, ptrdiff_t offset)
 {
 	if (offset != 0)
@@ -313,6 +327,75 @@ bool BeautifyPointer(const void *addr, char *out, size_t max_size)
 	return true;
 }
 
+void *GetModuleBase(const char *name)
+{
+	return GetImageBase(name);
+}
+
+#else
+
+bool IsMemoryValid(const void *addr, ptrdiff_t offset)
+{
+	if (offset != 0)
+		addr = (void *)(uintptr_t(addr) + offset);
+
+	if (!addr)
+		return false;
+
+	// Reading the byte is cheaper than looking it up in `/proc/self/maps`.
+	return ProbeMemory(addr);
+}
+
+bool IsMemoryExecutable(const void *addr, ptrdiff_t offset)
+{
+	if (offset != 0)
+		addr = (void *)(uintptr_t(addr) + offset);
+
+	if (!addr)
+		return false;
+
+	struct Query_t
+	{
+		uintptr_t Address;
+		bool Executable;
+	} query{ reinterpret_cast<uintptr_t>(addr), false };
+
+	EnumerateLocalRegions([](const MemoryRegion_t &region, void *param)
+	{
+		auto query = static_cast<Query_t *>(param);
+
+		if (query->Address >= region.End)
+			return true;
+
+		query->Executable = query->Address >= region.Begin && region.Readable && region.Executable;
+		return false;
+	}, &query);
+
+	return query.Executable;
+}
+
+void *GetBaseAddress(const void *addr)
+{
+	ElfModule_t module;
+
+	if (!FindElfModule(addr, module))
+		return nullptr;
+
+	return reinterpret_cast<void *>(module.Begin);
+}
+
+void *GetModuleBase(const char *name)
+{
+	ElfModule_t module;
+
+	if (!FindElfModule(name ? name : "", module))
+		return nullptr;
+
+	return reinterpret_cast<void *>(module.Begin);
+}
+
+#endif
+
 size_t Align(size_t value, int alignment)
 {
 	//Assert(alignment != 0);
@@ -343,6 +426,8 @@ void *Align(const void *value, int alignment)
 	return reinterpret_cast<void *>(addr);
 }
 
+#ifdef _WIN32
+
 void *GetSelfAddress()
 {
 	return GetBaseAddress(_ReturnAddress());
@@ -377,9 +462,7 @@ DWORD BeginThread(void (*fnFunction)())
 	return nThreadId;
 }
 
-using EnumModulesFn_t = bool(*)(PLDR_DATA_TABLE_ENTRY entry, LPVOID param);
-
-static void EnumModules(EnumModulesFn_t fn, LPVOID param)
+void EnumModules(EnumModulesFn_t fn, LPVOID param)
 {
 #ifdef _WIN64
 	PPEB pPeb = (PPEB)__readgsqword(0x60);
@@ -404,208 +487,19 @@ static void EnumModules(EnumModulesFn_t fn, LPVOID param)
 	}
 }
 
-using EnumExports_t = bool(*)(PLDR_DATA_TABLE_ENTRY entry, const char *name, void *address, WORD ordinal, LPVOID param);
-
-static bool IsForwardExport(void *function_ptr, PIMAGE_EXPORT_DIRECTORY exportDir, DWORD exportSize)
-{
-	BYTE *ptr = (BYTE *)function_ptr;
-	BYTE *start = (BYTE *)exportDir;
-	BYTE *end = start + exportSize;
-
-	return ptr >= start && ptr < end;
-}
-
-static void *ResolveForwardExport(const char *forward_str, bool force_load_library)
-{
-	char dll_name_raw[256];
-	char func_name[256];
-
-	strncpy_s(dll_name_raw, forward_str, sizeof(dll_name_raw));
-	dll_name_raw[sizeof(dll_name_raw) - 1] = '\0';
-
-	char *dot = strchr(dll_name_raw, '.');
-	if (!dot)
-		return nullptr;
-
-	*dot = '\0';
-	const char *dll_name_part = dll_name_raw;
-	const char *func_name_part = dot + 1;
-
-	strncpy_s(func_name, func_name_part, sizeof(func_name));
-	func_name[sizeof(func_name) - 1] = '\0';
-
-	char dll_name_full[MAX_PATH];
-	strncpy_s(dll_name_full, dll_name_part, sizeof(dll_name_full) - 5);
-	dll_name_full[sizeof(dll_name_full) - 5] = '\0';
-
-	size_t len = strlen(dll_name_full);
-	volatile char suffix[] = { '.', 'd', 'l', 'l' };
-
-	if (len < 4 || strncmp(dll_name_full + len - 4, const_cast<const char *>(suffix), 4) != 0)
-		strncat_s(dll_name_full, const_cast<const char *>(suffix), 4);
-
-	HMODULE module = GetModuleHandleDirect(FNV1a64(dll_name_full));
-	if (!module)
-	{
-		// TODO: force_load_library
-		return nullptr;
-	}
-
-	PIMAGE_DOS_HEADER dosHeader = (PIMAGE_DOS_HEADER)module;
-	if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE)
-		return nullptr;
-
-	PIMAGE_NT_HEADERS ntHeaders = (PIMAGE_NT_HEADERS)((PBYTE)module + dosHeader->e_lfanew);
-	if (ntHeaders->Signature != IMAGE_NT_SIGNATURE)
-		return nullptr;
-
-	PIMAGE_EXPORT_DIRECTORY exportDir = (PIMAGE_EXPORT_DIRECTORY)((PBYTE)module + ntHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress);
-	DWORD exportSize = ntHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].Size;
-
-	if (!exportDir || exportSize == 0)
-		return nullptr;
-
-	PDWORD functions = (PDWORD)((PBYTE)module + exportDir->AddressOfFunctions);
-	PDWORD names = (PDWORD)((PBYTE)module + exportDir->AddressOfNames);
-	PWORD ordinals = (PWORD)((PBYTE)module + exportDir->AddressOfNameOrdinals);
-
-	for (DWORD i = 0; i < exportDir->NumberOfNames; i++)
-	{
-		const char *name = (const char *)((PBYTE)module + names[i]);
-
-		if (strcmp(name, func_name) == 0)
-		{
-			if (ordinals[i] >= exportDir->NumberOfFunctions)
-				return nullptr;
-
-			return (void *)((PBYTE)module + functions[ordinals[i]]);
-		}
-	}
-
-	return nullptr;
-}
-
-static void EnumExports(HMODULE hModule, EnumExports_t fn, LPVOID param)
-{
-	struct Args_t
-	{
-		HMODULE Target;
-		EnumExports_t Processor;
-		LPVOID Param;
-	} args;
-
-	args.Target = hModule;
-	args.Processor = fn;
-	args.Param = param;
-
-	EnumModules(+[](PLDR_DATA_TABLE_ENTRY entry, LPVOID param) -> bool
-		{
-			Args_t *args = reinterpret_cast<Args_t *>(param);
-
-			if (args->Target && entry->DllBase != args->Target)
-				return true;
-
-			HMODULE hModule = (HMODULE)entry->DllBase;
-
-			PIMAGE_DOS_HEADER dosHeader = (PIMAGE_DOS_HEADER)hModule;
-			if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE)
-				return true;
-
-			PIMAGE_NT_HEADERS ntHeaders = (PIMAGE_NT_HEADERS)((PBYTE)hModule + dosHeader->e_lfanew);
-			if (ntHeaders->Signature != IMAGE_NT_SIGNATURE)
-				return true;
-
-			PIMAGE_EXPORT_DIRECTORY exportDir = (PIMAGE_EXPORT_DIRECTORY)((PBYTE)hModule + ntHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress);
-			DWORD exportSize = ntHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].Size;
-
-			if (!exportDir || exportSize == 0)
-				return true;
-
-			PDWORD functions = (PDWORD)((PBYTE)hModule + exportDir->AddressOfFunctions);
-			PDWORD names = (PDWORD)((PBYTE)hModule + exportDir->AddressOfNames);
-			PWORD ordinals = (PWORD)((PBYTE)hModule + exportDir->AddressOfNameOrdinals);
-
-			for (DWORD i = 0; i < exportDir->NumberOfNames; i++)
-			{
-				if (ordinals[i] >= exportDir->NumberOfFunctions)
-					continue;
-
-				const char *function_name = (const char *)((PBYTE)hModule + names[i]);
-				void *function_ptr = (void *)((PBYTE)hModule + functions[ordinals[i]]);
-
-				if (IsForwardExport(function_ptr, exportDir, exportSize))
-				{
-					function_ptr = ResolveForwardExport(static_cast<const char *>(function_ptr), true);
-
-					if (!function_ptr)
-						continue;
-				}
-
-				if (!args->Processor(entry, function_name, function_ptr, ordinals[i], args->Param))
-					return false;
-			}
-
-			return true;
-		}, &args);
-}
-
 HMODULE GetModuleHandleDirect(fnv1a_t module_name_hash)
 {
-	struct Args_t
-	{
-		HMODULE Result;
-		uint64_t Hash;
-	} args;
+	ModuleRecord_t module;
 
-	args.Result = nullptr;
-	args.Hash = module_name_hash;
-
-	EnumModules(+[](PLDR_DATA_TABLE_ENTRY entry, LPVOID param) -> bool
-		{
-			Args_t *args = reinterpret_cast<Args_t *>(param);
-
-			if (FNV1a64(entry->BaseDllName.Buffer) == args->Hash)
-			{
-				args->Result = reinterpret_cast<HMODULE>(entry->DllBase);
-				return false;
-			}
-
-			return true;
-		}, &args);
+	if (!GetModuleRegistry().Find(module_name_hash, module))
+		return nullptr;
 
-	return args.Result;
+	return reinterpret_cast<HMODULE>(module.Base);
 }
 
 void *GetProcAddressDirect(fnv1a_t module_name_hash, fnv1a_t function_name_hash)
 {
-	struct Args_t
-	{
-		uint64_t ModuleHash;
-		uint64_t SymbolHash;
-		void *Result;
-	} args;
-
-	args.ModuleHash = module_name_hash;
-	args.SymbolHash = function_name_hash;
-	args.Result = nullptr;
-
-	EnumExports(NULL, +[](PLDR_DATA_TABLE_ENTRY entry, const char *name, void *address, WORD ordinal, LPVOID param) -> bool
-		{
-			Args_t *args = reinterpret_cast<Args_t *>(param);
-
-			if (args->ModuleHash != 0 && FNV1a64(entry->BaseDllName.Buffer) != args->ModuleHash)
-				return true;
-
-			if (FNV1a64(name) == args->SymbolHash)
-			{
-				args->Result = address;
-				return false;
-			}
-
-			return true;
-		}, &args);
-
-	return args.Result;
+	return FindExport(module_name_hash, function_name_hash);
 }
 
 void *GetProcAddressDirect(fnv1a_t function_name_hash)
@@ -656,4 +550,6 @@ void *GetInterfaceAddress(const char *module_name, const char *interface_name)
 	return GetInterfaceAddress(handle, interface_name);
 }
 
+#endif
+
 MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,375 @@
+#include "memoria_core_modules.hpp"
+
+#include "memoria_core_errors.hpp"
+
+#ifdef _WIN32
+#include "memoria_core_misc.hpp"
+#include <Windows.h>
+#else
+#include "memoria_core_elf.hpp"
+#include <unistd.h>
+#endif
+
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+
+MEMORIA_BEGIN
+
+static size_t SlotOf(uint64_t name_hash)
+{
+	return static_cast<size_t>(name_hash ^ (name_hash >> 32));
+}
+
+#ifdef _WIN32
+
+static constexpr ULONG LdrDllNotificationLoaded = 1;
+static constexpr ULONG LdrDllNotificationUnloaded = 2;
+
+struct LdrDllNotificationData_t
+{
+	ULONG Flags;
+	const UNICODE_STRING *FullDllName;
+	const UNICODE_STRING *BaseDllName;
+	PVOID DllBase;
+	ULONG SizeOfImage;
+};
+
+using LdrDllNotificationFn_t = VOID(NTAPI *)(ULONG reason, const LdrDllNotificationData_t *data, PVOID context);
+using LdrRegisterDllNotificationFn_t = LONG(NTAPI *)(ULONG flags, LdrDllNotificationFn_t fn, PVOID context, PVOID *cookie);
+using LdrUnregisterDllNotificationFn_t = LONG(NTAPI *)(PVOID cookie);
+
+// The loader's strings are counted and not always terminated.
+static uint64_t HashModuleName(const UNICODE_STRING &name)
+{
+	wchar_t buffer[MAX_PATH];
+	size_t length = (std::min)(static_cast<size_t>(name.Length / sizeof(wchar_t)), std::size(buffer) - 1);
+
+	if (name.Buffer)
+		memcpy(buffer, name.Buffer, length * sizeof(wchar_t));
+	else
+		length = 0;
+
+	buffer[length] = L'\0';
+	return FNV1a64(buffer);
+}
+
+static VOID NTAPI OnDllNotification(ULONG reason, const LdrDllNotificationData_t *data, PVOID context)
+{
+	auto registry = static_cast<CModuleRegistry *>(context);
+
+	// Called with the loader lock held, which the registry never takes itself.
+	if (reason == LdrDllNotificationLoaded)
+		registry->OnLoad({ HashModuleName(*data->BaseDllName), reinterpret_cast<uintptr_t>(data->DllBase), data->SizeOfImage });
+	else if (reason == LdrDllNotificationUnloaded)
+		registry->OnUnload(reinterpret_cast<uintptr_t>(data->DllBase));
+}
+
+#else
+
+static uint64_t HashModuleName(const char *path)
+{
+	auto slash = strrchr(path, '/');
+	return FNV1a64(slash ? slash + 1 : path);
+}
+
+#endif
+
+CModuleRegistry::CModuleRegistry()
+{
+#ifdef _WIN32
+	// Subscribe first, so that nothing loaded while the list is read is missed.
+	if (auto ntdll = GetModuleHandleW(L"ntdll.dll"))
+	{
+		auto fn = reinterpret_cast<LdrRegisterDllNotificationFn_t>(GetProcAddress(ntdll, "LdrRegisterDllNotification"));
+
+		if (fn && fn(0, OnDllNotification, this, &_cookie) != 0)
+			_cookie = nullptr;
+	}
+
+	_tracked = (_cookie != nullptr);
+#endif
+
+	Refresh();
+}
+
+CModuleRegistry::~CModuleRegistry()
+{
+#ifdef _WIN32
+	if (_cookie)
+	{
+		auto fn = reinterpret_cast<LdrUnregisterDllNotificationFn_t>
+			(GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "LdrUnregisterDllNotification"));
+
+		if (fn)
+			fn(_cookie);
+	}
+#endif
+
+	delete _snapshot.load();
+
+	for (auto snapshot : _retired)
+		delete snapshot;
+}
+
+CModuleRegistry::Snapshot_t *CModuleRegistry::MakeSnapshot(const ModuleRecord_t *records, size_t count)
+{
+	size_t capacity = 16;
+
+	while (capacity < count * 2)
+		capacity *= 2;
+
+	auto snapshot = new Snapshot_t{ Memoria::Vector<ModuleRecord_t>(), Memoria::Vector<uint32_t>(capacity), capacity - 1, ++_version };
+
+	snapshot->Modules.reserve(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto &record = records[i];
+
+		if (!record.Base)
+			continue;
+
+		snapshot->Modules.push_back(record);
+
+		size_t index = SlotOf(record.NameHash) & snapshot->Mask;
+
+		while (snapshot->Slots[index] && snapshot->Modules[snapshot->Slots[index] - 1].NameHash != record.NameHash)
+			index = (index + 1) & snapshot->Mask;
+
+		// The first module with a name keeps it.
+		if (!snapshot->Slots[index])
+			snapshot->Slots[index] = static_cast<uint32_t>(snapshot->Modules.size());
+	}
+
+	return snapshot;
+}
+
+void CModuleRegistry::Publish(const Snapshot_t *snapshot)
+{
+	auto replaced = _snapshot.exchange(snapshot);
+
+	if (replaced)
+	{
+		_retired.push_back(replaced);
+	}
+
+	// A lookup that starts from now on loads the new snapshot, so with no lookup in
+	// progress, nothing can still be reading the replaced ones.
+	if (_readers.load() != 0)
+		return;
+
+	for (auto retired : _retired)
+		delete retired;
+
+	_retired = Memoria::Vector<const Snapshot_t *>();
+}
+
+void CModuleRegistry::Refresh()
+{
+	std::lock_guard<std::mutex> guard(_lock);
+
+	Memoria::Vector<ModuleRecord_t> records{};
+
+#ifdef _WIN32
+	EnumModules(+[](PLDR_DATA_TABLE_ENTRY entry, LPVOID param) -> bool
+		{
+			auto records = static_cast<Memoria::Vector<ModuleRecord_t> *>(param);
+
+			records->push_back({ HashModuleName(entry->BaseDllName), reinterpret_cast<uintptr_t>(entry->DllBase), entry->SizeOfImage });
+
+			return true;
+		}, &records);
+#else
+	// Read the counters before the list, so that a change made while it is read shows up as a new generation.
+	unsigned long long adds, subs;
+
+	_tracked = GetElfLoaderCounters(adds, subs);
+	_generation = adds + subs;
+
+	EnumerateElfModules([](const ElfModule_t &module, void *param) -> bool
+	{
+		auto records = static_cast<Memoria::Vector<ModuleRecord_t> *>(param);
+		uint64_t hash;
+
+		if (*module.Path)
+		{
+			hash = HashModuleName(module.Path);
+		}
+		else
+		{
+			// The main program, which the loader reports without a path.
+			char path[256];
+			ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+
+			path[length > 0 ? length : 0] = '\0';
+			hash = HashModuleName(path);
+		}
+
+		records->push_back({ hash, module.Begin, module.End - module.Begin });
+
+		return true;
+	}, &records);
+#endif
+
+	Publish(MakeSnapshot(records.data(), records.size()));
+}
+
+bool CModuleRegistry::IsStale() const
+{
+#ifdef _WIN32
+	return false;
+#else
+	unsigned long long adds, subs;
+
+	// The counters only grow, so their sum changes whenever either does.
+	return GetElfLoaderCounters(adds, subs) && adds + subs != _generation.load();
+#endif
+}
+
+void CModuleRegistry::OnLoad(const ModuleRecord_t &record)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+
+	auto current = _snapshot.load();
+	Memoria::Vector<ModuleRecord_t> records{};
+
+	// Not built yet. The list it will be built from already holds the module.
+	if (!current)
+		return;
+
+	records.reserve(current->Modules.size() + 1);
+
+	for (const auto &module : current->Modules)
+	{
+		if (module.Base == record.Base)
+			return;
+
+		records.push_back(module);
+	}
+
+	// Last, so that it does not take over the name of a module loaded before.
+	records.push_back(record);
+
+	Publish(MakeSnapshot(records.data(), records.size()));
+}
+
+void CModuleRegistry::OnUnload(uintptr_t base)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+
+	auto current = _snapshot.load();
+	Memoria::Vector<ModuleRecord_t> records{};
+
+	if (!current)
+		return;
+
+	records.reserve(current->Modules.size());
+
+	for (const auto &module : current->Modules)
+	{
+		if (module.Base != base)
+			records.push_back(module);
+	}
+
+	if (records.size() != current->Modules.size())
+		Publish(MakeSnapshot(records.data(), records.size()));
+}
+
+const ModuleRecord_t *CModuleRegistry::FindSlot(const Snapshot_t *snapshot, uint64_t name_hash)
+{
+	size_t index = SlotOf(name_hash) & snapshot->Mask;
+
+	while (snapshot->Slots[index])
+	{
+		const auto &module = snapshot->Modules[snapshot->Slots[index] - 1];
+
+		if (module.NameHash == name_hash)
+			return &module;
+
+		index = (index + 1) & snapshot->Mask;
+	}
+
+	return nullptr;
+}
+
+bool CModuleRegistry::Read(uint64_t name_hash, ModuleRecord_t &out)
+{
+	BeginRead();
+
+	auto record = FindSlot(_snapshot.load(), name_hash);
+
+	if (record)
+		out = *record;
+
+	EndRead();
+
+	return record != nullptr;
+}
+
+bool CModuleRegistry::Find(uint64_t name_hash, ModuleRecord_t &out)
+{
+	if (IsStale())
+		Refresh();
+
+	if (Read(name_hash, out))
+		return true;
+
+	// Without notifications from the loader, the module may have been loaded since.
+	if (!_tracked && (Refresh(), Read(name_hash, out)))
+		return true;
+
+	SetError(ME_NOT_FOUND);
+	return false;
+}
+
+uint64_t CModuleRegistry::GetModules(Memoria::Vector<ModuleRecord_t> &out)
+{
+	if (IsStale())
+		Refresh();
+
+	BeginRead();
+
+	auto snapshot = _snapshot.load();
+
+	out = Memoria::Vector<ModuleRecord_t>();
+	out.reserve(snapshot->Modules.size());
+
+	for (const auto &module : snapshot->Modules)
+		out.push_back(module);
+
+	uint64_t version = snapshot->Version;
+
+	EndRead();
+
+	return version;
+}
+
+uint64_t CModuleRegistry::GetVersion()
+{
+	if (IsStale())
+		Refresh();
+
+	BeginRead();
+	uint64_t version = _snapshot.load()->Version;
+	EndRead();
+
+	return version;
+}
+
+size_t CModuleRegistry::GetCount()
+{
+	BeginRead();
+	size_t count = _snapshot.load()->Modules.size();
+	EndRead();
+
+	return count;
+}
+
+CModuleRegistry &GetModuleRegistry()
+{
+	static CModuleRegistry registry;
+	return registry;
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -3,99 +3,108 @@
 #include "memoria_core_options.hpp"
 #include "memoria_core_misc.hpp"
 #include "memoria_core_errors.hpp"
+#include "memoria_core_guard.hpp"
+
+#include <string.h>
+#include <wchar.h>
 
 MEMORIA_BEGIN
 
-Memoria::Optional<uint8_t> ReadU8(const void *addr, ptrdiff_t offset)
+#ifndef _WIN32
+
+// `strncpy_s` with `_TRUNCATE`.
+template <typename T>
+static void CopyTruncated(T *out, size_t max_size, const T *src)
+{
+	size_t length = 0;
+
+	for (; length + 1 < max_size && src[length] != T(0); length++)
+		out[length] = src[length];
+
+	out[length] = T(0);
+}
+
+#endif
+
+// In safe mode the read is attempted under a fault guard instead of validating the address first.
+static bool ReadBytes(void *dest, const void *addr, ptrdiff_t offset, size_t size)
 {
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
+	auto src = reinterpret_cast<const void *>(reinterpret_cast<uintptr_t>(addr) + offset);
+
+	if (!IsSafeModeActive())
+	{
+		memcpy(dest, src, size);
+		return true;
+	}
+
+	if (!GuardedRead(dest, src, size))
 	{
 		SetError(ME_INVALID_MEMORY);
-		return std::nullopt;
+		return false;
 	}
 
-	return *reinterpret_cast<uint8_t *>(reinterpret_cast<uintptr_t>(addr) + offset);
+	return true;
 }
 
-Memoria::Optional<uint16_t> ReadU16(const void *addr, ptrdiff_t offset)
+template <typename T>
+static Memoria::Optional<T> ReadValue(const void *addr, ptrdiff_t offset)
 {
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
-	{
-		SetError(ME_INVALID_MEMORY);
+	T value;
+
+	if (!ReadBytes(&value, addr, offset, sizeof(T)))
 		return std::nullopt;
-	}
-	return *reinterpret_cast<uint16_t *>(reinterpret_cast<uintptr_t>(addr) + offset);
+
+	return value;
+}
+
+Memoria::Optional<uint8_t> ReadU8(const void *addr, ptrdiff_t offset)
+{
+	return ReadValue<uint8_t>(addr, offset);
+}
+
+Memoria::Optional<uint16_t> ReadU16(const void *addr, ptrdiff_t offset)
+{
+	return ReadValue<uint16_t>(addr, offset);
 }
 
 Memoria::Optional<uint32_t> ReadU24(const void *addr, ptrdiff_t offset)
 {
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
-	{
-		SetError(ME_INVALID_MEMORY);
-		return std::nullopt;
-	}
+	uint8_t bytes[3];
 
-	uint32_t value = (*reinterpret_cast<uint8_t *>(reinterpret_cast<uintptr_t>(addr) + offset)) |
-		((*reinterpret_cast<uint8_t *>(reinterpret_cast<uintptr_t>(addr) + offset + 1)) << 8) |
-		((*reinterpret_cast<uint8_t *>(reinterpret_cast<uintptr_t>(addr) + offset + 2)) << 16);
+	if (!ReadBytes(bytes, addr, offset, sizeof(bytes)))
+		return std::nullopt;
 
-	return value;
+	return static_cast<uint32_t>(bytes[0] | (bytes[1] << 8) | (bytes[2] << 16));
 }
 
 Memoria::Optional<uint32_t> ReadU32(const void *addr, ptrdiff_t offset)
 {
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
-	{
-		SetError(ME_INVALID_MEMORY);
-		return std::nullopt;
-	}
-	return *reinterpret_cast<uint32_t *>(reinterpret_cast<uintptr_t>(addr) + offset);
+	return ReadValue<uint32_t>(addr, offset);
 }
 
 Memoria::Optional<uint64_t> ReadU64(const void *addr, ptrdiff_t offset)
 {
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
-	{
-		SetError(ME_INVALID_MEMORY);
-		return std::nullopt;
-	}
-
-	return *reinterpret_cast<uint64_t *>(reinterpret_cast<uintptr_t>(addr) + offset);
+	return ReadValue<uint64_t>(addr, offset);
 }
 
 Memoria::Optional<int8_t> ReadI8(const void *addr, ptrdiff_t offset)
 {
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
-	{
-		SetError(ME_INVALID_MEMORY);
-		return std::nullopt;
-	}
-
-	return *reinterpret_cast<int8_t *>(reinterpret_cast<uintptr_t>(addr) + offset);
+	return ReadValue<int8_t>(addr, offset);
 }
 
 Memoria::Optional<int16_t> ReadI16(const void *addr, ptrdiff_t offset)
 {
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
-	{
-		SetError(ME_INVALID_MEMORY);
-		return std::nullopt;
-	}
-
-	return *reinterpret_cast<int16_t *>(reinterpret_cast<uintptr_t>(addr) + offset);
+	return ReadValue<int16_t>(addr, offset);
 }
 
 Memoria::Optional<int32_t> ReadI24(const void *addr, ptrdiff_t offset)
 {
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
-	{
-		SetError(ME_INVALID_MEMORY);
+	uint8_t bytes[3];
+
+	if (!ReadBytes(bytes, addr, offset, sizeof(bytes)))
 		return std::nullopt;
-	}
 
-	uint32_t value = (*reinterpret_cast<const uint8_t *>(reinterpret_cast<uintptr_t>(addr) + offset)) |
-		((*reinterpret_cast<const uint8_t *>(reinterpret_cast<uintptr_t>(addr) + offset + 1)) << 8) |
-		((*reinterpret_cast<const uint8_t *>(reinterpret_cast<uintptr_t>(addr) + offset + 2)) << 16);
+	uint32_t value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
 
 	if (value & 0x800000)
 		value |= 0xFF000000;
@@ -105,46 +114,22 @@ Memoria::Optional<int32_t> ReadI24(const void *addr, ptrdiff_t offset)
 
 Memoria::Optional<int32_t> ReadI32(const void *addr, ptrdiff_t offset)
 {
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
-	{
-		SetError(ME_INVALID_MEMORY);
-		return std::nullopt;
-	}
-
-	return *reinterpret_cast<int32_t *>(reinterpret_cast<uintptr_t>(addr) + offset);
+	return ReadValue<int32_t>(addr, offset);
 }
 
 Memoria::Optional<int64_t> ReadI64(const void *addr, ptrdiff_t offset)
 {
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
-	{
-		SetError(ME_INVALID_MEMORY);
-		return std::nullopt;
-	}
-
-	return *reinterpret_cast<int64_t *>(reinterpret_cast<uintptr_t>(addr) + offset);
+	return ReadValue<int64_t>(addr, offset);
 }
 
 Memoria::Optional<float> ReadFloat(const void *addr, ptrdiff_t offset)
 {
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
-	{
-		SetError(ME_INVALID_MEMORY);
-		return std::nullopt;
-	}
-
-	return *reinterpret_cast<float *>(reinterpret_cast<uintptr_t>(addr) + offset);
+	return ReadValue<float>(addr, offset);
 }
 
 Memoria::Optional<double> ReadDouble(const void *addr, ptrdiff_t offset)
 {
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
-	{
-		SetError(ME_INVALID_MEMORY);
-		return std::nullopt;
-	}
-
-	return *reinterpret_cast<double *>(reinterpret_cast<uintptr_t>(addr) + offset);
+	return ReadValue<double>(addr, offset);
 }
 
 bool ReadAStr(const void *addr, char *out, size_t max_size, ptrdiff_t offset)
@@ -152,14 +137,24 @@ bool ReadAStr(const void *addr, char *out, size_t max_size, ptrdiff_t offset)
 	if (!out || max_size == 0)
 		return false;
 
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
+	const char *src = reinterpret_cast<const char *>(reinterpret_cast<uintptr_t>(addr) + offset);
+
+	if (IsSafeModeActive())
 	{
-		SetError(ME_INVALID_MEMORY);
-		return false;
+		if (!GuardedCopyAStr(out, src, max_size))
+		{
+			SetError(ME_INVALID_MEMORY);
+			return false;
+		}
+
+		return true;
 	}
 
-	const char *src = reinterpret_cast<const char *>(reinterpret_cast<uintptr_t>(addr) + offset);
+#ifdef _WIN32
 	strncpy_s(out, max_size, src, _TRUNCATE);
+#else
+	CopyTruncated(out, max_size, src);
+#endif
 	return true;
 }
 
@@ -168,14 +163,24 @@ bool ReadWStr(const void *addr, wchar_t *out, size_t max_size, ptrdiff_t offset)
 	if (!out || max_size == 0)
 		return false;
 
-	if (IsSafeModeActive() && !IsMemoryValid(addr, offset))
+	const wchar_t *src = reinterpret_cast<const wchar_t *>(reinterpret_cast<uintptr_t>(addr) + offset);
+
+	if (IsSafeModeActive())
 	{
-		SetError(ME_INVALID_MEMORY);
-		return false;
+		if (!GuardedCopyWStr(out, src, max_size))
+		{
+			SetError(ME_INVALID_MEMORY);
+			return false;
+		}
+
+		return true;
 	}
 
-	const wchar_t *src = reinterpret_cast<const wchar_t *>(reinterpret_cast<uintptr_t>(addr) + offset);
+#ifdef _WIN32
 	wcsncpy_s(out, max_size, src, _TRUNCATE);
+#else
+	CopyTruncated(out, max_size, src);
+#endif
 	return true;
 }
 
@@ -184,8 +189,7 @@ bool GetMemoryBlock(const void *source, size_t size, void *dest)
 	if (source == nullptr || dest == nullptr)
 		return false;
 
-	memcpy(dest, source, size);
-	return true;
+	return ReadBytes(dest, source, 0, size);
 }
 
 std::span<const uint8_t> GetMemorySpan(const void *source, size_t size)
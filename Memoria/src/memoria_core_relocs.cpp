@@ -0,0 +1,412 @@
+#include "memoria_core_relocs.hpp"
+
+#include "memoria_core_errors.hpp"
+#include "memoria_core_module_cache.hpp"
+
+#ifndef _WIN32
+#include <link.h>
+#endif
+
+#include <string.h>
+#include <algorithm>
+
+MEMORIA_BEGIN
+
+// Base relocation types, as in <winnt.h>.
+static constexpr uint16_t PeRelocHighLow = 3;
+static constexpr uint16_t PeRelocDir64 = 10;
+
+// Header of a block of base relocations, one block per 4 KB page.
+struct PeRelocBlock_t
+{
+	uint32_t PageRva;
+	uint32_t SizeOfBlock;
+};
+
+//
+// CRelocationIndex
+//
+
+void CRelocationIndex::Finish()
+{
+	std::sort(_slots.begin(), _slots.end());
+
+	Memoria::Vector<uint32_t> slots{};
+	slots.reserve(_slots.size());
+
+	for (size_t i = 0; i < _slots.size(); i++)
+	{
+		if ((i == 0 || _slots[i] != _slots[i - 1]) && _slots[i] <= _size && _size - _slots[i] >= _width)
+			slots.push_back(_slots[i]);
+	}
+
+	_slots = std::move(slots);
+
+	std::sort(_writable.begin(), _writable.end(), [](const RelocationRange_t &a, const RelocationRange_t &b)
+	{
+		return a.Begin < b.Begin;
+	});
+}
+
+bool CRelocationIndex::Build(const CPeImage &image)
+{
+	Clear();
+
+	auto directory = image.GetDirectoryData(ePeDirectory::BaseReloc);
+
+	if (directory.empty())
+		return false;
+
+	uint16_t type = image.Is64() ? PeRelocDir64 : PeRelocHighLow;
+
+	_width = image.Is64() ? sizeof(uint64_t) : sizeof(uint32_t);
+	_size = image.GetSizeOfImage();
+
+	for (size_t offset = 0; directory.size() - offset >= sizeof(PeRelocBlock_t);)
+	{
+		PeRelocBlock_t block;
+		memcpy(&block, directory.data() + offset, sizeof(block));
+
+		if (block.SizeOfBlock < sizeof(block) || block.SizeOfBlock > directory.size() - offset)
+			break;
+
+		size_t count = (block.SizeOfBlock - sizeof(block)) / sizeof(uint16_t);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			uint16_t entry;
+			memcpy(&entry, directory.data() + offset + sizeof(block) + i * sizeof(uint16_t), sizeof(entry));
+
+			// Type in the high 4 bits, offset in the page in the low 12. ABSOLUTE entries only pad blocks.
+			if ((entry >> 12) == type)
+				_slots.push_back(block.PageRva + (entry & 0xFFF));
+		}
+
+		offset += block.SizeOfBlock;
+	}
+
+	// The loader writes the imports into the import address table, which is often read-only
+	// afterwards, without base relocations for it.
+	const auto &iat = image.GetDirectory(ePeDirectory::IAT);
+
+	for (uint32_t offset = 0; iat.VirtualAddress && iat.Size - offset >= _width; offset += _width)
+		_slots.push_back(iat.VirtualAddress + offset);
+
+	for (const auto &section : image.GetSections())
+	{
+		if (section.Characteristics & PeSectionWrite)
+			_writable.push_back({ section.VirtualAddress, section.VirtualAddress + section.VirtualSize });
+	}
+
+	_base = image.IsMapped() ? reinterpret_cast<uintptr_t>(image.GetData().data()) : 0;
+	_complete = !(image.GetCharacteristics() & PeFileRelocsStripped);
+	Finish();
+
+	if (_slots.empty())
+	{
+		Clear();
+		return false;
+	}
+
+	return true;
+}
+
+#ifndef _WIN32
+
+// The relocation types whose slot ends up holding a plain pointer.
+static bool IsPointerRelocation(uintptr_t info)
+{
+	uint32_t type = (sizeof(info) == 8) ? ELF64_R_TYPE(info) : ELF32_R_TYPE(info);
+
+#if defined(__x86_64__)
+	return type == R_X86_64_RELATIVE || type == R_X86_64_IRELATIVE || type == R_X86_64_GLOB_DAT || type == R_X86_64_64;
+#elif defined(__aarch64__)
+	return type == R_AARCH64_RELATIVE || type == R_AARCH64_IRELATIVE || type == R_AARCH64_GLOB_DAT || type == R_AARCH64_ABS64;
+#elif defined(__i386__)
+	return type == R_386_RELATIVE || type == R_386_IRELATIVE || type == R_386_GLOB_DAT || type == R_386_32;
+#else
+	return false;
+#endif
+}
+
+// The relocation types of the PLT relocations whose slot ends up holding a plain pointer.
+static bool IsJumpSlotRelocation(uintptr_t info)
+{
+	uint32_t type = (sizeof(info) == 8) ? ELF64_R_TYPE(info) : ELF32_R_TYPE(info);
+
+#if defined(__x86_64__)
+	return type == R_X86_64_JUMP_SLOT || type == R_X86_64_IRELATIVE;
+#elif defined(__aarch64__)
+	return type == R_AARCH64_JUMP_SLOT || type == R_AARCH64_IRELATIVE;
+#elif defined(__i386__)
+	return type == R_386_JMP_SLOT || type == R_386_IRELATIVE;
+#else
+	return false;
+#endif
+}
+
+bool CRelocationIndex::Build(const ElfModule_t &module)
+{
+	Clear();
+
+	CElfImage image(module);
+	auto dynamic = image.FindProgramHeader(PT_DYNAMIC);
+
+	if (!dynamic)
+		return false;
+
+	_base = module.Begin;
+	_size = module.End - module.Begin;
+
+	// An executable linked at a fixed address (ET_EXEC) has absolute pointers without relocations.
+	// The ELF header is in the first segment of a loaded object.
+	ElfW(Ehdr) header;
+	memcpy(&header, reinterpret_cast<const void *>(module.Begin), sizeof(header));
+
+	_complete = memcmp(header.e_ident, ELFMAG, SELFMAG) == 0 && header.e_type == ET_DYN;
+
+	// The loader rebases some of the addresses in the dynamic section in place, not all of them on every architecture.
+	auto translate = [&module](uintptr_t address) -> uintptr_t
+	{
+		return (address >= module.Begin && address < module.End) ? address : address + module.Bias;
+	};
+
+	auto add = [this, &module](uintptr_t vaddr)
+	{
+		uintptr_t address = vaddr + module.Bias;
+
+		if (address >= module.Begin && address < module.End)
+		{
+			_slots.push_back(static_cast<uint32_t>(address - module.Begin));
+		}
+	};
+
+	uintptr_t rela = 0, rel = 0, relr = 0, jmprel = 0;
+	size_t rela_size = 0, rel_size = 0, relr_size = 0, jmprel_size = 0;
+	size_t rela_entry = sizeof(ElfW(Rela)), rel_entry = sizeof(ElfW(Rel));
+	uintptr_t jmprel_type = 0;
+
+	for (auto entry = reinterpret_cast<const ElfW(Dyn) *>(dynamic->Address); entry->d_tag != DT_NULL; entry++)
+	{
+		switch (entry->d_tag)
+		{
+		case DT_RELA:     rela = translate(entry->d_un.d_ptr); break;
+		case DT_RELASZ:   rela_size = entry->d_un.d_val; break;
+		case DT_RELAENT:  rela_entry = entry->d_un.d_val; break;
+		case DT_REL:      rel = translate(entry->d_un.d_ptr); break;
+		case DT_RELSZ:    rel_size = entry->d_un.d_val; break;
+		case DT_RELENT:   rel_entry = entry->d_un.d_val; break;
+		case DT_JMPREL:   jmprel = translate(entry->d_un.d_ptr); break;
+		case DT_PLTRELSZ: jmprel_size = entry->d_un.d_val; break;
+		case DT_PLTREL:   jmprel_type = entry->d_un.d_val; break;
+#ifdef DT_RELR
+		case DT_RELR:     relr = translate(entry->d_un.d_ptr); break;
+		case DT_RELRSZ:   relr_size = entry->d_un.d_val; break;
+#endif
+		}
+	}
+
+	if (rela && rela_entry >= sizeof(ElfW(Rela)))
+	{
+		for (size_t offset = 0; rela_size - offset >= sizeof(ElfW(Rela)); offset += rela_entry)
+		{
+			auto entry = reinterpret_cast<const ElfW(Rela) *>(rela + offset);
+
+			if (IsPointerRelocation(entry->r_info))
+				add(entry->r_offset);
+		}
+	}
+
+	if (rel && rel_entry >= sizeof(ElfW(Rel)))
+	{
+		for (size_t offset = 0; rel_size - offset >= sizeof(ElfW(Rel)); offset += rel_entry)
+		{
+			auto entry = reinterpret_cast<const ElfW(Rel) *>(rel + offset);
+
+			if (IsPointerRelocation(entry->r_info))
+				add(entry->r_offset);
+		}
+	}
+
+	// The PLT relocations, REL or RELA entries as `DT_PLTREL` says. With full RELRO their slots are read-only.
+	if (jmprel && (jmprel_type == DT_RELA || jmprel_type == DT_REL))
+	{
+		size_t entry_size = (jmprel_type == DT_RELA) ? sizeof(ElfW(Rela)) : sizeof(ElfW(Rel));
+
+		for (size_t offset = 0; jmprel_size - offset >= entry_size; offset += entry_size)
+		{
+			// `r_offset` and `r_info` lead both entry types.
+			auto entry = reinterpret_cast<const ElfW(Rel) *>(jmprel + offset);
+
+			if (IsJumpSlotRelocation(entry->r_info))
+				add(entry->r_offset);
+		}
+	}
+
+	// RELR: an even entry is the address of a slot, an odd one a bitmap of the
+	// `8 * sizeof(word) - 1` slots that follow the last one.
+	if (relr)
+	{
+		using Word_t = ElfW(Addr);
+
+		auto entries = reinterpret_cast<const Word_t *>(relr);
+		Word_t next = 0;
+
+		for (size_t i = 0; i < relr_size / sizeof(Word_t); i++)
+		{
+			Word_t entry = entries[i];
+
+			if (!(entry & 1))
+			{
+				add(entry);
+				next = entry + sizeof(Word_t);
+				continue;
+			}
+
+			for (size_t bit = 1; bit < 8 * sizeof(Word_t); bit++)
+			{
+				if ((entry >> bit) & 1)
+					add(next + (bit - 1) * sizeof(Word_t));
+			}
+
+			next += (8 * sizeof(Word_t) - 1) * sizeof(Word_t);
+		}
+	}
+
+	// Writable, except for what becomes read-only once relocated.
+	auto relro = image.FindProgramHeader(PT_GNU_RELRO);
+
+	for (const auto &segment : image.GetSegments())
+	{
+		if (!segment.Writable)
+			continue;
+
+		uintptr_t begin = segment.Begin;
+		uintptr_t end = segment.End;
+
+		if (relro && relro->Address < end && relro->Address + relro->Size > begin)
+		{
+			if (relro->Address > begin)
+				_writable.push_back({ static_cast<uint32_t>(begin - module.Begin), static_cast<uint32_t>(relro->Address - module.Begin) });
+
+			begin = (std::min)(end, relro->Address + relro->Size);
+		}
+
+		if (begin < end)
+			_writable.push_back({ static_cast<uint32_t>(begin - module.Begin), static_cast<uint32_t>(end - module.Begin) });
+	}
+
+	Finish();
+
+	if (_slots.empty())
+	{
+		Clear();
+		return false;
+	}
+
+	return true;
+}
+
+#endif
+
+void CRelocationIndex::Clear()
+{
+	_slots = Memoria::Vector<uint32_t>();
+	_writable = Memoria::Vector<RelocationRange_t>();
+
+	_base = 0;
+	_size = 0;
+	_width = sizeof(void *);
+	_complete = false;
+}
+
+std::span<const uint32_t> CRelocationIndex::FindSlots(uint32_t begin, uint32_t end) const
+{
+	auto first = std::lower_bound(_slots.begin(), _slots.end(), begin);
+	auto last = std::lower_bound(first, _slots.end(), end);
+
+	return { first, static_cast<size_t>(last - first) };
+}
+
+bool CRelocationIndex::IsRelocated(uint32_t offset) const
+{
+	// The last slot that starts at or before `offset`.
+	auto it = std::upper_bound(_slots.begin(), _slots.end(), offset);
+	return it != _slots.begin() && offset - *(it - 1) < _width;
+}
+
+bool CRelocationIndex::IsWritable(uint32_t offset) const
+{
+	auto it = std::upper_bound(_writable.begin(), _writable.end(), offset, [](uint32_t value, const RelocationRange_t &range)
+	{
+		return value < range.Begin;
+	});
+
+	return it != _writable.begin() && offset < (it - 1)->End;
+}
+
+size_t CRelocationIndex::FindValue(uintptr_t value, void **out, size_t max_size) const
+{
+	size_t count = 0;
+
+	if (!_base || !out)
+		return 0;
+
+	for (auto slot : _slots)
+	{
+		if (count >= max_size)
+			break;
+
+		uintptr_t current = 0;
+		memcpy(&current, reinterpret_cast<const void *>(_base + slot), _width);
+
+		if (current == value)
+			out[count++] = reinterpret_cast<void *>(_base + slot);
+	}
+
+	return count;
+}
+
+//
+// Cache of the loaded modules
+//
+
+std::shared_ptr<const CRelocationIndex> GetRelocationIndex(const void *address)
+{
+	static CModuleIndexCache<CRelocationIndex> cache;
+
+	return cache.Get(address, [](CRelocationIndex &index, const auto &module)
+	{
+		index.Build(module);
+	});
+}
+
+CSignature MakeSignature(const void *address, size_t size)
+{
+	Memoria::Vector<char> mask(size);
+	memset(mask.data(), 'x', size);
+
+	auto relocations = address ? GetRelocationIndex(address) : nullptr;
+
+	if (relocations && !relocations->IsEmpty())
+	{
+		auto begin = reinterpret_cast<uintptr_t>(address) - relocations->GetBase();
+		size_t width = relocations->GetWidth();
+
+		// Slots that start before the bytes may still reach into them.
+		uint32_t first = static_cast<uint32_t>(begin >= width ? begin - width + 1 : 0);
+
+		for (auto slot : relocations->FindSlots(first, static_cast<uint32_t>((std::min)(begin + size, relocations->GetSize()))))
+		{
+			for (size_t i = 0; i < width; i++)
+			{
+				if (slot + i >= begin && slot + i - begin < size)
+					mask[slot + i - begin] = '?';
+			}
+		}
+	}
+
+	return CSignature(address, mask.data(), size);
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -1,9 +1,23 @@
 #include "memoria_core_rtti.hpp"
 
+#include "memoria_core_errors.hpp"
+#include "memoria_core_hash.hpp"
+#include "memoria_core_module_cache.hpp"
+
+#ifdef _WIN32
 #include "memoria_core_options.hpp"
 #include "memoria_core_misc.hpp"
-#include "memoria_core_errors.hpp"
 #include "memoria_core_search.hpp"
+#endif
+
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+#include <bit>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
 
 MEMORIA_BEGIN
 
@@ -95,7 +109,936 @@ struct RTTICompleteObjectLocator
 //	".P6A",
 //};
 
-void *GetRTTIDescriptor(const void *addr_start, const void *addr_min, const void *addr_max, const char *rtti_name)
+// Longest name taken for a type descriptor.
+static constexpr size_t MaxRttiName = 4096;
+
+// Sizes of a complete object locator.
+static constexpr size_t LocatorSize32 = 20;
+static constexpr size_t LocatorSize64 = 24;
+
+// `Signature` of a complete object locator with RVAs (x64) and with pointers (x86).
+static constexpr uint32_t LocatorSignatureRva = 1;
+static constexpr uint32_t LocatorSignaturePointer = 0;
+
+// Largest offset-to-top taken for an Itanium vtable, the size of an object it may be in.
+static constexpr intptr_t MaxOffsetToTop = intptr_t(1) << 24;
+
+// The vtables of the type_info classes of the C++ runtime, and the functions it puts in the
+// slots of pure and deleted virtual functions.
+static constexpr const char *ClassTypeInfoVTables[] =
+{
+	"_ZTVN10__cxxabiv117__class_type_infoE",
+	"_ZTVN10__cxxabiv120__si_class_type_infoE",
+	"_ZTVN10__cxxabiv121__vmi_class_type_infoE",
+};
+
+static constexpr const char *PlaceholderFunctions[] =
+{
+	"__cxa_pure_virtual",
+	"__cxa_deleted_virtual",
+};
+
+static size_t SlotOf(uint64_t hash)
+{
+	return static_cast<size_t>(hash ^ (hash >> 32));
+}
+
+static bool EqualsNoCase(const char *a, const char *b)
+{
+	for (; *a && *b; a++, b++)
+	{
+		if (tolower(static_cast<unsigned char>(*a)) != tolower(static_cast<unsigned char>(*b)))
+			return false;
+	}
+
+	return *a == *b;
+}
+
+// The part of the class name after its last "::", the whole name without one.
+static const char *GetBareName(const char *name)
+{
+	for (const char *p = name; (p = strstr(p, "::")) != nullptr; p += 2)
+		name = p + 2;
+
+	return name;
+}
+
+// Whether `cls` has `name` as its raw name, its name or its name without the scopes.
+static bool HasName(const CRttiIndex &index, const RttiClass_t &cls, const char *name)
+{
+	return EqualsNoCase(index.GetRawName(cls), name) ||
+		(cls.Name && (EqualsNoCase(index.GetName(cls), name) || EqualsNoCase(GetBareName(index.GetName(cls)), name)));
+}
+
+/**
+ * Turns ".?AVCPlayer@game@@" into "game::CPlayer". The names of a raw name are listed from
+ * the innermost scope out, each ended by '@', and the list by another '@'.
+ *
+ * Returns `false` for the names that take more than that to undecorate: templates ("?$"),
+ * anonymous namespaces ("?A0x...") and back references (a digit).
+ */
+static bool UndecorateName(const char *raw, Memoria::Vector<char> &out)
+{
+	const char *names[64];
+	size_t lengths[64];
+	size_t count = 0;
+
+	const char *p = raw + 4;
+
+	while (*p && *p != '@')
+	{
+		auto end = strchr(p, '@');
+
+		if (!end || count == std::size(names) || *p == '?' || isdigit(static_cast<unsigned char>(*p)) ||
+			memchr(p, '$', end - p))
+		{
+			return false;
+		}
+
+		names[count] = p;
+		lengths[count++] = end - p;
+		p = end + 1;
+	}
+
+	if (count == 0 || *p != '@' || p[1] != '\0')
+		return false;
+
+	out.clear();
+
+	for (size_t i = count; i-- > 0;)
+	{
+		size_t at = out.size();
+
+		out.resize(at + lengths[i]);
+		memcpy(&out[at], names[i], lengths[i]);
+
+		if (i)
+		{
+			out.push_back(':');
+			out.push_back(':');
+		}
+	}
+
+	out.push_back('\0');
+	return true;
+}
+
+// Whether `name` could be the mangled name of a class: a name, a nested name ('N'), a name in
+// std ('S') or a local name ('Z'), made of the characters of identifiers.
+static bool IsItaniumTypeName(const char *name, size_t length)
+{
+	if (length == 0 || (!isdigit(static_cast<unsigned char>(*name)) && *name != 'N' && *name != 'S' && *name != 'Z'))
+		return false;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		if (!isalnum(static_cast<unsigned char>(name[i])) && name[i] != '_')
+			return false;
+	}
+
+	return true;
+}
+
+// Reads a <source-name>, a length then that many characters, from `p`. `nullptr` if there is none.
+static const char *ReadSourceName(const char *p, const char *&name, size_t &length)
+{
+	if (!isdigit(static_cast<unsigned char>(*p)))
+		return nullptr;
+
+	length = 0;
+
+	for (; isdigit(static_cast<unsigned char>(*p)); p++)
+	{
+		length = length * 10 + (*p - '0');
+
+		if (length > MaxRttiName)
+			return nullptr;
+	}
+
+	if (strnlen(p, length) != length)
+		return nullptr;
+
+	name = p;
+	return p + length;
+}
+
+/**
+ * Turns "N4game7CPlayerE" into "game::CPlayer", without demangling it: the name is one
+ * <source-name>, or several between 'N' and 'E', optionally after "St" for std.
+ *
+ * Returns `false` for the names that take more than that: templates ('I'), substitutions
+ * ("S_"), local classes ('Z') and anonymous namespaces ("_GLOBAL__N").
+ */
+static bool UndecorateItaniumName(const char *raw, Memoria::Vector<char> &out)
+{
+	const char *names[64];
+	size_t lengths[64];
+	size_t count = 0;
+
+	const char *p = raw;
+	bool nested = (*p == 'N');
+
+	if (nested)
+		p++;
+
+	if (p[0] == 'S' && p[1] == 't')
+	{
+		names[count] = "std";
+		lengths[count++] = 3;
+		p += 2;
+	}
+
+	while (*p && *p != 'E')
+	{
+		if (count == std::size(names) || !(p = ReadSourceName(p, names[count], lengths[count])) ||
+			(lengths[count] >= 10 && memcmp(names[count], "_GLOBAL__N", 10) == 0))
+		{
+			return false;
+		}
+
+		count++;
+
+		if (!nested)
+			break;
+	}
+
+	if (count == 0 || (nested && *p++ != 'E') || *p != '\0')
+		return false;
+
+	out.clear();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t at = out.size();
+
+		out.resize(at + lengths[i]);
+		memcpy(&out[at], names[i], lengths[i]);
+
+		if (i + 1 < count)
+		{
+			out.push_back(':');
+			out.push_back(':');
+		}
+	}
+
+	out.push_back('\0');
+	return true;
+}
+
+//
+// CRttiIndex
+//
+
+// The bytes of a section that are in the image.
+static std::span<const uint8_t> GetSectionData(const CPeImage &image, const PeSection_t &section)
+{
+	size_t size = image.IsMapped() ? section.VirtualSize : (std::min)(section.VirtualSize, section.RawSize);
+	auto data = image.GetPointer(section.VirtualAddress, size);
+
+	return data ? std::span<const uint8_t>{ data, size } : std::span<const uint8_t>{};
+}
+
+static bool IsSorted(const Memoria::Vector<uint32_t> &values, uint32_t value)
+{
+	return std::binary_search(values.begin(), values.end(), value);
+}
+
+uint32_t CRttiIndex::AddName(const char *name, size_t length)
+{
+	auto offset = static_cast<uint32_t>(_names.size());
+
+	_names.resize(offset + length + 1);
+
+	memcpy(&_names[offset], name, length);
+	_names[offset + length] = '\0';
+
+	return offset;
+}
+
+bool CRttiIndex::Build(const CPeImage &image, uint64_t base)
+{
+	Clear();
+
+	if (!image.IsValid())
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	if (!base)
+		base = image.GetImageBase();
+
+	const size_t pointer_size = image.Is64() ? 8 : 4;
+	const uint32_t image_size = image.GetSizeOfImage();
+
+	// The RVA a pointer of the image points to, `image_size` if it points outside of it.
+	auto to_rva = [&](uint64_t pointer) -> uint32_t
+	{
+		return (pointer >= base && pointer - base < image_size) ? static_cast<uint32_t>(pointer - base) : image_size;
+	};
+
+	auto read_pointer = [&](const uint8_t *data) -> uint64_t
+	{
+		if (pointer_size == 8)
+		{
+			uint64_t value;
+			memcpy(&value, data, sizeof(value));
+			return value;
+		}
+
+		uint32_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	};
+
+	auto is_code = [&](uint32_t rva)
+	{
+		auto section = image.FindSectionByRva(rva);
+		return section && (section->Characteristics & PeSectionExecute);
+	};
+
+	struct Locator_t
+	{
+		uint32_t Rva;
+		uint32_t Descriptor;
+		uint32_t Offset;
+	};
+
+	Memoria::Vector<Descriptor_t> descriptors{};
+	Memoria::Vector<uint32_t> descriptor_rvas{};
+	Memoria::Vector<Locator_t> locators{};
+	Memoria::Vector<uint32_t> locator_rvas{};
+	Memoria::Vector<RttiVTable_t> vtables{};
+
+	// Type descriptors: the type_info vftable, a spare pointer, then the name.
+	for (const auto &section : image.GetSections())
+	{
+		auto data = GetSectionData(image, section);
+
+		if (section.Characteristics & PeSectionExecute)
+			continue;
+
+		for (size_t offset = 2 * pointer_size; offset + 4 < data.size();)
+		{
+			auto name = static_cast<const uint8_t *>(memchr(data.data() + offset, '.', data.size() - offset - 4));
+
+			if (!name)
+				break;
+
+			offset = name - data.data();
+
+			if (name[1] != '?' || name[2] != 'A' || (name[3] != 'V' && name[3] != 'U'))
+			{
+				offset++;
+				continue;
+			}
+
+			auto end = static_cast<const uint8_t *>(memchr(name, '\0', (std::min)(data.size() - offset, MaxRttiName)));
+
+			if (!end)
+			{
+				offset++;
+				continue;
+			}
+
+			descriptors.push_back({ static_cast<uint32_t>(section.VirtualAddress + offset - 2 * pointer_size),
+				reinterpret_cast<const char *>(name), static_cast<size_t>(end - name) });
+
+			offset = end - data.data() + 1;
+		}
+	}
+
+	if (descriptors.empty())
+	{
+		SetError(ME_NOT_FOUND);
+		return false;
+	}
+
+	std::sort(descriptors.begin(), descriptors.end(), [](const Descriptor_t &a, const Descriptor_t &b) { return a.Offset < b.Offset; });
+
+	descriptor_rvas.reserve(descriptors.size());
+
+	for (const auto &descriptor : descriptors)
+		descriptor_rvas.push_back(descriptor.Offset);
+
+	// Complete object locators, 4-byte aligned, that refer to a type descriptor. Like vtables,
+	// they are in the code section of images linked with read-only data merged into it.
+	const size_t locator_size = image.Is64() ? LocatorSize64 : LocatorSize32;
+
+	for (const auto &section : image.GetSections())
+	{
+		auto data = GetSectionData(image, section);
+
+		for (size_t offset = 0; offset + locator_size <= data.size(); offset += 4)
+		{
+			uint32_t fields[6];
+			memcpy(fields, data.data() + offset, locator_size);
+
+			uint32_t rva = static_cast<uint32_t>(section.VirtualAddress + offset);
+			uint32_t descriptor;
+
+			if (image.Is64())
+			{
+				// Signature, offset, constructor displacement, then the RVAs of the type descriptor,
+				// the class hierarchy descriptor and the locator itself.
+				if (fields[0] != LocatorSignatureRva || fields[5] != rva || fields[4] >= image_size)
+					continue;
+
+				descriptor = fields[3];
+			}
+			else
+			{
+				if (fields[0] != LocatorSignaturePointer || to_rva(fields[4]) == image_size)
+					continue;
+
+				descriptor = to_rva(fields[3]);
+			}
+
+			if (descriptor == image_size || !IsSorted(descriptor_rvas, descriptor))
+				continue;
+
+			locators.push_back({ rva, descriptor, fields[1] });
+		}
+	}
+
+	locator_rvas.reserve(locators.size());
+
+	for (const auto &locator : locators)
+		locator_rvas.push_back(locator.Rva);
+
+	std::sort(locator_rvas.begin(), locator_rvas.end());
+
+	// Vtables, preceded by a pointer to their locator, with a first slot that points to code.
+	for (const auto &section : image.GetSections())
+	{
+		auto data = GetSectionData(image, section);
+
+		if (locator_rvas.empty())
+			break;
+
+		for (size_t offset = 0; offset + 2 * pointer_size <= data.size(); offset += pointer_size)
+		{
+			uint32_t locator = to_rva(read_pointer(data.data() + offset));
+
+			if (locator == image_size || !IsSorted(locator_rvas, locator) || !is_code(to_rva(read_pointer(data.data() + offset + pointer_size))))
+				continue;
+
+			vtables.push_back({ locator, static_cast<uint32_t>(section.VirtualAddress + offset + pointer_size), 0 });
+		}
+	}
+
+	// The class and the offset of every vtable, from its locator.
+	std::sort(locators.begin(), locators.end(), [](const Locator_t &a, const Locator_t &b) { return a.Rva < b.Rva; });
+
+	Memoria::Vector<uint32_t> owners(vtables.size());
+
+	for (size_t i = 0; i < vtables.size(); i++)
+	{
+		auto locator = std::lower_bound(locators.begin(), locators.end(), vtables[i].Locator,
+			[](const Locator_t &entry, uint32_t rva) { return entry.Rva < rva; });
+
+		vtables[i].Offset = locator->Offset;
+		owners[i] = locator->Descriptor;
+	}
+
+	_base = image.IsMapped() ? reinterpret_cast<uintptr_t>(image.GetData().data()) : 0;
+	_size = image_size;
+
+	Assemble(descriptors, vtables, owners, UndecorateName);
+	return true;
+}
+
+#ifndef _WIN32
+
+bool CRttiIndex::Build(const CElfImage &image, uint64_t base)
+{
+	Clear();
+
+	if (!image.IsValid() || image.GetEnd() - image.GetBegin() > UINT32_MAX)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	// Objects of the process and their dumps have its pointer size.
+	constexpr size_t pointer_size = sizeof(uintptr_t);
+
+	const uintptr_t begin = image.GetBegin();
+	const size_t module_size = image.GetEnd() - begin;
+	const bool loaded = !base || base == begin;
+
+	if (!base)
+		base = begin;
+
+	auto segments = image.GetSegments();
+
+	// The offset a pointer of the module points to, `module_size` if it points outside of it.
+	auto to_offset = [&](uintptr_t pointer) -> size_t
+	{
+		return (pointer >= base && pointer - base < module_size) ? static_cast<size_t>(pointer - base) : module_size;
+	};
+
+	// The number of bytes that can be read at the offset, 0 if it is not in a readable segment.
+	auto readable = [&](size_t offset) -> size_t
+	{
+		for (const auto &segment : segments)
+		{
+			if (segment.Readable && begin + offset >= segment.Begin && begin + offset < segment.End)
+				return segment.End - (begin + offset);
+		}
+
+		return 0;
+	};
+
+	auto read_pointer = [](uintptr_t address) -> uintptr_t
+	{
+		uintptr_t value;
+		memcpy(&value, reinterpret_cast<const void *>(address), sizeof(value));
+		return value;
+	};
+
+	auto is_code = [&](uintptr_t pointer)
+	{
+		size_t offset = to_offset(pointer);
+
+		return offset != module_size && std::any_of(segments.begin(), segments.end(), [&](const ElfSegment_t &segment)
+		{
+			return segment.Executable && begin + offset >= segment.Begin && begin + offset < segment.End;
+		});
+	};
+
+	// A class type_info at the offset: a vtable pointer, then a pointer to its mangled name.
+	auto read_type_info = [&](size_t offset, Descriptor_t &out)
+	{
+		if (offset % pointer_size || readable(offset) < 2 * pointer_size || !read_pointer(begin + offset))
+			return false;
+
+		size_t name = to_offset(read_pointer(begin + offset + pointer_size));
+		size_t available = (name != module_size) ? readable(name) : 0;
+
+		if (!available)
+			return false;
+
+		auto text = reinterpret_cast<const char *>(begin + name);
+		auto end = static_cast<const char *>(memchr(text, '\0', (std::min)(available, MaxRttiName)));
+
+		if (!end || !IsItaniumTypeName(text, end - text))
+			return false;
+
+		out = { static_cast<uint32_t>(offset), text, static_cast<size_t>(end - text) };
+		return true;
+	};
+
+	// What the runtime of the process puts in the slots of the module, only known for a loaded one.
+	Memoria::Vector<uintptr_t> type_info_vtables{};
+	Memoria::Vector<uintptr_t> placeholders{};
+
+	if (loaded)
+	{
+		for (auto symbol : ClassTypeInfoVTables)
+		{
+			// A vtable pointer points past the offset-to-top and the type_info of the vtable.
+			if (auto vtable = dlsym(RTLD_DEFAULT, symbol))
+				type_info_vtables.push_back(reinterpret_cast<uintptr_t>(vtable) + 2 * pointer_size);
+		}
+
+		for (auto symbol : PlaceholderFunctions)
+		{
+			if (auto function = dlsym(RTLD_DEFAULT, symbol))
+				placeholders.push_back(reinterpret_cast<uintptr_t>(function));
+		}
+	}
+
+	Memoria::Vector<Descriptor_t> descriptors{};
+	Memoria::Vector<RttiVTable_t> vtables{};
+	Memoria::Vector<uint32_t> owners{};
+
+	// Vtables: an offset-to-top, a pointer to a class type_info of the module, then the virtual
+	// functions. The offset-to-top of a primary vtable is 0, and its first slot must point to
+	// code. Secondary vtables may have no slots of their own, but their offset-to-top is that of
+	// a subobject with a vtable pointer, aligned like one. Like in PE images, vtables may be in a
+	// segment with the code.
+	for (const auto &segment : segments)
+	{
+		if (!segment.Readable)
+			continue;
+
+		uintptr_t first = (segment.Begin + pointer_size - 1) & ~(pointer_size - 1);
+
+		for (uintptr_t address = first; address + 3 * pointer_size <= segment.End; address += pointer_size)
+		{
+			auto offset_to_top = static_cast<intptr_t>(read_pointer(address));
+
+			if (offset_to_top > 0 || offset_to_top < -MaxOffsetToTop || offset_to_top % static_cast<intptr_t>(pointer_size))
+				continue;
+
+			size_t type_info = to_offset(read_pointer(address + pointer_size));
+			uintptr_t function = read_pointer(address + 2 * pointer_size);
+			Descriptor_t descriptor;
+
+			if (type_info == module_size || type_info % pointer_size ||
+				(offset_to_top == 0 && !is_code(function) &&
+					std::find(placeholders.begin(), placeholders.end(), function) == placeholders.end()) ||
+				!read_type_info(type_info, descriptor))
+			{
+				continue;
+			}
+
+			vtables.push_back({ static_cast<uint32_t>(address - begin), static_cast<uint32_t>(address + 2 * pointer_size - begin),
+				static_cast<uint32_t>(-offset_to_top) });
+			owners.push_back(descriptor.Offset);
+			type_info_vtables.push_back(read_pointer(begin + descriptor.Offset));
+		}
+	}
+
+	std::sort(type_info_vtables.begin(), type_info_vtables.end());
+	type_info_vtables.erase(std::unique(type_info_vtables.begin(), type_info_vtables.end()), type_info_vtables.end());
+
+	// The vtables found, in the order of their address, so that a vtable group is contiguous.
+	// `vtables` is in that order already if the segments are.
+	Memoria::Vector<uint32_t> order(vtables.size());
+
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = static_cast<uint32_t>(i);
+
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return vtables[a].VTable < vtables[b].VTable; });
+
+	// The vtable whose first slot is at the address, -1 if there is none.
+	auto find_vtable = [&](uintptr_t pointer) -> size_t
+	{
+		size_t offset = to_offset(pointer);
+		auto it = std::lower_bound(order.begin(), order.end(), offset, [&](uint32_t index, size_t value) { return vtables[index].VTable < value; });
+
+		return (offset != module_size && it != order.end() && vtables[*it].VTable == offset) ? *it : size_t(-1);
+	};
+
+	// A construction vtable (B-in-D), which the constructors of D use for their B subobject,
+	// has the type_info of B, like the vtables of B itself. It is only pointed to by the VTT of
+	// D, an array of pointers to vtables that starts with those of D.
+	Memoria::Vector<uint8_t> construction(vtables.size());
+
+	// Class type_info, with or without a vtable of their own: those that use a type_info vtable.
+	// On the way, vtables pointed to right after a vtable of another class are taken as construction vtables.
+	for (const auto &segment : segments)
+	{
+		if (!segment.Readable || type_info_vtables.empty())
+			continue;
+
+		uintptr_t first = (segment.Begin + pointer_size - 1) & ~(pointer_size - 1);
+		size_t previous = size_t(-1);
+
+		for (uintptr_t address = first; address + 2 * pointer_size <= segment.End; address += pointer_size)
+		{
+			uintptr_t value = read_pointer(address);
+			size_t vtable = find_vtable(value);
+
+			if (vtable != size_t(-1) && previous != size_t(-1) && owners[vtable] != owners[previous])
+				construction[vtable] = 1;
+
+			previous = vtable;
+
+			Descriptor_t descriptor;
+
+			if (!std::binary_search(type_info_vtables.begin(), type_info_vtables.end(), value) ||
+				!read_type_info(address - begin, descriptor))
+			{
+				continue;
+			}
+
+			descriptors.push_back(descriptor);
+		}
+	}
+
+	if (descriptors.empty())
+	{
+		SetError(ME_NOT_FOUND);
+		return false;
+	}
+
+	std::sort(descriptors.begin(), descriptors.end(), [](const Descriptor_t &a, const Descriptor_t &b) { return a.Offset < b.Offset; });
+
+	// The secondary vtables of a group are construction vtables if its primary one is. Then
+	// they are dropped for the classes that have a primary vtable that is not one.
+	Memoria::Vector<uint32_t> classes{};
+	bool in_construction = false;
+
+	for (auto index : order)
+	{
+		if (vtables[index].Offset == 0)
+			in_construction = construction[index] != 0;
+		else
+			construction[index] = in_construction;
+
+		if (!construction[index] && vtables[index].Offset == 0)
+		{
+			classes.push_back(owners[index]);
+		}
+	}
+
+	std::sort(classes.begin(), classes.end());
+
+	Memoria::Vector<RttiVTable_t> kept{};
+	Memoria::Vector<uint32_t> kept_owners{};
+
+	kept.reserve(vtables.size());
+	kept_owners.reserve(vtables.size());
+
+	for (size_t i = 0; i < vtables.size(); i++)
+	{
+		if (construction[i] && IsSorted(classes, owners[i]))
+			continue;
+
+		kept.push_back(vtables[i]);
+		kept_owners.push_back(owners[i]);
+	}
+
+	_base = begin;
+	_size = module_size;
+
+	Assemble(descriptors, kept, kept_owners, UndecorateItaniumName);
+	return true;
+}
+
+#endif
+
+void CRttiIndex::Assemble(const Memoria::Vector<Descriptor_t> &descriptors, const Memoria::Vector<RttiVTable_t> &vtables,
+	const Memoria::Vector<uint32_t> &owners, UndecorateFn_t undecorate)
+{
+	Memoria::Vector<uint32_t> order(vtables.size());
+
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = static_cast<uint32_t>(i);
+
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+	{
+		if (owners[a] != owners[b])
+			return owners[a] < owners[b];
+
+		return vtables[a].Offset != vtables[b].Offset ? vtables[a].Offset < vtables[b].Offset : vtables[a].VTable < vtables[b].VTable;
+	});
+
+	// Classes, in the order of their type descriptors, with their vtables.
+	Memoria::Vector<char> name{};
+
+	_names.push_back('\0');
+	_classes.reserve(descriptors.size());
+	_vtables.reserve(vtables.size());
+
+	size_t next = 0;
+
+	for (const auto &descriptor : descriptors)
+	{
+		RttiClass_t cls{};
+
+		cls.TypeDescriptor = descriptor.Offset;
+		cls.FirstVTable = static_cast<uint32_t>(_vtables.size());
+		cls.RawName = AddName(descriptor.Name, descriptor.Length);
+
+		if (undecorate(&_names[cls.RawName], name))
+			cls.Name = AddName(name.data(), name.size() - 1);
+
+		for (; next < order.size() && owners[order[next]] <= descriptor.Offset; next++)
+		{
+			if (owners[order[next]] != descriptor.Offset)
+				continue;
+
+			const auto &vtable = vtables[order[next]];
+
+			if (!cls.VTable && vtable.Offset == 0)
+			{
+				cls.Locator = vtable.Locator;
+				cls.VTable = vtable.VTable;
+			}
+
+			_vtables.push_back(vtable);
+		}
+
+		cls.VTableCount = static_cast<uint32_t>(_vtables.size() - cls.FirstVTable);
+		_classes.push_back(cls);
+	}
+
+	Finish();
+}
+
+void CRttiIndex::Finish()
+{
+	_keys.clear();
+
+	for (size_t i = 0; i < _classes.size(); i++)
+	{
+		const auto &cls = _classes[i];
+		auto index = static_cast<uint32_t>(i);
+
+		_keys.push_back({ FNV1a64(GetRawName(cls)), index });
+
+		if (!cls.Name)
+			continue;
+
+		auto bare = GetBareName(GetName(cls));
+
+		_keys.push_back({ FNV1a64(GetName(cls)), index });
+
+		if (bare != GetName(cls))
+			_keys.push_back({ FNV1a64(bare), index });
+	}
+
+	// At most half full.
+	size_t capacity = std::bit_ceil((std::max)(_keys.size() * 2, size_t(16)));
+
+	_slots = Memoria::Vector<uint32_t>(capacity);
+	_mask = capacity - 1;
+
+	for (size_t i = 0; i < _keys.size(); i++)
+	{
+		size_t slot = SlotOf(_keys[i].Hash) & _mask;
+
+		while (_slots[slot])
+			slot = (slot + 1) & _mask;
+
+		_slots[slot] = static_cast<uint32_t>(i + 1);
+	}
+}
+
+void CRttiIndex::Clear()
+{
+	_classes = Memoria::Vector<RttiClass_t>();
+	_vtables = Memoria::Vector<RttiVTable_t>();
+	_names = Memoria::Vector<char>();
+	_keys = Memoria::Vector<Key_t>();
+	_slots = Memoria::Vector<uint32_t>();
+	_mask = 0;
+	_base = 0;
+	_size = 0;
+}
+
+const RttiClass_t *CRttiIndex::Find(const char *name) const
+{
+	if (!name || !*name || _slots.empty())
+		return nullptr;
+
+	// The symbols of an Itanium type_info and of its name.
+	if (strncmp(name, "_ZTS", 4) == 0 || strncmp(name, "_ZTI", 4) == 0)
+		name += 4;
+
+	uint64_t hash = FNV1a64(name);
+
+	// Keys were inserted in the order of the classes, so the first match is the first class with the name.
+	for (size_t slot = SlotOf(hash) & _mask; _slots[slot]; slot = (slot + 1) & _mask)
+	{
+		const auto &key = _keys[_slots[slot] - 1];
+
+		if (key.Hash != hash)
+			continue;
+
+		const auto &cls = _classes[key.Class];
+
+		if (HasName(*this, cls, name))
+			return &cls;
+	}
+
+	return nullptr;
+}
+
+const RttiClass_t *CRttiIndex::FindByDescriptor(uint32_t offset) const
+{
+	auto it = std::lower_bound(_classes.begin(), _classes.end(), offset,
+		[](const RttiClass_t &cls, uint32_t value) { return cls.TypeDescriptor < value; });
+
+	return (it != _classes.end() && it->TypeDescriptor == offset) ? &*it : nullptr;
+}
+
+//
+// Cache of the loaded modules
+//
+
+std::shared_ptr<const CRttiIndex> GetRttiIndex(const void *address)
+{
+	static CModuleIndexCache<CRttiIndex> cache;
+
+	return cache.Get(address, [](CRttiIndex &index, const auto &module)
+	{
+#ifdef _WIN32
+		index.Build(module, reinterpret_cast<uintptr_t>(module.GetData().data()));
+#else
+		index.Build(CElfImage(module));
+#endif
+	});
+}
+
+//
+// Lookups in a range
+//
+
+// The index of the module that holds all of [addr_min, addr_max), `nullptr` if there is none.
+static std::shared_ptr<const CRttiIndex> GetRangeIndex(const void *addr_min, const void *addr_max)
+{
+	auto index = GetRttiIndex(addr_min);
+
+	if (!index || index->IsEmpty() || reinterpret_cast<uintptr_t>(addr_max) - index->GetBase() > index->GetSize())
+		return nullptr;
+
+	return index;
+}
+
+static bool IsInRange(const void *address, const void *addr_min, const void *addr_max)
+{
+	return address && address >= addr_min && address < addr_max;
+}
+
+// Where a search from `addr_start` begins: the scans only look at and after it.
+static const void *GetRangeStart(const void *addr_start, const void *addr_min)
+{
+	return (std::max)(addr_start, addr_min);
+}
+
+/**
+ * Whether `name` names the class for the scan of the type descriptors: a name `HasName` accepts,
+ * or a partial MSVC raw name, the text after ".?AV" up to and excluding an '@'. "CPlayer@game"
+ * matches ".?AVCPlayer@game@@" and ".?AVCPlayer@game@world@@".
+ */
+static bool MatchesScanName(const CRttiIndex &index, const RttiClass_t &cls, const char *name)
+{
+	if (HasName(index, cls, name))
+		return true;
+
+	const char *raw = index.GetRawName(cls);
+
+	if (strncmp(raw, ".?A", 3) != 0 || !raw[3])
+		return false;
+
+	raw += 4;
+
+	for (; *name; raw++, name++)
+	{
+		if (tolower(static_cast<unsigned char>(*raw)) != tolower(static_cast<unsigned char>(*name)))
+			return false;
+	}
+
+	return *raw == '@';
+}
+
+// The class with the lowest type descriptor in [addr_start, addr_max) named `rtti_name`, as the scan finds it.
+static const RttiClass_t *FindClassInRange(const CRttiIndex &index, const void *addr_start, const void *addr_max, const char *rtti_name)
+{
+	if (!rtti_name || !*rtti_name)
+		return nullptr;
+
+	if (strncmp(rtti_name, "_ZTS", 4) == 0 || strncmp(rtti_name, "_ZTI", 4) == 0)
+		rtti_name += 4;
+
+	// The classes are sorted by the offset of their type descriptor.
+	for (const auto &cls : index.GetClasses())
+	{
+		if (IsInRange(index.GetAddress(cls.TypeDescriptor), addr_start, addr_max) && MatchesScanName(index, cls, rtti_name))
+			return &cls;
+	}
+
+	return nullptr;
+}
+
+#ifdef _WIN32
+
+static void *ScanRTTIDescriptor(const void *addr_start, const void *addr_min, const void *addr_max, const char *rtti_name)
 {
 	if (IsSafeModeActive())
 	{
@@ -167,7 +1110,7 @@ void *GetRTTIDescriptor(const void *addr_start, const void *addr_min, const void
 	return nullptr;
 }
 
-void **GetVTableForDescriptor(const void *addr_start, const void *addr_min, const void *addr_max, const void *rtti_descriptor)
+static void **ScanVTableForDescriptor(const void *addr_start, const void *addr_min, const void *addr_max, const void *rtti_descriptor)
 {
 	auto refs = FindReferences(addr_start, addr_min, addr_max, rtti_descriptor, 0, true, true, false, false, 4, 0);
 	
@@ -187,8 +1130,65 @@ void **GetVTableForDescriptor(const void *addr_start, const void *addr_min, cons
 	return nullptr;
 }
 
+#endif
+
+void *GetRTTIDescriptor(const void *addr_start, const void *addr_min, const void *addr_max, const char *rtti_name)
+{
+	if (auto index = GetRangeIndex(addr_min, addr_max))
+	{
+		if (auto cls = FindClassInRange(*index, GetRangeStart(addr_start, addr_min), addr_max, rtti_name))
+			return index->GetAddress(cls->TypeDescriptor);
+
+		SetError(ME_NOT_FOUND);
+		return nullptr;
+	}
+
+#ifdef _WIN32
+	return ScanRTTIDescriptor(addr_start, addr_min, addr_max, rtti_name);
+#else
+	SetError(ME_NOT_FOUND);
+	return nullptr;
+#endif
+}
+
+void **GetVTableForDescriptor(const void *addr_start, const void *addr_min, const void *addr_max, const void *rtti_descriptor)
+{
+	if (auto index = GetRangeIndex(addr_min, addr_max))
+	{
+		auto offset = reinterpret_cast<uintptr_t>(rtti_descriptor) - index->GetBase();
+		auto cls = (offset < index->GetSize()) ? index->FindByDescriptor(static_cast<uint32_t>(offset)) : nullptr;
+		auto vtable = cls ? index->GetAddress(cls->VTable) : nullptr;
+
+		if (IsInRange(vtable, GetRangeStart(addr_start, addr_min), addr_max))
+			return static_cast<void **>(vtable);
+
+		SetError(ME_NOT_FOUND);
+		return nullptr;
+	}
+
+#ifdef _WIN32
+	return ScanVTableForDescriptor(addr_start, addr_min, addr_max, rtti_descriptor);
+#else
+	SetError(ME_NOT_FOUND);
+	return nullptr;
+#endif
+}
+
 void **GetVTableForClass(const void *addr_start, const void *addr_min, const void *addr_max, const char *rtti_name)
 {
+	if (auto index = GetRangeIndex(addr_min, addr_max))
+	{
+		auto start = GetRangeStart(addr_start, addr_min);
+		auto cls = FindClassInRange(*index, start, addr_max, rtti_name);
+		auto vtable = cls ? index->GetAddress(cls->VTable) : nullptr;
+
+		if (IsInRange(vtable, start, addr_max))
+			return static_cast<void **>(vtable);
+
+		SetError(ME_NOT_FOUND);
+		return nullptr;
+	}
+
 	auto desc = GetRTTIDescriptor(addr_start, addr_min, addr_max, rtti_name);
 	if (!desc)
 		return nullptr;
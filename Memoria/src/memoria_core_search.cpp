@@ -2,11 +2,16 @@
 
 #include "memoria_core_misc.hpp"
 #include "memoria_core_errors.hpp"
+#include "memoria_core_guard.hpp"
 #include "memoria_core_options.hpp"
+#include "memoria_core_relocs.hpp"
+#include "memoria_core_source.hpp"
 #include "memoria_utils_assert.hpp"
 
 #include "hde64.h"
 
+#include <algorithm>
+
 MEMORIA_BEGIN
 
 using FindMemoryCmp_t = bool(*)(const void *addr1, const void *addr2, size_t size, void *param);
@@ -16,19 +21,55 @@ static bool FindMemoryCmp(const void *addr1, const void *addr2, size_t size, voi
 	return memcmp(addr1, addr2, size) == 0;
 }
 
-void *FindMemory(const void *addr_start, const void *addr_min, const void *addr_max, const void *data, size_t size, bool backward, 
-	ptrdiff_t offset = 0, FindMemoryCmp_t comparator = FindMemoryCmp, void *comparator_param = nullptr)
+// Tracks a contiguous range of pages known to be readable, so that a scan
+// probes every page once instead of validating every position.
+struct ReadablePages_t
 {
-	Assert(addr_min != nullptr && addr_max != nullptr && addr_min <= addr_max);
+	static constexpr uintptr_t PageSize = 4096;
 
-	if (IsSafeModeActive())
+	uintptr_t Low = 1;
+	uintptr_t High = 0;
+
+	// Checks the pages of `[lo, hi]`. On failure, `bad` receives the first unreadable page.
+	bool Check(uintptr_t lo, uintptr_t hi, uintptr_t &bad)
 	{
-		if (!IsMemoryValid(addr_start) || !IsMemoryValid(addr_min) || !IsMemoryValid(addr_max))
+		if (lo >= Low && hi <= High)
+			return true;
+
+		for (uintptr_t page = lo & ~(PageSize - 1);; page += PageSize)
 		{
-			SetError(ME_INVALID_MEMORY);
-			return nullptr;
+			if (page < Low || page > High)
+			{
+				if (!ProbeMemory(reinterpret_cast<const void *>(page)))
+				{
+					bad = page;
+					return false;
+				}
+
+				if (page == High + 1)
+					High = page + PageSize - 1;
+				else if (page + PageSize == Low)
+					Low = page;
+				else
+					Low = page, High = page + PageSize - 1;
+			}
+
+			if (page >= (hi & ~(PageSize - 1)))
+				return true;
 		}
+	}
+};
 
+void *FindMemory(const void *addr_start, const void *addr_min, const void *addr_max, const void *data, size_t size, bool backward, 
+	ptrdiff_t offset = 0, FindMemoryCmp_t comparator = FindMemoryCmp, void *comparator_param = nullptr)
+{
+	Assert(addr_min != nullptr && addr_max != nullptr && addr_min <= addr_max);
+
+	const bool safe_mode = IsSafeModeActive();
+
+	if (safe_mode)
+	{
+		// The range itself is not validated: unreadable pages are skipped during the scan.
 		if (!IsMemoryValid(data))
 		{
 			SetError(ME_INVALID_MEMORY);
@@ -48,11 +89,26 @@ void *FindMemory(const void *addr_start, const void *addr_min, const void *addr_
 	const void *result = static_cast<const void *>(addr_start);
 	addr_max = reinterpret_cast<const void *>(reinterpret_cast<intptr_t>(addr_max) - size);
 
+	ReadablePages_t pages;
+
 	do
 	{
 		if (!IsInBounds(result, addr_min, addr_max))
 			return nullptr;
 
+		uintptr_t bad;
+
+		if (safe_mode && !pages.Check(uintptr_t(result), uintptr_t(result) + size - 1, bad))
+		{
+			// Skip every position that overlaps the unreadable page.
+			if (backward)
+				result = reinterpret_cast<void *>(bad - size);
+			else
+				result = reinterpret_cast<void *>(bad + ReadablePages_t::PageSize);
+
+			continue;
+		}
+
 		if (comparator(result, data, size, comparator_param))
 			return reinterpret_cast<void *>(uintptr_t(result) + offset);
 
@@ -191,32 +247,125 @@ void *FindFirstSignature(const void *addr_start, const void *addr_min, const voi
 	return nullptr;
 }
 
-Memoria::Vector<Ref_t> FindReferences(const void *addr_start, const void *addr_min, const void *addr_max, const void *data, uint16_t opcode,
-	bool search_absolute, bool search_relative, bool stop_on_first_found, bool backward, ptrdiff_t pre_offset, ptrdiff_t offset)
-{
-	Memoria::Vector<Ref_t> refs{};
+using FindSourceCmp_t = bool(*)(const uint8_t *addr, const void *param);
 
-	if (!search_absolute && !search_relative)
+static uintptr_t FindInSource(IMemorySource &source, uintptr_t addr_min, uintptr_t addr_max, size_t size, bool backward, ptrdiff_t offset,
+	FindSourceCmp_t comparator, const void *comparator_param)
+{
+	if (size == 0 || addr_max <= addr_min || addr_max - addr_min < size)
 	{
 		SetError(ME_INVALID_ARGUMENT);
-		return refs;
+		return 0;
 	}
 
-	if (IsSafeModeActive())
+	constexpr size_t ChunkSize = 64 * 1024;
+	constexpr uintptr_t PageSize = 4096;
+
+	// Consecutive windows overlap by `size - 1` bytes, so that matches crossing a window boundary are found.
+	Memoria::Vector<uint8_t> buffer(ChunkSize + size - 1);
+	Memoria::Vector<MemoryIo_t> pages{};
+	size_t positions = addr_max - addr_min - size + 1;
+
+	for (size_t done = 0; done < positions; done += ChunkSize)
 	{
-		if (!IsMemoryValid(addr_start) || !IsMemoryValid(addr_min) || !IsMemoryValid(addr_max))
+		size_t count = (std::min)(ChunkSize, positions - done);
+		uintptr_t window = backward ? addr_min + positions - done - count : addr_min + done;
+		size_t length = count + size - 1;
+
+		// One request per page, so that inaccessible pages only leave holes in the window.
+		// The source coalesces them into as few reads as it can.
+		pages.clear();
+
+		for (size_t i = 0; i < length;)
 		{
-			SetError(ME_INVALID_ARGUMENT);
-			return refs;
+			size_t chunk = (std::min)(length - i, static_cast<size_t>(PageSize - ((window + i) & (PageSize - 1))));
+
+			if (pages.full())
+				pages.reserve(pages.capacity() * 2 + 32);
+
+			pages.push_back({ window + i, &buffer[i], chunk, 0 });
+			i += chunk;
 		}
 
-		if (!IsMemoryValid(data))
+		if (source.ReadBatch({ pages.data(), pages.size() }) == 0)
+			continue;
+
+		// A match may only consist of completely read pages.
+		auto is_readable = [&](size_t i) -> bool
 		{
-			SetError(ME_INVALID_ARGUMENT);
-			return refs;
+			size_t first = ((window & (PageSize - 1)) + i) / PageSize;
+			size_t last = ((window & (PageSize - 1)) + i + size - 1) / PageSize;
+
+			for (size_t k = first; k <= last; k++)
+			{
+				if (pages[k].Transferred != pages[k].Size)
+					return false;
+			}
+
+			return true;
+		};
+
+		if (backward)
+		{
+			for (size_t i = count; i-- > 0;)
+			{
+				if (is_readable(i) && comparator(&buffer[i], comparator_param))
+					return window + i + offset;
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				if (is_readable(i) && comparator(&buffer[i], comparator_param))
+					return window + i + offset;
+			}
 		}
 	}
 
+	SetError(ME_NOT_FOUND);
+	return 0;
+}
+
+struct FindSourceBlock_t
+{
+	const void *Data;
+	size_t Size;
+};
+
+uintptr_t FindBlock(IMemorySource &source, uintptr_t addr_min, uintptr_t addr_max, const void *data, size_t size, bool backward, ptrdiff_t offset)
+{
+	FindSourceBlock_t block{ data, size };
+
+	return FindInSource(source, addr_min, addr_max, size, backward, offset, [](const uint8_t *addr, const void *param) -> bool
+	{
+		auto block = static_cast<const FindSourceBlock_t *>(param);
+		return memcmp(addr, block->Data, block->Size) == 0;
+	}, &block);
+}
+
+uintptr_t FindSignature(IMemorySource &source, uintptr_t addr_min, uintptr_t addr_max, const CSignature &sig, bool backward, ptrdiff_t offset)
+{
+	return FindInSource(source, addr_min, addr_max, sig.GetPayload().size(), backward, offset, [](const uint8_t *addr, const void *param) -> bool
+	{
+		return static_cast<const CSignature *>(param)->Match(addr);
+	}, &sig);
+}
+
+uintptr_t FindSignature(IMemorySource &source, uintptr_t addr_min, uintptr_t addr_max, const char *sig, bool backward, ptrdiff_t offset)
+{
+	if (!sig || !*sig)
+		return 0;
+
+	CSignature s(sig);
+	return FindSignature(source, addr_min, addr_max, s, backward, offset);
+}
+
+// Compares the value at every position from `addr_start` to the end of the range in the direction of the scan,
+// or up to the first reference with `stop_on_first_found`.
+static void ScanReferences(Memoria::Vector<Ref_t> &refs, const void *addr_start, const void *addr_min, const void *addr_max, const void *data,
+	uint16_t opcode, bool search_absolute, bool search_relative, bool stop_on_first_found, bool backward, ptrdiff_t pre_offset, ptrdiff_t offset)
+{
 	const bool has_opcode_header = (opcode != 0);
 	const bool is_two_bytes_opcode = (has_opcode_header) && (opcode > 255);
 	void *result = const_cast<void *>(addr_start);
@@ -231,7 +380,7 @@ Memoria::Vector<Ref_t> FindReferences(const void *addr_start, const void *addr_m
 		if (!IsInBounds(result, addr_min, addr_max))
 		{
 			SetError(ME_NOT_FOUND);
-			return refs;
+			return;
 		}
 
 		void *addr_abs;
@@ -253,7 +402,7 @@ Memoria::Vector<Ref_t> FindReferences(const void *addr_start, const void *addr_m
 			if (result == nullptr)
 			{
 				SetError(ME_NOT_FOUND);
-				return refs;
+				return;
 			}
 
 			result = PtrOffset(result, offs);
@@ -267,6 +416,9 @@ Memoria::Vector<Ref_t> FindReferences(const void *addr_start, const void *addr_m
 			if (addr_abs == data)
 			{
 				refs.emplace_back(true, result, addr_abs, offset);
+
+				if (stop_on_first_found)
+					return;
 			}
 		}
 
@@ -275,6 +427,9 @@ Memoria::Vector<Ref_t> FindReferences(const void *addr_start, const void *addr_m
 			if (addr_rel == data)
 			{
 				refs.emplace_back(false, result, addr_rel, offset);
+
+				if (stop_on_first_found)
+					return;
 			}
 		}
 
@@ -283,6 +438,146 @@ Memoria::Vector<Ref_t> FindReferences(const void *addr_start, const void *addr_m
 		else
 			result = PtrAdvance(result, 1);
 	} while (true);
+}
+
+
+// Absolute references that relocation slots hold, for the slots in the read-only parts of [addr_min, addr_max)
+// that the scan from `addr_start` would reach.
+static void FindSlotReferences(Memoria::Vector<Ref_t> &refs, const CRelocationIndex &relocations, const void *addr_start,
+	const void *addr_min, const void *addr_max, const void *data, uint16_t opcode, bool backward, ptrdiff_t offset)
+{
+	uintptr_t base = relocations.GetBase();
+	uintptr_t start = reinterpret_cast<uintptr_t>(addr_start);
+	uintptr_t min = reinterpret_cast<uintptr_t>(addr_min);
+
+	// As in the scan, the value must end before `addr_max`.
+	uintptr_t max = reinterpret_cast<uintptr_t>(addr_max) - sizeof(void *);
+
+	size_t opcode_size = (opcode == 0) ? 0 : (opcode > 255 ? 2 : 1);
+	uintptr_t first = backward ? min : (std::max)(min, start);
+	uintptr_t last = backward ? (std::min)(max, start + 1) : max;
+
+	if (first >= last || relocations.GetWidth() != sizeof(void *))
+		return;
+
+	for (auto slot : relocations.FindSlots(static_cast<uint32_t>(first - base), static_cast<uint32_t>(last - base)))
+	{
+		auto address = reinterpret_cast<void *>(base + slot);
+
+		if (relocations.IsWritable(slot) || *static_cast<void **>(address) != data)
+			continue;
+
+		if (opcode_size)
+		{
+			uint16_t prefix = 0;
+
+			if (base + slot - opcode_size < min)
+				continue;
+
+			memcpy(&prefix, PtrOffset(address, -static_cast<ptrdiff_t>(opcode_size)), opcode_size);
+
+			if (prefix != opcode)
+				continue;
+		}
+
+		refs.emplace_back(true, address, const_cast<void *>(data), offset);
+	}
+}
+
+Memoria::Vector<Ref_t> FindReferences(const void *addr_start, const void *addr_min, const void *addr_max, const void *data, uint16_t opcode,
+	bool search_absolute, bool search_relative, bool stop_on_first_found, bool backward, ptrdiff_t pre_offset, ptrdiff_t offset)
+{
+	Memoria::Vector<Ref_t> refs{};
+
+	if (!search_absolute && !search_relative)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return refs;
+	}
+
+	if (IsSafeModeActive())
+	{
+		if (!IsMemoryValid(addr_start) || !IsMemoryValid(addr_min) || !IsMemoryValid(addr_max))
+		{
+			SetError(ME_INVALID_ARGUMENT);
+			return refs;
+		}
+
+		if (!IsMemoryValid(data))
+		{
+			SetError(ME_INVALID_ARGUMENT);
+			return refs;
+		}
+	}
+
+	// In the read-only parts of a module, a pointer can only be where the loader put one, in a relocation slot.
+	std::shared_ptr<const CRelocationIndex> relocations;
+
+	if (search_absolute)
+	{
+		relocations = GetRelocationIndex(addr_min);
+
+		uintptr_t end = relocations ? relocations->GetBase() + relocations->GetSize() : 0;
+
+		if (relocations && (relocations->IsEmpty() || !relocations->IsComplete() || !relocations->GetBase() || reinterpret_cast<uintptr_t>(addr_max) > end))
+			relocations = nullptr;
+	}
+
+	if (!relocations)
+	{
+		ScanReferences(refs, addr_start, addr_min, addr_max, data, opcode, search_absolute, search_relative, stop_on_first_found, backward, pre_offset, offset);
+		return refs;
+	}
+
+	if (search_relative)
+		ScanReferences(refs, addr_start, addr_min, addr_max, data, opcode, false, true, stop_on_first_found, backward, pre_offset, offset);
+
+	FindSlotReferences(refs, *relocations, addr_start, addr_min, addr_max, data, opcode, backward, offset);
+
+	// The writable parts are scanned, each up to a pointer past its end so that values that start in it are compared.
+	uintptr_t base = relocations->GetBase();
+
+	for (const auto &range : relocations->GetWritableRanges())
+	{
+		auto min = (std::max)(reinterpret_cast<uintptr_t>(addr_min), base + range.Begin);
+		auto max = (std::min)(reinterpret_cast<uintptr_t>(addr_max), base + range.End + sizeof(void *));
+		auto start = reinterpret_cast<uintptr_t>(addr_start);
+
+		if (min >= max || (!backward && start >= max) || (backward && start < min))
+			continue;
+
+		if (backward)
+		{
+			// A backward scan reads a whole pointer at its start, which must lie before `max - sizeof(void *)`.
+			if (max - min <= sizeof(void *))
+				continue;
+
+			start = (std::min)(start, max - sizeof(void *) - 1);
+		}
+		else
+		{
+			start = (std::max)(start, min);
+		}
+
+		ScanReferences(refs, reinterpret_cast<void *>(start), reinterpret_cast<void *>(min), reinterpret_cast<void *>(max),
+			data, opcode, true, false, stop_on_first_found, backward, pre_offset, offset);
+	}
+
+	// In the order of the scan, an absolute reference before a relative one at the same position.
+	std::stable_sort(refs.begin(), refs.end(), [backward](const Ref_t &a, const Ref_t &b)
+	{
+		if (a.xref != b.xref)
+			return backward ? a.xref > b.xref : a.xref < b.xref;
+
+		return a.is_absolute && !b.is_absolute;
+	});
+
+	// Each part stopped at its own first reference, only the first of all of them is kept.
+	if (stop_on_first_found && refs.size() > 1)
+		refs.erase(refs.begin() + 1, refs.end());
+
+	if (refs.empty())
+		SetError(ME_NOT_FOUND);
 
 	return refs;
 }
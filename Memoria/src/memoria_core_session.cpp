@@ -0,0 +1,455 @@
+#include "memoria_core_session.hpp"
+
+#include "memoria_core_errors.hpp"
+#include "memoria_utils_assert.hpp"
+
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MEMORIA_BEGIN
+
+static thread_local CWriteSession *gActiveSession = nullptr;
+
+//
+// Platform layer. Nothing here may allocate, since `Commit` can run while
+// other threads (possibly holding the heap lock) are suspended.
+//
+
+struct Region_t
+{
+	uint8_t *Base;
+	uint8_t *End;
+	uint32_t Protect;
+	bool Executable;
+};
+
+#ifdef _WIN32
+
+static bool QueryRegion(const void *addr, Region_t &region)
+{
+	MEMORY_BASIC_INFORMATION mbi;
+
+	if (VirtualQuery(addr, &mbi, sizeof(mbi)) == 0 || mbi.State != MEM_COMMIT)
+		return false;
+
+	region.Base = static_cast<uint8_t *>(mbi.BaseAddress);
+	region.End = region.Base + mbi.RegionSize;
+	region.Protect = mbi.Protect;
+	region.Executable = (mbi.Protect & (PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)) != 0;
+
+	return true;
+}
+
+static bool Unprotect(uint8_t *begin, size_t size, const Region_t &region, uint32_t &old_protection)
+{
+	DWORD old;
+
+	if (!VirtualProtect(begin, size, region.Executable ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE, &old))
+		return false;
+
+	old_protection = old;
+	return true;
+}
+
+static bool Reprotect(uint8_t *begin, size_t size, const Region_t &region, uint32_t old_protection)
+{
+	DWORD old;
+
+	if (!VirtualProtect(begin, size, old_protection, &old))
+		return false;
+
+	if (region.Executable)
+		FlushInstructionCache(GetCurrentProcess(), begin, size);
+
+	return true;
+}
+
+#else
+
+static uintptr_t GetPageSize()
+{
+	static uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+	return page_size;
+}
+
+// Parses one line of `/proc/self/maps`: "begin-end perms offset dev inode path".
+static bool ParseMapsLine(const char *line, Region_t &region)
+{
+	char *end;
+
+	auto begin = strtoull(line, &end, 16);
+
+	if (*end != '-')
+		return false;
+
+	auto finish = strtoull(end + 1, &end, 16);
+
+	if (*end != ' ' || strlen(end) < 4)
+		return false;
+
+	region.Base = reinterpret_cast<uint8_t *>(static_cast<uintptr_t>(begin));
+	region.End = reinterpret_cast<uint8_t *>(static_cast<uintptr_t>(finish));
+	region.Protect = (end[1] == 'r' ? PROT_READ : 0) | (end[2] == 'w' ? PROT_WRITE : 0) | (end[3] == 'x' ? PROT_EXEC : 0);
+	region.Executable = end[3] == 'x';
+
+	return true;
+}
+
+static bool QueryRegion(const void *addr, Region_t &region)
+{
+	int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return false;
+
+	// Only the leading fields of a line matter, so long paths are simply cut off.
+	char buffer[4096];
+	char line[256];
+	size_t line_size = 0;
+	bool found = false;
+
+	ssize_t count;
+
+	while (!found && (count = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (ssize_t i = 0; i < count && !found; i++)
+		{
+			if (buffer[i] != '\n')
+			{
+				if (line_size < sizeof(line) - 1)
+					line[line_size++] = buffer[i];
+
+				continue;
+			}
+
+			line[line_size] = '\0';
+			line_size = 0;
+
+			Region_t current;
+
+			if (ParseMapsLine(line, current) && addr >= current.Base && addr < current.End)
+			{
+				region = current;
+				found = true;
+			}
+		}
+	}
+
+	close(fd);
+	return found;
+}
+
+static bool Unprotect(uint8_t *begin, size_t size, const Region_t &region, uint32_t &old_protection)
+{
+	auto page = reinterpret_cast<uintptr_t>(begin) & ~(GetPageSize() - 1);
+	auto length = reinterpret_cast<uintptr_t>(begin) + size - page;
+
+	if (mprotect(reinterpret_cast<void *>(page), length, static_cast<int>(region.Protect) | PROT_READ | PROT_WRITE) != 0)
+		return false;
+
+	old_protection = region.Protect;
+	return true;
+}
+
+static bool Reprotect(uint8_t *begin, size_t size, const Region_t &region, uint32_t old_protection)
+{
+	auto page = reinterpret_cast<uintptr_t>(begin) & ~(GetPageSize() - 1);
+	auto length = reinterpret_cast<uintptr_t>(begin) + size - page;
+
+	if (mprotect(reinterpret_cast<void *>(page), length, static_cast<int>(old_protection)) != 0)
+		return false;
+
+	if (region.Executable)
+		__builtin___clear_cache(reinterpret_cast<char *>(begin), reinterpret_cast<char *>(begin + size));
+
+	return true;
+}
+
+#endif
+
+// Copies `size` bytes. With `atomic`, small writes go through a compare-exchange of the
+// enclosing aligned block, so concurrent readers see either the old or the new bytes.
+static void CopyBytes(void *dest, const void *src, size_t size, bool atomic)
+{
+	auto addr = reinterpret_cast<uintptr_t>(dest);
+
+	if (atomic && (addr & 7) + size <= 8)
+	{
+#ifdef _WIN32
+		auto block = reinterpret_cast<volatile LONG64 *>(addr & ~uintptr_t(7));
+		LONG64 expected = *block;
+
+		while (true)
+		{
+			LONG64 desired = expected;
+			memcpy(reinterpret_cast<uint8_t *>(&desired) + (addr & 7), src, size);
+
+			LONG64 previous = InterlockedCompareExchange64(block, desired, expected);
+
+			if (previous == expected)
+				return;
+
+			expected = previous;
+		}
+#else
+		auto block = reinterpret_cast<uint64_t *>(addr & ~uintptr_t(7));
+		uint64_t expected = __atomic_load_n(block, __ATOMIC_RELAXED);
+
+		while (true)
+		{
+			uint64_t desired = expected;
+			memcpy(reinterpret_cast<uint8_t *>(&desired) + (addr & 7), src, size);
+
+			// On failure, `expected` receives the current value.
+			if (__atomic_compare_exchange_n(block, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+				return;
+		}
+#endif
+	}
+
+#if defined(_WIN32) && defined(MEMORIA_64BIT)
+	if (atomic && (addr & 15) + size <= 16)
+	{
+		auto block = reinterpret_cast<volatile LONG64 *>(addr & ~uintptr_t(15));
+		alignas(16) LONG64 expected[2] = { block[0], block[1] };
+
+		while (true)
+		{
+			alignas(16) LONG64 desired[2] = { expected[0], expected[1] };
+			memcpy(reinterpret_cast<uint8_t *>(desired) + (addr & 15), src, size);
+
+			// On failure, `expected` receives the current value.
+			if (InterlockedCompareExchange128(block, desired[1], desired[0], expected))
+				return;
+		}
+	}
+#endif
+
+	memcpy(dest, src, size);
+}
+
+CWriteSession::CWriteSession()
+	: _previous(gActiveSession)
+{
+	gActiveSession = this;
+}
+
+CWriteSession::~CWriteSession()
+{
+	if (_active)
+	{
+		Commit();
+		Deactivate();
+	}
+}
+
+void CWriteSession::Deactivate()
+{
+	AssertMsg(gActiveSession == this, "Write sessions must be ended in reverse order of creation.");
+
+	gActiveSession = _previous;
+	_active = false;
+}
+
+size_t CWriteSession::Stage(void *addr, const void *data, size_t size, bool atomic)
+{
+
+	size_t offset = _data.size();
+	_data.resize(offset + size);
+
+	if (size != 0)
+		memcpy(&_data[offset], data, size);
+
+	Write_t write;
+	write.Address = static_cast<uint8_t *>(addr);
+	write.Offset = offset;
+	write.Size = size;
+	write.Seq = static_cast<uint32_t>(_writes.size());
+	write.Atomic = atomic;
+	write.Written = false;
+
+	_writes.push_back(write);
+
+	return _writes.size() - 1;
+}
+
+size_t CWriteSession::StageFill(void *addr, uint8_t value, size_t size)
+{
+	size_t index = Stage(addr, nullptr, 0);
+
+	_data.resize(_data.size() + size);
+
+	memset(&_data[_writes[index].Offset], value, size);
+	_writes[index].Size = size;
+
+	return index;
+}
+
+bool CWriteSession::CommitSpanning(Write_t &write)
+{
+	uint8_t *addr = write.Address;
+	uint8_t *end = write.Address + write.Size;
+	const uint8_t *data = &_data[write.Offset];
+
+	while (addr < end)
+	{
+		Region_t region;
+
+		if (!QueryRegion(addr, region))
+		{
+			SetError(ME_INVALID_MEMORY);
+			return false;
+		}
+
+		size_t size = (std::min)(end, region.End) - addr;
+		uint32_t old_protection;
+
+		if (!Unprotect(addr, size, region, old_protection))
+		{
+			SetError(ME_INVALID_PROTECTION_1);
+			return false;
+		}
+
+		memcpy(addr, data, size);
+
+		if (!Reprotect(addr, size, region, old_protection))
+		{
+			SetError(ME_INVALID_PROTECTION_2);
+			return false;
+		}
+
+		addr += size;
+		data += size;
+	}
+
+	write.Written = true;
+	return true;
+}
+
+bool CWriteSession::Commit()
+{
+	if (_committed == _writes.size())
+		return true;
+
+	// While committing, `WriteMemory` must write directly instead of staging into this session.
+	auto active = gActiveSession;
+	gActiveSession = _previous;
+
+	Write_t *begin = &_writes[_committed];
+	Write_t *end = begin + (_writes.size() - _committed);
+
+	std::sort(begin, end, [](const Write_t &a, const Write_t &b)
+	{
+		if (a.Address != b.Address)
+			return a.Address < b.Address;
+
+		return a.Seq < b.Seq;
+	});
+
+	bool result = true;
+	Write_t *it = begin;
+
+	while (it != end)
+	{
+		if (it->Size == 0)
+		{
+			it->Written = true;
+			++it;
+			continue;
+		}
+
+		Region_t region;
+
+		if (!QueryRegion(it->Address, region))
+		{
+			SetError(ME_INVALID_MEMORY);
+			result = false;
+			++it;
+			continue;
+		}
+
+		// All writes that lie entirely within the same region share one protection change.
+		uint8_t *run_end = it->Address;
+		Write_t *last = it;
+
+		while (last != end && last->Address + last->Size <= region.End)
+		{
+			run_end = (std::max)(run_end, last->Address + last->Size);
+			++last;
+		}
+
+		if (last == it)
+		{
+			result &= CommitSpanning(*it);
+			++it;
+			continue;
+		}
+
+		uint32_t old_protection;
+
+		if (!Unprotect(it->Address, run_end - it->Address, region, old_protection))
+		{
+			SetError(ME_INVALID_PROTECTION_1);
+			result = false;
+			it = last;
+			continue;
+		}
+
+		// Overlapping writes must land in the order they were made.
+		std::sort(it, last, [](const Write_t &a, const Write_t &b) { return a.Seq < b.Seq; });
+
+		uint8_t *run_begin = it->Address;
+
+		for (auto write = it; write != last; ++write)
+		{
+			run_begin = (std::min)(run_begin, write->Address);
+
+			CopyBytes(write->Address, &_data[write->Offset], write->Size, write->Atomic);
+			write->Written = true;
+		}
+
+		if (!Reprotect(run_begin, run_end - run_begin, region, old_protection))
+		{
+			SetError(ME_INVALID_PROTECTION_2);
+			result = false;
+		}
+
+		it = last;
+	}
+
+	// Back to staging order, so that indices returned by `Stage` stay valid.
+	std::sort(begin, end, [](const Write_t &a, const Write_t &b) { return a.Seq < b.Seq; });
+
+	_committed = _writes.size();
+	gActiveSession = active;
+
+	return result;
+}
+
+void CWriteSession::Discard()
+{
+	if (!_active)
+		return;
+
+	_writes.clear();
+	_data.clear();
+	_committed = 0;
+
+	Deactivate();
+}
+
+CWriteSession *CWriteSession::GetActive()
+{
+	return gActiveSession;
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "memoria_utils_assert.hpp"
 
+#include <string.h>
 #include <string_view>
 
 MEMORIA_BEGIN
@@ -82,6 +83,30 @@ CSignature::CSignature(const void *data, size_t size, Memoria::Optional<uint8_t>
 	}
 }
 
+CSignature::CSignature(const void *data, const char *mask, size_t size)
+	: _payload{}, _mask{}, _has_optionals(false)
+{
+	_payload.reserve(size);
+	_mask.reserve(size);
+
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		if (mask[i] == '?')
+		{
+			_has_optionals = true;
+			_payload.push_back(0x00);
+			_mask.push_back('?');
+		}
+		else
+		{
+			_payload.push_back(bytes[i]);
+			_mask.push_back('x');
+		}
+	}
+}
+
 Memoria::Vector<Memoria::Optional<uint8_t>> CSignature::CreatePattern() const
 {
 	Memoria::Vector<Memoria::Optional<uint8_t>> std_sig;
@@ -0,0 +1,671 @@
+#include "memoria_core_source.hpp"
+
+#include "memoria_core_errors.hpp"
+#include "memoria_core_misc.hpp"
+#include "memoria_core_options.hpp"
+#include "memoria_core_write.hpp"
+
+#include <string.h>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+MEMORIA_BEGIN
+
+static constexpr uintptr_t SourcePageSize = 4096;
+
+//
+// IMemorySource
+//
+
+size_t IMemorySource::ReadBatch(std::span<MemoryIo_t> requests)
+{
+	// Sort an index list rather than the requests, so the caller's order is kept.
+	Memoria::Vector<uint32_t> order(requests.size());
+
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = static_cast<uint32_t>(i);
+
+	std::sort(order.begin(), order.end(), [&requests](uint32_t a, uint32_t b)
+	{
+		return requests[a].Address < requests[b].Address;
+	});
+
+	Memoria::Vector<uint8_t> scratch{};
+	size_t i = 0;
+
+	while (i < order.size())
+	{
+		uintptr_t begin = requests[order[i]].Address;
+		uintptr_t end = begin + requests[order[i]].Size;
+		size_t j = i + 1;
+
+		while (j < order.size())
+		{
+			const auto &next = requests[order[j]];
+			uintptr_t next_end = (std::max)(end, next.Address + next.Size);
+
+			if (next.Address > end + MaxCoalesceGap || next_end - begin > MaxCoalesceSize)
+				break;
+
+			end = next_end;
+			j++;
+		}
+
+		if (j == i + 1)
+		{
+			auto &request = requests[order[i]];
+			request.Transferred = Read(request.Address, request.Buffer, request.Size);
+
+			i = j;
+			continue;
+		}
+
+		if (scratch.size() < end - begin)
+			scratch.resize(end - begin);
+
+		size_t count = Read(begin, scratch.data(), end - begin);
+
+		for (size_t k = i; k < j; k++)
+		{
+			auto &request = requests[order[k]];
+			size_t offset = request.Address - begin;
+
+			if (offset + request.Size <= count)
+			{
+				memcpy(request.Buffer, &scratch[offset], request.Size);
+				request.Transferred = request.Size;
+			}
+			else
+			{
+				// The combined range hit inaccessible memory, which may lie in a gap.
+				request.Transferred = Read(request.Address, request.Buffer, request.Size);
+			}
+		}
+
+		i = j;
+	}
+
+	size_t completed = 0;
+
+	for (const auto &request : requests)
+	{
+		if (request.Transferred == request.Size)
+			completed++;
+	}
+
+	return completed;
+}
+
+bool IMemorySource::ReadAStr(uintptr_t address, char *out, size_t max_size)
+{
+	if (!out || max_size == 0)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	// Read up to page boundaries, so that a string at the end of a region can still be read.
+	size_t length = 0;
+
+	while (length < max_size - 1)
+	{
+		uintptr_t current = address + length;
+		size_t chunk = (std::min)(max_size - 1 - length, static_cast<size_t>(SourcePageSize - (current & (SourcePageSize - 1))));
+		size_t count = Read(current, out + length, chunk);
+
+		auto terminator = static_cast<const char *>(memchr(out + length, '\0', count));
+
+		if (terminator)
+			return true;
+
+		length += count;
+
+		if (count < chunk)
+		{
+			out[length] = '\0';
+			SetError(ME_INVALID_MEMORY);
+			return false;
+		}
+	}
+
+	out[length] = '\0';
+	return true;
+}
+
+bool IMemorySource::ReadWStr(uintptr_t address, wchar_t *out, size_t max_size)
+{
+	if (!out || max_size == 0)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	size_t length = 0;
+
+	while (length < max_size - 1)
+	{
+		if (!ReadExact(address + length * sizeof(wchar_t), &out[length], sizeof(wchar_t)))
+		{
+			out[length] = L'\0';
+			SetError(ME_INVALID_MEMORY);
+			return false;
+		}
+
+		if (out[length] == L'\0')
+			return true;
+
+		length++;
+	}
+
+	out[length] = L'\0';
+	return true;
+}
+
+//
+// IMemorySink
+//
+
+size_t IMemorySink::WriteBatch(std::span<MemoryIo_t> requests)
+{
+	size_t completed = 0;
+
+	for (auto &request : requests)
+	{
+		request.Transferred = Write(request.Address, request.Buffer, request.Size);
+
+		if (request.Transferred == request.Size)
+			completed++;
+	}
+
+	return completed;
+}
+
+//
+// CLocalMemory
+//
+
+size_t CLocalMemory::Read(uintptr_t address, void *buffer, size_t size)
+{
+	if (size == 0)
+		return 0;
+
+	auto addr = reinterpret_cast<const void *>(address);
+
+	if (IsSafeModeActive() && (!IsMemoryValid(addr) || !IsMemoryValid(addr, size - 1)))
+	{
+		SetError(ME_INVALID_MEMORY);
+		return 0;
+	}
+
+	memcpy(buffer, addr, size);
+	return size;
+}
+
+size_t CLocalMemory::ReadBatch(std::span<MemoryIo_t> requests)
+{
+	// No system calls involved, nothing to coalesce.
+	size_t completed = 0;
+
+	for (auto &request : requests)
+	{
+		request.Transferred = Read(request.Address, request.Buffer, request.Size);
+
+		if (request.Transferred == request.Size)
+			completed++;
+	}
+
+	return completed;
+}
+
+size_t CLocalMemory::Write(uintptr_t address, const void *data, size_t size)
+{
+	if (size == 0)
+		return 0;
+
+	return WriteMemory(reinterpret_cast<void *>(address), data, size) ? size : 0;
+}
+
+CLocalMemory &GetLocalMemory()
+{
+	static CLocalMemory local;
+	return local;
+}
+
+#ifdef _WIN32
+
+size_t EnumerateLocalRegions(MemoryRegionCallback_t cb, void *param)
+{
+	constexpr DWORD Writable = PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+	constexpr DWORD Executable = PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+
+	MEMORY_BASIC_INFORMATION mbi;
+	size_t count = 0;
+
+	for (uintptr_t address = 0; VirtualQuery(reinterpret_cast<LPCVOID>(address), &mbi, sizeof(mbi)) != 0;)
+	{
+		uintptr_t next = reinterpret_cast<uintptr_t>(mbi.BaseAddress) + mbi.RegionSize;
+
+		if (mbi.State == MEM_COMMIT)
+		{
+			MemoryRegion_t region;
+
+			region.Begin = reinterpret_cast<uintptr_t>(mbi.BaseAddress);
+			region.End = next;
+			region.Readable = mbi.Protect && !(mbi.Protect & (PAGE_NOACCESS | PAGE_GUARD));
+			region.Writable = region.Readable && (mbi.Protect & Writable);
+			region.Executable = (mbi.Protect & Executable) != 0;
+
+			count++;
+
+			if (!cb(region, param))
+				break;
+		}
+
+		if (next <= address)
+			break;
+
+		address = next;
+	}
+
+	return count;
+}
+
+#else
+
+size_t EnumerateLocalRegions(MemoryRegionCallback_t cb, void *param)
+{
+	FILE *maps = fopen("/proc/self/maps", "r");
+
+	if (!maps)
+		return 0;
+
+	char line[512];
+	size_t count = 0;
+
+	// "begin-end perms offset dev inode path"
+	while (fgets(line, sizeof(line), maps))
+	{
+		char *end;
+
+		auto begin = strtoull(line, &end, 16);
+
+		if (*end != '-')
+			continue;
+
+		auto finish = strtoull(end + 1, &end, 16);
+
+		if (*end != ' ' || strlen(end) < 4)
+			continue;
+
+		MemoryRegion_t region;
+
+		region.Begin = static_cast<uintptr_t>(begin);
+		region.End = static_cast<uintptr_t>(finish);
+		region.Readable = end[1] == 'r';
+		region.Writable = end[2] == 'w';
+		region.Executable = end[3] == 'x';
+
+		// Kernel-provided pages that are not ordinary memory.
+		if (strstr(end, "[vvar") || strstr(end, "[vsyscall]"))
+			region.Readable = region.Writable = false;
+
+		count++;
+
+		if (!cb(region, param))
+			break;
+	}
+
+	fclose(maps);
+	return count;
+}
+
+#endif
+
+#ifdef _WIN32
+
+//
+// CProcessMemory
+//
+
+CProcessMemory::CProcessMemory(DWORD pid)
+	: _owns_handle(true)
+{
+	_process = OpenProcess(PROCESS_VM_READ | PROCESS_VM_WRITE | PROCESS_VM_OPERATION | PROCESS_QUERY_INFORMATION, FALSE, pid);
+
+	if (!_process)
+		_process = OpenProcess(PROCESS_VM_READ | PROCESS_QUERY_INFORMATION, FALSE, pid);
+
+	if (!_process)
+		SetError(ME_INVALID_ARGUMENT);
+}
+
+CProcessMemory::CProcessMemory(HANDLE process, bool owns_handle)
+	: _process(process)
+	, _owns_handle(owns_handle)
+{
+
+}
+
+CProcessMemory::~CProcessMemory()
+{
+	if (_process && _owns_handle)
+		CloseHandle(_process);
+}
+
+size_t CProcessMemory::Read(uintptr_t address, void *buffer, size_t size)
+{
+	if (!_process || size == 0)
+		return 0;
+
+	SIZE_T count = 0;
+
+	if (ReadProcessMemory(_process, reinterpret_cast<LPCVOID>(address), buffer, size, &count))
+		return count;
+
+	// The range crosses into inaccessible memory, read what precedes it page by page.
+	size_t total = 0;
+
+	while (total < size)
+	{
+		uintptr_t current = address + total;
+		size_t chunk = (std::min)(size - total, static_cast<size_t>(SourcePageSize - (current & (SourcePageSize - 1))));
+
+		if (!ReadProcessMemory(_process, reinterpret_cast<LPCVOID>(current), static_cast<uint8_t *>(buffer) + total, chunk, &count))
+			break;
+
+		total += count;
+	}
+
+	if (total < size)
+		SetError(ME_INVALID_MEMORY);
+
+	return total;
+}
+
+size_t CProcessMemory::Write(uintptr_t address, const void *data, size_t size)
+{
+	if (!_process || size == 0)
+		return 0;
+
+	SIZE_T count = 0;
+
+	if (!WriteProcessMemory(_process, reinterpret_cast<LPVOID>(address), data, size, &count))
+		SetError(ME_INVALID_MEMORY);
+
+	return count;
+}
+
+#else
+
+//
+// CProcessVmMemory
+//
+
+// `IOV_MAX` is 1024 on Linux, but a smaller batch keeps the stack usage reasonable.
+static constexpr size_t MaxIovecCount = 256;
+
+using ProcessVmFn_t = ssize_t(*)(pid_t pid, const iovec *local, unsigned long local_count,
+	const iovec *remote, unsigned long remote_count, unsigned long flags);
+
+// Transfers the requests in as few system calls as possible. Partial transfers happen at
+// the granularity of whole iovec elements, so an element that fails is handed to `single`.
+template <typename Single>
+static size_t TransferBatch(pid_t pid, std::span<MemoryIo_t> requests, ProcessVmFn_t fn, Single single)
+{
+	iovec local[MaxIovecCount];
+	iovec remote[MaxIovecCount];
+
+	size_t i = 0;
+
+	while (i < requests.size())
+	{
+		size_t count = (std::min)(requests.size() - i, MaxIovecCount);
+
+		for (size_t k = 0; k < count; k++)
+		{
+			local[k].iov_base = requests[i + k].Buffer;
+			local[k].iov_len = requests[i + k].Size;
+
+			remote[k].iov_base = reinterpret_cast<void *>(requests[i + k].Address);
+			remote[k].iov_len = requests[i + k].Size;
+		}
+
+		ssize_t result = fn(pid, local, count, remote, count, 0);
+		size_t transferred = (result > 0) ? static_cast<size_t>(result) : 0;
+
+		size_t k = i;
+
+		while (k < i + count && transferred >= requests[k].Size)
+		{
+			requests[k].Transferred = requests[k].Size;
+			transferred -= requests[k].Size;
+			k++;
+		}
+
+		if (k < i + count)
+		{
+			requests[k].Transferred = single(requests[k]);
+			k++;
+		}
+
+		i = k;
+	}
+
+	size_t completed = 0;
+
+	for (const auto &request : requests)
+	{
+		if (request.Transferred == request.Size)
+			completed++;
+	}
+
+	return completed;
+}
+
+// Transfers a single range. If it crosses into inaccessible memory, the accessible
+// prefix is transferred page by page.
+static size_t TransferSingle(pid_t pid, uintptr_t address, void *buffer, size_t size, ProcessVmFn_t fn)
+{
+	if (size == 0)
+		return 0;
+
+	iovec local{ buffer, size };
+	iovec remote{ reinterpret_cast<void *>(address), size };
+
+	ssize_t result = fn(pid, &local, 1, &remote, 1, 0);
+
+	if (result == static_cast<ssize_t>(size))
+		return size;
+
+	size_t total = 0;
+
+	while (total < size)
+	{
+		uintptr_t current = address + total;
+		size_t chunk = (std::min)(size - total, static_cast<size_t>(SourcePageSize - (current & (SourcePageSize - 1))));
+
+		local.iov_base = static_cast<uint8_t *>(buffer) + total;
+		local.iov_len = chunk;
+
+		remote.iov_base = reinterpret_cast<void *>(current);
+		remote.iov_len = chunk;
+
+		result = fn(pid, &local, 1, &remote, 1, 0);
+
+		if (result <= 0)
+			break;
+
+		total += static_cast<size_t>(result);
+
+		if (static_cast<size_t>(result) < chunk)
+			break;
+	}
+
+	if (total < size)
+		SetError(ME_INVALID_MEMORY);
+
+	return total;
+}
+
+size_t CProcessVmMemory::Read(uintptr_t address, void *buffer, size_t size)
+{
+	return TransferSingle(_pid, address, buffer, size, process_vm_readv);
+}
+
+size_t CProcessVmMemory::ReadBatch(std::span<MemoryIo_t> requests)
+{
+	return TransferBatch(_pid, requests, process_vm_readv, [this](const MemoryIo_t &request)
+	{
+		return Read(request.Address, request.Buffer, request.Size);
+	});
+}
+
+size_t CProcessVmMemory::Write(uintptr_t address, const void *data, size_t size)
+{
+	return TransferSingle(_pid, address, const_cast<void *>(data), size, process_vm_writev);
+}
+
+size_t CProcessVmMemory::WriteBatch(std::span<MemoryIo_t> requests)
+{
+	return TransferBatch(_pid, requests, process_vm_writev, [this](const MemoryIo_t &request)
+	{
+		return Write(request.Address, request.Buffer, request.Size);
+	});
+}
+
+//
+// CProcMemMemory
+//
+
+CProcMemMemory::CProcMemMemory(pid_t pid)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/mem", static_cast<int>(pid));
+
+	_fd = open(path, O_RDWR | O_CLOEXEC);
+
+	if (_fd < 0)
+		_fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (_fd < 0)
+		SetError(ME_INVALID_ARGUMENT);
+}
+
+CProcMemMemory::~CProcMemMemory()
+{
+	if (_fd >= 0)
+		close(_fd);
+}
+
+size_t CProcMemMemory::Read(uintptr_t address, void *buffer, size_t size)
+{
+	size_t total = 0;
+
+	// `pread` stops at the first inaccessible page, which is exactly the semantics of `Read`.
+	while (_fd >= 0 && total < size)
+	{
+		ssize_t result = pread(_fd, static_cast<uint8_t *>(buffer) + total, size - total, static_cast<off_t>(address + total));
+
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result <= 0)
+			break;
+
+		total += static_cast<size_t>(result);
+	}
+
+	if (total < size)
+		SetError(ME_INVALID_MEMORY);
+
+	return total;
+}
+
+size_t CProcMemMemory::Write(uintptr_t address, const void *data, size_t size)
+{
+	size_t total = 0;
+
+	while (_fd >= 0 && total < size)
+	{
+		ssize_t result = pwrite(_fd, static_cast<const uint8_t *>(data) + total, size - total, static_cast<off_t>(address + total));
+
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result <= 0)
+			break;
+
+		total += static_cast<size_t>(result);
+	}
+
+	if (total < size)
+		SetError(ME_INVALID_MEMORY);
+
+	return total;
+}
+
+#endif
+
+//
+// CMemoryMirror
+//
+
+bool CMemoryMirror::Load(IMemorySource &source, uintptr_t base, size_t size)
+{
+	_remote_base = base;
+
+	_data.clear();
+	_data.resize(size);
+
+	// One request per page, so that unreadable pages only leave holes.
+	Memoria::Vector<MemoryIo_t> requests{};
+	requests.reserve(size / SourcePageSize + 2);
+
+	size_t offset = 0;
+
+	while (offset < size)
+	{
+		uintptr_t current = base + offset;
+		size_t chunk = (std::min)(size - offset, static_cast<size_t>(SourcePageSize - (current & (SourcePageSize - 1))));
+
+		requests.push_back({ current, &_data[offset], chunk, 0 });
+		offset += chunk;
+	}
+
+	source.ReadBatch({ requests.data(), requests.size() });
+
+	bool any = false;
+
+	for (const auto &request : requests)
+	{
+		if (request.Transferred < request.Size)
+			memset(static_cast<uint8_t *>(request.Buffer) + request.Transferred, 0, request.Size - request.Transferred);
+
+		any |= request.Transferred != 0;
+	}
+
+	return any;
+}
+
+const void *CMemoryMirror::ToLocal(uintptr_t remote) const
+{
+	if (remote < _remote_base || remote - _remote_base >= _data.size())
+		return nullptr;
+
+	return _data.data() + (remote - _remote_base);
+}
+
+uintptr_t CMemoryMirror::ToRemote(const void *local) const
+{
+	return _remote_base + (static_cast<const uint8_t *>(local) - _data.data());
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include "memoria_core_thunk.hpp"
+
+#include "memoria_core_errors.hpp"
+#include "memoria_core_misc.hpp"
+#include "memoria_utils_asm.hpp"
+#include "memoria_utils_assert.hpp"
+
+#include <Windows.h>
+#include <mutex>
+
+MEMORIA_BEGIN
+
+static constexpr size_t ThunkPageSize = 4096;
+
+#ifdef MEMORIA_64BIT
+static constexpr size_t ThunkSlotSize = 32;
+#else
+static constexpr size_t ThunkSlotSize = 16;
+#endif
+
+static constexpr size_t ThunkSlotCount = ThunkPageSize / ThunkSlotSize;
+
+struct ThunkData_t
+{
+	// Bound context, or the next free slot while the slot is not allocated.
+	void *Context;
+
+	// Jump target, `nullptr` while the slot is not allocated.
+	const void *Target;
+};
+
+// Lives at the beginning of the data page, followed by the slot data.
+struct ThunkChunk_t
+{
+	ThunkChunk_t *Next;
+	ThunkData_t Slots[ThunkSlotCount];
+};
+
+static_assert(sizeof(ThunkChunk_t) <= ThunkPageSize, "Thunk data does not fit into a page.");
+
+// Guards the chunk list and the free list.
+static std::mutex gThunkLock;
+
+static ThunkChunk_t *gThunkChunks = nullptr;
+static ThunkData_t *gFreeThunks = nullptr;
+
+static uint8_t *GetChunkCode(ThunkChunk_t *chunk)
+{
+	return reinterpret_cast<uint8_t *>(chunk) - ThunkPageSize;
+}
+
+static bool EmitThunkSlot(void *code, ThunkData_t *data)
+{
+	CAssembler as(code, ThunkSlotSize);
+
+#ifdef MEMORIA_64BIT
+	// Make room for the context in the first argument register.
+	as.Movaps(eXmm::Xmm3, eXmm::Xmm2);
+	as.Movaps(eXmm::Xmm2, eXmm::Xmm1);
+	as.Movaps(eXmm::Xmm1, eXmm::Xmm0);
+	as.Mov(eReg::R9, eReg::R8);
+	as.Mov(eReg::R8, eReg::Rdx);
+	as.Mov(eReg::Rdx, eReg::Rcx);
+#endif
+
+	as.Mov(eReg::Rcx, MemRip(&data->Context));
+	as.Jmp(MemRip(&data->Target));
+
+	if (as.GetSize() < ThunkSlotSize)
+		as.Int3(ThunkSlotSize - as.GetSize());
+
+	return as.Finalize();
+}
+
+// Called with `gThunkLock` held.
+static bool AllocateThunkChunk()
+{
+	// [code page (RX)][data page (RW)]
+	auto code = static_cast<uint8_t *>(VirtualAlloc(nullptr, ThunkPageSize * 2, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+	if (!code)
+		return false;
+
+	auto chunk = reinterpret_cast<ThunkChunk_t *>(code + ThunkPageSize);
+
+	for (size_t i = 0; i < ThunkSlotCount; i++)
+	{
+		if (!EmitThunkSlot(code + i * ThunkSlotSize, &chunk->Slots[i]))
+		{
+			VirtualFree(code, 0, MEM_RELEASE);
+			return false;
+		}
+	}
+
+	DWORD old_protection;
+
+	if (!VirtualProtect(code, ThunkPageSize, PAGE_EXECUTE_READ, &old_protection))
+	{
+		VirtualFree(code, 0, MEM_RELEASE);
+		return false;
+	}
+
+	FlushInstructionCache(GetCurrentProcess(), code, ThunkPageSize);
+
+	for (size_t i = 0; i < ThunkSlotCount; i++)
+	{
+		chunk->Slots[i].Context = (i + 1 < ThunkSlotCount) ? &chunk->Slots[i + 1] : gFreeThunks;
+		chunk->Slots[i].Target = nullptr;
+	}
+
+	gFreeThunks = &chunk->Slots[0];
+
+	chunk->Next = gThunkChunks;
+	gThunkChunks = chunk;
+
+	return true;
+}
+
+// Maps a thunk to its data slot, `nullptr` if `thunk` is not an allocated thunk.
+// Called with `gThunkLock` held.
+static ThunkData_t *GetThunkData(const void *thunk)
+{
+	auto addr = reinterpret_cast<uintptr_t>(thunk);
+
+	if (addr == 0 || addr % ThunkSlotSize != 0)
+		return nullptr;
+
+	// Chunks are allocated on page boundaries, so the code page is found by alignment.
+	uintptr_t code = addr & ~(ThunkPageSize - 1);
+	auto chunk = reinterpret_cast<ThunkChunk_t *>(code + ThunkPageSize);
+
+	// Only a known chunk may be read, any other pointer could point anywhere.
+	bool found = false;
+
+	for (auto it = gThunkChunks; it; it = it->Next)
+	{
+		if (it == chunk)
+		{
+			found = true;
+			break;
+		}
+	}
+
+	AssertMsg(found, "Pointer 0x%p is not a thunk.", thunk);
+
+	if (!found)
+		return nullptr;
+
+	auto data = &chunk->Slots[(addr - code) / ThunkSlotSize];
+
+	if (data->Target == nullptr)
+		return nullptr;
+
+	return data;
+}
+
+void *AllocateThunk(void *context, const void *target)
+{
+	if (!target)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> guard(gThunkLock);
+
+	if (!gFreeThunks && !AllocateThunkChunk())
+	{
+		SetError(ME_INVALID_MEMORY);
+		return nullptr;
+	}
+
+	auto data = gFreeThunks;
+	gFreeThunks = static_cast<ThunkData_t *>(data->Context);
+
+	data->Context = context;
+	data->Target = target;
+
+	// Data pages directly follow their code pages, so the slot index maps back to the code.
+	auto chunk = reinterpret_cast<ThunkChunk_t *>(reinterpret_cast<uintptr_t>(data) & ~(ThunkPageSize - 1));
+	size_t index = data - &chunk->Slots[0];
+
+	return GetChunkCode(chunk) + index * ThunkSlotSize;
+}
+
+bool RebindThunk(const void *thunk, void *context, const void *target)
+{
+	std::lock_guard<std::mutex> guard(gThunkLock);
+
+	auto data = GetThunkData(thunk);
+
+	if (!data || !target)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	data->Context = context;
+	data->Target = target;
+
+	return true;
+}
+
+bool FreeThunk(const void *thunk)
+{
+	std::lock_guard<std::mutex> guard(gThunkLock);
+
+	auto data = GetThunkData(thunk);
+
+	if (!data)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	data->Target = nullptr;
+	data->Context = gFreeThunks;
+	gFreeThunks = data;
+
+	return true;
+}
+
+void FreeThunks()
+{
+	std::lock_guard<std::mutex> guard(gThunkLock);
+
+	while (gThunkChunks)
+	{
+		auto next = gThunkChunks->Next;
+		VirtualFree(GetChunkCode(gThunkChunks), 0, MEM_RELEASE);
+		gThunkChunks = next;
+	}
+
+	gFreeThunks = nullptr;
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "memoria_core_windows.hpp"
 
 #include "memoria_core_misc.hpp"
+#include "memoria_core_pe_iter.hpp"
 
 #include <VersionHelpers.h>
 #include <string_view>
@@ -310,45 +311,33 @@ size_t ParseExportDirectory(HMODULE handle, ExportFunc_t *out, size_t max_size)
 	if (!handle || !out || max_size == 0)
 		return 0;
 
-	size_t count = 0;
-	BYTE *base = reinterpret_cast<BYTE *>(handle);
-	IMAGE_DOS_HEADER *dosHeader = reinterpret_cast<IMAGE_DOS_HEADER *>(base);
+	CPeImage image;
 
-	if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE)
+	if (!image.ParseMapped(handle))
 		return 0;
 
-	IMAGE_NT_HEADERS *ntHeaders = reinterpret_cast<IMAGE_NT_HEADERS *>(base + dosHeader->e_lfanew);
-
-	if (ntHeaders->Signature != IMAGE_NT_SIGNATURE)
-		return 0;
+	size_t count = 0;
+	uint32_t base = 0;
+	BYTE *module = reinterpret_cast<BYTE *>(handle);
 
-	DWORD exportDirRVA = ntHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress;
+	for (const auto &entry : CPeExports(image, false))
+	{
+		if (count >= max_size)
+			break;
 
-	if (!exportDirRVA)
-		return 0;
+		if (count == 0)
+			base = entry.Ordinal;
 
-	IMAGE_EXPORT_DIRECTORY *exportDir = reinterpret_cast<IMAGE_EXPORT_DIRECTORY *>(base + exportDirRVA);
-	DWORD *functions = reinterpret_cast<DWORD *>(base + exportDir->AddressOfFunctions);
-	DWORD *names = reinterpret_cast<DWORD *>(base + exportDir->AddressOfNames);
-	WORD *ordinals = reinterpret_cast<WORD *>(base + exportDir->AddressOfNameOrdinals);
+		out[count++] = { module + entry.Rva, nullptr, static_cast<WORD>(entry.Ordinal) };
+	}
 
-	for (DWORD i = 0; i < exportDir->NumberOfFunctions && count < max_size; ++i)
+	// The name table lists each name once; the first one for an ordinal is kept.
+	for (const auto &entry : CPeExports(image))
 	{
-		ExportFunc_t &func = out[count];
-		func.Address = reinterpret_cast<void *>(base + functions[i]);
-		func.Name = nullptr;
+		size_t index = entry.Ordinal - base;
 
-		for (DWORD j = 0; j < exportDir->NumberOfNames; ++j)
-		{
-			if (ordinals[j] == i)
-			{
-				func.Name = reinterpret_cast<const char *>(base + names[j]);
-				break;
-			}
-		}
-
-		func.Ordinal = static_cast<WORD>(exportDir->Base + i);
-		++count;
+		if (index < count && !out[index].Name)
+			out[index].Name = entry.Name;
 	}
 
 	return count;
@@ -362,58 +351,20 @@ size_t ParseImportDirectory(HMODULE handle, ImportFunc_t *out, size_t max_size)
 	if (!handle || !out || max_size == 0)
 		return 0;
 
-	size_t count = 0;
-	BYTE *base = reinterpret_cast<BYTE *>(handle);
-	IMAGE_DOS_HEADER *dosHeader = reinterpret_cast<IMAGE_DOS_HEADER *>(base);
-
-	if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE)
-		return 0;
-
-	IMAGE_NT_HEADERS *ntHeaders = reinterpret_cast<IMAGE_NT_HEADERS *>(base + dosHeader->e_lfanew);
-
-	if (ntHeaders->Signature != IMAGE_NT_SIGNATURE)
-		return 0;
-
-	DWORD importDirRVA = ntHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress;
+	CPeImage image;
 
-	if (!importDirRVA)
+	if (!image.ParseMapped(handle))
 		return 0;
 
-	IMAGE_IMPORT_DESCRIPTOR *importDesc = reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR *>(base + importDirRVA);
+	size_t count = 0;
+	BYTE *module = reinterpret_cast<BYTE *>(handle);
 
-	while (importDesc->Name && count < max_size)
+	for (const auto &entry : CPeImports(image))
 	{
-		const char *dllName = reinterpret_cast<const char *>(base + importDesc->Name);
-		IMAGE_THUNK_DATA *origThunk = reinterpret_cast<IMAGE_THUNK_DATA *>(base + importDesc->OriginalFirstThunk);
-		IMAGE_THUNK_DATA *iatThunk = reinterpret_cast<IMAGE_THUNK_DATA *>(base + importDesc->FirstThunk);
-
-		if (!origThunk)
-			origThunk = iatThunk;
-
-		while (origThunk->u1.AddressOfData && count < max_size)
-		{
-			ImportFunc_t &func = out[count];
-			func.DLLName = dllName;
-			func.IATAddress = reinterpret_cast<void *>(&iatThunk->u1.Function);
-
-			if (origThunk->u1.Ordinal & IMAGE_ORDINAL_FLAG)
-			{
-				func.Ordinal = static_cast<WORD>(origThunk->u1.Ordinal & 0xFFFF);
-				func.FuncName = nullptr;
-			}
-			else
-			{
-				IMAGE_IMPORT_BY_NAME *importByName = reinterpret_cast<IMAGE_IMPORT_BY_NAME *>(base + origThunk->u1.AddressOfData);
-				func.FuncName = reinterpret_cast<const char *>(importByName->Name);
-				func.Ordinal = 0;
-			}
-
-			++origThunk;
-			++iatThunk;
-			++count;
-		}
+		if (count >= max_size)
+			break;
 
-		++importDesc;
+		out[count++] = { entry.Module, entry.Name, entry.Ordinal, module + entry.Slot };
 	}
 
 	return count;
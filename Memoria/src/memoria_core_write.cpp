@@ -3,8 +3,13 @@
 #include "memoria_core_options.hpp"
 #include "memoria_core_misc.hpp"
 #include "memoria_core_errors.hpp"
+#include "memoria_core_session.hpp"
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
+
+#include <string.h>
 #include <string_view>
 
 MEMORIA_BEGIN
@@ -20,6 +25,18 @@ bool WriteMemory(void *addr, const void *data, size_t size, ptrdiff_t offset, bo
 	if (offset != 0)
 		addr = PtrOffset(addr, offset);
 
+	// Deferred until the session is committed.
+	if (auto session = CWriteSession::GetActive())
+	{
+		if (use_setmem)
+			session->StageFill(addr, *static_cast<const uint8_t *>(data), size);
+		else
+			session->Stage(addr, data, size);
+
+		return true;
+	}
+
+#ifdef _WIN32
 	DWORD new_protection, old_protection;
 
 	if (IsMemoryExecutable(addr, offset))
@@ -49,6 +66,17 @@ bool WriteMemory(void *addr, const void *data, size_t size, ptrdiff_t offset, bo
 	}
 
 	return true;
+#else
+	// A one-write session, for the `mprotect` handling and instruction cache flush it already does.
+	CWriteSession session;
+
+	if (use_setmem)
+		session.StageFill(addr, *static_cast<const uint8_t *>(data), size);
+	else
+		session.Stage(addr, data, size);
+
+	return session.Commit();
+#endif
 }
 
 bool WriteU8(void *addr, uint8_t value, ptrdiff_t offset)
@@ -0,0 +1,672 @@
+#include "memoria_ext_freezer.hpp"
+
+#include "memoria_core_errors.hpp"
+#include "memoria_core_guard.hpp"
+#include "memoria_core_options.hpp"
+#include "memoria_core_source.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#ifdef _WIN32
+#include <Windows.h>
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#include <sys/mman.h>
+#endif
+
+MEMORIA_BEGIN
+
+// Nanoseconds on the steady clock.
+static int64_t Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// Page protection. A held page is writable until it is released.
+//
+
+#ifdef _WIN32
+
+using Regions_t = int;
+
+static bool HoldPage(uintptr_t page, size_t size, Regions_t &, uint32_t &protect, bool &changed)
+{
+	MEMORY_BASIC_INFORMATION mbi;
+
+	if (VirtualQuery(reinterpret_cast<void *>(page), &mbi, sizeof(mbi)) == 0 || mbi.State != MEM_COMMIT)
+		return false;
+
+	if (mbi.Protect & (PAGE_NOACCESS | PAGE_GUARD))
+		return false;
+
+	protect = mbi.Protect;
+	changed = false;
+
+	if (mbi.Protect & (PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY))
+		return true;
+
+	bool executable = (mbi.Protect & (PAGE_EXECUTE | PAGE_EXECUTE_READ)) != 0;
+	DWORD old;
+
+	if (!VirtualProtect(reinterpret_cast<void *>(page), size, executable ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE, &old))
+		return false;
+
+	changed = true;
+	return true;
+}
+
+static void ReleasePage(uintptr_t page, size_t size, uint32_t protect)
+{
+	DWORD old;
+	VirtualProtect(reinterpret_cast<void *>(page), size, protect, &old);
+}
+
+#else
+
+// Regions of the process, read from `/proc/self/maps` once per rebuild that needs them.
+struct Regions_t
+{
+	Memoria::Vector<MemoryRegion_t> List{};
+	bool Loaded = false;
+};
+
+static bool HoldPage(uintptr_t page, size_t size, Regions_t &regions, uint32_t &protect, bool &changed)
+{
+	if (!regions.Loaded)
+	{
+		EnumerateLocalRegions([](const MemoryRegion_t &region, void *param)
+		{
+			auto list = static_cast<Memoria::Vector<MemoryRegion_t> *>(param);
+
+			list->push_back(region);
+
+			return true;
+		}, &regions.List);
+
+		regions.Loaded = true;
+	}
+
+	auto it = std::upper_bound(regions.List.begin(), regions.List.end(), page, [](uintptr_t a, const MemoryRegion_t &b)
+	{
+		return a < b.Begin;
+	});
+
+	if (it == regions.List.begin() || page >= (it - 1)->End || !(it - 1)->Readable)
+		return false;
+
+	const auto &region = *(it - 1);
+
+	protect = PROT_READ | (region.Writable ? PROT_WRITE : 0) | (region.Executable ? PROT_EXEC : 0);
+	changed = false;
+
+	if (region.Writable)
+		return true;
+
+	if (mprotect(reinterpret_cast<void *>(page), size, static_cast<int>(protect) | PROT_WRITE) != 0)
+		return false;
+
+	changed = true;
+	return true;
+}
+
+static void ReleasePage(uintptr_t page, size_t size, uint32_t protect)
+{
+	mprotect(reinterpret_cast<void *>(page), size, static_cast<int>(protect));
+}
+
+#endif
+
+//
+// Store loops
+//
+
+template <typename T>
+static size_t StoreLane(const Memoria::Vector<uint8_t *> &addresses, const Memoria::Vector<T> &values, bool compare)
+{
+	uint8_t *const *address = addresses.data();
+	const T *value = values.data();
+	size_t count = addresses.size();
+
+	if (!compare)
+	{
+		for (size_t i = 0; i < count; i++)
+			memcpy(address[i], &value[i], sizeof(T));
+
+		return count;
+	}
+
+	size_t written = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		T current;
+		memcpy(&current, address[i], sizeof(T));
+
+		if (current != value[i])
+		{
+			memcpy(address[i], &value[i], sizeof(T));
+			written++;
+		}
+	}
+
+	return written;
+}
+
+template <typename T>
+static void AddToLane(Memoria::Vector<uint8_t *> &addresses, Memoria::Vector<T> &values, uintptr_t address, const uint8_t *value)
+{
+	T data;
+	memcpy(&data, value, sizeof(T));
+
+	addresses.push_back(reinterpret_cast<uint8_t *>(address));
+	values.push_back(data);
+}
+
+//
+// CFreezer
+//
+
+CFreezer::CFreezer(const FreezerOptions_t &options)
+	: _options(options)
+{
+
+}
+
+CFreezer::~CFreezer()
+{
+	Stop();
+	Clear();
+}
+
+void CFreezer::ReleasePages()
+{
+	for (const auto &page : _pages)
+	{
+		if (page.Changed)
+			ReleasePage(page.Base, PageSize, page.Protect);
+	}
+}
+
+void CFreezer::Rebuild()
+{
+	_changed = false;
+
+	// Live entries in address order.
+	Memoria::Vector<uint32_t> order{};
+	order.reserve(_entries.size());
+
+	for (size_t i = 0; i < _entries.size(); i++)
+	{
+		if (_entries[i].Flags == 0)
+			order.push_back(static_cast<uint32_t>(i));
+	}
+
+	std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+	{
+		return _entries[a].Address < _entries[b].Address;
+	});
+
+	// The pages they lie on. An entry crossing a page boundary needs both pages.
+	Memoria::Vector<uintptr_t> needed{};
+
+	for (auto index : order)
+	{
+		const auto &entry = _entries[index];
+
+		uintptr_t first = entry.Address & ~(PageSize - 1);
+		uintptr_t last = (entry.Address + entry.Size - 1) & ~(PageSize - 1);
+
+		for (uintptr_t page = first; page <= last; page += PageSize)
+		{
+			needed.push_back(page);
+		}
+	}
+
+	std::sort(needed.begin(), needed.end());
+	needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+
+	// Keep the pages already held, hold the new ones, release the rest.
+	Memoria::Vector<Page_t> pages{};
+	pages.reserve(needed.size());
+
+	Regions_t regions{};
+
+	for (auto base : needed)
+	{
+		auto it = std::lower_bound(_pages.begin(), _pages.end(), base, [](const Page_t &a, uintptr_t b)
+		{
+			return a.Base < b;
+		});
+
+		if (it != _pages.end() && it->Base == base)
+		{
+			pages.push_back(*it);
+
+			// Handed over, so that `ReleasePages` leaves it alone.
+			it->Changed = false;
+			continue;
+		}
+
+		Page_t page;
+		page.Base = base;
+
+		// Pages that are not accessible are skipped along with their entries. They are
+		// tried again on the next rebuild.
+		if (HoldPage(base, PageSize, regions, page.Protect, page.Changed))
+			pages.push_back(page);
+	}
+
+	ReleasePages();
+	_pages = std::move(pages);
+
+	auto is_held = [this](uintptr_t base)
+	{
+		auto it = std::lower_bound(_pages.begin(), _pages.end(), base, [](const Page_t &a, uintptr_t b)
+		{
+			return a.Base < b;
+		});
+
+		return it != _pages.end() && it->Base == base;
+	};
+
+	// The plan.
+	_lane8 = {};
+	_lane16 = {};
+	_lane32 = {};
+	_lane64 = {};
+	_bytes = Memoria::Vector<Bytes_t>();
+
+	for (auto index : order)
+	{
+		const auto &entry = _entries[index];
+		const uint8_t *value = &_values[entry.Offset];
+
+		uintptr_t first = entry.Address & ~(PageSize - 1);
+		uintptr_t last = (entry.Address + entry.Size - 1) & ~(PageSize - 1);
+
+		bool held = true;
+
+		for (uintptr_t page = first; page <= last && held; page += PageSize)
+			held = is_held(page);
+
+		if (!held)
+			continue;
+
+		switch (entry.Size)
+		{
+		case 1:
+			AddToLane(_lane8.Addresses, _lane8.Values, entry.Address, value);
+			break;
+
+		case 2:
+			AddToLane(_lane16.Addresses, _lane16.Values, entry.Address, value);
+			break;
+
+		case 4:
+			AddToLane(_lane32.Addresses, _lane32.Values, entry.Address, value);
+			break;
+
+		case 8:
+			AddToLane(_lane64.Addresses, _lane64.Values, entry.Address, value);
+			break;
+
+		default:
+			_bytes.push_back({ reinterpret_cast<uint8_t *>(entry.Address), entry.Offset, entry.Size });
+			break;
+		}
+	}
+}
+
+size_t CFreezer::StorePlan()
+{
+	bool compare = _options.WriteIfDifferent;
+
+	size_t written = StoreLane(_lane8.Addresses, _lane8.Values, compare);
+	written += StoreLane(_lane16.Addresses, _lane16.Values, compare);
+	written += StoreLane(_lane32.Addresses, _lane32.Values, compare);
+	written += StoreLane(_lane64.Addresses, _lane64.Values, compare);
+
+	for (const auto &bytes : _bytes)
+	{
+		const uint8_t *value = &_values[bytes.Offset];
+
+		if (compare && memcmp(bytes.Address, value, bytes.Size) == 0)
+			continue;
+
+		memcpy(bytes.Address, value, bytes.Size);
+		written++;
+	}
+
+	return written;
+}
+
+size_t CFreezer::StoreEntries()
+{
+	size_t written = 0;
+
+	for (auto &entry : _entries)
+	{
+		if (entry.Flags != 0)
+			continue;
+
+		auto address = reinterpret_cast<void *>(entry.Address);
+		const uint8_t *value = &_values[entry.Offset];
+
+		if (_options.WriteIfDifferent && entry.Size <= sizeof(uint64_t))
+		{
+			uint8_t current[sizeof(uint64_t)];
+
+			if (GuardedRead(current, address, entry.Size) && memcmp(current, value, entry.Size) == 0)
+				continue;
+		}
+
+		if (GuardedCopy(address, value, entry.Size) != entry.Size)
+		{
+			entry.Flags |= FlagFaulted;
+			_changed = true;
+			continue;
+		}
+
+		written++;
+	}
+
+	return written;
+}
+
+size_t CFreezer::Store()
+{
+	if (_changed)
+		Rebuild();
+
+	if (!IsSafeModeActive())
+		return StorePlan();
+
+	struct Context_t
+	{
+		CFreezer *Self;
+		size_t Written;
+	} context = { this, 0 };
+
+	bool completed = GuardedCall([](void *param)
+	{
+		auto context = static_cast<Context_t *>(param);
+		context->Written = context->Self->StorePlan();
+	}, &context);
+
+	if (completed)
+		return context.Written;
+
+	// Some memory went away. Find the entries that fault and drop them.
+	return StoreEntries();
+}
+
+FreezeId_t CFreezer::Add(void *address, const void *value, size_t size)
+{
+	if (!address || !value || size == 0 || size > UINT16_MAX)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return InvalidFreezeId;
+	}
+
+	std::lock_guard<std::mutex> guard(_lock);
+
+	Entry_t entry;
+	entry.Address = reinterpret_cast<uintptr_t>(address);
+	entry.Offset = static_cast<uint32_t>(_values.size());
+	entry.Size = static_cast<uint16_t>(size);
+	entry.Flags = 0;
+
+	_values.resize(_values.size() + size);
+	memcpy(&_values[entry.Offset], value, size);
+
+	_entries.push_back(entry);
+
+	_changed = true;
+
+	return static_cast<FreezeId_t>(_entries.size() - 1);
+}
+
+bool CFreezer::Set(FreezeId_t id, const void *value, size_t size)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+
+	if (id >= _entries.size() || (_entries[id].Flags & FlagRemoved) || _entries[id].Size != size || !value)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	memcpy(&_values[_entries[id].Offset], value, size);
+	_changed = true;
+
+	return true;
+}
+
+bool CFreezer::Remove(FreezeId_t id)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+
+	if (id >= _entries.size() || (_entries[id].Flags & FlagRemoved))
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	_entries[id].Flags |= FlagRemoved;
+	_changed = true;
+
+	return true;
+}
+
+bool CFreezer::IsActive(FreezeId_t id) const
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	return id < _entries.size() && _entries[id].Flags == 0;
+}
+
+size_t CFreezer::Apply()
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	return Store();
+}
+
+#ifdef _WIN32
+
+bool CFreezer::WaitUntil(int64_t deadline)
+{
+	int64_t remaining = deadline - Now();
+
+	if (remaining <= 0)
+		return !_stop;
+
+	// Relative due time in 100 ns units.
+	LARGE_INTEGER due;
+	due.QuadPart = -(std::max)(remaining / 100, int64_t(1));
+
+	if (!SetWaitableTimer(_timer, &due, 0, nullptr, nullptr, FALSE))
+		return WaitForSingleObject(_stop_event, static_cast<DWORD>(remaining / 1000000)) == WAIT_TIMEOUT;
+
+	HANDLE handles[] = { _stop_event, _timer };
+	return WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0;
+}
+
+#else
+
+bool CFreezer::WaitUntil(int64_t deadline)
+{
+	std::unique_lock<std::mutex> guard(_wait_lock);
+
+	auto time = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(deadline)));
+
+	return !_wait.wait_until(guard, time, [this]() { return _stop.load(); });
+}
+
+#endif
+
+void CFreezer::ThreadProc()
+{
+#ifdef _WIN32
+	// Waking up on time does not help if the thread then waits behind others for a time slice.
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+
+	int64_t period = static_cast<int64_t>(_period) * 1000;
+	int64_t deadline = Now() + period;
+
+	while (WaitUntil(deadline))
+	{
+		int64_t wake = Now();
+
+		std::lock_guard<std::mutex> guard(_lock);
+
+		size_t written = Store();
+		int64_t done = Now();
+
+		auto jitter = static_cast<uint64_t>((std::max)(wake - deadline, int64_t(0)));
+		auto apply = static_cast<uint64_t>(done - wake);
+
+		_totals.Ticks++;
+		_totals.Writes += written;
+		_totals.Jitter += jitter;
+		_totals.MaxJitter = (std::max)(_totals.MaxJitter, jitter);
+		_totals.Apply += apply;
+		_totals.MaxApply = (std::max)(_totals.MaxApply, apply);
+
+		deadline += period;
+
+		// Skip the deadlines that already passed instead of running the ticks back to back.
+		if (deadline <= done)
+		{
+			int64_t missed = (done - deadline) / period + 1;
+
+			_totals.Missed += static_cast<uint64_t>(missed);
+			deadline += missed * period;
+		}
+	}
+}
+
+bool CFreezer::Start(uint32_t period_us)
+{
+	if (_thread.joinable())
+		return false;
+
+	if (period_us == 0)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	_period = period_us;
+	_stop = false;
+
+#ifdef _WIN32
+	_timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+
+	// High-resolution timers need Windows 10 1803 or later.
+	if (!_timer)
+		_timer = CreateWaitableTimerW(nullptr, TRUE, nullptr);
+
+	_stop_event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+	if (!_timer || !_stop_event)
+	{
+		if (_timer)
+			CloseHandle(_timer);
+
+		if (_stop_event)
+			CloseHandle(_stop_event);
+
+		_timer = nullptr;
+		_stop_event = nullptr;
+		return false;
+	}
+#endif
+
+	_thread = std::thread(&CFreezer::ThreadProc, this);
+	return true;
+}
+
+void CFreezer::Stop()
+{
+	if (!_thread.joinable())
+		return;
+
+	_stop = true;
+
+#ifdef _WIN32
+	SetEvent(_stop_event);
+#else
+	{
+		// Taken so that the flag cannot be set between the thread's check and its wait.
+		std::lock_guard<std::mutex> guard(_wait_lock);
+	}
+
+	_wait.notify_all();
+#endif
+
+	_thread.join();
+
+#ifdef _WIN32
+	CloseHandle(_timer);
+	CloseHandle(_stop_event);
+
+	_timer = nullptr;
+	_stop_event = nullptr;
+#endif
+}
+
+FreezerStats_t CFreezer::GetStats() const
+{
+	std::lock_guard<std::mutex> guard(_lock);
+
+	FreezerStats_t stats;
+
+	stats.Ticks = _totals.Ticks;
+	stats.Missed = _totals.Missed;
+	stats.Writes = _totals.Writes;
+	stats.MeanJitterNs = _totals.Ticks ? _totals.Jitter / _totals.Ticks : 0;
+	stats.MaxJitterNs = _totals.MaxJitter;
+	stats.MeanApplyNs = _totals.Ticks ? _totals.Apply / _totals.Ticks : 0;
+	stats.MaxApplyNs = _totals.MaxApply;
+
+	return stats;
+}
+
+void CFreezer::ResetStats()
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	_totals = {};
+}
+
+size_t CFreezer::GetCount() const
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	return _entries.size();
+}
+
+void CFreezer::Clear()
+{
+	std::lock_guard<std::mutex> guard(_lock);
+
+	ReleasePages();
+
+	_pages = Memoria::Vector<Page_t>();
+	_entries = Memoria::Vector<Entry_t>();
+	_values = Memoria::Vector<uint8_t>();
+
+	_lane8 = {};
+	_lane16 = {};
+	_lane32 = {};
+	_lane64 = {};
+	_bytes = Memoria::Vector<Bytes_t>();
+
+	_changed = false;
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,228 @@
+#include "memoria_ext_integrity.hpp"
+
+#include "memoria_core_hash.hpp"
+#include "memoria_core_misc.hpp"
+#include "memoria_core_options.hpp"
+
+#include <algorithm>
+
+#include <Windows.h>
+
+MEMORIA_BEGIN
+
+static constexpr uintptr_t IntegrityPageSize = 4096;
+
+CIntegrityMonitor::CIntegrityMonitor(CPatchRegistry &registry)
+	: _registry(&registry)
+{
+
+}
+
+CIntegrityMonitor::~CIntegrityMonitor()
+{
+	Stop();
+}
+
+void CIntegrityMonitor::SetCallback(IntegrityCallback_t callback, void *param)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+
+	_callback = callback;
+	_param = param;
+}
+
+void CIntegrityMonitor::Rebuild()
+{
+	struct Entry_t
+	{
+		uintptr_t Page;
+		PatchId_t Id;
+	};
+
+	Memoria::Vector<Entry_t> entries{};
+	entries.reserve(_registry->GetCount());
+
+	{
+		// The sizes share a word with the flags that toggles flip.
+		std::lock_guard<std::mutex> registry_guard(_registry->_lock);
+
+		for (size_t i = 0; i < _registry->GetCount(); i++)
+		{
+			auto id = static_cast<PatchId_t>(i);
+			auto address = reinterpret_cast<uintptr_t>(_registry->GetAddress(id));
+
+			if (!address)
+				continue;
+
+			// A patch crossing a page boundary belongs to both pages.
+			uintptr_t first = address & ~(IntegrityPageSize - 1);
+			uintptr_t last = (address + _registry->GetSize(id) - 1) & ~(IntegrityPageSize - 1);
+
+			for (uintptr_t page = first; page <= last; page += IntegrityPageSize)
+			{
+				if (entries.size() == entries.capacity())
+					entries.reserve(entries.capacity() * 2);
+
+				entries.push_back({ page, id });
+			}
+		}
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const Entry_t &a, const Entry_t &b)
+	{
+		return (a.Page != b.Page) ? a.Page < b.Page : a.Id < b.Id;
+	});
+
+	std::lock_guard<std::mutex> guard(_lock);
+
+	_pages.clear();
+	_entries.clear();
+	_entries.reserve(entries.size());
+
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if (_pages.empty() || _pages.back().Base != entries[i].Page)
+		{
+			if (_pages.size() == _pages.capacity())
+				_pages.reserve((std::max)(_pages.capacity() * 2, size_t(16)));
+
+			_pages.push_back({ entries[i].Page, 0, static_cast<uint32_t>(i), 0, false });
+		}
+
+		_entries.push_back(entries[i].Id);
+		_pages.back().Count++;
+	}
+
+	for (auto &page : _pages)
+	{
+		auto memory = reinterpret_cast<const void *>(page.Base);
+
+		if (IsSafeModeActive() && !IsMemoryValid(memory))
+			continue;
+
+		page.Crc = CRC32C(memory, IntegrityPageSize);
+
+		// The flags of the patches change on toggles, which may run on another thread.
+		std::lock_guard<std::mutex> registry_guard(_registry->_lock);
+
+		// If the page is already damaged, make sure the first check looks at it.
+		for (uint32_t i = 0; i < page.Count; i++)
+		{
+			if (!_registry->IsValid(_entries[page.First + i]))
+			{
+				page.Crc = ~page.Crc;
+				break;
+			}
+		}
+	}
+}
+
+size_t CIntegrityMonitor::CheckPages(bool confirm)
+{
+	// Damaged patches are collected under the lock and reported after it is released,
+	// so the callback may call back into the monitor (or block) without deadlocking.
+	Memoria::Vector<PatchId_t> damaged_ids{};
+	IntegrityCallback_t callback;
+	void *param;
+
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+
+		callback = _callback;
+		param = _param;
+
+		for (auto &page : _pages)
+		{
+			auto memory = reinterpret_cast<const void *>(page.Base);
+
+			if (IsSafeModeActive() && !IsMemoryValid(memory))
+				continue;
+
+			uint32_t crc = CRC32C(memory, IntegrityPageSize);
+
+			if (crc == page.Crc)
+			{
+				page.Suspect = false;
+				continue;
+			}
+
+			bool damaged = false;
+
+			// Not while a toggle flips the flags of the patches, see `CPatchRegistry::Complete`.
+			std::lock_guard<std::mutex> registry_guard(_registry->_lock);
+
+			for (uint32_t i = 0; i < page.Count; i++)
+			{
+				PatchId_t id = _entries[page.First + i];
+
+				if (_registry->IsValid(id))
+					continue;
+
+				damaged = true;
+
+				if (!confirm || page.Suspect)
+					damaged_ids.push_back(id);
+			}
+
+			if (damaged && confirm && !page.Suspect)
+			{
+				// Look again on the next check before reporting.
+				page.Suspect = true;
+				continue;
+			}
+
+			// Either the change was legitimate (a toggle, or data next to the patches)
+			// or it has been reported. Either way, it is the new expected state.
+			page.Crc = crc;
+			page.Suspect = false;
+		}
+	}
+
+	if (callback)
+	{
+		for (auto id : damaged_ids)
+			callback(id, param);
+	}
+
+	return damaged_ids.size();
+}
+
+size_t CIntegrityMonitor::Check()
+{
+	return CheckPages(false);
+}
+
+void CIntegrityMonitor::ThreadProc()
+{
+	while (WaitForSingleObject(_stop_event, _interval) == WAIT_TIMEOUT)
+		CheckPages(true);
+}
+
+bool CIntegrityMonitor::Start(uint32_t interval_ms)
+{
+	if (_thread.joinable())
+		return false;
+
+	_interval = interval_ms;
+	_stop_event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+	if (!_stop_event)
+		return false;
+
+	_thread = std::thread(&CIntegrityMonitor::ThreadProc, this);
+	return true;
+}
+
+void CIntegrityMonitor::Stop()
+{
+	if (!_thread.joinable())
+		return;
+
+	SetEvent(_stop_event);
+	_thread.join();
+
+	CloseHandle(_stop_event);
+	_stop_event = nullptr;
+}
+
+MEMORIA_END
\ No newline at end of file
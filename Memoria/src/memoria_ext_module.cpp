@@ -1,15 +1,24 @@
 #include "memoria_ext_module.hpp"
 
-#include "memoria_core_misc.hpp"
+#include "memoria_core_errors.hpp"
 #include "memoria_core_search.hpp"
 #include "memoria_core_write.hpp"
+
+#ifdef _WIN32
+#include "memoria_core_misc.hpp"
 #include "memoria_core_windows.hpp"
 
 #include "memoria_ext_patch.hpp"
+#endif
 
 #include "memoria_utils_assert.hpp"
 
+#ifdef _WIN32
 #include "memoria_utils_secure.hpp"
+#endif
+
+#include <string.h>
+#include <algorithm>
 
 #ifdef MEMORIA_USE_LAZYIMPORT
 	#define GetModuleHandleA    LI_FN(GetModuleHandleA)
@@ -17,6 +26,54 @@
 
 MEMORIA_BEGIN
 
+static void *LastByte(const void *address, size_t size)
+{
+	return const_cast<uint8_t *>(static_cast<const uint8_t *>(address) + (size ? size - 1 : 0));
+}
+
+static void *AtRva(const void *base, uint32_t rva)
+{
+	return const_cast<uint8_t *>(static_cast<const uint8_t *>(base) + rva);
+}
+
+#ifdef _WIN32
+
+// Debug directory entry, as in <winnt.h>.
+struct PeDebugDirectory_t
+{
+	uint32_t Characteristics;
+	uint32_t TimeDateStamp;
+	uint16_t MajorVersion;
+	uint16_t MinorVersion;
+	uint32_t Type;
+	uint32_t SizeOfData;
+	uint32_t AddressOfRawData;
+	uint32_t PointerToRawData;
+};
+
+static constexpr uint32_t PeDebugTypeCodeView = 2;
+
+// "RSDS", followed by the GUID and the age of the PDB.
+static constexpr uint32_t PeCodeViewSignature = 0x53445352;
+static constexpr size_t PeCodeViewIdSize = 16 + 4;
+
+#else
+
+// The ELF and program headers are in the first page of an object.
+static constexpr size_t ElfDumpHeaderSize = 4096;
+
+// ELF names of the values of `eSection`, `nullptr` where there is no equivalent.
+static const char *const ElfSectionNames[] =
+{
+	".dynsym", nullptr, nullptr, ".eh_frame", nullptr, ".rela.dyn", nullptr, nullptr,
+	nullptr, ".tdata", nullptr, nullptr, ".got.plt", nullptr, nullptr, nullptr,
+	".text", ".rodata", ".data.rel.ro", ".data",
+};
+
+static_assert(sizeof(ElfSectionNames) / sizeof(*ElfSectionNames) == static_cast<size_t>(eSection::Data) + 1);
+
+#endif
+
 CMemoryBlock::CMemoryBlock(const void *address, size_t size)
 	: _address(address)
 	, _size(size)
@@ -41,9 +98,11 @@ size_t CMemoryBlock::GetSize() const
 
 void *CMemoryBlock::GetLastByte() const
 {
-	return _size ? PtrOffset(_address, _size - 1) : const_cast<void *>(_address);
+	return LastByte(_address, _size);
 }
 
+#ifdef _WIN32
+
 CMemoryModule::CMemoryModule(const char *libname, size_t size) : CMemoryModule()
 {
 	if (!libname || !*libname)
@@ -55,6 +114,8 @@ CMemoryModule::CMemoryModule(const char *libname, size_t size) : CMemoryModule()
 
 	_address = handle;
 	_size = size;
+
+	_image.ParseMapped(_address);
 }
 
 CMemoryModule::CMemoryModule(HMODULE handle, size_t size) : CMemoryModule()
@@ -63,6 +124,72 @@ CMemoryModule::CMemoryModule(HMODULE handle, size_t size) : CMemoryModule()
 
 	_address = handle;
 	_size = size;
+
+	_image.ParseMapped(_address);
+}
+
+#else
+
+CMemoryModule::CMemoryModule(const char *libname, size_t size) : CMemoryModule()
+{
+	ElfModule_t module;
+
+	if (!libname || !FindElfModule(libname, module))
+		return;
+
+	if (!_elf.Parse(module))
+		return;
+
+	_address = reinterpret_cast<const void *>(module.Begin);
+	_size = size ? size : module.End - module.Begin;
+}
+
+CMemoryModule::CMemoryModule(const ElfModule_t &module, size_t size) : CMemoryModule()
+{
+	Assert(module.Begin < module.End);
+
+	if (!_elf.Parse(module))
+		return;
+
+	_address = reinterpret_cast<const void *>(module.Begin);
+	_size = size ? size : module.End - module.Begin;
+}
+
+#endif
+
+CMemoryModule::CMemoryModule(std::unique_ptr<CModuleDump> dump) : CMemoryModule()
+{
+	Assert(dump && dump->IsLoaded());
+
+	std::span<const uint8_t> view{ static_cast<const uint8_t *>(dump->GetView()), dump->GetSize() };
+
+	if (dump->GetFormat() == eModuleDumpFormat::Pe)
+	{
+		if (!_image.Parse(view, true))
+			return;
+
+		// Not a loaded module, so not one `GetFunctionIndex` knows.
+		auto functions = std::make_shared<CFunctionIndex>();
+
+		if (functions->Build(_image))
+			_functions = std::move(functions);
+	}
+#ifndef _WIN32
+	else if (dump->GetFormat() == eModuleDumpFormat::Elf)
+	{
+		if (!_elf.ParseMapped(view.data(), view.size()))
+			return;
+	}
+#endif
+	else
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return;
+	}
+
+	_address = view.data();
+	_size = view.size();
+	_dump = std::move(dump);
 }
 
 bool CMemoryModule::IsLoaded() const
@@ -70,11 +197,102 @@ bool CMemoryModule::IsLoaded() const
 	return (_address != nullptr);
 }
 
+size_t CMemoryModule::GetFingerprint(uint8_t *out, size_t max_size) const
+{
+	if (_dump)
+	{
+		auto fingerprint = _dump->GetFingerprint();
+
+		if (fingerprint.empty() || max_size < fingerprint.size())
+			return 0;
+
+		memcpy(out, fingerprint.data(), fingerprint.size());
+		return fingerprint.size();
+	}
+
+#ifdef _WIN32
+	auto directory = _image.GetDirectoryData(ePeDirectory::Debug);
+
+	for (size_t offset = 0; directory.size() - offset >= sizeof(PeDebugDirectory_t); offset += sizeof(PeDebugDirectory_t))
+	{
+		PeDebugDirectory_t entry;
+		memcpy(&entry, directory.data() + offset, sizeof(entry));
+
+		if (entry.Type != PeDebugTypeCodeView || entry.SizeOfData < 4 + PeCodeViewIdSize)
+			continue;
+
+		auto data = _image.GetPointer(entry.AddressOfRawData, 4 + PeCodeViewIdSize);
+		uint32_t signature;
+
+		if (!data || (memcpy(&signature, data, 4), signature != PeCodeViewSignature))
+			continue;
+
+		if (max_size < PeCodeViewIdSize)
+			return 0;
+
+		memcpy(out, data + 4, PeCodeViewIdSize);
+		return PeCodeViewIdSize;
+	}
+
+	return 0;
+#else
+	auto build_id = _elf.GetBuildId();
+
+	if (build_id.empty() || max_size < build_id.size())
+		return 0;
+
+	memcpy(out, build_id.data(), build_id.size());
+	return build_id.size();
+#endif
+}
+
+bool CMemoryModule::Dump(const char *path) const
+{
+	if (!_address)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	uint8_t fingerprint[MaxFingerprintSize];
+	size_t fingerprint_size = GetFingerprint(fingerprint, sizeof(fingerprint));
+
+	// The headers are trusted to be readable, as they are for any loaded module.
+	bool is_pe = _image.IsValid();
+	size_t header_size;
+
+#ifdef _WIN32
+	header_size = (std::min)(static_cast<size_t>(_image.GetSizeOfHeaders()), _size);
+#else
+	header_size = (std::min)(is_pe ? static_cast<size_t>(_image.GetSizeOfHeaders()) : ElfDumpHeaderSize, _size);
+#endif
+
+	Memoria::Vector<uint8_t> headers(header_size);
+	memcpy(headers.data(), _address, header_size);
+
+#ifdef _WIN32
+	bool realigned = is_pe && _image.RealignHeaders({ headers.data(), headers.size() });
+#else
+	bool realigned = is_pe ? _image.RealignHeaders({ headers.data(), headers.size() }) : _elf.RealignHeaders({ headers.data(), headers.size() });
+#endif
+
+	if (!realigned)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	return WriteModuleDump(path, _address, _size, is_pe ? eModuleDumpFormat::Pe : eModuleDumpFormat::Elf,
+		{ headers.data(), headers.size() }, { fingerprint, fingerprint_size });
+}
+
 std::unique_ptr<CMemoryBlock> CMemoryBlock::CreateFromAddress(const void *address, size_t size)
 {
 	return std::make_unique<CMemoryBlock>(address, size);
 }
 
+#ifdef _WIN32
+
 // TODO: calc offset for ref in FindReferences
 size_t CMemoryBlock::HookRefAddr(const void *addr_target, const void *addr_hook, uint16_t opcode)
 {
@@ -105,6 +323,8 @@ size_t CMemoryBlock::HookRefJump(const void *addr_target, const void *addr_hook)
 	return HookRefAddr(addr_target, addr_hook, 0xE9);
 }
 
+#endif
+
 void CMemoryBlock::Sig(const CSignature &signature, SigCallbackFn cb, void *lpParam)
 {
 	void *output = nullptr;
@@ -130,67 +350,63 @@ void CMemoryBlock::Sig(SigCallbackFn cb, void *lpParam)
 
 std::pair<void *, size_t> CMemoryModule::GetSectionInfo(eSection section)
 {
-	PIMAGE_SECTION_HEADER pSection;
-
-	switch (section)
+	// Loaded PE modules, and dumps of them on any platform.
+	if (_image.IsValid())
 	{
-	case eSection::Export:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_EXPORT);
-		break;
-	case eSection::Import:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_IMPORT);
-		break;
-	case eSection::Resource:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_RESOURCE);
-		break;
-	case eSection::Exception:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_EXCEPTION);
-		break;
-	case eSection::Security:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_SECURITY);
-		break;
-	case eSection::BaseReloc:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_BASERELOC);
-		break;
-	case eSection::Debug:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_DEBUG);
-		break;
-	case eSection::Architecture:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_ARCHITECTURE);
-		break;
-	case eSection::GlobalPtr:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_GLOBALPTR);
-		break;
-	case eSection::TLS:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_TLS);
-		break;
-	case eSection::LoadConfig:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG);
-		break;
-	case eSection::BoundImport:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT);
-		break;
-	case eSection::IAT:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_IAT);
-		break;
-	case eSection::DelayImport:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT);
-		break;
-	case eSection::CLR:
-		pSection = GetSectionByIndex(GetHandle(), IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR);
-		break;
-	case eSection::Reserved:
-		pSection = GetSectionByIndex(GetHandle(), 15);
-		break;
-	default:
-		pSection = nullptr;
-		break;
+		const PeSection_t *pSection;
+
+		// `eSection` follows the order of the data directories, up to `Reserved`.
+		switch (section)
+		{
+		case eSection::Code:         pSection = _image.FindSection(".text"); break;
+		case eSection::ReadOnlyData: pSection = _image.FindSection(".rdata"); break;
+		case eSection::RelRo:        pSection = nullptr; break;
+		case eSection::Data:         pSection = _image.FindSection(".data"); break;
+		default:                     pSection = _image.GetDirectorySection(static_cast<ePeDirectory>(section)); break;
+		}
+
+		if (!pSection)
+			return {};
+
+		return std::make_pair(AtRva(_address, pSection->VirtualAddress), pSection->VirtualSize);
 	}
 
-	if (!pSection)
+#ifdef _WIN32
+	return {};
+#else
+	auto index = static_cast<size_t>(section);
+
+	if (index >= std::size(ElfSectionNames) || !ElfSectionNames[index])
 		return {};
 
-	return std::make_pair(PtrOffset(GetHandle(), pSection->VirtualAddress), pSection->Misc.VirtualSize);
+	auto pSection = _elf.FindSection(ElfSectionNames[index]);
+
+	if (pSection)
+		return std::make_pair(reinterpret_cast<void *>(pSection->Address), pSection->Size);
+
+	// Without section headers, fall back to the PT_LOAD segments that usually hold them:
+	// the executable one, the first read-only one after it and the writable one.
+	const ElfSegment_t *pCode = nullptr;
+	const ElfSegment_t *pSegment = nullptr;
+
+	for (const auto &segment : _elf.GetSegments())
+	{
+		if (segment.Executable && !pCode)
+			pCode = &segment;
+
+		if (section == eSection::Code && segment.Executable)
+			pSegment = &segment;
+		else if (section == eSection::ReadOnlyData && pCode && !segment.Executable && !segment.Writable)
+			pSegment = &segment;
+		else if (section == eSection::Data && segment.Writable)
+			pSegment = &segment;
+
+		if (pSegment)
+			return std::make_pair(reinterpret_cast<void *>(pSegment->Begin), pSegment->End - pSegment->Begin);
+	}
+
+	return {};
+#endif
 }
 
 std::unique_ptr<CMemoryBlock> CMemoryModule::GetSection(eSection section)
@@ -204,12 +420,22 @@ std::unique_ptr<CMemoryBlock> CMemoryModule::GetSection(eSection section)
 
 std::unique_ptr<CMemoryBlock> CMemoryModule::GetEntrySection()
 {
-	auto pSection = Memoria::GetEntrySection(GetHandle());
-	if (!pSection)
-		return {};
+	if (_image.IsValid())
+	{
+		auto pSection = _image.GetEntrySection();
+		if (!pSection)
+			return {};
 
-	return std::make_unique<CMemoryBlock>
-		(PtrOffset(GetHandle(), pSection->VirtualAddress), pSection->Misc.VirtualSize);
+		return std::make_unique<CMemoryBlock>
+			(AtRva(_address, pSection->VirtualAddress), pSection->VirtualSize);
+	}
+
+#ifdef _WIN32
+	return {};
+#else
+	// Shared objects have no entry point of their own, and that of a program is in .text.
+	return GetSection(eSection::Code);
+#endif
 }
 
 bool CMemoryModule::SigSec(eSection directory, const CSignature &signature, SigCallbackFn cb, void *lpParam)
@@ -218,7 +444,7 @@ bool CMemoryModule::SigSec(eSection directory, const CSignature &signature, SigC
 	if (!ptr)
 		return false;
 
-	CSigHandle sig(ptr, PtrOffset(ptr, size - 1));
+	CSigHandle sig(ptr, LastByte(ptr, size));
 	sig.FindSignature(signature);
 
 	cb(sig, lpParam);
@@ -238,12 +464,133 @@ bool CMemoryModule::SigSec(eSection directory, SigCallbackFn cb, void *lpParam)
 	if (!ptr)
 		return false;
 
-	CSigHandle sig(ptr, PtrOffset(ptr, size - 1));
+	CSigHandle sig(ptr, LastByte(ptr, size));
+	cb(sig, lpParam);
+
+	return true;
+}
+
+std::shared_ptr<const CFunctionIndex> CMemoryModule::GetFunctions() const
+{
+	if (_dump)
+		return _functions;
+
+	return _address ? GetFunctionIndex(_address) : nullptr;
+}
+
+bool CMemoryModule::SigFunction(const void *address, const CSignature &signature, SigCallbackFn cb, void *lpParam)
+{
+	auto functions = GetFunctions();
+	auto entry = functions ? functions->Find(address) : nullptr;
+
+	if (!entry)
+		return false;
+
+	auto begin = functions->GetAddress(entry->Begin);
+
+	CSigHandle sig(begin, LastByte(begin, entry->End - entry->Begin));
+	sig.FindSignature(signature);
+
 	cb(sig, lpParam);
 
 	return true;
 }
 
+bool CMemoryModule::SigFunction(const void *address, const char *signature, SigCallbackFn cb, void *lpParam)
+{
+	CSignature sig(signature);
+	return SigFunction(address, sig, cb, lpParam);
+}
+
+size_t CMemoryModule::FindInFunctions(const CSignature &signature, void **out, size_t max_size)
+{
+	auto functions = GetFunctions();
+	size_t count = 0;
+	size_t size = signature.GetPayload().size();
+
+	if (!functions || !out || size == 0)
+		return 0;
+
+	for (const auto &entry : functions->GetEntries())
+	{
+		if (entry.End - entry.Begin < size)
+			continue;
+
+		auto begin = static_cast<const uint8_t *>(functions->GetAddress(entry.Begin));
+
+		// `FindSignature` tries positions below `addr_max - size`, so one past the end lets a match end on the last byte.
+		auto end = begin + (entry.End - entry.Begin) + 1;
+
+		for (auto at = begin; count < max_size; count++)
+		{
+			auto match = static_cast<const uint8_t *>(FindSignature(at, begin, end, signature));
+
+			if (!match)
+				break;
+
+			out[count] = const_cast<uint8_t *>(match);
+			at = match + 1;
+		}
+
+		if (count >= max_size)
+			break;
+	}
+
+	return count;
+}
+
+std::shared_ptr<const CRttiIndex> CMemoryModule::GetRtti() const
+{
+	if (!_dump)
+		return _address ? GetRttiIndex(_address) : nullptr;
+
+	std::call_once(_rtti_once, [this]()
+	{
+		auto rtti = std::make_shared<CRttiIndex>();
+		bool built = _image.IsValid() && rtti->Build(_image, _dump->GetBase());
+
+#ifndef _WIN32
+		built = built || (_elf.IsValid() && rtti->Build(_elf, _dump->GetBase()));
+#endif
+
+		if (built)
+			_rtti = std::move(rtti);
+	});
+
+	return _rtti;
+}
+
+void **CMemoryModule::GetVTableForClass(const char *name) const
+{
+	auto rtti = GetRtti();
+	auto cls = rtti ? rtti->Find(name) : nullptr;
+
+	if (!cls || !cls->VTable)
+	{
+		SetError(ME_NOT_FOUND);
+		return nullptr;
+	}
+
+	return static_cast<void **>(rtti->GetAddress(cls->VTable));
+}
+
+std::unique_ptr<CMemoryModule> CMemoryModule::CreateFromDump(const char *path)
+{
+	auto dump = std::make_unique<CModuleDump>();
+
+	if (!dump->Load(path))
+		return {};
+
+	auto result = std::make_unique<CMemoryModule>(std::move(dump));
+
+	if (!result->IsLoaded())
+		return {};
+
+	return result;
+}
+
+#ifdef _WIN32
+
 std::unique_ptr<CMemoryModule> CMemoryModule::CreateFromExecutable()
 {
 	return CreateFromHandle(NULL, 0);
@@ -291,4 +638,49 @@ std::unique_ptr<CMemoryModule> CMemoryModule::CreateFromAddress(std::nullptr_t)
 	return CMemoryModule::CreateFromHandle(NULL, 0);
 }
 
+#else
+
+std::unique_ptr<CMemoryModule> CMemoryModule::CreateFromExecutable()
+{
+	return CreateFromLibrary(nullptr, 0);
+}
+
+std::unique_ptr<CMemoryModule> CMemoryModule::CreateFromLibrary(const char *libname, size_t size)
+{
+	ElfModule_t module;
+
+	// The main program is the object without a name.
+	if (!FindElfModule(libname ? libname : "", module))
+		return {};
+
+	auto result = std::make_unique<CMemoryModule>(module, size);
+
+	if (!result->IsLoaded())
+		return {};
+
+	return result;
+}
+
+std::unique_ptr<CMemoryModule> CMemoryModule::CreateFromAddress(const void *address, size_t size)
+{
+	ElfModule_t module;
+
+	if (!FindElfModule(address, module))
+		return {};
+
+	auto result = std::make_unique<CMemoryModule>(module, size);
+
+	if (!result->IsLoaded())
+		return {};
+
+	return result;
+}
+
+std::unique_ptr<CMemoryModule> CMemoryModule::CreateFromAddress(std::nullptr_t)
+{
+	return CMemoryModule::CreateFromExecutable();
+}
+
+#endif
+
 MEMORIA_END
\ No newline at end of file
@@ -1,9 +1,14 @@
 #include "memoria_ext_patch.hpp"
 
 #include <Windows.h>
+#include <TlHelp32.h>
 #include <string_view>
+#include <algorithm>
 
 #include "memoria_core_debug.hpp"
+#include "memoria_core_errors.hpp"
+#include "memoria_core_options.hpp"
+#include "memoria_core_session.hpp"
 #include "memoria_core_write.hpp"
 #include "memoria_core_misc.hpp"
 
@@ -12,6 +17,7 @@
 MEMORIA_BEGIN
 
 static Memoria::FixedVector<CPatch, MAX_PATCHES_COUNT> Patches{};
+static CPatchRegistry PatchRegistry;
 
 bool CPatch::IsActive() const
 {
@@ -228,6 +234,550 @@ CPatch *PatchWStr(void *addr, const wchar_t *value, bool instant_deploy, ptrdiff
 		(len + 1) * sizeof(wchar_t), instant_deploy);
 }
 
+CPatchRegistry::Record_t *CPatchRegistry::GetRecord(PatchId_t id)
+{
+	if (id >= _records.size() || (_records[id].Flags & FlagRemoved))
+		return nullptr;
+
+	return &_records[id];
+}
+
+const CPatchRegistry::Record_t *CPatchRegistry::GetRecord(PatchId_t id) const
+{
+	if (id >= _records.size() || (_records[id].Flags & FlagRemoved))
+		return nullptr;
+
+	return &_records[id];
+}
+
+PatchId_t CPatchRegistry::Add(void *address, const void *data, size_t size, bool instant_deploy)
+{
+	if (!address || !data || size == 0)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return InvalidPatchId;
+	}
+
+	if (size > MaxPatchSize || size > (UINT32_MAX - _arena.size()) / 2 || _records.size() >= InvalidPatchId)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return InvalidPatchId;
+	}
+
+	if (IsSafeModeActive() && (!IsMemoryValid(address) || !IsMemoryValid(address, static_cast<ptrdiff_t>(size) - 1)))
+	{
+		SetError(ME_INVALID_MEMORY);
+		return InvalidPatchId;
+	}
+
+	Record_t record{};
+	record.Address = address;
+	record.DataOffset = static_cast<uint32_t>(_arena.size());
+	record.Size = static_cast<uint32_t>(size) & MaxPatchSize;
+
+	_arena.resize(_arena.size() + size * 2);
+
+	memcpy(&_arena[record.DataOffset], address, size);
+	memcpy(&_arena[record.DataOffset + size], data, size);
+
+	_records.push_back(record);
+
+	auto id = static_cast<PatchId_t>(_records.size() - 1);
+
+	if (instant_deploy)
+		Apply(id);
+
+	return id;
+}
+
+bool CPatchRegistry::Remove(PatchId_t id)
+{
+	auto record = GetRecord(id);
+
+	if (!record)
+		return false;
+
+	if (record->Flags & FlagActive)
+		Restore(id);
+
+	std::lock_guard<std::mutex> guard(_lock);
+
+	record->Flags |= FlagRemoved;
+	return true;
+}
+
+bool CPatchRegistry::IsActive(PatchId_t id) const
+{
+	auto record = GetRecord(id);
+	return record && (record->Flags & FlagActive);
+}
+
+bool CPatchRegistry::IsValid(PatchId_t id) const
+{
+	auto record = GetRecord(id);
+
+	if (!record)
+		return false;
+
+	if (IsSafeModeActive() && !IsMemoryValid(record->Address))
+		return false;
+
+	auto expected = (record->Flags & FlagActive) ? GetDataPatch(id) : GetDataOrigin(id);
+	return memcmp(record->Address, expected, record->Size) == 0;
+}
+
+size_t CPatchRegistry::Stage(CWriteSession &session, uint32_t *indices, size_t count, bool state, bool atomic)
+{
+	// Drop the patches that are already in the requested state.
+	size_t pending = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto &record = _records[indices[i]];
+
+		if (!(record.Flags & FlagRemoved) && ((record.Flags & FlagActive) != 0) != state)
+			indices[pending++] = indices[i];
+	}
+
+	// The session applies writes in staging order. Overlapping patches are applied in the
+	// order they were added and restored in reverse, so the oldest original bytes win.
+	if (state)
+		std::sort(indices, indices + pending);
+	else
+		std::sort(indices, indices + pending, [](uint32_t a, uint32_t b) { return a > b; });
+
+	for (size_t i = 0; i < pending; i++)
+	{
+		const auto &record = _records[indices[i]];
+		const uint8_t *data = &_arena[record.DataOffset + (state ? record.Size : 0)];
+
+		session.Stage(record.Address, data, record.Size, atomic);
+	}
+
+	return pending;
+}
+
+size_t CPatchRegistry::Complete(const CWriteSession &session, size_t first, const uint32_t *indices, size_t count)
+{
+	size_t toggled = 0;
+
+	std::lock_guard<std::mutex> guard(_lock);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (session.IsWritten(first + i))
+		{
+			_records[indices[i]].Flags ^= FlagActive;
+			toggled++;
+		}
+	}
+
+	return toggled;
+}
+
+size_t CPatchRegistry::Write(uint32_t *indices, size_t count, bool state, bool atomic)
+{
+	CWriteSession session;
+
+	size_t first = session.GetCount();
+	size_t pending = Stage(session, indices, count, state, atomic);
+
+	session.Commit();
+
+	return Complete(session, first, indices, pending);
+}
+
+bool CPatchRegistry::Apply(PatchId_t id)
+{
+	return Toggle(id, true);
+}
+
+bool CPatchRegistry::Restore(PatchId_t id)
+{
+	return Toggle(id, false);
+}
+
+bool CPatchRegistry::Toggle(PatchId_t id, bool state)
+{
+	auto record = GetRecord(id);
+
+	if (!record)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	if (((record->Flags & FlagActive) != 0) == state)
+		return true;
+
+	uint32_t index = id;
+	return Write(&index, 1, state, false) == 1;
+}
+
+size_t CPatchRegistry::Apply(std::span<const PatchId_t> ids)
+{
+	return Toggle(ids, true);
+}
+
+size_t CPatchRegistry::Restore(std::span<const PatchId_t> ids)
+{
+	return Toggle(ids, false);
+}
+
+size_t CPatchRegistry::Toggle(std::span<const PatchId_t> ids, bool state, bool atomic)
+{
+	Memoria::Vector<uint32_t> indices;
+	indices.reserve(ids.size());
+
+	for (auto id : ids)
+	{
+		if (GetRecord(id))
+			indices.push_back(id);
+	}
+
+	return Write(indices.data(), indices.size(), state, atomic);
+}
+
+size_t CPatchRegistry::ApplyAll()
+{
+	Memoria::Vector<uint32_t> indices(_records.size());
+
+	for (size_t i = 0; i < indices.size(); i++)
+		indices[i] = static_cast<uint32_t>(i);
+
+	return Write(indices.data(), indices.size(), true, false);
+}
+
+size_t CPatchRegistry::RestoreAll()
+{
+	Memoria::Vector<uint32_t> indices(_records.size());
+
+	for (size_t i = 0; i < indices.size(); i++)
+		indices[i] = static_cast<uint32_t>(i);
+
+	return Write(indices.data(), indices.size(), false, false);
+}
+
+void *CPatchRegistry::GetAddress(PatchId_t id) const
+{
+	auto record = GetRecord(id);
+	return record ? record->Address : nullptr;
+}
+
+size_t CPatchRegistry::GetSize(PatchId_t id) const
+{
+	auto record = GetRecord(id);
+	return record ? record->Size : 0;
+}
+
+const uint8_t *CPatchRegistry::GetDataOrigin(PatchId_t id) const
+{
+	auto record = GetRecord(id);
+	return record ? &_arena[record->DataOffset] : nullptr;
+}
+
+const uint8_t *CPatchRegistry::GetDataPatch(PatchId_t id) const
+{
+	auto record = GetRecord(id);
+	return record ? &_arena[record->DataOffset + record->Size] : nullptr;
+}
+
+void CPatchRegistry::Clear()
+{
+	RestoreAll();
+
+	_records.clear();
+	_arena.clear();
+}
+
+CPatchRegistry &GetPatchRegistry()
+{
+	return PatchRegistry;
+}
+
+//
+// Suspends every other thread of the process for its lifetime.
+//
+// Threads whose instruction pointer is inside one of the given ranges would resume
+// in the middle of a rewritten instruction, so in that case everything is resumed
+// and the attempt is repeated a few times. If it never succeeds, or the threads
+// can't be enumerated, nothing stays suspended and `IsSuspended` returns false.
+//
+class CThreadSuspender
+{
+private:
+	Memoria::Vector<HANDLE> _threads{};
+	bool _suspended = false;
+
+	void ResumeAll()
+	{
+		for (auto thread : _threads)
+		{
+			ResumeThread(thread);
+			CloseHandle(thread);
+		}
+
+		_threads.clear();
+	}
+
+	bool SuspendAll()
+	{
+		// Everything that may allocate is done before the first thread is suspended,
+		// since a suspended thread may be holding the heap lock.
+		Memoria::Vector<DWORD> ids{};
+
+		HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+
+		if (snapshot == INVALID_HANDLE_VALUE)
+			return false;
+
+		DWORD pid = GetCurrentProcessId();
+		DWORD tid = GetCurrentThreadId();
+
+		THREADENTRY32 entry{};
+		entry.dwSize = sizeof(entry);
+
+		for (BOOL ok = Thread32First(snapshot, &entry); ok; ok = Thread32Next(snapshot, &entry))
+		{
+			if (entry.th32OwnerProcessID == pid && entry.th32ThreadID != tid)
+			{
+				ids.push_back(entry.th32ThreadID);
+			}
+		}
+
+		CloseHandle(snapshot);
+
+		_threads.reserve(ids.size());
+
+		for (auto id : ids)
+		{
+			HANDLE thread = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT, FALSE, id);
+
+			if (!thread)
+				continue;
+
+			if (SuspendThread(thread) == static_cast<DWORD>(-1))
+			{
+				CloseHandle(thread);
+				continue;
+			}
+
+			_threads.push_back(thread);
+		}
+
+		return true;
+	}
+
+	bool IsAnyThreadInside(const CPatchRegistry &registry, std::span<const PatchId_t> ids) const
+	{
+		for (auto thread : _threads)
+		{
+			CONTEXT context{};
+			context.ContextFlags = CONTEXT_CONTROL;
+
+			if (!GetThreadContext(thread, &context))
+				continue;
+
+#ifdef MEMORIA_64BIT
+			auto ip = static_cast<uintptr_t>(context.Rip);
+#else
+			auto ip = static_cast<uintptr_t>(context.Eip);
+#endif
+
+			for (auto id : ids)
+			{
+				auto begin = reinterpret_cast<uintptr_t>(registry.GetAddress(id));
+
+				// Stopping exactly at the start of a patch is fine.
+				if (ip > begin && ip < begin + registry.GetSize(id))
+					return true;
+			}
+		}
+
+		return false;
+	}
+
+public:
+	CThreadSuspender(const CPatchRegistry &registry, std::span<const PatchId_t> ids)
+	{
+		constexpr int MaxAttempts = 16;
+
+		for (int attempt = 0; attempt < MaxAttempts; attempt++)
+		{
+			if (!SuspendAll())
+			{
+				ResumeAll();
+				return;
+			}
+
+			if (!IsAnyThreadInside(registry, ids))
+			{
+				_suspended = true;
+				return;
+			}
+
+			ResumeAll();
+			Sleep(1);
+		}
+	}
+
+	~CThreadSuspender()
+	{
+		ResumeAll();
+	}
+
+	bool IsSuspended() const
+	{
+		return _suspended;
+	}
+};
+
+CPatchSet::CPatchSet(const char *name, CPatchRegistry &registry)
+	: _name(name)
+	, _registry(&registry)
+	, _hash_origin(FNV1A_64_BASIS)
+	, _hash_patch(FNV1A_64_BASIS)
+{
+
+}
+
+PatchId_t CPatchSet::Add(void *address, const void *data, size_t size)
+{
+	PatchId_t id = _registry->Add(address, data, size, _active);
+
+	if (id == InvalidPatchId)
+		return InvalidPatchId;
+
+	_patches.push_back(id);
+
+	_hash_origin = FNV1a64Data(_registry->GetDataOrigin(id), size, _hash_origin);
+	_hash_patch = FNV1a64Data(_registry->GetDataPatch(id), size, _hash_patch);
+
+	return id;
+}
+
+bool CPatchSet::AddHook(void *target, const void *hook, void *trampoline, eInvokeMethod method)
+{
+	CTrampoline *tramp = CreateTrampoline(target, hook, IsX64(), method);
+
+	if (!tramp)
+		return false;
+
+	uint8_t bytes[32];
+	size_t size = AssembleHook(bytes, sizeof(bytes), target, hook, tramp->Is64Bit(), method);
+	PatchId_t id = (size != 0) ? Add(target, bytes, size) : InvalidPatchId;
+
+	if (id == InvalidPatchId)
+	{
+		FreeTrampoline(tramp);
+		return false;
+	}
+
+	_hooks.push_back({ id, tramp });
+
+	if (trampoline)
+		*reinterpret_cast<void **>(trampoline) = tramp->GetOriginal();
+
+	return true;
+}
+
+bool CPatchSet::Apply(bool suspend_threads)
+{
+	return Toggle(true, suspend_threads);
+}
+
+bool CPatchSet::Restore(bool suspend_threads)
+{
+	return Toggle(false, suspend_threads);
+}
+
+bool CPatchSet::Toggle(bool state, bool suspend_threads)
+{
+	auto ids = GetPatches();
+
+	Memoria::Vector<uint32_t> indices(ids.size());
+
+	for (size_t i = 0; i < ids.size(); i++)
+		indices[i] = ids[i];
+
+	// Staging allocates, so it is done before any thread is suspended.
+	CWriteSession session;
+
+	size_t first = session.GetCount();
+	size_t pending = _registry->Stage(session, indices.data(), indices.size(), state, !suspend_threads);
+
+	if (suspend_threads)
+	{
+		CThreadSuspender suspender(*_registry, ids);
+
+		// Writing while another thread may be executing the patched bytes is exactly
+		// what `suspend_threads` asks to avoid, so nothing is written in that case.
+		if (!suspender.IsSuspended())
+		{
+			session.Discard();
+
+			SetError(ME_INVALID_MEMORY);
+			return false;
+		}
+
+		session.Commit();
+	}
+	else
+	{
+		session.Commit();
+	}
+
+	_registry->Complete(session, first, indices.data(), pending);
+
+	for (auto id : ids)
+	{
+		if (_registry->IsActive(id) != state)
+			return false;
+	}
+
+	_active = state;
+	return true;
+}
+
+bool CPatchSet::IsValid() const
+{
+	uint64_t hash = FNV1A_64_BASIS;
+
+	for (auto id : _patches)
+	{
+		auto address = _registry->GetAddress(id);
+
+		if (!address || (IsSafeModeActive() && !IsMemoryValid(address)))
+			return false;
+
+		hash = FNV1a64Data(address, _registry->GetSize(id), hash);
+	}
+
+	return hash == (_active ? _hash_patch : _hash_origin);
+}
+
+void CPatchSet::Clear()
+{
+	Restore();
+
+	// A hook that is still installed keeps its trampoline.
+	for (const auto &hook : _hooks)
+	{
+		if (!_registry->IsActive(hook.Patch))
+			FreeTrampoline(hook.Trampoline);
+	}
+
+	for (auto id : _patches)
+		_registry->Remove(id);
+
+	_hooks.clear();
+	_patches.clear();
+	_active = false;
+
+	_hash_origin = FNV1A_64_BASIS;
+	_hash_patch = FNV1A_64_BASIS;
+}
+
 Memoria::FixedVector<CPatch, MAX_PATCHES_COUNT> &GetPatches()
 {
 	return Patches;
@@ -238,6 +788,8 @@ bool FreePatches()
 	for (auto &patch : GetPatches())
 		patch.Restore();
 
+	GetPatchRegistry().RestoreAll();
+
 	return true;
 }
 
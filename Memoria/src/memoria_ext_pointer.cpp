@@ -0,0 +1,493 @@
+#include "memoria_ext_pointer.hpp"
+
+#include "memoria_core_errors.hpp"
+#include "memoria_core_guard.hpp"
+#include "memoria_core_misc.hpp"
+#include "memoria_core_options.hpp"
+#include "memoria_ext_sig.hpp"
+
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+MEMORIA_BEGIN
+
+// Reads a pointer from an address that passed the region check. The map may be outdated
+// (memory freed since it was cached), so safe mode still guards the read.
+static bool ReadLink(uintptr_t address, uintptr_t &value)
+{
+	if (IsSafeModeActive())
+		return GuardedRead(&value, reinterpret_cast<const void *>(address), sizeof(value));
+
+	value = *reinterpret_cast<const uintptr_t *>(address);
+	return true;
+}
+
+//
+// CRegionMap
+//
+
+bool CRegionMap::Learn(uintptr_t address)
+{
+	Region_t region;
+
+#ifdef _WIN32
+	MEMORY_BASIC_INFORMATION mbi;
+
+	if (VirtualQuery(reinterpret_cast<LPCVOID>(address), &mbi, sizeof(mbi)) == 0 || mbi.State != MEM_COMMIT)
+		return false;
+
+	if ((mbi.Protect & (PAGE_NOACCESS | PAGE_GUARD)) || mbi.Protect == 0)
+		return false;
+
+	region.Begin = reinterpret_cast<uintptr_t>(mbi.BaseAddress);
+	region.End = region.Begin + mbi.RegionSize;
+#else
+	// Without a cheap region query, learn page by page.
+	constexpr uintptr_t PageSize = 4096;
+
+	if (!ProbeMemory(reinterpret_cast<const void *>(address)))
+		return false;
+
+	region.Begin = address & ~(PageSize - 1);
+	region.End = region.Begin + PageSize;
+#endif
+
+	auto it = std::lower_bound(_regions.begin(), _regions.end(), region.Begin, [](const Region_t &a, uintptr_t b)
+	{
+		return a.Begin < b;
+	});
+
+	size_t index = it - _regions.begin();
+
+	_regions.insert(_regions.begin() + index, Region_t{ region });
+
+	_last = index;
+	return true;
+}
+
+bool CRegionMap::IsReadable(uintptr_t address, size_t size)
+{
+	if (address == 0)
+		return false;
+
+	uintptr_t end = address + size;
+
+	while (true)
+	{
+		const Region_t *region = nullptr;
+
+		if (_last < _regions.size() && _regions[_last].Begin <= address && address < _regions[_last].End)
+		{
+			region = &_regions[_last];
+		}
+		else
+		{
+			auto it = std::upper_bound(_regions.begin(), _regions.end(), address, [](uintptr_t a, const Region_t &b)
+			{
+				return a < b.Begin;
+			});
+
+			if (it != _regions.begin() && address < (it - 1)->End)
+			{
+				region = it - 1;
+				_last = region - _regions.begin();
+			}
+		}
+
+		if (!region)
+		{
+			if (!Learn(address))
+				return false;
+
+			continue;
+		}
+
+		if (end <= region->End)
+			return true;
+
+		// The range continues into the next region.
+		address = region->End;
+	}
+}
+
+void CRegionMap::Clear()
+{
+	_regions.clear();
+	_last = 0;
+}
+
+CRegionMap &GetRegionMap()
+{
+	static CRegionMap regions;
+	return regions;
+}
+
+//
+// CPointerPath
+//
+
+CPointerPath::CPointerPath(const void *base, std::initializer_list<ptrdiff_t> offsets)
+	: CPointerPath(base, std::span<const ptrdiff_t>(offsets.begin(), offsets.size()))
+{
+
+}
+
+CPointerPath::CPointerPath(const void *base, std::span<const ptrdiff_t> offsets)
+	: _base(reinterpret_cast<uintptr_t>(base))
+{
+	_offsets.reserve(offsets.size());
+	_links.reserve(offsets.size());
+
+	for (auto offset : offsets)
+	{
+		_offsets.push_back(offset);
+		_links.push_back(0);
+	}
+}
+
+static const char *SkipSpaces(const char *text)
+{
+	while (*text == ' ' || *text == '\t')
+		text++;
+
+	return text;
+}
+
+static bool IsHexDigit(char ch)
+{
+	return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+}
+
+// Parses a hexadecimal number with an optional `0x` prefix.
+static bool ParseHex(const char *&text, uintptr_t &value)
+{
+	if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+		text += 2;
+
+	if (!IsHexDigit(*text))
+		return false;
+
+	value = 0;
+
+	for (; IsHexDigit(*text); text++)
+	{
+		char ch = *text;
+		int digit = (ch <= '9') ? ch - '0' : (ch | 0x20) - 'a' + 10;
+
+		value = (value << 4) | static_cast<uintptr_t>(digit);
+	}
+
+	return true;
+}
+
+// Parses one term of the base expression: a number or a module name.
+static bool ParseTerm(const char *&text, uintptr_t &value)
+{
+	const char *end = text;
+
+	while (*end && *end != '+' && *end != '-' && *end != ']' && *end != ' ')
+		end++;
+
+	if (end == text)
+		return false;
+
+	// Anything that is not entirely a hexadecimal number is a module name.
+	const char *number = text;
+
+	if (ParseHex(number, value) && number == end)
+	{
+		text = end;
+		return true;
+	}
+
+	char name[260];
+	size_t length = end - text;
+
+	if (length >= sizeof(name))
+		return false;
+
+	memcpy(name, text, length);
+	name[length] = '\0';
+
+	value = reinterpret_cast<uintptr_t>(GetModuleBase(name));
+	text = end;
+
+	return value != 0;
+}
+
+// Parses an optional `+hex`/`-hex`, 0 if there is none.
+static bool ParseOffset(const char *&text, ptrdiff_t &offset)
+{
+	text = SkipSpaces(text);
+	offset = 0;
+
+	if (*text != '+' && *text != '-')
+		return true;
+
+	bool negative = (*text == '-');
+	text = SkipSpaces(text + 1);
+
+	uintptr_t value;
+
+	if (!ParseHex(text, value))
+		return false;
+
+	offset = negative ? -static_cast<ptrdiff_t>(value) : static_cast<ptrdiff_t>(value);
+	return true;
+}
+
+Memoria::Optional<CPointerPath> CPointerPath::Parse(const char *text)
+{
+	if (!text)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return std::nullopt;
+	}
+
+	size_t depth = 0;
+
+	for (text = SkipSpaces(text); *text == '['; text = SkipSpaces(text + 1))
+		depth++;
+
+	// Base: terms joined by `+` and `-`.
+	uintptr_t base;
+
+	if (!ParseTerm(text, base))
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return std::nullopt;
+	}
+
+	while (true)
+	{
+		text = SkipSpaces(text);
+
+		if (*text != '+' && *text != '-')
+			break;
+
+		bool negative = (*text == '-');
+		text = SkipSpaces(text + 1);
+
+		uintptr_t value;
+
+		if (!ParseTerm(text, value))
+		{
+			SetError(ME_INVALID_ARGUMENT);
+			return std::nullopt;
+		}
+
+		base = negative ? base - value : base + value;
+	}
+
+	// One offset per dereference, following its closing bracket.
+	Memoria::Vector<ptrdiff_t> offsets{};
+	offsets.reserve(depth);
+
+	for (size_t i = 0; i < depth; i++)
+	{
+		text = SkipSpaces(text);
+
+		ptrdiff_t offset;
+
+		if (*text != ']' || !ParseOffset(++text, offset))
+		{
+			SetError(ME_INVALID_ARGUMENT);
+			return std::nullopt;
+		}
+
+		offsets.push_back(offset);
+	}
+
+	if (*SkipSpaces(text) != '\0')
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return std::nullopt;
+	}
+
+	return CPointerPath(reinterpret_cast<const void *>(base), std::span<const ptrdiff_t>(offsets.data(), offsets.size()));
+}
+
+CPointerPath CPointerPath::CreateFromSigHandle(const CSigHandle &handle, std::initializer_list<ptrdiff_t> offsets)
+{
+	return CPointerPath(handle.GetPointer(), offsets);
+}
+
+void *CPointerPath::Resolve(CRegionMap &regions)
+{
+	uintptr_t address = _base;
+
+	for (size_t i = 0; i < _offsets.size(); i++)
+	{
+		// A link read from the same address as last time was already checked.
+		if (_links[i] != address && !regions.IsReadable(address, sizeof(uintptr_t)))
+		{
+			for (size_t k = i; k < _links.size(); k++)
+				_links[k] = 0;
+
+			SetError(ME_INVALID_MEMORY);
+			return nullptr;
+		}
+
+		uintptr_t value;
+
+		if (!ReadLink(address, value))
+		{
+			for (size_t k = i; k < _links.size(); k++)
+				_links[k] = 0;
+
+			SetError(ME_INVALID_MEMORY);
+			return nullptr;
+		}
+
+		_links[i] = address;
+		address = value + _offsets[i];
+	}
+
+	return reinterpret_cast<void *>(address);
+}
+
+void CPointerPath::Invalidate()
+{
+	for (auto &link : _links)
+		link = 0;
+}
+
+//
+// CPointerTrie
+//
+
+size_t CPointerTrie::HashNode(uint32_t parent, intptr_t offset) const
+{
+	uint64_t hash = (static_cast<uint64_t>(parent) * 0x9E3779B97F4A7C15ull) ^ static_cast<uint64_t>(offset);
+	hash *= 0xBF58476D1CE4E5B9ull;
+
+	return static_cast<size_t>(hash >> 32) & (_lookup.size() - 1);
+}
+
+void CPointerTrie::Rehash(size_t buckets)
+{
+	_lookup.clear();
+	_lookup.resize(buckets);
+
+	for (auto &bucket : _lookup)
+		bucket = InvalidNode;
+
+	for (uint32_t i = 0; i < _nodes.size(); i++)
+	{
+		size_t index = HashNode(_nodes[i].Parent, _nodes[i].Offset);
+
+		while (_lookup[index] != InvalidNode)
+			index = (index + 1) & (_lookup.size() - 1);
+
+		_lookup[index] = i;
+	}
+}
+
+uint32_t CPointerTrie::FindOrAddNode(uint32_t parent, intptr_t offset)
+{
+	// At most half full, so that probe sequences stay short.
+	if ((_nodes.size() + 1) * 2 > _lookup.size())
+		Rehash((std::max)(_lookup.size() * 2, size_t(64)));
+
+	size_t index = HashNode(parent, offset);
+
+	while (_lookup[index] != InvalidNode)
+	{
+		const auto &node = _nodes[_lookup[index]];
+
+		if (node.Parent == parent && node.Offset == offset)
+			return _lookup[index];
+
+		index = (index + 1) & (_lookup.size() - 1);
+	}
+
+	uint32_t node = static_cast<uint32_t>(_nodes.size());
+
+	_nodes.push_back({ parent, offset, false });
+
+	if (parent != InvalidNode)
+		_nodes[parent].HasChildren = true;
+
+	_lookup[index] = node;
+	return node;
+}
+
+size_t CPointerTrie::Add(const CPointerPath &path)
+{
+	return Add(path.GetBase(), path.GetOffsets());
+}
+
+size_t CPointerTrie::Add(const void *base, std::span<const ptrdiff_t> offsets)
+{
+	uint32_t node = FindOrAddNode(InvalidNode, reinterpret_cast<intptr_t>(base));
+
+	for (auto offset : offsets)
+		node = FindOrAddNode(node, offset);
+
+	_paths.push_back(node);
+
+	return _paths.size() - 1;
+}
+
+size_t CPointerTrie::Resolve(CRegionMap &regions)
+{
+	_addresses.resize(_nodes.size());
+	_values.resize(_nodes.size());
+
+	// Parents precede their children, so one pass in order resolves everything,
+	// reading each shared hop exactly once.
+	for (size_t i = 0; i < _nodes.size(); i++)
+	{
+		const auto &node = _nodes[i];
+		uintptr_t address;
+
+		if (node.Parent == InvalidNode)
+			address = static_cast<uintptr_t>(node.Offset);
+		else if (_values[node.Parent] != 0)
+			address = _values[node.Parent] + node.Offset;
+		else
+			address = 0;
+
+		_addresses[i] = address;
+		_values[i] = 0;
+
+		if (address && node.HasChildren && regions.IsReadable(address, sizeof(uintptr_t)))
+		{
+			if (!ReadLink(address, _values[i]))
+				_values[i] = 0;
+		}
+	}
+
+	size_t resolved = 0;
+
+	for (auto leaf : _paths)
+	{
+		if (_addresses[leaf] != 0)
+			resolved++;
+	}
+
+	return resolved;
+}
+
+void *CPointerTrie::GetResult(size_t index) const
+{
+	if (index >= _paths.size() || _paths[index] >= _addresses.size())
+		return nullptr;
+
+	return reinterpret_cast<void *>(_addresses[_paths[index]]);
+}
+
+void CPointerTrie::Clear()
+{
+	_nodes.clear();
+	_addresses.clear();
+	_values.clear();
+	_paths.clear();
+	_lookup.clear();
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,911 @@
+#include "memoria_ext_pointerscan.hpp"
+
+#include "memoria_core_errors.hpp"
+#include "memoria_core_misc.hpp"
+#include "memoria_core_workers.hpp"
+#include "memoria_ext_module.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define MEMORIA_SCAN_SIMD 1
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#include <nmmintrin.h>
+#endif
+
+#if defined(MEMORIA_64BIT) && (defined(__GNUC__) || defined(__clang__))
+#define MEMORIA_TARGET_SSE42 __attribute__((target("sse4.2")))
+#else
+#define MEMORIA_TARGET_SSE42
+#endif
+
+MEMORIA_BEGIN
+
+static constexpr uintptr_t ScanPageSize = 4096;
+
+// Regions are snapshotted in chunks of this size, the unit of work of a worker.
+static constexpr size_t ScanChunkSize = 1024 * 1024;
+
+// Addresses of one level are expanded in batches of this size.
+static constexpr size_t ScanNodeBatch = 256;
+
+// "MPSC"
+static constexpr uint32_t ScanFileMagic = 0x4353504D;
+static constexpr uint32_t ScanFileVersion = 1;
+
+static void CopyName(char (&dest)[64], const char *name)
+{
+	size_t length = name ? strlen(name) : 0;
+
+	if (length >= sizeof(dest))
+		length = sizeof(dest) - 1;
+
+	memcpy(dest, name, length);
+	dest[length] = '\0';
+}
+
+//
+// Candidate filter
+//
+
+#ifdef MEMORIA_SCAN_SIMD
+
+static bool IsVectorFilterSupported()
+{
+#ifdef MEMORIA_64BIT
+	// The 64-bit comparison needs SSE4.2. CPUID.01H:ECX.SSE4_2[bit 20]
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 20)) != 0;
+#else
+	unsigned int eax, ebx, ecx, edx;
+	return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 20)) != 0;
+#endif
+#else
+	// SSE2 is the baseline of every x86 target of the library.
+	return true;
+#endif
+}
+
+// Stores the indices of the slots whose value lies in `[low, low + range)` into `hits`
+// and returns their number.
+MEMORIA_TARGET_SSE42 static size_t FilterSlotsVector(const uint8_t *data, size_t count, uintptr_t low, uintptr_t range, uint32_t *hits)
+{
+	constexpr size_t Lanes = 16 / sizeof(uintptr_t);
+
+	size_t found = 0;
+	size_t i = 0;
+
+	// `value - low < range` is an unsigned comparison. SSE only compares signed integers,
+	// so both sides are biased by the sign bit first.
+#ifdef MEMORIA_64BIT
+	const __m128i bias = _mm_set1_epi64x(INT64_MIN);
+	const __m128i base = _mm_set1_epi64x(static_cast<int64_t>(low));
+	const __m128i limit = _mm_xor_si128(_mm_set1_epi64x(static_cast<int64_t>(range)), bias);
+#else
+	const __m128i bias = _mm_set1_epi32(INT32_MIN);
+	const __m128i base = _mm_set1_epi32(static_cast<int32_t>(low));
+	const __m128i limit = _mm_xor_si128(_mm_set1_epi32(static_cast<int32_t>(range)), bias);
+#endif
+
+	for (; i + Lanes <= count; i += Lanes)
+	{
+		__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i * sizeof(uintptr_t)));
+
+#ifdef MEMORIA_64BIT
+		__m128i delta = _mm_xor_si128(_mm_sub_epi64(values, base), bias);
+		int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(limit, delta)));
+#else
+		__m128i delta = _mm_xor_si128(_mm_sub_epi32(values, base), bias);
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(limit, delta)));
+#endif
+
+		// Most slots are no pointers, so the whole vector is usually rejected at once.
+		if (mask == 0)
+			continue;
+
+		for (size_t lane = 0; lane < Lanes; lane++)
+		{
+			if (mask & (1 << lane))
+				hits[found++] = static_cast<uint32_t>(i + lane);
+		}
+	}
+
+	for (; i < count; i++)
+	{
+		uintptr_t value;
+		memcpy(&value, data + i * sizeof(uintptr_t), sizeof(value));
+
+		if (value - low < range)
+			hits[found++] = static_cast<uint32_t>(i);
+	}
+
+	return found;
+}
+
+// -1 until detected. Detection is idempotent, so a race here is harmless.
+static int gHasVectorFilter = -1;
+
+#endif
+
+static size_t FilterSlots(const uint8_t *data, size_t count, uintptr_t low, uintptr_t range, uint32_t *hits)
+{
+#ifdef MEMORIA_SCAN_SIMD
+	if (gHasVectorFilter < 0)
+		gHasVectorFilter = IsVectorFilterSupported() ? 1 : 0;
+
+	if (gHasVectorFilter)
+		return FilterSlotsVector(data, count, low, range, hits);
+#endif
+
+	size_t found = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		uintptr_t value;
+		memcpy(&value, data + i * sizeof(uintptr_t), sizeof(value));
+
+		if (value - low < range)
+			hits[found++] = static_cast<uint32_t>(i);
+	}
+
+	return found;
+}
+
+//
+// File format
+//
+// Header: magic, version, pointer size, module count (4 bytes each).
+// Modules: name length (1 byte), name.
+// Results until the end of the file: module, depth (4 bytes each), base offset (8 bytes),
+// `depth` offsets (4 bytes each).
+//
+
+static FILE *OpenFile(const char *path, const char *mode)
+{
+#ifdef _MSC_VER
+	FILE *file = nullptr;
+	return (fopen_s(&file, path, mode) == 0) ? file : nullptr;
+#else
+	return fopen(path, mode);
+#endif
+}
+
+static bool WriteHeader(FILE *file, size_t modules)
+{
+	uint32_t header[4] = { ScanFileMagic, ScanFileVersion, sizeof(uintptr_t), static_cast<uint32_t>(modules) };
+	return fwrite(header, sizeof(header), 1, file) == 1;
+}
+
+static bool WriteModuleName(FILE *file, const char *name)
+{
+	uint8_t length = static_cast<uint8_t>(strlen(name));
+	return fwrite(&length, 1, 1, file) == 1 && fwrite(name, 1, length, file) == length;
+}
+
+static bool WriteResult(FILE *file, const PointerScanResult_t &result)
+{
+	uint32_t fields[2] = { result.Module, result.Depth };
+	uint64_t base = result.BaseOffset;
+
+	return fwrite(fields, sizeof(fields), 1, file) == 1 && fwrite(&base, sizeof(base), 1, file) == 1
+		&& fwrite(result.Offsets, sizeof(uint32_t), result.Depth, file) == result.Depth;
+}
+
+static bool ReadResult(FILE *file, PointerScanResult_t &result)
+{
+	uint32_t fields[2];
+	uint64_t base;
+
+	if (fread(fields, sizeof(fields), 1, file) != 1 || fread(&base, sizeof(base), 1, file) != 1)
+		return false;
+
+	if (fields[1] == 0 || fields[1] > MaxPointerScanDepth)
+		return false;
+
+	result = {};
+	result.Module = fields[0];
+	result.Depth = fields[1];
+	result.BaseOffset = static_cast<uintptr_t>(base);
+
+	return fread(result.Offsets, sizeof(uint32_t), result.Depth, file) == result.Depth;
+}
+
+//
+// CPointerScanner
+//
+
+CPointerScanner::CPointerScanner(const PointerScanOptions_t &options)
+	: _options(options)
+{
+	_options.MaxDepth = (std::min)((std::max)(_options.MaxDepth, size_t(1)), MaxPointerScanDepth);
+	_options.MaxParents = (std::max)(_options.MaxParents, size_t(1));
+
+	// A power of two that keeps every slot within a page.
+	size_t alignment = 1;
+
+	while (alignment < _options.Alignment && alignment < sizeof(uintptr_t))
+		alignment *= 2;
+
+	_options.Alignment = alignment;
+}
+
+size_t CPointerScanner::GetWorkerCount() const
+{
+	return Memoria::GetWorkerCount(_options.Workers);
+}
+
+void CPointerScanner::AddRegion(uintptr_t begin, size_t size)
+{
+	if (size == 0)
+		return;
+
+	_regions.push_back({ begin, begin + size, InvalidIndex });
+}
+
+bool CPointerScanner::AddStaticRegion(const char *name, uintptr_t base, uintptr_t begin, size_t size)
+{
+	if (!name || size == 0)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	Region_t region = { begin, begin + size, InvalidIndex };
+
+	auto it = std::lower_bound(_statics.begin(), _statics.end(), begin, [](const Region_t &a, uintptr_t b)
+	{
+		return a.Begin < b;
+	});
+
+	if ((it != _statics.end() && it->Begin < region.End) || (it != _statics.begin() && (it - 1)->End > begin))
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	// Regions of the same module share its entry.
+	uint32_t module = 0;
+
+	for (; module < _modules.size(); module++)
+	{
+		if (_modules[module].Base == base && strncmp(_modules[module].Name, name, sizeof(_modules[module].Name) - 1) == 0)
+			break;
+	}
+
+	if (module == _modules.size())
+	{
+		Module_t entry;
+
+		CopyName(entry.Name, name);
+		entry.Base = base;
+
+		_modules.push_back(entry);
+	}
+
+	region.Module = module;
+
+	size_t index = it - _statics.begin();
+
+	_statics.insert(_statics.begin() + index, Region_t{ region });
+
+	AddRegion(begin, size);
+	return true;
+}
+
+bool CPointerScanner::AddModule(const char *name, const CMemoryModule &module)
+{
+	auto base = reinterpret_cast<uintptr_t>(module.GetBase());
+
+	if (!base)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+#ifdef _WIN32
+	auto section = module.GetImage().FindSection(".data");
+
+	if (!section || section->VirtualSize == 0)
+	{
+		SetError(ME_NOT_FOUND);
+		return false;
+	}
+
+	return AddStaticRegion(name, base, base + section->VirtualAddress, section->VirtualSize);
+#else
+	// `.data` and `.bss` share the writable PT_LOAD segment, the sections may be stripped.
+	size_t added = 0;
+
+	for (auto &segment : module.GetElfImage().GetSegments())
+	{
+		if (!segment.Writable)
+			continue;
+
+		if (!AddStaticRegion(name, base, segment.Begin, segment.End - segment.Begin))
+			return false;
+
+		added++;
+	}
+
+	if (added == 0)
+	{
+		SetError(ME_NOT_FOUND);
+		return false;
+	}
+
+	return true;
+#endif
+}
+
+static bool AddReadableRegion(const MemoryRegion_t &region, void *param)
+{
+	if (region.Readable)
+		static_cast<CPointerScanner *>(param)->AddRegion(region.Begin, region.End - region.Begin);
+
+	return true;
+}
+
+size_t CPointerScanner::AddLocalRegions()
+{
+	size_t count = _regions.size();
+	EnumerateLocalRegions(AddReadableRegion, this);
+
+	return _regions.size() - count;
+}
+
+size_t CPointerScanner::Snapshot(IMemorySource &source)
+{
+	_refs.clear();
+
+	if (_regions.empty())
+		return 0;
+
+	// Merge overlapping regions, so that no memory is scanned twice.
+	std::sort(_regions.begin(), _regions.end(), [](const Region_t &a, const Region_t &b)
+	{
+		return a.Begin < b.Begin;
+	});
+
+	size_t merged = 0;
+
+	for (size_t i = 0; i < _regions.size(); i++)
+	{
+		if (merged > 0 && _regions[i].Begin <= _regions[merged - 1].End)
+			_regions[merged - 1].End = (std::max)(_regions[merged - 1].End, _regions[i].End);
+		else
+			_regions[merged++] = _regions[i];
+	}
+
+	_regions.erase(_regions.begin() + merged, _regions.end());
+
+	struct Chunk_t
+	{
+		uintptr_t Begin;
+		uintptr_t End;
+
+		// Slots may extend past the chunk, but not past its region.
+		uintptr_t RegionEnd;
+	};
+
+	Memoria::Vector<Chunk_t> chunks{};
+
+	for (const auto &region : _regions)
+	{
+		uintptr_t begin = (region.Begin + _options.Alignment - 1) & ~static_cast<uintptr_t>(_options.Alignment - 1);
+
+		for (; begin < region.End; begin += ScanChunkSize)
+		{
+			chunks.push_back({ begin, (std::min)(begin + ScanChunkSize, region.End), region.End });
+
+			if (begin + ScanChunkSize < begin)
+				break;
+		}
+	}
+
+	const uintptr_t low = _regions.front().Begin;
+	const uintptr_t range = _regions.back().End - low;
+
+	const auto &regions = _regions;
+
+	// Whether a value passing the vector filter actually points into a region.
+	auto is_pointer = [&regions](uintptr_t value)
+	{
+		auto it = std::upper_bound(regions.begin(), regions.end(), value, [](uintptr_t a, const Region_t &b)
+		{
+			return a < b.Begin;
+		});
+
+		return it != regions.begin() && value < (it - 1)->End;
+	};
+
+	std::atomic<size_t> next{ 0 };
+	std::mutex lock;
+
+	RunWorkers((std::min)(GetWorkerCount(), chunks.size()), [&]()
+	{
+		Memoria::Vector<uint8_t> buffer(ScanChunkSize + sizeof(uintptr_t));
+		Memoria::Vector<uint32_t> hits(ScanChunkSize / sizeof(uintptr_t) + 1);
+		Memoria::Vector<Ref_t> refs{};
+
+		for (size_t index; (index = next.fetch_add(1)) < chunks.size();)
+		{
+			const auto &chunk = chunks[index];
+			uintptr_t address = chunk.Begin;
+
+			while (address < chunk.End)
+			{
+				size_t size = static_cast<size_t>((std::min)(chunk.End + sizeof(uintptr_t) - 1, chunk.RegionEnd) - address);
+				size_t read = source.Read(address, buffer.data(), size);
+
+				// Slots that start in the chunk and were read completely.
+				size_t slots = 0;
+
+				if (read >= sizeof(uintptr_t))
+					slots = (std::min)(read - sizeof(uintptr_t), static_cast<size_t>(chunk.End - address - 1)) / _options.Alignment + 1;
+
+				if (_options.Alignment == sizeof(uintptr_t))
+				{
+					size_t found = FilterSlots(buffer.data(), slots, low, range, hits.data());
+
+					for (size_t i = 0; i < found; i++)
+					{
+						uintptr_t value;
+						memcpy(&value, &buffer[hits[i] * sizeof(uintptr_t)], sizeof(value));
+
+						if (is_pointer(value))
+						{
+							refs.push_back({ value, address + hits[i] * sizeof(uintptr_t) });
+						}
+					}
+				}
+				else
+				{
+					for (size_t i = 0; i < slots; i++)
+					{
+						uintptr_t value;
+						memcpy(&value, &buffer[i * _options.Alignment], sizeof(value));
+
+						if (value - low < range && is_pointer(value))
+						{
+							refs.push_back({ value, address + i * _options.Alignment });
+						}
+					}
+				}
+
+				if (read == size)
+					break;
+
+				// Skip the page that could not be read.
+				address = ((address + read) | (ScanPageSize - 1)) + 1;
+			}
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+
+		for (const auto &ref : refs)
+			_refs.push_back(ref);
+	});
+
+	std::sort(_refs.begin(), _refs.end(), [](const Ref_t &a, const Ref_t &b)
+	{
+		return a.Value < b.Value || (a.Value == b.Value && a.Location < b.Location);
+	});
+
+	return _refs.size();
+}
+
+const CPointerScanner::Region_t *CPointerScanner::FindStatic(uintptr_t address) const
+{
+	auto it = std::upper_bound(_statics.begin(), _statics.end(), address, [](uintptr_t a, const Region_t &b)
+	{
+		return a < b.Begin;
+	});
+
+	if (it == _statics.begin() || address >= (it - 1)->End)
+		return nullptr;
+
+	return it - 1;
+}
+
+void CPointerScanner::MakeResult(uint32_t node, uintptr_t location, uint32_t offset, const Region_t &region, PointerScanResult_t &result) const
+{
+	result = {};
+	result.Module = region.Module;
+	result.BaseOffset = location - _modules[region.Module].Base;
+
+	// The first offset leads from the static pointer to `node`, the rest follow the nodes to the target.
+	result.Offsets[result.Depth++] = offset;
+
+	for (; node != 0; node = _nodes[node].Parent)
+		result.Offsets[result.Depth++] = _nodes[node].Offset;
+}
+
+size_t CPointerScanner::Scan(uintptr_t target, PointerScanCallback_t cb, void *param)
+{
+	_nodes.clear();
+
+	_nodes.push_back({ target, InvalidIndex, 0 });
+
+	if (_refs.empty())
+		return 0;
+
+	struct Candidate_t
+	{
+		uintptr_t Location;
+		uint32_t Parent;
+		uint32_t Offset;
+	};
+
+	// Sorted, every address that is a node already.
+	Memoria::Vector<uintptr_t> visited{};
+	visited.push_back(target);
+
+	Memoria::Vector<Candidate_t> candidates{};
+
+	size_t found = 0;
+	size_t level_begin = 0;
+	bool stop = false;
+
+	for (size_t level = 0; level < _options.MaxDepth && !stop; level++)
+	{
+		size_t level_end = _nodes.size();
+
+		if (level_begin == level_end)
+			break;
+
+		candidates.clear();
+
+		std::atomic<size_t> next{ level_begin };
+		std::mutex lock;
+
+		size_t batches = (level_end - level_begin + ScanNodeBatch - 1) / ScanNodeBatch;
+
+		// Every location holding a pointer into `[address - MaxOffset, address]`.
+		RunWorkers((std::min)(GetWorkerCount(), batches), [&]()
+		{
+			Memoria::Vector<Candidate_t> local{};
+
+			for (size_t begin; (begin = next.fetch_add(ScanNodeBatch)) < level_end;)
+			{
+				size_t end = (std::min)(begin + ScanNodeBatch, level_end);
+
+				for (size_t i = begin; i < end; i++)
+				{
+					uintptr_t address = _nodes[i].Address;
+					uintptr_t lowest = (address >= _options.MaxOffset) ? address - _options.MaxOffset : 0;
+
+					auto it = std::lower_bound(_refs.begin(), _refs.end(), lowest, [](const Ref_t &a, uintptr_t b)
+					{
+						return a.Value < b;
+					});
+
+					for (; it != _refs.end() && it->Value <= address; ++it)
+					{
+						local.push_back({ it->Location, static_cast<uint32_t>(i), static_cast<uint32_t>(address - it->Value) });
+					}
+				}
+			}
+
+			std::lock_guard<std::mutex> guard(lock);
+
+			for (const auto &candidate : local)
+				candidates.push_back(candidate);
+		});
+
+		// Workers finish in any order, sorting keeps the results deterministic.
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate_t &a, const Candidate_t &b)
+		{
+			if (a.Location != b.Location)
+				return a.Location < b.Location;
+
+			return a.Parent < b.Parent || (a.Parent == b.Parent && a.Offset < b.Offset);
+		});
+
+		size_t visited_size = visited.size();
+
+		// Nodes added for the current location.
+		size_t parents = 0;
+
+		for (const auto &candidate : candidates)
+		{
+			if (auto region = FindStatic(candidate.Location))
+			{
+				PointerScanResult_t result;
+				MakeResult(candidate.Parent, candidate.Location, candidate.Offset, *region, result);
+
+				found++;
+
+				if ((cb && !cb(result, param)) || (_options.MaxResults && found >= _options.MaxResults))
+				{
+					stop = true;
+					break;
+				}
+
+				continue;
+			}
+
+			if (level + 1 >= _options.MaxDepth)
+				continue;
+
+			// Only the first `MaxParents` paths to an address are followed further. Candidates are
+			// sorted, so a location found again on this level is the last one added to `visited`.
+			bool added = visited.size() > visited_size && visited.back() == candidate.Location;
+
+			if (added ? parents >= _options.MaxParents : std::binary_search(visited.begin(), visited.begin() + visited_size, candidate.Location))
+				continue;
+
+			if (!added)
+			{
+				visited.push_back(candidate.Location);
+				parents = 0;
+			}
+
+			_nodes.push_back({ candidate.Location, candidate.Parent, candidate.Offset });
+			parents++;
+		}
+
+		std::inplace_merge(visited.begin(), visited.begin() + visited_size, visited.end());
+
+		level_begin = level_end;
+	}
+
+	return found;
+}
+
+struct ScanFileWriter_t
+{
+	FILE *File;
+	bool Failed;
+};
+
+static bool WriteScanResult(const PointerScanResult_t &result, void *param)
+{
+	auto writer = static_cast<ScanFileWriter_t *>(param);
+
+	if (!WriteResult(writer->File, result))
+	{
+		writer->Failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+size_t CPointerScanner::ScanToFile(uintptr_t target, const char *path)
+{
+	FILE *file = path ? OpenFile(path, "wb") : nullptr;
+
+	if (!file)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return 0;
+	}
+
+	bool written = WriteHeader(file, _modules.size());
+
+	for (size_t i = 0; written && i < _modules.size(); i++)
+		written = WriteModuleName(file, _modules[i].Name);
+
+	ScanFileWriter_t writer{ file, !written };
+	size_t found = written ? Scan(target, WriteScanResult, &writer) : 0;
+
+	if (fclose(file) != 0)
+		writer.Failed = true;
+
+	if (writer.Failed)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return 0;
+	}
+
+	return found;
+}
+
+const char *CPointerScanner::GetModuleName(uint32_t module) const
+{
+	return (module < _modules.size()) ? _modules[module].Name : nullptr;
+}
+
+void CPointerScanner::Clear()
+{
+	_regions.clear();
+	_statics.clear();
+	_modules.clear();
+	_refs.clear();
+	_nodes.clear();
+}
+
+//
+// CPointerScanFile
+//
+
+bool CPointerScanFile::Load(const char *path)
+{
+	_modules.clear();
+	_results.clear();
+
+	FILE *file = path ? OpenFile(path, "rb") : nullptr;
+
+	if (!file)
+	{
+		SetError(ME_NOT_FOUND);
+		return false;
+	}
+
+	uint32_t header[4];
+
+	if (fread(header, sizeof(header), 1, file) != 1 || header[0] != ScanFileMagic || header[1] != ScanFileVersion || header[2] != sizeof(uintptr_t))
+	{
+		fclose(file);
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header[3]; i++)
+	{
+		uint8_t length;
+		char name[256];
+
+		if (fread(&length, 1, 1, file) != 1 || fread(name, 1, length, file) != length)
+		{
+			fclose(file);
+			_modules.clear();
+
+			SetError(ME_INVALID_ARGUMENT);
+			return false;
+		}
+
+		name[length] = '\0';
+
+		Module_t module;
+		CopyName(module.Name, name);
+
+		_modules.push_back(module);
+	}
+
+	PointerScanResult_t result;
+
+	while (ReadResult(file, result))
+	{
+		if (result.Module >= _modules.size())
+			break;
+
+		_results.push_back(result);
+	}
+
+	fclose(file);
+	return true;
+}
+
+bool CPointerScanFile::Save(const char *path) const
+{
+	FILE *file = path ? OpenFile(path, "wb") : nullptr;
+
+	if (!file)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return false;
+	}
+
+	bool written = WriteHeader(file, _modules.size());
+
+	for (size_t i = 0; written && i < _modules.size(); i++)
+		written = WriteModuleName(file, _modules[i].Name);
+
+	for (size_t i = 0; written && i < _results.size(); i++)
+		written = WriteResult(file, _results[i]);
+
+	if (fclose(file) != 0)
+		written = false;
+
+	if (!written)
+		SetError(ME_INVALID_ARGUMENT);
+
+	return written;
+}
+
+uint32_t CPointerScanFile::FindModule(const char *name) const
+{
+	for (uint32_t i = 0; i < _modules.size(); i++)
+	{
+		if (strcmp(_modules[i].Name, name) == 0)
+			return i;
+	}
+
+	return static_cast<uint32_t>(-1);
+}
+
+// Orders results by module, base and offsets. Unused offsets are zero, so they compare equal.
+static bool CompareResults(const PointerScanResult_t &a, const PointerScanResult_t &b)
+{
+	if (a.Module != b.Module)
+		return a.Module < b.Module;
+
+	if (a.BaseOffset != b.BaseOffset)
+		return a.BaseOffset < b.BaseOffset;
+
+	if (a.Depth != b.Depth)
+		return a.Depth < b.Depth;
+
+	return memcmp(a.Offsets, b.Offsets, sizeof(a.Offsets)) < 0;
+}
+
+size_t CPointerScanFile::Intersect(const CPointerScanFile &other)
+{
+	// The other file's results, with module indices translated to this file's.
+	Memoria::Vector<PointerScanResult_t> keys{};
+
+	for (const auto &result : other._results)
+	{
+		uint32_t module = FindModule(other._modules[result.Module].Name);
+
+		if (module == static_cast<uint32_t>(-1))
+			continue;
+
+		keys.push_back(result);
+		keys.back().Module = module;
+	}
+
+	std::sort(keys.begin(), keys.end(), CompareResults);
+
+	size_t count = 0;
+
+	for (size_t i = 0; i < _results.size(); i++)
+	{
+		if (std::binary_search(keys.begin(), keys.end(), _results[i], CompareResults))
+			_results[count++] = _results[i];
+	}
+
+	_results.erase(_results.begin() + count, _results.end());
+	return count;
+}
+
+const char *CPointerScanFile::GetModuleName(uint32_t module) const
+{
+	return (module < _modules.size()) ? _modules[module].Name : nullptr;
+}
+
+CPointerPath CPointerScanFile::GetPath(size_t index, uintptr_t module_base) const
+{
+	const auto &result = _results[index];
+
+	ptrdiff_t offsets[MaxPointerScanDepth];
+
+	for (uint32_t i = 0; i < result.Depth; i++)
+		offsets[i] = static_cast<ptrdiff_t>(result.Offsets[i]);
+
+	return CPointerPath(reinterpret_cast<const void *>(module_base + result.BaseOffset), std::span<const ptrdiff_t>(offsets, result.Depth));
+}
+
+Memoria::Optional<CPointerPath> CPointerScanFile::GetPath(size_t index) const
+{
+	if (index >= _results.size())
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return std::nullopt;
+	}
+
+	auto base = GetModuleBase(_modules[_results[index].Module].Name);
+
+	if (!base)
+	{
+		SetError(ME_NOT_FOUND);
+		return std::nullopt;
+	}
+
+	return GetPath(index, reinterpret_cast<uintptr_t>(base));
+}
+
+MEMORIA_END
\ No newline at end of file
@@ -0,0 +1,665 @@
+#include "memoria_ext_snapshot.hpp"
+
+#include "memoria_core_errors.hpp"
+#include "memoria_core_hash.hpp"
+#include "memoria_core_workers.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define MEMORIA_DIFF_SIMD 1
+#include <emmintrin.h>
+#endif
+
+MEMORIA_BEGIN
+
+// Stored pages are appended to chunks of this size.
+static constexpr size_t SnapshotChunkSize = 1024 * 1024;
+
+// Pages read with one batch request.
+static constexpr size_t SnapshotBatch = 64;
+
+//
+// Page codec
+//
+// A byte-oriented LZ77 in the style of LZ4. A sequence is a token (literal count in the
+// high nibble, match length - 4 in the low nibble, 15 meaning more length bytes follow),
+// the literals, and a 2-byte match offset. The last sequence has literals only.
+//
+
+static constexpr size_t MinMatch = 4;
+
+static void PutLength(uint8_t *&out, size_t length)
+{
+	for (; length >= 255; length -= 255)
+		*out++ = 255;
+
+	*out++ = static_cast<uint8_t>(length);
+}
+
+static bool GetLength(const uint8_t *&in, const uint8_t *end, size_t &length)
+{
+	uint8_t byte;
+
+	do
+	{
+		if (in >= end)
+			return false;
+
+		byte = *in++;
+		length += byte;
+	} while (byte == 255);
+
+	return true;
+}
+
+// Worst-case size of a sequence.
+static size_t GetSequenceBound(size_t literals, size_t match)
+{
+	return 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1;
+}
+
+// Returns the compressed size, or 0 if the result would not fit into `capacity` bytes.
+static size_t CompressPage(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity)
+{
+	// Positions + 1 of the last occurrence of each 4-byte hash, 0 if none.
+	uint16_t table[4096] = {};
+
+	const uint8_t *ip = src;
+	const uint8_t *anchor = src;
+	const uint8_t *end = src + size;
+
+	uint8_t *op = dst;
+	uint8_t *op_end = dst + capacity;
+
+	while (ip + MinMatch <= end)
+	{
+		uint32_t sequence;
+		memcpy(&sequence, ip, sizeof(sequence));
+
+		uint32_t hash = (sequence * 2654435761u) >> 20;
+		size_t candidate = table[hash];
+
+		table[hash] = static_cast<uint16_t>(ip - src + 1);
+
+		if (candidate == 0 || memcmp(src + candidate - 1, ip, MinMatch) != 0)
+		{
+			ip++;
+			continue;
+		}
+
+		const uint8_t *match = src + candidate - 1;
+		size_t length = MinMatch;
+
+		while (ip + length < end && match[length] == ip[length])
+			length++;
+
+		size_t literals = ip - anchor;
+
+		if (GetSequenceBound(literals, length) > static_cast<size_t>(op_end - op))
+			return 0;
+
+		uint8_t *token = op++;
+		*token = static_cast<uint8_t>(((std::min)(literals, size_t(15)) << 4) | (std::min)(length - MinMatch, size_t(15)));
+
+		if (literals >= 15)
+			PutLength(op, literals - 15);
+
+		memcpy(op, anchor, literals);
+		op += literals;
+
+		size_t offset = ip - match;
+
+		*op++ = static_cast<uint8_t>(offset);
+		*op++ = static_cast<uint8_t>(offset >> 8);
+
+		if (length - MinMatch >= 15)
+			PutLength(op, length - MinMatch - 15);
+
+		ip += length;
+		anchor = ip;
+	}
+
+	size_t literals = end - anchor;
+
+	if (GetSequenceBound(literals, 0) > static_cast<size_t>(op_end - op))
+		return 0;
+
+	*op++ = static_cast<uint8_t>((std::min)(literals, size_t(15)) << 4);
+
+	if (literals >= 15)
+		PutLength(op, literals - 15);
+
+	memcpy(op, anchor, literals);
+	op += literals;
+
+	return op - dst;
+}
+
+// Decompresses exactly `capacity` bytes. Fails on malformed input.
+static bool DecompressPage(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity)
+{
+	const uint8_t *ip = src;
+	const uint8_t *end = src + size;
+
+	uint8_t *op = dst;
+	uint8_t *op_end = dst + capacity;
+
+	while (ip < end)
+	{
+		uint8_t token = *ip++;
+		size_t literals = token >> 4;
+
+		if (literals == 15 && !GetLength(ip, end, literals))
+			return false;
+
+		if (literals > static_cast<size_t>(end - ip) || literals > static_cast<size_t>(op_end - op))
+			return false;
+
+		memcpy(op, ip, literals);
+
+		ip += literals;
+		op += literals;
+
+		// The last sequence has no match.
+		if (ip == end)
+			break;
+
+		if (end - ip < 2)
+			return false;
+
+		size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+		ip += 2;
+
+		size_t length = token & 15;
+
+		if (length == 15 && !GetLength(ip, end, length))
+			return false;
+
+		length += MinMatch;
+
+		if (offset == 0 || offset > static_cast<size_t>(op - dst) || length > static_cast<size_t>(op_end - op))
+			return false;
+
+		// Byte by byte, a match may overlap the bytes it produces.
+		const uint8_t *match = op - offset;
+
+		for (size_t i = 0; i < length; i++)
+			op[i] = match[i];
+
+		op += length;
+	}
+
+	return op == op_end;
+}
+
+//
+// Diffing
+//
+
+static void AddRange(Memoria::Vector<DiffRange_t> &ranges, uintptr_t address, size_t size)
+{
+	if (!ranges.empty() && ranges.back().Address + ranges.back().Size == address)
+	{
+		ranges.back().Size += size;
+		return;
+	}
+
+	ranges.push_back({ address, size });
+}
+
+// Appends the ranges where the pages `a` and `b` differ. Returns the number of changed bytes.
+static size_t DiffPage(const uint8_t *a, const uint8_t *b, uintptr_t address, Memoria::Vector<DiffRange_t> &ranges)
+{
+	size_t changed = 0;
+
+	for (size_t i = 0; i < CMemorySnapshot::PageSize; i += 16)
+	{
+		int mask = 0;
+
+#ifdef MEMORIA_DIFF_SIMD
+		__m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+		__m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+
+		mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(left, right)) & 0xFFFF;
+#else
+		for (size_t j = 0; j < 16; j++)
+		{
+			if (a[i + j] != b[i + j])
+				mask |= 1 << j;
+		}
+#endif
+
+		if (mask == 0)
+			continue;
+
+		if (mask == 0xFFFF)
+		{
+			AddRange(ranges, address + i, 16);
+			changed += 16;
+			continue;
+		}
+
+		for (size_t j = 0; j < 16; j++)
+		{
+			if (mask & (1 << j))
+			{
+				AddRange(ranges, address + i + j, 1);
+				changed++;
+			}
+		}
+	}
+
+	return changed;
+}
+
+//
+// CMemorySnapshot
+//
+
+CMemorySnapshot::CMemorySnapshot(const SnapshotOptions_t &options)
+	: _options(options)
+{
+
+}
+
+size_t CMemorySnapshot::GetWorkerCount() const
+{
+	return Memoria::GetWorkerCount(_options.Workers);
+}
+
+const CMemorySnapshot::Page_t *CMemorySnapshot::FindPage(uintptr_t address) const
+{
+	auto it = std::lower_bound(_pages.begin(), _pages.end(), address, [](const Page_t &a, uintptr_t b)
+	{
+		return a.Address < b;
+	});
+
+	if (it == _pages.end() || it->Address != address)
+		return nullptr;
+
+	return it;
+}
+
+bool CMemorySnapshot::LoadPage(uint32_t stored, uint8_t *buffer) const
+{
+	const auto &page = _stored[stored];
+	const uint8_t *data = &_chunks[page.Chunk][page.Offset];
+
+	if (page.Size == PageSize)
+	{
+		memcpy(buffer, data, PageSize);
+		return true;
+	}
+
+	return DecompressPage(data, page.Size, buffer, PageSize);
+}
+
+void CMemorySnapshot::Rehash(size_t buckets)
+{
+	_table.clear();
+	_table.resize(buckets);
+
+	for (auto &bucket : _table)
+		bucket = InvalidPage;
+
+	size_t mask = buckets - 1;
+
+	for (uint32_t i = 0; i < _stored.size(); i++)
+	{
+		size_t index = _stored[i].Hash & mask;
+
+		while (_table[index] != InvalidPage)
+			index = (index + 1) & mask;
+
+		_table[index] = i;
+	}
+}
+
+uint32_t CMemorySnapshot::StorePage(const uint8_t *data, uint32_t hash)
+{
+	// At most half full, so that probe sequences stay short.
+	if ((_stored.size() + 1) * 2 > _table.size())
+		Rehash((std::max)(_table.size() * 2, size_t(1024)));
+
+	size_t mask = _table.size() - 1;
+	size_t bucket = hash & mask;
+
+	uint8_t buffer[PageSize];
+
+	for (; _table[bucket] != InvalidPage; bucket = (bucket + 1) & mask)
+	{
+		uint32_t index = _table[bucket];
+
+		// Equal hashes are almost always equal pages, but only the contents can tell.
+		if (_stored[index].Hash == hash && LoadPage(index, buffer) && memcmp(buffer, data, PageSize) == 0)
+			return index;
+	}
+
+	size_t size = _options.Compress ? CompressPage(data, PageSize, buffer, PageSize - 1) : 0;
+
+	const uint8_t *bytes = size ? buffer : data;
+
+	if (size == 0)
+		size = PageSize;
+
+	if (_chunks.empty() || _chunks.back().size() + size > SnapshotChunkSize)
+	{
+		Memoria::Vector<uint8_t> chunk{};
+		chunk.reserve(SnapshotChunkSize);
+
+		_chunks.push_back(std::move(chunk));
+	}
+
+	auto &chunk = _chunks.back();
+	size_t offset = chunk.size();
+
+	chunk.resize(offset + size);
+	memcpy(&chunk[offset], bytes, size);
+
+	uint32_t index = static_cast<uint32_t>(_stored.size());
+
+	_stored.push_back({ hash, static_cast<uint32_t>(_chunks.size() - 1), static_cast<uint32_t>(offset), static_cast<uint32_t>(size) });
+
+	_table[bucket] = index;
+	return index;
+}
+
+size_t CMemorySnapshot::Capture(uintptr_t begin, size_t size, IMemorySource &source)
+{
+	if (size == 0)
+		return 0;
+
+	uintptr_t first = begin & ~static_cast<uintptr_t>(PageSize - 1);
+	uintptr_t last = (begin + size - 1) & ~static_cast<uintptr_t>(PageSize - 1);
+
+	Memoria::Vector<Page_t> pages{};
+	Memoria::Vector<uint8_t> buffer(SnapshotBatch * PageSize);
+
+	MemoryIo_t requests[SnapshotBatch];
+	size_t read = 0;
+
+	for (uintptr_t page = first; page <= last && page >= first;)
+	{
+		size_t count = 0;
+
+		for (; count < SnapshotBatch && page <= last && page >= first; page += PageSize, count++)
+			requests[count] = { page, &buffer[count * PageSize], PageSize, 0 };
+
+		source.ReadBatch({ requests, count });
+
+		for (size_t i = 0; i < count; i++)
+		{
+			Page_t entry = { requests[i].Address, 0, InvalidPage };
+
+			if (requests[i].Transferred == PageSize)
+			{
+				auto data = static_cast<const uint8_t *>(requests[i].Buffer);
+
+				entry.Hash = CRC32C(data, PageSize);
+				entry.Stored = StorePage(data, entry.Hash);
+
+				read++;
+			}
+
+			pages.push_back(entry);
+		}
+	}
+
+	// Merge with the pages captured before, the new ones replace old ones at the same address.
+	Memoria::Vector<Page_t> merged{};
+	merged.reserve(_pages.size() + pages.size());
+
+	size_t i = 0;
+	size_t j = 0;
+
+	while (i < _pages.size() || j < pages.size())
+	{
+		if (j == pages.size() || (i < _pages.size() && _pages[i].Address < pages[j].Address))
+		{
+			merged.push_back(_pages[i++]);
+			continue;
+		}
+
+		if (i < _pages.size() && _pages[i].Address == pages[j].Address)
+			i++;
+
+		merged.push_back(pages[j++]);
+	}
+
+	_pages = std::move(merged);
+	return read;
+}
+
+size_t CMemorySnapshot::DiffPages(IMemorySource &source, const uint32_t *indices, size_t pages, Memoria::Vector<DiffRange_t> &ranges) const
+{
+	ranges.clear();
+
+	std::atomic<size_t> next{ 0 };
+	std::mutex lock;
+
+	size_t total = 0;
+	size_t batches = (pages + SnapshotBatch - 1) / SnapshotBatch;
+
+	RunWorkers((std::min)(GetWorkerCount(), batches), [&]()
+	{
+		Memoria::Vector<uint8_t> buffer(SnapshotBatch * PageSize);
+		Memoria::Vector<uint8_t> stored(PageSize);
+		Memoria::Vector<DiffRange_t> local{};
+
+		MemoryIo_t requests[SnapshotBatch];
+		size_t changed = 0;
+
+		for (size_t begin; (begin = next.fetch_add(SnapshotBatch)) < pages;)
+		{
+			size_t count = (std::min)(SnapshotBatch, pages - begin);
+
+			for (size_t i = 0; i < count; i++)
+				requests[i] = { _pages[indices ? indices[begin + i] : begin + i].Address, &buffer[i * PageSize], PageSize, 0 };
+
+			source.ReadBatch({ requests, count });
+
+			for (size_t i = 0; i < count; i++)
+			{
+				const auto &page = _pages[indices ? indices[begin + i] : begin + i];
+				auto data = static_cast<const uint8_t *>(requests[i].Buffer);
+
+				bool readable = (requests[i].Transferred == PageSize);
+				bool captured = (page.Stored != InvalidPage);
+
+				if (!readable || !captured)
+				{
+					if (readable != captured)
+					{
+						AddRange(local, page.Address, PageSize);
+						changed += PageSize;
+					}
+
+					continue;
+				}
+
+				if (CRC32C(data, PageSize) == page.Hash)
+					continue;
+
+				if (!LoadPage(page.Stored, stored.data()))
+				{
+					AddRange(local, page.Address, PageSize);
+					changed += PageSize;
+					continue;
+				}
+
+				changed += DiffPage(stored.data(), data, page.Address, local);
+			}
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+
+		for (const auto &range : local)
+			ranges.push_back(range);
+
+		total += changed;
+	});
+
+	// Workers finish in any order: sort, then merge the ranges that meet at batch boundaries.
+	std::sort(ranges.begin(), ranges.end(), [](const DiffRange_t &a, const DiffRange_t &b)
+	{
+		return a.Address < b.Address;
+	});
+
+	size_t count = 0;
+
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		if (count > 0 && ranges[count - 1].Address + ranges[count - 1].Size == ranges[i].Address)
+			ranges[count - 1].Size += ranges[i].Size;
+		else
+			ranges[count++] = ranges[i];
+	}
+
+	ranges.erase(ranges.begin() + count, ranges.end());
+	return total;
+}
+
+size_t CMemorySnapshot::Diff(IMemorySource &source, Memoria::Vector<DiffRange_t> &ranges) const
+{
+	return DiffPages(source, nullptr, _pages.size(), ranges);
+}
+
+size_t CMemorySnapshot::Diff(IMemorySource &source, std::span<const uintptr_t> pages, Memoria::Vector<DiffRange_t> &ranges) const
+{
+	// Both lists are sorted: a merge join finds the captured pages that were written.
+	Memoria::Vector<uint32_t> indices{};
+
+	for (size_t i = 0, j = 0; i < _pages.size() && j < pages.size();)
+	{
+		if (_pages[i].Address < pages[j])
+		{
+			i++;
+		}
+		else if (pages[j] < _pages[i].Address)
+		{
+			j++;
+		}
+		else
+		{
+			indices.push_back(static_cast<uint32_t>(i));
+
+			i++;
+			j++;
+		}
+	}
+
+	return DiffPages(source, indices.data(), indices.size(), ranges);
+}
+
+size_t CMemorySnapshot::Diff(const CMemorySnapshot &other, Memoria::Vector<DiffRange_t> &ranges) const
+{
+	ranges.clear();
+
+	uint8_t left[PageSize];
+	uint8_t right[PageSize];
+
+	size_t changed = 0;
+	size_t i = 0;
+	size_t j = 0;
+
+	while (i < _pages.size() || j < other._pages.size())
+	{
+		const Page_t *a = (i < _pages.size()) ? &_pages[i] : nullptr;
+		const Page_t *b = (j < other._pages.size()) ? &other._pages[j] : nullptr;
+
+		// A page only one snapshot has.
+		if (!b || (a && a->Address < b->Address))
+		{
+			b = nullptr;
+			i++;
+		}
+		else if (!a || b->Address < a->Address)
+		{
+			a = nullptr;
+			j++;
+		}
+		else
+		{
+			i++;
+			j++;
+		}
+
+		bool valid_a = a && a->Stored != InvalidPage;
+		bool valid_b = b && b->Stored != InvalidPage;
+
+		if (!valid_a || !valid_b)
+		{
+			if (valid_a || valid_b)
+			{
+				AddRange(ranges, a ? a->Address : b->Address, PageSize);
+				changed += PageSize;
+			}
+
+			continue;
+		}
+
+		if (a->Hash == b->Hash)
+			continue;
+
+		if (!LoadPage(a->Stored, left) || !other.LoadPage(b->Stored, right))
+		{
+			AddRange(ranges, a->Address, PageSize);
+			changed += PageSize;
+			continue;
+		}
+
+		changed += DiffPage(left, right, a->Address, ranges);
+	}
+
+	return changed;
+}
+
+size_t CMemorySnapshot::Read(uintptr_t address, void *buffer, size_t size)
+{
+	uint8_t data[PageSize];
+	size_t total = 0;
+
+	while (total < size)
+	{
+		uintptr_t current = address + total;
+		auto page = FindPage(current & ~static_cast<uintptr_t>(PageSize - 1));
+
+		if (!page || page->Stored == InvalidPage || !LoadPage(page->Stored, data))
+			break;
+
+		size_t offset = current - page->Address;
+		size_t chunk = (std::min)(size - total, PageSize - offset);
+
+		memcpy(static_cast<uint8_t *>(buffer) + total, data + offset, chunk);
+		total += chunk;
+	}
+
+	if (total < size)
+		SetError(ME_INVALID_MEMORY);
+
+	return total;
+}
+
+size_t CMemorySnapshot::GetStoredSize() const
+{
+	size_t size = 0;
+
+	for (const auto &chunk : _chunks)
+		size += chunk.size();
+
+	return size;
+}
+
+void CMemorySnapshot::Clear()
+{
+	_pages.clear();
+	_stored.clear();
+	_chunks.clear();
+	_table.clear();
+}
+
+MEMORIA_END
\ No newline at end of file
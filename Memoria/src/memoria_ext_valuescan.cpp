@@ -0,0 +1,607 @@
+#include "memoria_ext_valuescan.hpp"
+
+#include "memoria_core_dirty.hpp"
+#include "memoria_core_errors.hpp"
+#include "memoria_core_workers.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define MEMORIA_SCAN_SIMD 1
+#include <emmintrin.h>
+#endif
+
+MEMORIA_BEGIN
+
+// Slots of one block start within this many bytes. Blocks are the unit of work of a worker.
+static constexpr size_t ScanBlockSize = 1024 * 1024;
+
+template <typename T>
+static T LoadValue(const uint8_t *data)
+{
+	T value;
+	memcpy(&value, data, sizeof(T));
+
+	return value;
+}
+
+template <typename T>
+static bool TestValue(eScanCondition condition, T current, T previous, T a, T b)
+{
+	switch (condition)
+	{
+	case eScanCondition::Equal:
+		return current == a;
+	case eScanCondition::Between:
+		return a <= current && current <= b;
+	case eScanCondition::Unknown:
+		return true;
+
+	// Bitwise, so that a NaN that stays NaN counts as unchanged.
+	case eScanCondition::Changed:
+		return memcmp(&current, &previous, sizeof(T)) != 0;
+	case eScanCondition::Unchanged:
+		return memcmp(&current, &previous, sizeof(T)) == 0;
+
+	case eScanCondition::Increased:
+		return current > previous;
+	case eScanCondition::Decreased:
+		return current < previous;
+	}
+
+	return false;
+}
+
+// Stores the indices of the slots of `data` that hold `value` into `hits`, returns their number.
+template <typename T>
+static size_t MatchEqual(const uint8_t *data, size_t slots, size_t stride, T value, uint32_t *hits)
+{
+	size_t found = 0;
+	size_t i = 0;
+
+#ifdef MEMORIA_SCAN_SIMD
+	if (stride == sizeof(T))
+	{
+		// Byte-wise comparison against the value repeated over the vector. A slot
+		// matches when all of its bytes do.
+		constexpr size_t Lanes = 16 / sizeof(T);
+		constexpr int LaneMask = (1 << sizeof(T)) - 1;
+
+		alignas(16) T pattern[Lanes];
+
+		for (auto &lane : pattern)
+			lane = value;
+
+		const __m128i expected = _mm_load_si128(reinterpret_cast<const __m128i *>(pattern));
+
+		for (; i + Lanes <= slots; i += Lanes)
+		{
+			__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i * sizeof(T)));
+			int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(values, expected));
+
+			if (mask == 0)
+				continue;
+
+			for (size_t lane = 0; lane < Lanes; lane++)
+			{
+				if (((mask >> (lane * sizeof(T))) & LaneMask) == LaneMask)
+					hits[found++] = static_cast<uint32_t>(i + lane);
+			}
+		}
+	}
+	else
+	{
+		// Every byte starts a slot: look for the first byte of the value, then compare the rest.
+		uint8_t head;
+		memcpy(&head, &value, 1);
+
+		const __m128i expected = _mm_set1_epi8(static_cast<char>(head));
+
+		for (; i + 16 <= slots; i += 16)
+		{
+			int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), expected));
+
+			if (mask == 0)
+				continue;
+
+			for (size_t lane = 0; lane < 16; lane++)
+			{
+				if ((mask & (1 << lane)) && memcmp(data + i + lane, &value, sizeof(T)) == 0)
+					hits[found++] = static_cast<uint32_t>(i + lane);
+			}
+		}
+	}
+#endif
+
+	for (; i < slots; i++)
+	{
+		if (memcmp(data + i * stride, &value, sizeof(T)) == 0)
+			hits[found++] = static_cast<uint32_t>(i);
+	}
+
+	return found;
+}
+
+static size_t GetVarintSize(uint32_t value)
+{
+	size_t size = 1;
+
+	for (; value >= 0x80; value >>= 7)
+		size++;
+
+	return size;
+}
+
+template <typename T>
+struct CValueScanner<T>::Scratch_t
+{
+	// The memory of a block as read.
+	Memoria::Vector<uint8_t> Memory;
+
+	// Slots that passed the scan.
+	Memoria::Vector<uint32_t> Hits;
+};
+
+template <typename T>
+CValueScanner<T>::CValueScanner(const ValueScanOptions_t &options)
+	: _options(options)
+	, _stride(options.Aligned ? sizeof(T) : 1)
+{
+
+}
+
+template <typename T>
+size_t CValueScanner<T>::GetWorkerCount() const
+{
+	return Memoria::GetWorkerCount(_options.Workers);
+}
+
+template <typename T>
+void CValueScanner<T>::AddRegion(uintptr_t begin, size_t size)
+{
+	if (size < sizeof(T))
+		return;
+
+	_regions.push_back({ begin, begin + size });
+}
+
+template <typename T>
+static bool AddWritableRegion(const MemoryRegion_t &region, void *param)
+{
+	if (region.Writable)
+		static_cast<CValueScanner<T> *>(param)->AddRegion(region.Begin, region.End - region.Begin);
+
+	return true;
+}
+
+template <typename T>
+size_t CValueScanner<T>::AddLocalRegions()
+{
+	size_t count = _regions.size();
+	EnumerateLocalRegions(AddWritableRegion<T>, this);
+
+	return _regions.size() - count;
+}
+
+template <typename T>
+template <typename Fn>
+void CValueScanner<T>::ForEachCandidate(const Block_t &block, Fn &&fn)
+{
+	switch (block.Encoding)
+	{
+	case eEncoding::All:
+	{
+		for (uint32_t slot = 0; slot < block.Slots; slot++)
+			fn(slot, slot);
+
+		break;
+	}
+	case eEncoding::Bitmap:
+	{
+		const uint8_t *bits = block.Candidates.data();
+		size_t index = 0;
+
+		for (uint32_t byte = 0; byte < block.Candidates.size(); byte++)
+		{
+			// Mostly zero for sparse bitmaps.
+			if (bits[byte] == 0)
+				continue;
+
+			for (uint32_t bit = 0; bit < 8; bit++)
+			{
+				if (bits[byte] & (1 << bit))
+					fn(byte * 8 + bit, index++);
+			}
+		}
+
+		break;
+	}
+	case eEncoding::List:
+	{
+		const uint8_t *data = block.Candidates.data();
+		const uint8_t *end = data + block.Candidates.size();
+
+		uint32_t slot = 0;
+		size_t index = 0;
+
+		while (data < end)
+		{
+			uint32_t delta = 0;
+
+			for (uint32_t shift = 0; data < end; shift += 7)
+			{
+				uint8_t byte = *data++;
+				delta |= static_cast<uint32_t>(byte & 0x7F) << shift;
+
+				if (!(byte & 0x80))
+					break;
+			}
+
+			slot += delta;
+			fn(slot, index++);
+		}
+
+		break;
+	}
+	}
+}
+
+template <typename T>
+void CValueScanner<T>::EncodeCandidates(Block_t &block, const uint32_t *slots, size_t count)
+{
+	size_t bitmap = (block.Slots + 7) / 8;
+
+	// Size of the list, given up as soon as the bitmap is smaller.
+	size_t list = 0;
+
+	for (size_t i = 0; i < count && list < bitmap; i++)
+		list += GetVarintSize(slots[i] - (i ? slots[i - 1] : 0));
+
+	Memoria::Vector<uint8_t> candidates{};
+
+	if (list < bitmap)
+	{
+		candidates.reserve(list);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t delta = slots[i] - (i ? slots[i - 1] : 0);
+
+			for (; delta >= 0x80; delta >>= 7)
+				candidates.push_back(static_cast<uint8_t>(delta | 0x80));
+
+			candidates.push_back(static_cast<uint8_t>(delta));
+		}
+
+		block.Encoding = eEncoding::List;
+	}
+	else
+	{
+		candidates.resize(bitmap);
+
+		for (size_t i = 0; i < count; i++)
+			candidates[slots[i] / 8] |= static_cast<uint8_t>(1 << (slots[i] % 8));
+
+		block.Encoding = eEncoding::Bitmap;
+	}
+
+	// Assigned anew rather than cleared, so that the memory of a larger set is released.
+	block.Candidates = std::move(candidates);
+}
+
+template <typename T>
+void CValueScanner<T>::RestoreBlock(const Block_t &block, uint8_t *memory) const
+{
+	if (block.Encoding == eEncoding::All)
+	{
+		memcpy(memory, block.Values.data(), block.Values.size());
+		return;
+	}
+
+	// Only the candidate slots are restored, the other bytes are never looked at.
+	const uint8_t *values = block.Values.data();
+
+	ForEachCandidate(block, [&](uint32_t slot, size_t index)
+	{
+		memcpy(memory + slot * _stride, values + index * sizeof(T), sizeof(T));
+	});
+}
+
+template <typename T>
+void CValueScanner<T>::ScanBlock(Block_t &block, IMemorySource &source, eScanCondition condition, T a, T b, bool first, const std::span<const uintptr_t> *pages, Scratch_t &scratch) const
+{
+	uint8_t *memory = scratch.Memory.data();
+	uint32_t *hits = scratch.Hits.data();
+
+	size_t span = (block.Slots - 1) * _stride + sizeof(T);
+	size_t read = span;
+
+	if (!pages)
+	{
+		read = source.Read(block.Begin, memory, span);
+	}
+	else
+	{
+		RestoreBlock(block, memory);
+
+		uintptr_t end = block.Begin + span;
+		uintptr_t page = block.Begin & ~static_cast<uintptr_t>(CDirtyTracker::PageSize - 1);
+
+		auto it = std::lower_bound(pages->begin(), pages->end(), page);
+
+		// Read the written pages over the restored memory. Reading stops where the memory is gone.
+		for (; it != pages->end() && *it < end; ++it)
+		{
+			uintptr_t begin = (std::max)(*it, block.Begin);
+			size_t size = (std::min)(*it + CDirtyTracker::PageSize, end) - begin;
+
+			if (source.Read(begin, memory + (begin - block.Begin), size) != size)
+			{
+				read = begin - block.Begin;
+				break;
+			}
+		}
+	}
+
+	// Slots that were read completely.
+	uint32_t readable = 0;
+
+	if (read >= sizeof(T))
+		readable = (std::min)(static_cast<uint32_t>((read - sizeof(T)) / _stride + 1), block.Slots);
+
+	size_t found = 0;
+
+	if (first && condition == eScanCondition::Unknown)
+	{
+		// Every slot that could be read, without listing them.
+		block.Slots = readable;
+		found = readable;
+	}
+	else if (first && condition == eScanCondition::Equal && std::is_integral_v<T>)
+	{
+		found = MatchEqual(memory, readable, _stride, a, hits);
+	}
+	else if (first)
+	{
+		for (uint32_t slot = 0; slot < readable; slot++)
+		{
+			if (TestValue(condition, LoadValue<T>(memory + slot * _stride), T(), a, b))
+				hits[found++] = slot;
+		}
+	}
+	else
+	{
+		const uint8_t *values = block.Values.data();
+		bool all = (block.Encoding == eEncoding::All);
+
+		ForEachCandidate(block, [&](uint32_t slot, size_t index)
+		{
+			if (slot >= readable)
+				return;
+
+			T previous = LoadValue<T>(all ? values + slot * _stride : values + index * sizeof(T));
+
+			if (TestValue(condition, LoadValue<T>(memory + slot * _stride), previous, a, b))
+				hits[found++] = slot;
+		});
+	}
+
+	block.Count = static_cast<uint32_t>(found);
+
+	if (found == 0)
+	{
+		block.Candidates = Memoria::Vector<uint8_t>();
+		block.Values = Memoria::Vector<uint8_t>();
+	}
+	else if (found == block.Slots)
+	{
+		// Every slot is a candidate: keep the memory itself, which also holds all values.
+		block.Encoding = eEncoding::All;
+		block.Candidates = Memoria::Vector<uint8_t>();
+
+		Memoria::Vector<uint8_t> values((block.Slots - 1) * _stride + sizeof(T));
+		memcpy(values.data(), memory, values.size());
+
+		block.Values = std::move(values);
+	}
+	else
+	{
+		EncodeCandidates(block, hits, found);
+
+		Memoria::Vector<uint8_t> values(found * sizeof(T));
+
+		for (size_t i = 0; i < found; i++)
+			memcpy(&values[i * sizeof(T)], memory + hits[i] * _stride, sizeof(T));
+
+		block.Values = std::move(values);
+	}
+}
+
+template <typename T>
+size_t CValueScanner<T>::Run(IMemorySource &source, eScanCondition condition, T a, T b, bool first, const std::span<const uintptr_t> *pages)
+{
+	std::atomic<size_t> next{ 0 };
+	std::atomic<size_t> total{ 0 };
+
+	RunWorkers((std::min)(GetWorkerCount(), _blocks.size()), [&]()
+	{
+		Scratch_t scratch;
+
+		scratch.Memory.resize(ScanBlockSize + sizeof(T));
+		scratch.Hits.resize(ScanBlockSize / _stride);
+
+		size_t count = 0;
+
+		for (size_t index; (index = next.fetch_add(1)) < _blocks.size();)
+		{
+			ScanBlock(_blocks[index], source, condition, a, b, first, pages, scratch);
+			count += _blocks[index].Count;
+		}
+
+		total += count;
+	});
+
+	// Drop the blocks without candidates.
+	size_t kept = 0;
+
+	for (size_t i = 0; i < _blocks.size(); i++)
+	{
+		if (_blocks[i].Count == 0)
+			continue;
+
+		if (kept != i)
+			_blocks[kept] = std::move(_blocks[i]);
+
+		kept++;
+	}
+
+	_blocks.erase(_blocks.begin() + kept, _blocks.end());
+
+	_count = total;
+	_scanned = true;
+
+	return _count;
+}
+
+template <typename T>
+size_t CValueScanner<T>::FirstScan(eScanCondition condition, T a, T b, IMemorySource &source)
+{
+	if (condition != eScanCondition::Equal && condition != eScanCondition::Between && condition != eScanCondition::Unknown)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return 0;
+	}
+
+	Reset();
+
+	std::sort(_regions.begin(), _regions.end(), [](const Region_t &x, const Region_t &y)
+	{
+		return x.Begin < y.Begin;
+	});
+
+	for (const auto &region : _regions)
+	{
+		uintptr_t begin = (region.Begin + _stride - 1) & ~static_cast<uintptr_t>(_stride - 1);
+
+		// Slots must lie completely inside the region.
+		if (begin + sizeof(T) > region.End || begin < region.Begin)
+			continue;
+
+		uintptr_t last = region.End - sizeof(T);
+
+		for (uintptr_t block = begin; block <= last; block += ScanBlockSize)
+		{
+			uintptr_t end = (std::min)(block + ScanBlockSize - 1, last);
+
+			Block_t entry;
+
+			entry.Begin = block;
+			entry.Slots = static_cast<uint32_t>((end - block) / _stride + 1);
+			entry.Count = entry.Slots;
+			entry.Encoding = eEncoding::All;
+
+			_blocks.push_back(std::move(entry));
+
+			if (block + ScanBlockSize < block)
+				break;
+		}
+	}
+
+	return Run(source, condition, a, b, true, nullptr);
+}
+
+template <typename T>
+size_t CValueScanner<T>::NextScan(eScanCondition condition, T a, T b, IMemorySource &source)
+{
+	if (!_scanned || condition == eScanCondition::Unknown)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return 0;
+	}
+
+	return Run(source, condition, a, b, false, nullptr);
+}
+
+template <typename T>
+size_t CValueScanner<T>::NextScan(eScanCondition condition, T a, T b, std::span<const uintptr_t> pages, IMemorySource &source)
+{
+	if (!_scanned || condition == eScanCondition::Unknown)
+	{
+		SetError(ME_INVALID_ARGUMENT);
+		return 0;
+	}
+
+	return Run(source, condition, a, b, false, &pages);
+}
+
+template <typename T>
+size_t CValueScanner<T>::Enumerate(ValueScanCallback_t<T> cb, void *param) const
+{
+	size_t count = 0;
+	bool stop = false;
+
+	for (const auto &block : _blocks)
+	{
+		const uint8_t *values = block.Values.data();
+		bool all = (block.Encoding == eEncoding::All);
+
+		ForEachCandidate(block, [&](uint32_t slot, size_t index)
+		{
+			if (stop)
+				return;
+
+			T value = LoadValue<T>(all ? values + slot * _stride : values + index * sizeof(T));
+
+			count++;
+
+			if (!cb(block.Begin + slot * _stride, value, param))
+				stop = true;
+		});
+
+		if (stop)
+			break;
+	}
+
+	return count;
+}
+
+template <typename T>
+size_t CValueScanner<T>::GetMemoryUsage() const
+{
+	size_t usage = _blocks.capacity() * sizeof(Block_t);
+
+	for (const auto &block : _blocks)
+		usage += block.Candidates.capacity() + block.Values.capacity();
+
+	return usage;
+}
+
+template <typename T>
+void CValueScanner<T>::Reset()
+{
+	_blocks.clear();
+	_count = 0;
+	_scanned = false;
+}
+
+template <typename T>
+void CValueScanner<T>::Clear()
+{
+	Reset();
+	_regions.clear();
+}
+
+template class CValueScanner<uint8_t>;
+template class CValueScanner<uint16_t>;
+template class CValueScanner<uint32_t>;
+template class CValueScanner<uint64_t>;
+template class CValueScanner<int8_t>;
+template class CValueScanner<int16_t>;
+template class CValueScanner<int32_t>;
+template class CValueScanner<int64_t>;
+template class CValueScanner<float>;
+template class CValueScanner<double>;
+
+MEMORIA_END
\ No newline at end of file
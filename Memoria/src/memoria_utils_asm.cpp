@@ -0,0 +1,685 @@
+#include "memoria_utils_asm.hpp"
+
+#include "memoria_utils_assert.hpp"
+
+#include <string.h>
+
+MEMORIA_BEGIN
+
+static inline bool IsInt8(int64_t value)
+{
+	return value >= INT8_MIN && value <= INT8_MAX;
+}
+
+static inline bool IsInt32(int64_t value)
+{
+	return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+CAssembler::CAssembler(void *data, size_t size, const void *runtime_address, bool is_x64)
+	: CWriteBuffer(data, size)
+	, _runtime(static_cast<const uint8_t *>(runtime_address ? runtime_address : data))
+	, _x64(is_x64)
+{
+
+}
+
+void CAssembler::Fail()
+{
+	AssertMsg(false, "Invalid instruction or buffer overflow in CAssembler.");
+	_failed = true;
+}
+
+bool CAssembler::Reserve(size_t size)
+{
+	if (_pos + size > _size)
+	{
+		Fail();
+		return false;
+	}
+
+	return true;
+}
+
+uint8_t CAssembler::RegBits(eReg reg)
+{
+	auto value = static_cast<uint8_t>(reg);
+
+	// x86 has no REX prefix, so only the first 8 registers are encodable.
+	if (value > 15 || (!_x64 && value > 7))
+	{
+		Fail();
+		return 0;
+	}
+
+	return value;
+}
+
+void CAssembler::EmitRex(bool w, uint8_t reg, uint8_t index, uint8_t base)
+{
+	if (!_x64)
+		return;
+
+	uint8_t rex = 0x40;
+
+	if (w)
+		rex |= 0x08;
+	if (reg & 8)
+		rex |= 0x04;
+	if (index & 8)
+		rex |= 0x02;
+	if (base & 8)
+		rex |= 0x01;
+
+	if (rex != 0x40)
+		WriteU8(rex);
+}
+
+void CAssembler::EmitRexFor(bool w, uint8_t reg, const Mem_t &mem)
+{
+	uint8_t index = (mem.Index != eReg::None) ? RegBits(mem.Index) : 0;
+	uint8_t base = (mem.Base != eReg::None && !mem.IsRip) ? RegBits(mem.Base) : 0;
+
+	EmitRex(w, reg, index, base);
+}
+
+void CAssembler::EmitModRM(uint8_t mod, uint8_t reg, uint8_t rm)
+{
+	WriteU8(static_cast<uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7)));
+}
+
+void CAssembler::EmitMem(uint8_t reg, const Mem_t &mem, uint8_t tail)
+{
+	if (mem.IsRip)
+	{
+		// mod = 00, rm = 101: [rip + disp32] in x64, [disp32] in x86
+		EmitModRM(0, reg, 5);
+
+		if (_x64)
+		{
+			if (mem.Target)
+				AddFixup(eFixup::AbsRel32, tail, 0, mem.Target);
+			else
+				AddFixup(eFixup::LabelRel32, tail, mem.Label, nullptr);
+		}
+		else
+		{
+			if (mem.Target)
+				WriteU32(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(mem.Target)));
+			else
+			{
+				AddFixup(eFixup::LabelAbs32, tail, mem.Label, nullptr);
+				WriteU32(0);
+			}
+			return;
+		}
+
+		WriteI32(0);
+		return;
+	}
+
+	bool has_base = mem.Base != eReg::None;
+	bool has_index = mem.Index != eReg::None;
+
+	if (has_index && RegBits(mem.Index) == 4)
+	{
+		// RSP cannot be used as an index.
+		Fail();
+		return;
+	}
+
+	uint8_t scale_bits;
+
+	switch (mem.Scale)
+	{
+	case 1: scale_bits = 0; break;
+	case 2: scale_bits = 1; break;
+	case 4: scale_bits = 2; break;
+	case 8: scale_bits = 3; break;
+	default:
+		Fail();
+		return;
+	}
+
+	if (!has_base)
+	{
+		if (has_index)
+		{
+			// [index * scale + disp32]
+			EmitModRM(0, reg, 4);
+			EmitModRM(scale_bits, RegBits(mem.Index), 5);
+		}
+		else if (_x64)
+		{
+			// [disp32] without RIP needs a SIB byte in x64 mode.
+			EmitModRM(0, reg, 4);
+			EmitModRM(0, 4, 5);
+		}
+		else
+		{
+			EmitModRM(0, reg, 5);
+		}
+
+		WriteI32(mem.Disp);
+		return;
+	}
+
+	uint8_t base = RegBits(mem.Base);
+	uint8_t mod;
+
+	// RBP/R13 cannot be encoded without displacement.
+	if (mem.Disp == 0 && (base & 7) != 5)
+		mod = 0;
+	else if (IsInt8(mem.Disp))
+		mod = 1;
+	else
+		mod = 2;
+
+	if (has_index || (base & 7) == 4)
+	{
+		EmitModRM(mod, reg, 4);
+		EmitModRM(scale_bits, has_index ? RegBits(mem.Index) : 4, base);
+	}
+	else
+	{
+		EmitModRM(mod, reg, base);
+	}
+
+	if (mod == 1)
+		WriteI8(static_cast<int8_t>(mem.Disp));
+	else if (mod == 2)
+		WriteI32(mem.Disp);
+}
+
+void CAssembler::EmitRegRm(uint8_t opcode, uint8_t reg, uint8_t rm)
+{
+	EmitRex(true, reg, 0, rm);
+	WriteU8(opcode);
+	EmitModRM(3, reg, rm);
+}
+
+void CAssembler::EmitRegMem(uint8_t opcode, uint8_t reg, const Mem_t &mem, uint8_t tail)
+{
+	EmitRexFor(true, reg, mem);
+	WriteU8(opcode);
+	EmitMem(reg, mem, tail);
+}
+
+void CAssembler::EmitGroupImm(uint8_t ext, eReg dst, int32_t imm)
+{
+	uint8_t rm = RegBits(dst);
+
+	EmitRex(true, 0, 0, rm);
+
+	if (IsInt8(imm))
+	{
+		WriteU8(0x83); // op r/m, imm8
+		EmitModRM(3, ext, rm);
+		WriteI8(static_cast<int8_t>(imm));
+	}
+	else
+	{
+		WriteU8(0x81); // op r/m, imm32
+		EmitModRM(3, ext, rm);
+		WriteI32(imm);
+	}
+}
+
+void CAssembler::AddFixup(eFixup kind, uint8_t tail, Label_t label, const void *target, bool is_cond)
+{
+	if (_fixups.full())
+	{
+		Fail();
+		return;
+	}
+
+	Fixup_t fixup;
+	fixup.Pos = static_cast<uint32_t>(_pos);
+	fixup.Tail = tail;
+	fixup.Kind = kind;
+	fixup.IsCond = is_cond;
+	fixup.Label = label;
+	fixup.Target = target;
+
+	_fixups.push_back(fixup);
+}
+
+Label_t CAssembler::NewLabel()
+{
+	if (_labels.full())
+	{
+		Fail();
+		return 0;
+	}
+
+	_labels.push_back(UnboundLabel);
+	return static_cast<Label_t>(_labels.size() - 1);
+}
+
+void CAssembler::Bind(Label_t label)
+{
+	if (label >= _labels.size() || _labels[label] != UnboundLabel)
+	{
+		Fail();
+		return;
+	}
+
+	_labels[label] = static_cast<uint32_t>(_pos);
+}
+
+void CAssembler::Mov(eReg dst, eReg src)
+{
+	EmitRegRm(0x89, RegBits(src), RegBits(dst)); // mov r/m, r
+}
+
+void CAssembler::Mov(eReg dst, const Mem_t &src)
+{
+	EmitRegMem(0x8B, RegBits(dst), src); // mov r, r/m
+}
+
+void CAssembler::Mov(const Mem_t &dst, eReg src)
+{
+	EmitRegMem(0x89, RegBits(src), dst); // mov r/m, r
+}
+
+void CAssembler::Mov(eReg dst, uint64_t imm)
+{
+	uint8_t reg = RegBits(dst);
+
+	if (!_x64 || imm <= UINT32_MAX)
+	{
+		// mov r32, imm32 (zero-extends in x64 mode)
+		EmitRex(false, 0, 0, reg);
+		WriteU8(0xB8 + (reg & 7));
+		WriteU32(static_cast<uint32_t>(imm));
+	}
+	else if (IsInt32(static_cast<int64_t>(imm)))
+	{
+		// mov r/m64, imm32 (sign-extended)
+		EmitRex(true, 0, 0, reg);
+		WriteU8(0xC7);
+		EmitModRM(3, 0, reg);
+		WriteI32(static_cast<int32_t>(imm));
+	}
+	else
+	{
+		MovAbs(dst, imm);
+	}
+}
+
+void CAssembler::MovAbs(eReg dst, uint64_t imm)
+{
+	uint8_t reg = RegBits(dst);
+
+	EmitRex(true, 0, 0, reg);
+	WriteU8(0xB8 + (reg & 7));
+
+	if (_x64)
+		WriteU64(imm);
+	else
+		WriteU32(static_cast<uint32_t>(imm));
+}
+
+void CAssembler::Lea(eReg dst, const Mem_t &src)
+{
+	EmitRegMem(0x8D, RegBits(dst), src);
+}
+
+void CAssembler::Push(eReg reg)
+{
+	uint8_t bits = RegBits(reg);
+
+	EmitRex(false, 0, 0, bits);
+	WriteU8(0x50 + (bits & 7));
+}
+
+void CAssembler::Push(int32_t imm)
+{
+	if (IsInt8(imm))
+	{
+		WriteU8(0x6A);
+		WriteI8(static_cast<int8_t>(imm));
+	}
+	else
+	{
+		WriteU8(0x68);
+		WriteI32(imm);
+	}
+}
+
+void CAssembler::PushAbs(uint32_t imm)
+{
+	WriteU8(0x68);
+	WriteU32(imm);
+}
+
+void CAssembler::Pop(eReg reg)
+{
+	uint8_t bits = RegBits(reg);
+
+	EmitRex(false, 0, 0, bits);
+	WriteU8(0x58 + (bits & 7));
+}
+
+void CAssembler::Movdqu(eXmm dst, const Mem_t &src)
+{
+	auto reg = static_cast<uint8_t>(dst);
+
+	WriteU8(0xF3); // the mandatory prefix goes before REX
+	EmitRexFor(false, reg, src);
+	WriteU16(0x6F0F);
+	EmitMem(reg, src, 0);
+}
+
+void CAssembler::Movdqu(const Mem_t &dst, eXmm src)
+{
+	auto reg = static_cast<uint8_t>(src);
+
+	WriteU8(0xF3);
+	EmitRexFor(false, reg, dst);
+	WriteU16(0x7F0F);
+	EmitMem(reg, dst, 0);
+}
+
+void CAssembler::Movaps(eXmm dst, eXmm src)
+{
+	auto reg = static_cast<uint8_t>(dst);
+	auto rm = static_cast<uint8_t>(src);
+
+	EmitRex(false, reg, 0, rm);
+	WriteU16(0x280F);
+	EmitModRM(3, reg, rm);
+}
+
+void CAssembler::Add(eReg dst, int32_t imm)
+{
+	EmitGroupImm(0, dst, imm);
+}
+
+void CAssembler::Add(eReg dst, eReg src)
+{
+	EmitRegRm(0x01, RegBits(src), RegBits(dst));
+}
+
+void CAssembler::Sub(eReg dst, int32_t imm)
+{
+	EmitGroupImm(5, dst, imm);
+}
+
+void CAssembler::Sub(eReg dst, eReg src)
+{
+	EmitRegRm(0x29, RegBits(src), RegBits(dst));
+}
+
+void CAssembler::Xor(eReg dst, eReg src)
+{
+	EmitRegRm(0x31, RegBits(src), RegBits(dst));
+}
+
+void CAssembler::Cmp(eReg lhs, int32_t imm)
+{
+	EmitGroupImm(7, lhs, imm);
+}
+
+void CAssembler::Cmp(eReg lhs, eReg rhs)
+{
+	EmitRegRm(0x39, RegBits(rhs), RegBits(lhs));
+}
+
+void CAssembler::Cmp(const Mem_t &lhs, eReg rhs)
+{
+	EmitRegMem(0x39, RegBits(rhs), lhs);
+}
+
+void CAssembler::Test(eReg lhs, eReg rhs)
+{
+	EmitRegRm(0x85, RegBits(rhs), RegBits(lhs));
+}
+
+void CAssembler::Test(eReg lhs, int32_t imm)
+{
+	uint8_t rm = RegBits(lhs);
+
+	EmitRex(true, 0, 0, rm);
+	WriteU8(0xF7); // test r/m, imm32
+	EmitModRM(3, 0, rm);
+	WriteI32(imm);
+}
+
+void CAssembler::Call(const void *target)
+{
+	WriteU8(0xE8);
+	AddFixup(eFixup::AbsRel32, 0, 0, target);
+	WriteI32(0);
+}
+
+void CAssembler::Call(Label_t label)
+{
+	WriteU8(0xE8);
+	AddFixup(eFixup::LabelRel32, 0, label, nullptr);
+	WriteI32(0);
+}
+
+void CAssembler::Call(eReg reg)
+{
+	uint8_t rm = RegBits(reg);
+
+	EmitRex(false, 0, 0, rm);
+	WriteU8(0xFF); // call r/m
+	EmitModRM(3, 2, rm);
+}
+
+void CAssembler::Call(const Mem_t &mem)
+{
+	EmitRexFor(false, 0, mem);
+	WriteU8(0xFF);
+	EmitMem(2, mem, 0);
+}
+
+void CAssembler::Jmp(const void *target)
+{
+	WriteU8(0xE9);
+	AddFixup(eFixup::AbsRel32, 0, 0, target);
+	WriteI32(0);
+}
+
+void CAssembler::Jmp(Label_t label)
+{
+	WriteU8(0xEB);
+	AddFixup(eFixup::LabelRel8, 0, label, nullptr, false);
+	WriteI8(0);
+}
+
+void CAssembler::Jmp(eReg reg)
+{
+	uint8_t rm = RegBits(reg);
+
+	EmitRex(false, 0, 0, rm);
+	WriteU8(0xFF); // jmp r/m
+	EmitModRM(3, 4, rm);
+}
+
+void CAssembler::Jmp(const Mem_t &mem)
+{
+	EmitRexFor(false, 0, mem);
+	WriteU8(0xFF);
+	EmitMem(4, mem, 0);
+}
+
+void CAssembler::Jcc(eCond cond, const void *target)
+{
+	WriteU8(0x0F);
+	WriteU8(0x80 + static_cast<uint8_t>(cond));
+	AddFixup(eFixup::AbsRel32, 0, 0, target);
+	WriteI32(0);
+}
+
+void CAssembler::Jcc(eCond cond, Label_t label)
+{
+	WriteU8(0x70 + static_cast<uint8_t>(cond));
+	AddFixup(eFixup::LabelRel8, 0, label, nullptr, true);
+	WriteI8(0);
+}
+
+void CAssembler::Ret(uint16_t pop_bytes)
+{
+	if (pop_bytes != 0)
+	{
+		WriteU8(0xC2);
+		WriteU16(pop_bytes);
+	}
+	else
+	{
+		WriteU8(0xC3);
+	}
+}
+
+void CAssembler::Nop(size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		WriteU8(0x90);
+}
+
+void CAssembler::Int3(size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		WriteU8(0xCC);
+}
+
+//
+// Widens every short jump whose label is out of rel8 range. Widening moves the code
+// after the jump, which may push other short jumps out of range, so the pass is
+// repeated until nothing changes. Each jump can only grow once, so this terminates.
+//
+bool CAssembler::Relax()
+{
+	bool changed;
+
+	do
+	{
+		changed = false;
+
+		for (auto &fixup : _fixups)
+		{
+			if (fixup.Kind != eFixup::LabelRel8)
+				continue;
+
+			if (fixup.Label >= _labels.size() || _labels[fixup.Label] == UnboundLabel)
+				return false;
+
+			int64_t end = static_cast<int64_t>(fixup.Pos) + 1;
+			int64_t rel = static_cast<int64_t>(_labels[fixup.Label]) - end;
+
+			if (IsInt8(rel))
+				continue;
+
+			// jmp rel8 (EB xx)    -> jmp rel32 (E9 xx xx xx xx), +3 bytes
+			// jcc rel8 (7x xx)    -> jcc rel32 (0F 8x xx xx xx xx), +4 bytes
+			uint32_t grow = fixup.IsCond ? 4 : 3;
+			uint32_t opcode_pos = fixup.Pos - 1;
+
+			if (_pos + grow > _size)
+				return false;
+
+			memmove(&_data[fixup.Pos + 1 + grow], &_data[fixup.Pos + 1], _pos - (fixup.Pos + 1));
+			_pos += grow;
+
+			if (fixup.IsCond)
+			{
+				uint8_t cond = _data[opcode_pos] - 0x70;
+				_data[opcode_pos] = 0x0F;
+				_data[opcode_pos + 1] = 0x80 + cond;
+				fixup.Pos = opcode_pos + 2;
+			}
+			else
+			{
+				_data[opcode_pos] = 0xE9;
+				fixup.Pos = opcode_pos + 1;
+			}
+
+			fixup.Kind = eFixup::LabelRel32;
+
+			for (auto &label : _labels)
+			{
+				if (label != UnboundLabel && label > opcode_pos)
+					label += grow;
+			}
+
+			for (auto &other : _fixups)
+			{
+				if (&other != &fixup && other.Pos > opcode_pos)
+					other.Pos += grow;
+			}
+
+			changed = true;
+		}
+	} while (changed);
+
+	return true;
+}
+
+bool CAssembler::Finalize()
+{
+	if (_finalized)
+		return !_failed;
+
+	_finalized = true;
+
+	if (_failed || !Relax())
+	{
+		_failed = true;
+		return false;
+	}
+
+	for (auto &fixup : _fixups)
+	{
+		uint8_t field_size = (fixup.Kind == eFixup::LabelRel8) ? 1 : 4;
+		const uint8_t *end = _runtime + fixup.Pos + field_size + fixup.Tail;
+
+		const uint8_t *target;
+
+		if (fixup.Kind == eFixup::AbsRel32)
+		{
+			target = static_cast<const uint8_t *>(fixup.Target);
+		}
+		else
+		{
+			if (fixup.Label >= _labels.size() || _labels[fixup.Label] == UnboundLabel)
+			{
+				_failed = true;
+				return false;
+			}
+
+			target = _runtime + _labels[fixup.Label];
+		}
+
+		if (fixup.Kind == eFixup::LabelAbs32)
+		{
+			auto value = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(target));
+			memcpy(&_data[fixup.Pos], &value, sizeof(value));
+			continue;
+		}
+
+		int64_t rel = reinterpret_cast<intptr_t>(target) - reinterpret_cast<intptr_t>(end);
+
+		if (field_size == 1)
+		{
+			_data[fixup.Pos] = static_cast<uint8_t>(static_cast<int8_t>(rel));
+		}
+		else
+		{
+			if (_x64 && !IsInt32(rel))
+			{
+				_failed = true;
+				return false;
+			}
+
+			auto value = static_cast<int32_t>(rel);
+			memcpy(&_data[fixup.Pos], &value, sizeof(value));
+		}
+	}
+
+	return true;
+}
+
+MEMORIA_END
\ No newline at end of file
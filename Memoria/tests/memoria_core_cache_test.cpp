@@ -0,0 +1,70 @@
+#include "memoria_test.hpp"
+
+#include "memoria_core_cache.hpp"
+
+#include <string.h>
+
+using namespace Memoria;
+
+static constexpr size_t PageSize = CPageCache::PageSize;
+
+// Serves a fixed pattern for every address and counts the batches it was asked for.
+class CCountingSource : public IMemorySource
+{
+public:
+	size_t Batches = 0;
+
+	size_t Read(uintptr_t address, void *buffer, size_t size) override
+	{
+		memset(buffer, static_cast<uint8_t>(address / PageSize), size);
+		return size;
+	}
+
+	size_t ReadBatch(std::span<MemoryIo_t> requests) override
+	{
+		Batches++;
+
+		for (auto &request : requests)
+			request.Transferred = Read(request.Address, request.Buffer, request.Size);
+
+		return requests.size();
+	}
+};
+
+TEST(MultiPageReadCountsMisses)
+{
+	CCountingSource source;
+	CPageCache cache(source, 16, 1);
+
+	uint8_t buffer[4 * PageSize];
+	CHECK(cache.Read(0x10000, buffer, sizeof(buffer)) == sizeof(buffer));
+
+	// All four pages were loaded for the read, in one batch; none of them was a hit.
+	CHECK(source.Batches == 1);
+	CHECK(cache.GetStats().Hits == 0);
+	CHECK(cache.GetStats().Misses == 4);
+
+	CHECK(cache.Read(0x10000, buffer, sizeof(buffer)) == sizeof(buffer));
+	CHECK(source.Batches == 1);
+	CHECK(cache.GetStats().Hits == 4);
+	CHECK(cache.GetStats().Misses == 4);
+}
+
+TEST(PrefetchedPagesMissOnce)
+{
+	CCountingSource source;
+	CPageCache cache(source, 16, 1);
+
+	cache.Prefetch(0x20000, 2 * PageSize);
+	CHECK(cache.GetStats().Prefetched == 2);
+
+	auto value = cache.ReadValue<uint32_t>(0x20000 + PageSize);
+	CHECK(value.has_value() && value.value() == 0x21212121);
+	CHECK(cache.GetStats().Hits == 0 && cache.GetStats().Misses == 1);
+
+	value = cache.ReadValue<uint32_t>(0x20000 + PageSize + 8);
+	CHECK(cache.GetStats().Hits == 1 && cache.GetStats().Misses == 1);
+	CHECK(source.Batches == 1);
+}
+
+TEST_MAIN()
\ No newline at end of file
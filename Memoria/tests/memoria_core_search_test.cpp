@@ -0,0 +1,174 @@
+#include "memoria_test.hpp"
+
+#include "memoria_core_elf.hpp"
+#include "memoria_core_options.hpp"
+#include "memoria_core_read.hpp"
+#include "memoria_core_relocs.hpp"
+#include "memoria_core_search.hpp"
+
+#include <dlfcn.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace Memoria;
+
+static constexpr size_t PageSize = 4096;
+
+//
+// Three pages with an inaccessible one in the middle.
+//
+class CPages
+{
+private:
+	uint8_t *_pages;
+
+public:
+	CPages()
+	{
+		_pages = static_cast<uint8_t *>(mmap(nullptr, 3 * PageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+		mprotect(_pages + PageSize, PageSize, PROT_NONE);
+
+		SetSafeModeState(true);
+	}
+
+	~CPages()
+	{
+		SetSafeModeState(false);
+		munmap(_pages, 3 * PageSize);
+	}
+
+	uint8_t *Get(size_t offset = 0) const { return _pages + offset; }
+	uint8_t *End() const { return _pages + 3 * PageSize; }
+};
+
+TEST(FindAcrossUnreadablePage)
+{
+	CPages pages;
+
+	uint32_t value = 0xDEADBEEF;
+	memcpy(pages.Get(16), &value, sizeof(value));
+	memcpy(pages.Get(2 * PageSize + 32), &value, sizeof(value));
+
+	// Forward from the first match skips the inaccessible page instead of faulting.
+	CHECK(FindU32(pages.Get(), pages.Get(), pages.End(), value) == reinterpret_cast<uint32_t *>(pages.Get(16)));
+	CHECK(FindU32(pages.Get(17), pages.Get(), pages.End(), value) == reinterpret_cast<uint32_t *>(pages.Get(2 * PageSize + 32)));
+
+	// Backward from the end.
+	CHECK(FindU32(pages.End() - sizeof(value) - 1, pages.Get(), pages.End(), value, true) == reinterpret_cast<uint32_t *>(pages.Get(2 * PageSize + 32)));
+	CHECK(FindU32(pages.Get(2 * PageSize + 31), pages.Get(), pages.End(), value, true) == reinterpret_cast<uint32_t *>(pages.Get(16)));
+
+	// Starting inside the inaccessible page.
+	CHECK(FindU32(pages.Get(PageSize + 8), pages.Get(), pages.End(), value) == reinterpret_cast<uint32_t *>(pages.Get(2 * PageSize + 32)));
+
+	CHECK(FindU32(pages.Get(), pages.Get(), pages.End(), 0x12345678) == nullptr);
+}
+
+TEST(FindSignatureAndString)
+{
+	CPages pages;
+
+	const uint8_t code[] = { 0x48, 0x8B, 0x05, 0x11, 0x22, 0x33, 0x44, 0xC3 };
+	memcpy(pages.Get(2 * PageSize + 100), code, sizeof(code));
+	strcpy(reinterpret_cast<char *>(pages.Get(200)), "memoria");
+
+	CHECK(FindSignature(pages.Get(), pages.Get(), pages.End(), "48 8B 05 ? ? ? ? C3") == pages.Get(2 * PageSize + 100));
+	CHECK(FindSignature(pages.Get(), pages.Get(), pages.End(), "48 8B 05 ? ? ? ? C3", false, 3) == pages.Get(2 * PageSize + 103));
+	CHECK(FindAStr(pages.Get(), pages.Get(), pages.End(), "memoria") == pages.Get(200));
+}
+
+TEST(GuardedReads)
+{
+	CPages pages;
+
+	memset(pages.Get(), 0x22, 8);
+
+	auto value = ReadU32(pages.Get());
+	CHECK(value.has_value() && value.value() == 0x22222222);
+
+	CHECK(!ReadU32(pages.Get(PageSize)).has_value());
+
+	// Straddling the boundary into the inaccessible page.
+	CHECK(!ReadU64(pages.Get(PageSize - 4)).has_value());
+
+	char text[16];
+	CHECK(!ReadAStr(pages.Get(PageSize + 4), text, sizeof(text)));
+}
+
+// Pointers to `gTarget`: one the loader relocates in read-only data, one in writable data.
+static int gTarget;
+
+extern int *const gReadOnlyRef;
+int *const gReadOnlyRef = &gTarget;
+int *gWritableRef = &gTarget;
+
+static bool Contains(const Memoria::Vector<Ref_t> &refs, const void *xref)
+{
+	for (const auto &ref : refs)
+	{
+		if (ref.is_absolute && ref.xref == xref)
+			return true;
+	}
+
+	return false;
+}
+
+TEST(FindReferencesInModule)
+{
+	ElfModule_t module;
+	CHECK(FindElfModule(&gTarget, module));
+
+	// The test programs are position independent, so the relocation slots are searched.
+	auto relocations = GetRelocationIndex(&gTarget);
+	CHECK(relocations && relocations->IsComplete());
+
+	auto begin = reinterpret_cast<void *>(module.Begin);
+	auto end = reinterpret_cast<void *>(module.End);
+
+	auto refs = FindReferences(begin, begin, end, &gTarget, 0, true, false, false);
+	CHECK(Contains(refs, &gReadOnlyRef) && Contains(refs, &gWritableRef));
+
+	// Backward from the very end of the module.
+	refs = FindReferences(end, begin, end, &gTarget, 0, true, false, false, true);
+	CHECK(Contains(refs, &gReadOnlyRef) && Contains(refs, &gWritableRef));
+}
+
+TEST(FindReferencesInFullRelroGot)
+{
+	// Only ever called, never taken by address, so the test has a JUMP_SLOT for it and no GLOB_DAT.
+	CHECK(getpagesize() > 0);
+
+	ElfModule_t module;
+	CHECK(FindElfModule(&gTarget, module));
+
+	// The test is linked with `-z relro -z now`, the PLT slots are bound and read-only.
+	auto relocations = GetRelocationIndex(&gTarget);
+	CHECK(relocations && relocations->IsComplete());
+
+	CElfImage image(module);
+	auto target = dlsym(RTLD_DEFAULT, "getpagesize");
+	auto begin = reinterpret_cast<void *>(module.Begin);
+	auto end = reinterpret_cast<void *>(module.End);
+	size_t count = 0;
+
+	auto refs = FindReferences(begin, begin, end, target, 0, true, false, false);
+
+	for (const auto &segment : image.GetSegments())
+	{
+		if (!segment.Readable)
+			continue;
+
+		for (uintptr_t slot = segment.Begin; slot + sizeof(void *) <= segment.End; slot += sizeof(void *))
+		{
+			if (*reinterpret_cast<void **>(slot) != target)
+				continue;
+
+			CHECK(Contains(refs, reinterpret_cast<void *>(slot)));
+			count++;
+		}
+	}
+
+	CHECK(count != 0);
+}
+
+TEST_MAIN()
\ No newline at end of file
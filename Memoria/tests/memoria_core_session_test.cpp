@@ -0,0 +1,187 @@
+#include "memoria_test.hpp"
+
+#include "memoria_core_session.hpp"
+#include "memoria_core_write.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+using namespace Memoria;
+
+static constexpr size_t PageSize = 4096;
+
+//
+// Two read-only pages, the second one made writable by `SplitProtection`.
+//
+class CPages
+{
+private:
+	uint8_t *_pages;
+
+public:
+	CPages()
+	{
+		_pages = static_cast<uint8_t *>(mmap(nullptr, 2 * PageSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	}
+
+	~CPages()
+	{
+		munmap(_pages, 2 * PageSize);
+	}
+
+	void SplitProtection()
+	{
+		mprotect(_pages + PageSize, PageSize, PROT_READ | PROT_WRITE);
+	}
+
+	uint8_t *Get(size_t offset = 0) const { return _pages + offset; }
+};
+
+// The permissions of the mapping that contains `addr`, as in `/proc/self/maps` ("r--p").
+static bool GetPermissions(const void *addr, char (&perms)[5])
+{
+	FILE *maps = fopen("/proc/self/maps", "r");
+
+	if (!maps)
+		return false;
+
+	char line[512];
+	bool found = false;
+
+	while (!found && fgets(line, sizeof(line), maps))
+	{
+		unsigned long long begin, end;
+
+		if (sscanf(line, "%llx-%llx %4s", &begin, &end, perms) == 3)
+			found = reinterpret_cast<uintptr_t>(addr) >= begin && reinterpret_cast<uintptr_t>(addr) < end;
+	}
+
+	fclose(maps);
+	return found;
+}
+
+static bool IsReadOnly(const void *addr)
+{
+	char perms[5];
+	return GetPermissions(addr, perms) && perms[0] == 'r' && perms[1] == '-';
+}
+
+TEST(StagedUntilCommit)
+{
+	CPages pages;
+
+	{
+		CWriteSession session;
+
+		CHECK(CWriteSession::GetActive() == &session);
+
+		// Staged only, the page is still read-only and unchanged.
+		CHECK(WriteU32(pages.Get(0), 0x11111111));
+		CHECK(WriteU32(pages.Get(64), 0x22222222));
+		CHECK(FillChar(pages.Get(128), 0x33, 16));
+
+		CHECK(session.GetCount() == 3);
+		CHECK(!session.IsWritten(0));
+		CHECK(pages.Get()[0] == 0);
+
+		// All three in one region, written together and the protection restored.
+		CHECK(session.Commit());
+		CHECK(session.IsWritten(0) && session.IsWritten(1) && session.IsWritten(2));
+
+		uint32_t value;
+		memcpy(&value, pages.Get(64), sizeof(value));
+
+		CHECK(value == 0x22222222);
+		CHECK(pages.Get()[0] == 0x11 && pages.Get()[143] == 0x33 && pages.Get()[144] == 0);
+		CHECK(IsReadOnly(pages.Get()));
+
+		// The session stays usable after a commit.
+		CHECK(WriteU8(pages.Get(200), 0x44));
+		CHECK(pages.Get()[200] == 0);
+	}
+
+	CHECK(CWriteSession::GetActive() == nullptr);
+	CHECK(pages.Get()[200] == 0x44);
+	CHECK(IsReadOnly(pages.Get()));
+}
+
+TEST(WriteAcrossRegions)
+{
+	CPages pages;
+	pages.SplitProtection();
+
+	const uint8_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+	{
+		CWriteSession session;
+
+		// Crosses from the read-only into the writable page.
+		session.Stage(pages.Get(PageSize - 4), data, sizeof(data));
+		CHECK(session.Commit());
+		CHECK(session.IsWritten(0));
+	}
+
+	CHECK(memcmp(pages.Get(PageSize - 4), data, sizeof(data)) == 0);
+	CHECK(IsReadOnly(pages.Get()));
+	CHECK(!IsReadOnly(pages.Get(PageSize)));
+}
+
+TEST(OverlappingWritesInOrder)
+{
+	CPages pages;
+
+	{
+		CWriteSession session;
+
+		// Staged at decreasing addresses, every write must still land after the previous ones.
+		FillChar(pages.Get(4), 0xAA, 4);
+		FillChar(pages.Get(2), 0xBB, 4);
+		FillChar(pages.Get(4), 0xCC, 1);
+		FillChar(pages.Get(0), 0xDD, 3);
+	}
+
+	const uint8_t expected[8] = { 0xDD, 0xDD, 0xDD, 0xBB, 0xCC, 0xBB, 0xAA, 0xAA };
+	CHECK(memcmp(pages.Get(), expected, sizeof(expected)) == 0);
+}
+
+TEST(NestedSessions)
+{
+	CPages pages;
+
+	{
+		CWriteSession outer;
+
+		WriteU8(pages.Get(0), 1);
+
+		{
+			CWriteSession inner;
+
+			CHECK(CWriteSession::GetActive() == &inner);
+
+			WriteU8(pages.Get(1), 2);
+
+			CHECK(inner.GetCount() == 1 && outer.GetCount() == 1);
+		}
+
+		// The inner session is committed on its own, the outer one is active again.
+		CHECK(CWriteSession::GetActive() == &outer);
+		CHECK(pages.Get()[0] == 0 && pages.Get()[1] == 2);
+
+		{
+			CWriteSession discarded;
+
+			WriteU8(pages.Get(2), 3);
+			discarded.Discard();
+
+			CHECK(CWriteSession::GetActive() == &outer);
+		}
+
+		CHECK(pages.Get()[2] == 0);
+	}
+
+	CHECK(pages.Get()[0] == 1 && pages.Get()[2] == 0);
+	CHECK(CWriteSession::GetActive() == nullptr);
+}
+
+TEST_MAIN()
\ No newline at end of file
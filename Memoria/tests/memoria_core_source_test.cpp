@@ -0,0 +1,227 @@
+#include "memoria_test.hpp"
+
+#include "memoria_core_options.hpp"
+#include "memoria_core_source.hpp"
+
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace Memoria;
+
+static constexpr size_t PageSize = 4096;
+
+//
+// A forked child sharing the parent's address layout.
+//
+// The child fills the first page of `_pages` with its own pattern (the parent keeps
+// its copy zeroed, so a local read can't pass for a remote one), then waits until the
+// parent is done and reports whether the parent's writes arrived.
+//
+class CChild
+{
+private:
+	uint8_t *_pages;
+	pid_t _pid = -1;
+	int _to_child[2];
+	int _to_parent[2];
+
+public:
+	static constexpr uint8_t Pattern = 0x5A;
+	static constexpr size_t WriteOffset = 128;
+	static constexpr uint8_t Written = 0xC3;
+
+	CChild()
+	{
+		// The second page is unmapped, reads running into it must stop short. A `PROT_NONE`
+		// page would not do, `/proc/<pid>/mem` reads through page protection.
+		_pages = static_cast<uint8_t *>(mmap(nullptr, 2 * PageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+		munmap(_pages + PageSize, PageSize);
+
+		if (pipe(_to_child) != 0 || pipe(_to_parent) != 0)
+			return;
+
+		_pid = fork();
+
+		if (_pid == 0)
+		{
+			memset(_pages, Pattern, PageSize);
+			Signal(_to_parent[1]);
+			Wait(_to_child[0]);
+
+			bool ok = true;
+
+			for (size_t i = 0; i < 16; i++)
+				ok &= _pages[WriteOffset + i] == Written;
+
+			_exit(ok ? 0 : 1);
+		}
+
+		if (_pid > 0)
+			Wait(_to_parent[0]);
+	}
+
+	~CChild()
+	{
+		if (_pid > 0)
+		{
+			kill(_pid, SIGKILL);
+			waitpid(_pid, nullptr, 0);
+		}
+
+		munmap(_pages, PageSize);
+	}
+
+	static void Signal(int fd)
+	{
+		char ch = 0;
+		(void)!write(fd, &ch, 1);
+	}
+
+	static void Wait(int fd)
+	{
+		char ch;
+		(void)!read(fd, &ch, 1);
+	}
+
+	pid_t GetPid() const { return _pid; }
+	uintptr_t GetAddress(size_t offset = 0) const { return reinterpret_cast<uintptr_t>(_pages) + offset; }
+
+	// Lets the child check the writes. Returns whether they all arrived.
+	bool Finish()
+	{
+		Signal(_to_child[1]);
+
+		int status = 0;
+		waitpid(_pid, &status, 0);
+		_pid = -1;
+
+		return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+};
+
+template <typename Backend>
+static void CheckBackend(Backend &memory, CChild &child)
+{
+	uint8_t buffer[64];
+
+	// Plain read.
+	memset(buffer, 0, sizeof(buffer));
+	CHECK(memory.Read(child.GetAddress(), buffer, sizeof(buffer)) == sizeof(buffer));
+	CHECK(buffer[0] == CChild::Pattern && buffer[63] == CChild::Pattern);
+
+	// Partial read into the inaccessible page.
+	CHECK(memory.Read(child.GetAddress(PageSize - 16), buffer, sizeof(buffer)) == 16);
+	CHECK(memory.Read(child.GetAddress(PageSize), buffer, sizeof(buffer)) == 0);
+
+	// Batch with a complete, a partial and a failed request.
+	uint8_t a[8], b[32], c[8];
+
+	MemoryIo_t requests[] =
+	{
+		{ child.GetAddress(64), a, sizeof(a), 0 },
+		{ child.GetAddress(PageSize - 8), b, sizeof(b), 0 },
+		{ child.GetAddress(PageSize + 64), c, sizeof(c), 0 },
+	};
+
+	CHECK(memory.ReadBatch(requests) == 1);
+	CHECK(requests[0].Transferred == sizeof(a) && a[0] == CChild::Pattern);
+	CHECK(requests[1].Transferred < sizeof(b));
+	CHECK(requests[2].Transferred == 0);
+
+	auto value = memory.template ReadValue<uint32_t>(child.GetAddress());
+	CHECK(value.has_value() && value.value() == 0x5A5A5A5A);
+
+	// Writes, checked by the child.
+	uint8_t data[16];
+	memset(data, CChild::Written, sizeof(data));
+
+	CHECK(memory.Write(child.GetAddress(CChild::WriteOffset), data, 8) == 8);
+
+	MemoryIo_t writes[] =
+	{
+		{ child.GetAddress(CChild::WriteOffset + 8), data, 8, 0 },
+		{ child.GetAddress(PageSize), data, 8, 0 },
+	};
+
+	CHECK(memory.WriteBatch(writes) == 1);
+	CHECK(writes[0].Transferred == 8 && writes[1].Transferred == 0);
+
+	CHECK(child.Finish());
+}
+
+TEST(ProcessVmMemory)
+{
+	CChild child;
+	CHECK(child.GetPid() > 0);
+
+	CProcessVmMemory memory(child.GetPid());
+	CheckBackend(memory, child);
+}
+
+TEST(ProcMemMemory)
+{
+	CChild child;
+	CHECK(child.GetPid() > 0);
+
+	CProcMemMemory memory(child.GetPid());
+	CHECK(memory.IsOpen());
+	CheckBackend(memory, child);
+}
+
+TEST(LocalMemory)
+{
+	auto &local = GetLocalMemory();
+
+	auto pages = static_cast<uint8_t *>(mmap(nullptr, 2 * PageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	memset(pages, 0x11, PageSize);
+	mprotect(pages + PageSize, PageSize, PROT_NONE);
+
+	auto address = reinterpret_cast<uintptr_t>(pages);
+	uint8_t buffer[32];
+
+	CHECK(local.Read(address, buffer, sizeof(buffer)) == sizeof(buffer) && buffer[31] == 0x11);
+
+	// In safe mode an inaccessible range fails instead of faulting.
+	SetSafeModeState(true);
+	CHECK(local.Read(address + PageSize, buffer, sizeof(buffer)) == 0);
+	SetSafeModeState(false);
+
+	uint32_t value = 0xDEADBEEF;
+	CHECK(local.WriteValue(address + 4, value));
+	CHECK(*reinterpret_cast<uint32_t *>(pages + 4) == 0xDEADBEEF);
+
+	// Writes go through `mprotect`, read-only pages are writable too.
+	mprotect(pages, PageSize, PROT_READ);
+	CHECK(local.WriteValue(address + 8, value));
+	CHECK(*reinterpret_cast<uint32_t *>(pages + 8) == 0xDEADBEEF);
+
+	munmap(pages, 2 * PageSize);
+}
+
+TEST(LocalRegions)
+{
+	static int marker;
+
+	struct Query_t
+	{
+		uintptr_t Address;
+		bool Found;
+	} query{ reinterpret_cast<uintptr_t>(&marker), false };
+
+	CHECK(EnumerateLocalRegions([](const MemoryRegion_t &region, void *param)
+	{
+		auto query = static_cast<Query_t *>(param);
+
+		if (query->Address >= region.Begin && query->Address < region.End)
+			query->Found = region.Readable && region.Writable && !region.Executable;
+
+		return true;
+	}, &query) > 0);
+
+	CHECK(query.Found);
+}
+
+TEST_MAIN()
\ No newline at end of file
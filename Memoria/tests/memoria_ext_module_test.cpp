@@ -0,0 +1,197 @@
+#include "memoria_test.hpp"
+
+#include "memoria_core_rtti.hpp"
+#include "memoria_ext_module.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace Memoria;
+
+class CModuleTestBase
+{
+public:
+	virtual ~CModuleTestBase() = default;
+
+	// Out of line, so this file emits the vtable even if no base object is ever built.
+	virtual int Get() const;
+};
+
+int CModuleTestBase::Get() const
+{
+	return 1;
+}
+
+class CModuleTestDerived : public CModuleTestBase
+{
+public:
+	int Get() const override { return 2; }
+};
+
+extern "C" __attribute__((noinline)) unsigned ModuleTestMarker(unsigned value)
+{
+	return (value ^ 0x13572468u) * 0x2468ACE1u;
+}
+
+// The first bytes of `ModuleTestMarker` as a signature.
+static void MarkerSignature(char *out, size_t max_size, size_t length)
+{
+	auto code = reinterpret_cast<const uint8_t *>(&ModuleTestMarker);
+	size_t used = 0;
+
+	for (size_t i = 0; i < length && used + 4 < max_size; i++)
+		used += snprintf(out + used, max_size - used, i ? " %02X" : "%02X", code[i]);
+}
+
+TEST(ModuleOfExecutable)
+{
+	auto module = CMemoryModule::CreateFromAddress(reinterpret_cast<const void *>(&ModuleTestMarker));
+	CHECK(module && module->IsLoaded());
+
+	if (!module || !module->IsLoaded())
+		return;
+
+	auto text = module->GetSection(eSection::Code);
+	CHECK(text != nullptr);
+
+	if (text)
+	{
+		auto marker = reinterpret_cast<uintptr_t>(&ModuleTestMarker);
+		auto base = reinterpret_cast<uintptr_t>(text->GetBase());
+
+		CHECK(marker >= base && marker < base + text->GetSize());
+	}
+
+	uint8_t fingerprint[CMemoryModule::MaxFingerprintSize];
+	CHECK(module->GetFingerprint(fingerprint, sizeof(fingerprint)) > 0);
+}
+
+TEST(SignatureInSection)
+{
+	auto module = CMemoryModule::CreateFromAddress(reinterpret_cast<const void *>(&ModuleTestMarker));
+
+	if (!module || !module->IsLoaded())
+	{
+		CHECK(false);
+		return;
+	}
+
+	char signature[128];
+	MarkerSignature(signature, sizeof(signature), 16);
+
+	void *found = nullptr;
+
+	CHECK(module->SigSec(eSection::Code, signature, [](CSigHandle &sig, void *param)
+	{
+		*static_cast<void **>(param) = sig.GetPointer();
+	}, &found));
+
+	CHECK(found == reinterpret_cast<void *>(&ModuleTestMarker));
+}
+
+TEST(VTableForClass)
+{
+	CModuleTestDerived object;
+	CModuleTestBase *base = &object;
+	CHECK(base->Get() == 2);
+
+	auto module = CMemoryModule::CreateFromAddress(reinterpret_cast<const void *>(&ModuleTestMarker));
+
+	if (!module || !module->IsLoaded())
+	{
+		CHECK(false);
+		return;
+	}
+
+	auto vtable = *reinterpret_cast<void ***>(&object);
+
+	CHECK(module->GetRtti() != nullptr);
+	CHECK(module->GetVTableForClass("CModuleTestDerived") == vtable);
+	CHECK(module->GetVTableForClass("CModuleTestBase") != nullptr);
+	CHECK(module->GetVTableForClass("CModuleTestMissing") == nullptr);
+
+	// The range lookups only return what lies at or after the start.
+	auto rtti = GetRttiIndex(reinterpret_cast<const void *>(&ModuleTestMarker));
+	CHECK(rtti != nullptr);
+
+	if (!rtti)
+		return;
+
+	auto begin = reinterpret_cast<const uint8_t *>(rtti->GetBase());
+	auto end = begin + rtti->GetSize();
+
+	auto descriptor = static_cast<const uint8_t *>(GetRTTIDescriptor(begin, begin, end, "CModuleTestDerived"));
+	CHECK(descriptor != nullptr);
+	CHECK(GetRTTIDescriptor(descriptor + 1, begin, end, "CModuleTestDerived") == nullptr);
+
+	CHECK(GetVTableForClass(begin, begin, end, "CModuleTestDerived") == vtable);
+	CHECK(GetVTableForClass(reinterpret_cast<const uint8_t *>(vtable) + 1, begin, end, "CModuleTestDerived") == nullptr);
+}
+
+TEST(DumpRoundTrip)
+{
+	auto module = CMemoryModule::CreateFromAddress(reinterpret_cast<const void *>(&ModuleTestMarker));
+
+	if (!module || !module->IsLoaded())
+	{
+		CHECK(false);
+		return;
+	}
+
+	char path[] = "/tmp/memoria_dump_XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+
+	if (fd < 0)
+		return;
+
+	close(fd);
+	CHECK(module->Dump(path));
+
+	auto dump = CMemoryModule::CreateFromDump(path);
+	CHECK(dump && dump->IsLoaded() && dump->GetDump());
+
+	if (dump && dump->IsLoaded() && dump->GetDump())
+	{
+		auto marker = reinterpret_cast<uintptr_t>(&ModuleTestMarker);
+
+		// The executable is still mapped at its base, so the dump lives elsewhere.
+		CHECK(!dump->GetDump()->IsAtBase());
+		CHECK(dump->GetDump()->GetBase() == reinterpret_cast<uintptr_t>(module->GetBase()));
+
+		uint8_t live[CMemoryModule::MaxFingerprintSize], dumped[CMemoryModule::MaxFingerprintSize];
+		size_t size = module->GetFingerprint(live, sizeof(live));
+
+		CHECK(size > 0 && dump->GetFingerprint(dumped, sizeof(dumped)) == size && memcmp(live, dumped, size) == 0);
+
+		auto code = dump->GetDump()->ToView(marker);
+		CHECK(code && memcmp(code, reinterpret_cast<const void *>(marker), 16) == 0);
+
+		char signature[128];
+		MarkerSignature(signature, sizeof(signature), 16);
+
+		void *found = nullptr;
+
+		CHECK(dump->SigSec(eSection::Code, signature, [](CSigHandle &sig, void *param)
+		{
+			*static_cast<void **>(param) = sig.GetPointer();
+		}, &found));
+
+		CHECK(found == code);
+
+		// The vtable is found in the mapping, the same one as in the running module.
+		CModuleTestDerived object;
+		auto vtable = *reinterpret_cast<void ***>(&object);
+
+		CHECK(dump->GetVTableForClass("CModuleTestDerived") == dump->GetDump()->ToView(reinterpret_cast<uintptr_t>(vtable)));
+	}
+
+	unlink(path);
+
+	char info[sizeof(path) + 8];
+	snprintf(info, sizeof(info), "%s%s", path, ModuleDumpInfoSuffix);
+	unlink(info);
+}
+
+TEST_MAIN()
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include "memoria_test.hpp"
+
+#include "memoria_ext_module.hpp"
+#include "memoria_ext_pointerscan.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace Memoria;
+
+static constexpr size_t HeapSize = 64 * 1024;
+static constexpr size_t NodeSize = 256;
+
+// The static roots, in `.bss` of the test program.
+static uintptr_t gRoots[8];
+
+//
+// A synthetic heap of fixed-size nodes:
+//
+//   gRoots[2] -> A, [A + 0x18] -> B, [B + 0x28] -> C, target = C + 0x30
+//
+// plus a cycle (D <-> E) and a node pointing at the target that no root reaches.
+//
+class CHeapGraph
+{
+private:
+	uint8_t *_heap;
+
+public:
+	CHeapGraph()
+	{
+		_heap = static_cast<uint8_t *>(mmap(nullptr, HeapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+		Link(0, 0x18, 1);
+		Link(1, 0x28, 2);
+
+		Link(3, 0x08, 4);
+		Link(4, 0x08, 3);
+
+		Set(5, 0x10, GetTarget());
+
+		gRoots[2] = GetNode(0);
+	}
+
+	~CHeapGraph()
+	{
+		memset(gRoots, 0, sizeof(gRoots));
+		munmap(_heap, HeapSize);
+	}
+
+	uintptr_t GetNode(size_t index) const { return reinterpret_cast<uintptr_t>(_heap + index * NodeSize); }
+	uintptr_t GetTarget() const { return GetNode(2) + 0x30; }
+
+	uintptr_t GetBegin() const { return reinterpret_cast<uintptr_t>(_heap); }
+
+	void Set(size_t node, size_t offset, uintptr_t value)
+	{
+		memcpy(_heap + node * NodeSize + offset, &value, sizeof(value));
+	}
+
+	void Link(size_t from, size_t offset, size_t to)
+	{
+		Set(from, offset, GetNode(to));
+	}
+};
+
+struct Results_t
+{
+	PointerScanResult_t Results[16];
+	size_t Count;
+};
+
+static bool CollectResult(const PointerScanResult_t &result, void *param)
+{
+	auto results = static_cast<Results_t *>(param);
+
+	if (results->Count < 16)
+		results->Results[results->Count++] = result;
+
+	return true;
+}
+
+TEST(ScanSyntheticGraph)
+{
+	CHeapGraph graph;
+
+	PointerScanOptions_t options;
+	options.MaxDepth = 4;
+	options.MaxOffset = 0x100;
+	options.Workers = 2;
+
+	CPointerScanner scanner(options);
+	auto roots = reinterpret_cast<uintptr_t>(gRoots);
+
+	CHECK(scanner.AddStaticRegion("roots", roots, roots, sizeof(gRoots)));
+	scanner.AddRegion(graph.GetBegin(), HeapSize);
+
+	// A -> B, B -> C, D <-> E, the stray pointer and the root.
+	CHECK(scanner.Snapshot() == 6);
+
+	Results_t results{};
+	CHECK(scanner.Scan(graph.GetTarget(), CollectResult, &results) == 1);
+
+	auto &result = results.Results[0];
+
+	CHECK(result.Module == 0 && strcmp(scanner.GetModuleName(0), "roots") == 0);
+	CHECK(result.BaseOffset == 2 * sizeof(uintptr_t));
+	CHECK(result.Depth == 3);
+	CHECK(result.Offsets[0] == 0x18 && result.Offsets[1] == 0x28 && result.Offsets[2] == 0x30);
+
+	ptrdiff_t offsets[] = { 0x18, 0x28, 0x30 };
+	CPointerPath path(&gRoots[2], offsets);
+
+	CHECK(reinterpret_cast<uintptr_t>(path.Resolve()) == graph.GetTarget());
+
+	// Too shallow for the path.
+	options.MaxDepth = 2;
+	CPointerScanner shallow(options);
+
+	shallow.AddStaticRegion("roots", roots, roots, sizeof(gRoots));
+	shallow.AddRegion(graph.GetBegin(), HeapSize);
+	shallow.Snapshot();
+
+	CHECK(shallow.Scan(graph.GetTarget(), CollectResult, &results) == 0);
+}
+
+TEST(ScanMultipleParents)
+{
+	CHeapGraph graph;
+
+	// gRoots[5] -> G, [G + 0x08] -> F, and both [F + 0x10] and [F + 0x20] -> H, target = H + 0x40.
+	// G points into F, so the scan reaches G through both fields of F.
+	graph.Link(6, 0x10, 8);
+	graph.Link(6, 0x20, 8);
+	graph.Link(9, 0x08, 6);
+
+	gRoots[5] = graph.GetNode(9);
+
+	auto roots = reinterpret_cast<uintptr_t>(gRoots);
+	auto target = graph.GetNode(8) + 0x40;
+
+	PointerScanOptions_t options;
+	options.MaxDepth = 4;
+	options.MaxOffset = 0x100;
+
+	for (size_t parents : { 1, 2 })
+	{
+		options.MaxParents = parents;
+
+		CPointerScanner scanner(options);
+
+		scanner.AddStaticRegion("roots", roots, roots, sizeof(gRoots));
+		scanner.AddRegion(graph.GetBegin(), HeapSize);
+		scanner.Snapshot();
+
+		Results_t results{};
+		CHECK(scanner.Scan(target, CollectResult, &results) == parents);
+
+		for (size_t i = 0; i < results.Count; i++)
+		{
+			auto &result = results.Results[i];
+
+			CHECK(result.BaseOffset == 5 * sizeof(uintptr_t) && result.Depth == 3);
+			CHECK(result.Offsets[0] == 0x08 && result.Offsets[1] == 0x10 * (i + 1) && result.Offsets[2] == 0x40);
+		}
+	}
+}
+
+TEST(ScanModuleToFile)
+{
+	CHeapGraph graph;
+
+	// The main program, found again by `GetModuleBase("")`.
+	auto module = CMemoryModule::CreateFromAddress(&gRoots);
+	CHECK(module && module->IsLoaded());
+
+	if (!module || !module->IsLoaded())
+		return;
+
+	PointerScanOptions_t options;
+	options.MaxDepth = 3;
+	options.MaxOffset = 0x100;
+
+	CPointerScanner scanner(options);
+
+	CHECK(scanner.AddModule("", *module));
+	scanner.AddRegion(graph.GetBegin(), HeapSize);
+	CHECK(scanner.Snapshot() >= 6);
+
+	char path[] = "/tmp/memoria_scan_XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+
+	if (fd < 0)
+		return;
+
+	close(fd);
+
+	CHECK(scanner.ScanToFile(graph.GetTarget(), path) >= 1);
+
+	CPointerScanFile file;
+	CHECK(file.Load(path) && file.GetCount() >= 1);
+
+	bool resolved = false;
+
+	for (size_t i = 0; i < file.GetCount(); i++)
+	{
+		auto result = file.GetPath(i);
+
+		if (result.has_value())
+			resolved |= reinterpret_cast<uintptr_t>(result.value().Resolve()) == graph.GetTarget();
+	}
+
+	CHECK(resolved);
+
+	// A second run over the same graph keeps every path.
+	CPointerScanFile again;
+	CHECK(again.Load(path) && file.Intersect(again) == again.GetCount());
+
+	unlink(path);
+}
+
+TEST_MAIN()
\ No newline at end of file
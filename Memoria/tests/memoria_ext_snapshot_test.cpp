@@ -0,0 +1,170 @@
+#include "memoria_test.hpp"
+
+#include "memoria_ext_snapshot.hpp"
+
+#include <string.h>
+#include <sys/mman.h>
+
+using namespace Memoria;
+
+static constexpr size_t PageSize = CMemorySnapshot::PageSize;
+static constexpr size_t PageCount = 4;
+
+//
+// Four pages: zeros, repeated text, noise, and the same text again.
+//
+class CPages
+{
+private:
+	uint8_t *_pages;
+
+public:
+	CPages()
+	{
+		_pages = static_cast<uint8_t *>(mmap(nullptr, PageCount * PageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+		static const char text[] = "memoria snapshot ";
+
+		for (size_t i = 0; i < PageSize; i++)
+			_pages[PageSize + i] = static_cast<uint8_t>(text[i % (sizeof(text) - 1)]);
+
+		uint32_t state = 0x12345678;
+
+		for (size_t i = 0; i < PageSize; i++)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+
+			_pages[2 * PageSize + i] = static_cast<uint8_t>(state);
+		}
+
+		memcpy(_pages + 3 * PageSize, _pages + PageSize, PageSize);
+	}
+
+	~CPages()
+	{
+		munmap(_pages, PageCount * PageSize);
+	}
+
+	uint8_t *Get(size_t offset = 0) const { return _pages + offset; }
+	uintptr_t Address(size_t offset = 0) const { return reinterpret_cast<uintptr_t>(_pages + offset); }
+};
+
+static bool HasRange(const Memoria::Vector<DiffRange_t> &ranges, uintptr_t address, size_t size)
+{
+	for (const auto &range : ranges)
+	{
+		if (range.Address == address && range.Size == size)
+			return true;
+	}
+
+	return false;
+}
+
+TEST(RoundTripAndDedup)
+{
+	CPages pages;
+	uint8_t buffer[PageCount * PageSize];
+
+	for (bool compress : { true, false })
+	{
+		SnapshotOptions_t options;
+		options.Compress = compress;
+
+		CMemorySnapshot snapshot(options);
+
+		CHECK(snapshot.Capture(pages.Address(), PageCount * PageSize) == PageCount);
+		CHECK(snapshot.GetPageCount() == PageCount);
+
+		// The two text pages share one stored page.
+		CHECK(snapshot.GetStoredCount() == 3);
+
+		CHECK(snapshot.Read(pages.Address(), buffer, sizeof(buffer)) == sizeof(buffer));
+		CHECK(memcmp(buffer, pages.Get(), sizeof(buffer)) == 0);
+
+		// Across a page boundary.
+		CHECK(snapshot.Read(pages.Address(PageSize - 8), buffer, 16) == 16);
+		CHECK(memcmp(buffer, pages.Get(PageSize - 8), 16) == 0);
+
+		// The noise does not compress and is stored as it is, the rest shrinks.
+		if (compress)
+			CHECK(snapshot.GetStoredSize() < 2 * PageSize);
+		else
+			CHECK(snapshot.GetStoredSize() == 3 * PageSize);
+	}
+}
+
+TEST(DiffRanges)
+{
+	CPages pages;
+
+	SnapshotOptions_t options;
+	options.Workers = 2;
+
+	CMemorySnapshot before(options);
+	CHECK(before.Capture(pages.Address(), PageCount * PageSize) == PageCount);
+
+	// Two adjacent bytes, a whole 16-byte block and a change across a page boundary.
+	pages.Get()[10] = 1;
+	pages.Get()[11] = 2;
+
+	for (size_t i = 32; i < 48; i++)
+		pages.Get(PageSize)[i] ^= 0xFF;
+
+	pages.Get(3 * PageSize)[-1] ^= 0xFF;
+	pages.Get(3 * PageSize)[0] ^= 0xFF;
+
+	Memoria::Vector<DiffRange_t> ranges{};
+
+	CHECK(before.Diff(GetLocalMemory(), ranges) == 20);
+	CHECK(ranges.size() == 3);
+	CHECK(HasRange(ranges, pages.Address(10), 2));
+	CHECK(HasRange(ranges, pages.Address(PageSize + 32), 16));
+	CHECK(HasRange(ranges, pages.Address(3 * PageSize - 1), 2));
+
+	// Only the listed pages are compared.
+	const uintptr_t dirty[] = { pages.Address(), pages.Address(2 * PageSize) };
+
+	CHECK(before.Diff(GetLocalMemory(), dirty, ranges) == 3);
+	CHECK(ranges.size() == 2);
+	CHECK(HasRange(ranges, pages.Address(10), 2));
+	CHECK(HasRange(ranges, pages.Address(3 * PageSize - 1), 1));
+
+	// Against a newer snapshot, the same ranges.
+	CMemorySnapshot after(options);
+	CHECK(after.Capture(pages.Address(), PageCount * PageSize) == PageCount);
+
+	CHECK(before.Diff(after, ranges) == 20);
+	CHECK(ranges.size() == 3);
+	CHECK(HasRange(ranges, pages.Address(PageSize + 32), 16));
+
+	CHECK(after.Diff(GetLocalMemory(), ranges) == 0);
+	CHECK(ranges.empty());
+}
+
+TEST(UnreadablePages)
+{
+	CPages pages;
+
+	mprotect(pages.Get(3 * PageSize), PageSize, PROT_NONE);
+
+	CMemorySnapshot snapshot;
+	CHECK(snapshot.Capture(pages.Address(), PageCount * PageSize) == PageCount - 1);
+	CHECK(snapshot.GetPageCount() == PageCount);
+
+	// Reads stop at the page that could not be read.
+	uint8_t buffer[32];
+	CHECK(snapshot.Read(pages.Address(3 * PageSize - 16), buffer, sizeof(buffer)) == 16);
+
+	// A page that became readable counts as changed as a whole.
+	mprotect(pages.Get(3 * PageSize), PageSize, PROT_READ | PROT_WRITE);
+
+	Memoria::Vector<DiffRange_t> ranges{};
+
+	CHECK(snapshot.Diff(GetLocalMemory(), ranges) == PageSize);
+	CHECK(ranges.size() == 1);
+	CHECK(HasRange(ranges, pages.Address(3 * PageSize), PageSize));
+}
+
+TEST_MAIN()
\ No newline at end of file
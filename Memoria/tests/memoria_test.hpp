@@ -0,0 +1,73 @@
+//
+// memoria_test.hpp
+//
+// Minimal test harness for the Linux test programs in this directory.
+//
+// Every test program is a plain executable: `CHECK` records a failure and keeps going,
+// `TEST_MAIN` runs the registered tests and exits with a nonzero status if any failed.
+// Build and run them with `make -C tests`.
+//
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST(name) \
+	static void name(); \
+	static MemoriaTest::CRegister name##_register(#name, name); \
+	static void name()
+
+#define CHECK(cond) \
+	do \
+	{ \
+		if (!(cond)) \
+		{ \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			MemoriaTest::gFailures++; \
+		} \
+	} while (0)
+
+#define TEST_MAIN() \
+	int main() \
+	{ \
+		return MemoriaTest::Run(); \
+	}
+
+namespace MemoriaTest
+{
+	using TestFn_t = void(*)();
+
+	struct Test_t
+	{
+		const char *Name;
+		TestFn_t Fn;
+	};
+
+	inline Test_t gTests[64];
+	inline int gTestCount = 0;
+	inline int gFailures = 0;
+
+	struct CRegister
+	{
+		CRegister(const char *name, TestFn_t fn)
+		{
+			if (gTestCount < static_cast<int>(sizeof(gTests) / sizeof(gTests[0])))
+				gTests[gTestCount++] = { name, fn };
+		}
+	};
+
+	inline int Run()
+	{
+		for (int i = 0; i < gTestCount; i++)
+		{
+			int failures = gFailures;
+			gTests[i].Fn();
+
+			printf("%s %s\n", gFailures == failures ? "[ OK ]" : "[FAIL]", gTests[i].Name);
+		}
+
+		printf("%d test(s), %d failed check(s)\n", gTestCount, gFailures);
+		return gFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,263 @@
+#include "memoria_test.hpp"
+
+#include "memoria_utils_asm.hpp"
+
+#include "hde32.h"
+#include "hde64.h"
+
+#include <string.h>
+
+using namespace Memoria;
+
+// The code is placed at this address for the relative operands, it is never run.
+static const uint8_t *const Runtime = reinterpret_cast<const uint8_t *>(uintptr_t(0x10000000));
+
+//
+// Decodes every instruction of a finalized assembler with hde64 or hde32.
+// Fails the test if an instruction does not decode or the lengths do not add up to the code.
+//
+template <typename Hde>
+class CDecoded
+{
+private:
+	static constexpr size_t MaxInstructions = 256;
+
+	Hde _instructions[MaxInstructions];
+	size_t _count = 0;
+	size_t _offsets[MaxInstructions];
+
+public:
+	CDecoded(const CAssembler &a)
+	{
+		const uint8_t *code = a.GetData();
+		size_t offset = 0;
+
+		while (offset < a.GetSize() && _count < MaxInstructions)
+		{
+			Hde &hs = _instructions[_count];
+			unsigned length;
+
+			if constexpr (sizeof(Hde) == sizeof(hde64s))
+				length = hde64_disasm(code + offset, &hs);
+			else
+				length = hde32_disasm(code + offset, &hs);
+
+			CHECK(length != 0 && !(hs.flags & F64_ERROR));
+
+			if (length == 0)
+				break;
+
+			_offsets[_count++] = offset;
+			offset += length;
+		}
+
+		CHECK(offset == a.GetSize());
+	}
+
+	size_t GetCount() const { return _count; }
+	const Hde &operator[](size_t index) const { return _instructions[index]; }
+
+	// Where the relative operand of an instruction points to, at the runtime address.
+	uintptr_t GetTarget(size_t index) const
+	{
+		auto &hs = _instructions[index];
+		auto end = reinterpret_cast<uintptr_t>(Runtime) + _offsets[index] + hs.len;
+
+		if (hs.flags & F64_IMM8)
+			return end + static_cast<int8_t>(hs.imm.imm8);
+
+		return end + static_cast<int32_t>(hs.imm.imm32);
+	}
+
+	uintptr_t GetRipTarget(size_t index) const
+	{
+		auto &hs = _instructions[index];
+		return reinterpret_cast<uintptr_t>(Runtime) + _offsets[index] + hs.len + static_cast<int32_t>(hs.disp.disp32);
+	}
+};
+
+TEST(RegisterEncodings64)
+{
+	CIndependentAssembler256 a(Runtime, true);
+
+	a.Mov(eReg::Rax, eReg::R9);
+	a.Mov(eReg::R12, Mem(eReg::Rsp, 0x18));
+	a.Mov(Mem(eReg::R13), eReg::Rcx);
+	a.Mov(eReg::Rdx, Mem(eReg::Rbx, eReg::R10, 8, 0x1000));
+	a.Mov(eReg::R8, uint64_t(0x12345678));
+	a.Mov(eReg::Rax, uint64_t(0xFFFFFFFFFFFFFFF0));
+	a.MovAbs(eReg::R11, 0x1122334455667788);
+	a.Lea(eReg::Rsi, Mem(eReg::Rbp, -8));
+	a.Push(eReg::R15);
+	a.Pop(eReg::Rbx);
+	a.Add(eReg::Rsp, 0x28);
+	a.Sub(eReg::Rsp, 0x1000);
+	a.Xor(eReg::Rax, eReg::Rax);
+	a.Cmp(eReg::Rcx, eReg::R8);
+	a.Test(eReg::Rdi, 0x100);
+	a.Movdqu(eXmm::Xmm9, Mem(eReg::Rsp, 0x20));
+	a.Movaps(eXmm::Xmm0, eXmm::Xmm15);
+	a.Ret(8);
+
+	CHECK(a.Finalize());
+	CDecoded<hde64s> d(a);
+	CHECK(d.GetCount() == 18);
+
+	if (d.GetCount() != 18)
+		return;
+
+	// mov rax, r9
+	CHECK(d[0].opcode == 0x89 && d[0].rex_w && d[0].rex_r && d[0].modrm_reg == 1 && d[0].modrm_rm == 0);
+
+	// mov r12, [rsp + 0x18]: a SIB byte for RSP, disp8
+	CHECK(d[1].opcode == 0x8B && d[1].rex_r && (d[1].flags & F64_SIB) && d[1].sib_base == 4 && d[1].disp.disp8 == 0x18);
+
+	// mov [r13], rcx: R13 needs a displacement of 0
+	CHECK(d[2].opcode == 0x89 && d[2].rex_b && d[2].modrm_mod == 1 && d[2].disp.disp8 == 0);
+
+	// mov rdx, [rbx + r10 * 8 + 0x1000]
+	CHECK(d[3].opcode == 0x8B && d[3].rex_x && d[3].sib_scale == 3 && d[3].sib_index == 2 && d[3].sib_base == 3);
+	CHECK((d[3].flags & F64_DISP32) && d[3].disp.disp32 == 0x1000);
+
+	// mov r8d, imm32
+	CHECK(d[4].opcode == 0xB8 && d[4].rex_b && !d[4].rex_w && d[4].imm.imm32 == 0x12345678);
+
+	// mov rax, imm32 sign-extended
+	CHECK(d[5].opcode == 0xC7 && d[5].rex_w && d[5].imm.imm32 == 0xFFFFFFF0);
+
+	// movabs r11, imm64
+	CHECK(d[6].opcode == 0xBB && d[6].rex_w && d[6].rex_b && (d[6].flags & F64_IMM64) && d[6].imm.imm64 == 0x1122334455667788);
+
+	// lea rsi, [rbp - 8]
+	CHECK(d[7].opcode == 0x8D && d[7].modrm_mod == 1 && d[7].modrm_rm == 5 && static_cast<int8_t>(d[7].disp.disp8) == -8);
+
+	CHECK(d[8].opcode == 0x57 && d[8].rex_b);
+	CHECK(d[9].opcode == 0x5B && !(d[9].flags & F64_PREFIX_REX));
+
+	// add rsp, imm8 / sub rsp, imm32
+	CHECK(d[10].opcode == 0x83 && d[10].modrm_reg == 0 && d[10].imm.imm8 == 0x28);
+	CHECK(d[11].opcode == 0x81 && d[11].modrm_reg == 5 && d[11].imm.imm32 == 0x1000);
+
+	CHECK(d[12].opcode == 0x31 && d[12].modrm_mod == 3);
+	CHECK(d[13].opcode == 0x39 && d[13].rex_r);
+	CHECK(d[14].opcode == 0xF7 && d[14].modrm_reg == 0 && d[14].imm.imm32 == 0x100);
+
+	// movdqu xmm9, [rsp + 0x20]: F3 before REX
+	CHECK(d[15].opcode == 0x0F && d[15].opcode2 == 0x6F && d[15].p_rep == 0xF3 && d[15].rex_r);
+	CHECK(d[16].opcode == 0x0F && d[16].opcode2 == 0x28 && d[16].rex_b && d[16].modrm_mod == 3);
+
+	CHECK(d[17].opcode == 0xC2 && d[17].imm.imm16 == 8);
+}
+
+TEST(RelativeOperands64)
+{
+	CIndependentAssembler256 a(Runtime, true);
+
+	auto forward = a.NewLabel();
+	auto far = a.NewLabel();
+	auto data = a.NewLabel();
+
+	const void *target = Runtime + 0x123456;
+
+	a.Jcc(eCond::NE, forward);
+	a.Call(target);
+	a.Mov(eReg::Rax, MemRip(data));
+	a.Jmp(MemRip(target));
+	a.Bind(forward);
+
+	// Pushes `far` out of rel8 range, so the jump must be widened.
+	a.Jmp(far);
+	a.Nop(200);
+	a.Bind(far);
+	a.Jcc(eCond::E, target);
+	a.Bind(data);
+	a.WriteU64(0);
+
+	CHECK(a.Finalize());
+
+	// The 8 data bytes at the end are not code.
+	CIndependentAssembler256 code(Runtime, true);
+	code.WriteData(a.GetData(), a.GetSize() - 8);
+
+	CDecoded<hde64s> d(code);
+	CHECK(d.GetCount() == 206);
+
+	if (d.GetCount() < 206)
+		return;
+
+	uintptr_t forward_at = reinterpret_cast<uintptr_t>(Runtime) + 2 + 5 + 7 + 6;
+	uintptr_t data_at = reinterpret_cast<uintptr_t>(Runtime) + a.GetSize() - 8;
+
+	CHECK(d[0].opcode == 0x75 && d.GetTarget(0) == forward_at);
+	CHECK(d[1].opcode == 0xE8 && d.GetTarget(1) == reinterpret_cast<uintptr_t>(target));
+	CHECK(d[2].opcode == 0x8B && d[2].modrm_mod == 0 && d[2].modrm_rm == 5 && d.GetRipTarget(2) == data_at);
+	CHECK(d[3].opcode == 0xFF && d[3].modrm_reg == 4 && d.GetRipTarget(3) == reinterpret_cast<uintptr_t>(target));
+
+	// Widened to rel32.
+	CHECK(d[4].opcode == 0xE9 && d.GetTarget(4) == forward_at + 5 + 200);
+	CHECK(d[205].opcode == 0x0F && d[205].opcode2 == 0x84 && d.GetTarget(205) == reinterpret_cast<uintptr_t>(target));
+}
+
+TEST(Encodings32)
+{
+	CIndependentAssembler256 a(Runtime, false);
+
+	auto label = a.NewLabel();
+
+	a.Push(eReg::Rbp);
+	a.Mov(eReg::Rbp, eReg::Rsp);
+	a.Mov(eReg::Rax, Mem(eReg::Rbp, 8));
+	a.Mov(eReg::Rcx, uint64_t(0xDEADBEEF));
+	a.Mov(eReg::Rdx, MemRip(Runtime + 0x40));
+	a.Push(0x12345678);
+	a.PushAbs(0x1000);
+	a.Call(Runtime + 0x1000);
+	a.Jmp(label);
+	a.Bind(label);
+	a.Pop(eReg::Rbp);
+	a.Ret();
+
+	CHECK(a.Finalize());
+	CDecoded<hde32s> d(a);
+	CHECK(d.GetCount() == 11);
+
+	if (d.GetCount() != 11)
+		return;
+
+	CHECK(d[0].opcode == 0x55);
+	CHECK(d[1].opcode == 0x89 && d[1].modrm == 0xE5);
+	CHECK(d[2].opcode == 0x8B && d[2].modrm_mod == 1 && d[2].disp.disp8 == 8);
+	CHECK(d[3].opcode == 0xB9 && d[3].imm.imm32 == 0xDEADBEEF);
+
+	// Absolute [disp32] in x86.
+	CHECK(d[4].opcode == 0x8B && d[4].modrm_mod == 0 && d[4].modrm_rm == 5 && d[4].disp.disp32 == 0x10000040);
+
+	CHECK(d[5].opcode == 0x68 && d[5].imm.imm32 == 0x12345678);
+	CHECK(d[6].opcode == 0x68 && d[6].imm.imm32 == 0x1000);
+	CHECK(d[7].opcode == 0xE8 && d.GetTarget(7) == reinterpret_cast<uintptr_t>(Runtime + 0x1000));
+	CHECK(d[8].opcode == 0xEB && d[8].imm.imm8 == 0);
+	CHECK(d[9].opcode == 0x5D && d[10].opcode == 0xC3);
+}
+
+TEST(InvalidOperands)
+{
+	CIndependentAssembler64 a(Runtime, false);
+
+	// No REX prefix in x86.
+	a.Mov(eReg::Rax, eReg::R8);
+	CHECK(a.IsFailed() && !a.Finalize());
+
+	CIndependentAssembler64 b(Runtime, true);
+
+	// RSP cannot be an index.
+	b.Mov(eReg::Rax, Mem(eReg::Rbx, eReg::Rsp, 2));
+	CHECK(b.IsFailed());
+
+	CIndependentAssembler64 c(Runtime, true);
+
+	auto unbound = c.NewLabel();
+	c.Jmp(unbound);
+	CHECK(!c.Finalize());
+}
+
+TEST_MAIN()
\ No newline at end of file